@@ -112,16 +112,12 @@ def expand_std_vector_proto(gen, protos, is_constructor_proto=False):
 	return protos + expanded_protos
 
 
-def bind_task_system(gen):
-	gen.add_include('foundation/task_system.h')
+def bind_worker_pool(gen):
+	gen.add_include('foundation/worker_pool.h')
 
-	gen.insert_binding_code('''
-static void _CreateWorkers() { hg::g_task_system.get().create_workers(); }
-static void _DeleteWorkers() { hg::g_task_system.get().delete_workers(); }
-''')
-
-	gen.bind_function('CreateWorkers', 'void', {'route': route_lambda('_CreateWorkers')})
-	gen.bind_function('DeleteWorkers', 'void', {'route': route_lambda('_DeleteWorkers')})
+	gen.bind_function('hg::start_workers', 'void', ['?int count'], bound_name='StartWorkers')
+	gen.bind_function('hg::stop_workers', 'void', [], bound_name='StopWorkers')
+	gen.bind_function('hg::get_worker_count', 'int', [], bound_name='GetWorkerCount')
 
 
 def bind_log(gen):
@@ -1558,6 +1554,8 @@ static std::vector<hg::ForwardPipelineLight> _GetSceneForwardPipelineLights(cons
 
 	gen.bind_function('hg::PrepareSceneForwardPipelineCommonRenderData', 'void', ['bgfx::ViewId &view_id', 'const hg::Scene &scene', 'hg::SceneForwardPipelineRenderData &render_data',
 	'const hg::ForwardPipeline &pipeline', 'const hg::PipelineResources &resources', 'hg::SceneForwardPipelinePassViewId &views', '?const char *debug_name'], {'arg_in_out': ['view_id','views']})
+	gen.bind_function('hg::PrepareSceneForwardPipelineCommonRenderData', 'void', ['bgfx::ViewId &view_id', 'const hg::ViewState &view_state', 'const hg::Scene &scene', 'hg::SceneForwardPipelineRenderData &render_data',
+	'const hg::ForwardPipeline &pipeline', 'const hg::PipelineResources &resources', 'hg::SceneForwardPipelinePassViewId &views', '?const char *debug_name'], {'arg_in_out': ['view_id','views']})
 
 	gen.bind_function('hg::PrepareSceneForwardPipelineViewDependentRenderData', 'void', ['bgfx::ViewId &view_id', 'const hg::ViewState &view_state', 'const hg::Scene &scene', 'hg::SceneForwardPipelineRenderData &render_data',
 	'const hg::ForwardPipeline &pipeline', 'const hg::PipelineResources &resources', 'hg::SceneForwardPipelinePassViewId &views', '?const char *debug_name'], {'arg_in_out': ['view_id','views']})
@@ -1990,8 +1988,16 @@ def bind_font(gen):
 	font = gen.begin_class('hg::Font')
 	gen.end_class(font)
 
-	gen.bind_function('hg::LoadFontFromFile', 'hg::Font', ['const char *path', '?float size', '?uint16_t resolution', '?int padding', '?const char *glyphs'])
-	gen.bind_function('hg::LoadFontFromAssets', 'hg::Font', ['const char *name', '?float size', '?uint16_t resolution', '?int padding', '?const char *glyphs'])
+	gen.bind_function('hg::LoadFontFromFile', 'hg::Font', ['const char *path', '?float size', '?uint16_t resolution', '?int padding', '?const char *glyphs', '?uint16_t max_page_count'])
+	gen.bind_function('hg::LoadFontFromAssets', 'hg::Font', ['const char *name', '?float size', '?uint16_t resolution', '?int padding', '?const char *glyphs', '?uint16_t max_page_count'])
+
+	gen.bind_function('hg::UpdateFontAtlas', 'void', ['const hg::Font &font'])
+
+	font_atlas_stats = gen.begin_class('hg::FontAtlasStats')
+	gen.bind_members(font_atlas_stats, ['size_t page_count', 'size_t cell_count', 'size_t glyph_count', 'size_t rasterized_count', 'size_t evicted_count', 'size_t dropped_count', 'float occupancy'])
+	gen.end_class(font_atlas_stats)
+
+	gen.bind_function('hg::GetFontAtlasStats', 'hg::FontAtlasStats', ['const hg::Font &font'])
 
 	gen.bind_named_enum('hg::DrawTextHAlign', ['DTHA_Left', 'DTHA_Center', 'DTHA_Right'])
 	gen.bind_named_enum('hg::DrawTextVAlign', ['DTVA_Top', 'DTVA_Center', 'DTVA_Bottom'])
@@ -2011,6 +2017,34 @@ def bind_font(gen):
 		'const std::vector<hg::UniformSetTexture> &textures', '?hg::RenderState state', '?uint32_t depth'], [])
 	]))
 
+	text_batch = gen.begin_class('hg::TextBatch')
+	gen.end_class(text_batch)
+
+	gen.bind_function('hg::AddTextToBatch', 'void', ['hg::TextBatch &batch', 'const hg::Font &font', 'const char *text', 'const hg::Mat4 &mtx', '?hg::Vec3 pos',
+		'?const hg::Color &color', '?hg::DrawTextHAlign halign', '?hg::DrawTextVAlign valign'])
+
+	gen.bind_function_overloads('hg::DrawTextBatch', expand_std_vector_proto(gen, [
+		('void', ['bgfx::ViewId view_id', 'const hg::TextBatch &batch', 'bgfx::ProgramHandle prg', 'const char *page_uniform', 'uint8_t page_stage'], []),
+		('void', ['bgfx::ViewId view_id', 'const hg::TextBatch &batch', 'bgfx::ProgramHandle prg', 'const char *page_uniform', 'uint8_t page_stage',
+		'const std::vector<hg::UniformSetValue> &values', 'const std::vector<hg::UniformSetTexture> &textures', '?hg::RenderState state', '?uint32_t depth'], [])
+	]))
+
+	gen.bind_function('hg::ClearTextBatch', 'void', ['hg::TextBatch &batch'])
+
+	retained_text = gen.begin_class('hg::RetainedText', noncopyable=True)
+	gen.end_class(retained_text)
+
+	gen.bind_function('hg::SetRetainedText', 'void', ['hg::RetainedText &text', 'const hg::Font &font', 'const char *str', '?hg::Vec3 pos', '?const hg::Color &color',
+		'?hg::DrawTextHAlign halign', '?hg::DrawTextVAlign valign'])
+
+	gen.bind_function_overloads('hg::DrawRetainedText', expand_std_vector_proto(gen, [
+		('void', ['bgfx::ViewId view_id', 'hg::RetainedText &text', 'bgfx::ProgramHandle prg', 'const char *page_uniform', 'uint8_t page_stage', 'const hg::Mat4 &mtx'], []),
+		('void', ['bgfx::ViewId view_id', 'hg::RetainedText &text', 'bgfx::ProgramHandle prg', 'const char *page_uniform', 'uint8_t page_stage', 'const hg::Mat4 &mtx',
+		'const std::vector<hg::UniformSetValue> &values', 'const std::vector<hg::UniformSetTexture> &textures', '?hg::RenderState state', '?uint32_t depth'], [])
+	]))
+
+	gen.bind_function('hg::DestroyRetainedText', 'void', ['hg::RetainedText &text'])
+
 	gen.bind_function('hg::ComputeTextRect', 'hg::Rect<float>', ['const hg::Font &font', 'const char *text', '?float xpos', '?float ypos'])
 	gen.bind_function('hg::ComputeTextHeight', 'float', ['const hg::Font &font', 'const char *text'])
 
@@ -2057,6 +2091,7 @@ def bind_render(gen):
 		('hg::Window *', ['const char *window_title', 'int width', 'int height', 'bgfx::RendererType::Enum type', '?uint32_t reset_flags', '?bgfx::TextureFormat::Enum format', '?uint32_t debug_flags'], {'constants_group': {'reset_flags': 'ResetFlags', 'debug_flags': 'DebugFlags'}})
 	])
 	gen.bind_function('hg::RenderShutdown', 'void', [])
+	gen.bind_function('hg::SetRenderWorkerCount', 'void', ['int count'])
 
 	gen.bind_function('hg::RenderResetToWindow', 'bool', ['hg::Window *win', 'int &width', 'int &height', '?uint32_t reset_flags'], {'arg_in_out': ['width', 'height']})
 
@@ -2261,6 +2296,7 @@ static void _SetViewTransform(bgfx::ViewId view_id, const hg::Mat4 &view, const
 	gen.bind_function('hg::ProcessTextureLoadQueue', 'size_t', ['hg::PipelineResources &res', '?hg::time_ns t_budget'])
 
 	gen.bind_function('hg::ProcessModelLoadQueue', 'size_t', ['hg::PipelineResources &res', '?hg::time_ns t_budget'])
+	gen.bind_function('hg::SetModelLoadPriority', 'void', ['hg::PipelineResources &resources', 'hg::ModelRef ref', 'float priority'])
 	gen.bind_function('hg::ProcessLoadQueues', 'size_t', ['hg::PipelineResources &res', '?hg::time_ns t_budget'])
 
 	# ModelRef/TextureRef/MaterialRef/PipelineProgramRef
@@ -2493,9 +2529,15 @@ static bgfx::TextureInfo _PipelineResources_GetTextureInfo(hg::PipelineResources
 }
 ''')
 
+	texture_load_stats = gen.begin_class('hg::TextureLoadStats')
+	gen.bind_members(texture_load_stats, ['size_t uploaded_size', 'size_t completed_count', 'hg::time_ns total_latency', 'hg::time_ns max_latency'])
+	gen.end_class(texture_load_stats)
+
 	pipe_res = gen.begin_class('hg::PipelineResources')
 	gen.bind_constructor(pipe_res, [])
 
+	gen.bind_members(pipe_res, ['size_t texture_upload_budget', 'hg::TextureLoadStats texture_load_stats'])
+
 	gen.bind_method(pipe_res, 'AddTexture', 'hg::TextureRef', ['const char *name', 'const hg::Texture &tex'], {'route': route_lambda('_PipelineResources_AddTexture')})
 	gen.bind_method(pipe_res, 'AddModel', 'hg::ModelRef', ['const char *name', 'const hg::Model &mdl'], {'route': route_lambda('_PipelineResources_AddModel')})
 	gen.bind_method(pipe_res, 'AddProgram', 'hg::PipelineProgramRef', ['const char *name', 'const hg::PipelineProgram &prg'], {'route': route_lambda('_PipelineResources_AddProgram')})
@@ -2529,6 +2571,8 @@ static bgfx::TextureInfo _PipelineResources_GetTextureInfo(hg::PipelineResources
 
 	gen.end_class(pipe_res)
 
+	gen.bind_function('hg::SetTextureLoadPriority', 'void', ['hg::PipelineResources &resources', 'hg::TextureRef ref', 'float priority'])
+
 	#
 	gen.bind_function('hg::UpdateMaterialPipelineProgramVariant', 'void', ['hg::Material &mat', 'const hg::PipelineResources &resources'])
 
@@ -2705,6 +2749,21 @@ def bind_iso_surface(gen):
 		('bool', ['hg::ModelBuilder &builder', 'const hg::IsoSurface &surface', 'int width', 'int height', 'int depth', 'uint16_t material', 'float isolevel', 'float scale_x', 'float scale_y', 'float scale_z'], {})
 	])
 
+	iso_surface_chunks = gen.begin_class('hg::IsoSurfaceChunks')
+	gen.end_class(iso_surface_chunks)
+
+	gen.bind_function('hg::NewIsoSurfaceChunks', 'hg::IsoSurfaceChunks', ['int width', 'int height', 'int depth', '?int chunk_size'])
+
+	gen.bind_function_overloads('hg::MarkIsoSurfaceChunksDirty', [
+		('void', ['hg::IsoSurfaceChunks &chunks'], {}),
+		('void', ['hg::IsoSurfaceChunks &chunks', 'int x0', 'int y0', 'int z0', 'int x1', 'int y1', 'int z1'], {})
+	])
+	gen.bind_function('hg::MarkIsoSurfaceSphereDirty', 'void', ['hg::IsoSurfaceChunks &chunks', 'float x', 'float y', 'float z', 'float radius'])
+	gen.bind_function('hg::GetDirtyIsoSurfaceChunkCount', 'size_t', ['const hg::IsoSurfaceChunks &chunks'])
+
+	gen.bind_function('hg::UpdateIsoSurfaceChunks', 'size_t', ['hg::IsoSurfaceChunks &chunks', 'const hg::IsoSurface &surface', '?float isolevel', '?float scale_x', '?float scale_y', '?float scale_z'])
+	gen.bind_function('hg::IsoSurfaceChunksToModel', 'bool', ['hg::ModelBuilder &builder', 'const hg::IsoSurfaceChunks &chunks', '?uint16_t material'])
+
 
 def bind_fps_controller(gen):
 	gen.add_include('engine/fps_controller.h')
@@ -2721,7 +2780,7 @@ def bind_forward_pipeline(gen):
 	gen.add_base(forward_pipeline, gen.get_conv('hg::Pipeline'))
 	gen.end_class(forward_pipeline)
 
-	gen.bind_function('hg::CreateForwardPipeline', 'hg::ForwardPipeline', ['?int shadow_map_resolution', '?bool spot_16bit_shadow_map'])
+	gen.bind_function('hg::CreateForwardPipeline', 'hg::ForwardPipeline', ['?int shadow_map_resolution', '?bool spot_16bit_shadow_map', '?bool cache_static_shadow_maps'])
 	gen.bind_function('hg::DestroyForwardPipeline', 'void', ['hg::ForwardPipeline &pipeline'])
 
 	# ForwardPipelineLight
@@ -3003,6 +3062,18 @@ static void _Picture_SetPixelRGBA(hg::Picture *picture, uint16_t x, uint16_t y,
 	gen.bind_function('SaveTGA', 'bool', ['hg::Picture &pict', 'const char *path'])
 	gen.bind_function('SaveBMP', 'bool', ['hg::Picture &pict', 'const char *path'])
 
+	bind_std_vector(gen, picture)
+
+	# processing
+	gen.add_include('engine/picture_processing.h')
+
+	gen.bind_named_enum('hg::PictureFilter', ['PFT_Box', 'PFT_Triangle', 'PFT_CubicBSpline', 'PFT_CatmullRom', 'PFT_Mitchell'])
+
+	gen.bind_function('hg::ResizePicture', 'hg::Picture', ['const hg::Picture &pic', 'uint16_t width', 'uint16_t height', '?hg::PictureFilter filter', '?bool srgb'])
+	gen.bind_function('hg::ConvertPicture', 'hg::Picture', ['const hg::Picture &pic', 'hg::PictureFormat format'])
+	gen.bind_function('hg::GenerateMipChain', 'std::vector<hg::Picture>', ['const hg::Picture &pic', '?hg::PictureFilter filter', '?bool srgb'])
+	gen.bind_function('hg::GetMipCount', 'size_t', ['uint16_t width', 'uint16_t height'])
+
 
 def bind_math(gen):
 	gen.begin_class('hg::Vec3')
@@ -4265,7 +4336,12 @@ def bind_audio(gen):
 
 	gen.add_include('engine/audio.h')
 	
-	gen.bind_function('hg::AudioInit', 'bool', [])
+	audio_config = gen.begin_class('hg::AudioConfig')
+	gen.bind_constructor(audio_config, [])
+	gen.bind_members(audio_config, ['size_t max_source', 'size_t max_streamed_source', 'size_t stream_buffer_count', 'hg::time_ns read_ahead', 'size_t pcm_block_size', 'size_t pcm_block_count', 'std::string device'])
+	gen.end_class(audio_config)
+
+	gen.bind_function_overloads('hg::AudioInit', [('bool', [], []), ('bool', ['const hg::AudioConfig &config'], [])])
 	gen.bind_function('hg::AudioShutdown', 'void', [])
 
 	gen.typedef('hg::SoundRef', 'int')
@@ -4287,23 +4363,23 @@ def bind_audio(gen):
 	gen.bind_named_enum('hg::SourceRepeat', ['SR_Once', 'SR_Loop'])
 
 	gen.insert_binding_code('''
-static hg::StereoSourceState *__ConstructStereoSourceState(float volume = 1.f, hg::SourceRepeat repeat = hg::SR_Once, float panning = 0.f) {
-	return new hg::StereoSourceState{volume, repeat, panning};
+static hg::StereoSourceState *__ConstructStereoSourceState(float volume = 1.f, hg::SourceRepeat repeat = hg::SR_Once, float panning = 0.f, int priority = 0) {
+	return new hg::StereoSourceState{volume, repeat, panning, priority};
 }
 
-static hg::SpatializedSourceState *__ConstructSpatializedSourceState(hg::Mat4 mtx = hg::Mat4::Identity, float volume = 1.f, hg::SourceRepeat repeat = hg::SR_Once, const hg::Vec3 &vel = {}) {
-	return new hg::SpatializedSourceState{mtx, volume, repeat, vel};
+static hg::SpatializedSourceState *__ConstructSpatializedSourceState(hg::Mat4 mtx = hg::Mat4::Identity, float volume = 1.f, hg::SourceRepeat repeat = hg::SR_Once, const hg::Vec3 &vel = {}, int priority = 0) {
+	return new hg::SpatializedSourceState{mtx, volume, repeat, vel, priority};
 }
 ''')
 
 	stereo_source_state = gen.begin_class('hg::StereoSourceState')
-	gen.bind_members(stereo_source_state, ['float volume', 'hg::SourceRepeat repeat', 'float panning'])
-	gen.bind_constructor(stereo_source_state, ['?float volume', '?hg::SourceRepeat repeat', '?float panning'], {'route': route_lambda('__ConstructStereoSourceState')})
+	gen.bind_members(stereo_source_state, ['float volume', 'hg::SourceRepeat repeat', 'float panning', 'int priority'])
+	gen.bind_constructor(stereo_source_state, ['?float volume', '?hg::SourceRepeat repeat', '?float panning', '?int priority'], {'route': route_lambda('__ConstructStereoSourceState')})
 	gen.end_class(stereo_source_state)
 
 	spatialized_source_state = gen.begin_class('hg::SpatializedSourceState')
-	gen.bind_members(spatialized_source_state, ['hg::Mat4 mtx', 'float volume', 'hg::SourceRepeat repeat', 'hg::Vec3 vel'])
-	gen.bind_constructor(spatialized_source_state, ['?hg::Mat4 mtx', '?float volume', '?hg::SourceRepeat repeat', '?const hg::Vec3 &vel'], {'route': route_lambda('__ConstructSpatializedSourceState')})
+	gen.bind_members(spatialized_source_state, ['hg::Mat4 mtx', 'float volume', 'hg::SourceRepeat repeat', 'hg::Vec3 vel', 'int priority'])
+	gen.bind_constructor(spatialized_source_state, ['?hg::Mat4 mtx', '?float volume', '?hg::SourceRepeat repeat', '?const hg::Vec3 &vel', '?int priority'], {'route': route_lambda('__ConstructSpatializedSourceState')})
 	gen.end_class(spatialized_source_state)
 	
 	gen.bind_function('hg::PlayStereo', 'hg::SourceRef', ['hg::SoundRef snd', 'const hg::StereoSourceState &state'], {'rval_constants_group': 'SourceRef', 'constants_group': {'snd': 'SoundRef'}})
@@ -4338,6 +4414,13 @@ static hg::SpatializedSourceState *__ConstructSpatializedSourceState(hg::Mat4 mt
 	gen.bind_function('hg::StopSource', 'void', ['hg::SourceRef source'], {'constants_group': {'source': 'SourceRef'}})
 	gen.bind_function('hg::StopAllSources', 'void', [])
 
+	audio_stats = gen.begin_class('hg::AudioStats')
+	gen.bind_members(audio_stats, ['size_t source_count', 'size_t playing_source_count', 'size_t streamed_source_count', 'size_t stolen_source_count', 'size_t underrun_count',
+		'size_t pcm_block_count', 'size_t free_pcm_block_count', 'size_t decoded_byte_count', 'hg::time_ns decode_time'])
+	gen.end_class(audio_stats)
+
+	gen.bind_function('hg::GetAudioStats', 'hg::AudioStats', [])
+
 
 def bind_bloom(gen):
 	gen.add_include('engine/bloom.h')
@@ -4511,6 +4594,7 @@ def bind(gen):
 	bind_std_vector(gen, gen.get_conv('std::string'), 'StringList')
 
 	bind_log(gen)
+	bind_worker_pool(gen)
 	bind_time(gen)
 	bind_clock(gen)
 	bind_file(gen)
@@ -77,7 +77,11 @@ if( MSVC )
 	target_compile_definitions( bgfx PRIVATE "_CRT_SECURE_NO_WARNINGS" )
 endif()
 
-target_compile_definitions( bgfx PUBLIC BGFX_CONFIG_MULTITHREADED=0 )
+if( HG_ENABLE_BGFX_MULTITHREADED AND NOT EMSCRIPTEN )
+	target_compile_definitions( bgfx PUBLIC BGFX_CONFIG_MULTITHREADED=1 ) # multiple encoders, rendering stays on the API thread (see RenderInit)
+else()
+	target_compile_definitions( bgfx PUBLIC BGFX_CONFIG_MULTITHREADED=0 )
+endif()
 
 target_link_libraries( bgfx PUBLIC bx bimg )
 
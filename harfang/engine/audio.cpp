@@ -5,7 +5,8 @@
 #include "foundation/cext.h"
 #include "foundation/format.h"
 #include "foundation/log.h"
-#include "foundation/timer.h"
+#include "foundation/math.h"
+#include "foundation/thread.h"
 
 #include "engine/ogg_audio_stream.h"
 #include "engine/wav_audio_stream.h"
@@ -19,44 +20,219 @@
 
 #include <bx/bx.h>
 
+#include <atomic>
+#include <chrono>
 #include <cmath>
-#include <future>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace hg {
 
-static const size_t max_source = 64;
-static const time_ns audio_mixer_period = time_from_ms(20);
+static const time_ns audio_decode_period = time_from_ms(10);
+static const size_t audio_command_queue_size = 1024; // must be a power of 2
+static const size_t audio_max_frame_size = 32768; // largest frame returned by the audio streamers
 
 //
-struct ALStream {
-	std::mutex lock;
+struct ALVoice {
+	uint32_t generation{0}; // incremented each time the source is acquired or stopped
+	int priority{0};
+	uint64_t start_order{0};
 
-	IAudioStreamer streamer{};
-	AudioStreamRef ref{InvalidAudioStreamRef};
+	bool streamed{false};
+	time_ns duration{0};
 
-	std::vector<ALuint> buffers;
-	std::vector<time_ns> buffers_timestamp;
-	std::vector<AudioFrameFormat> buffers_format;
-
-	time_ns timestamp;
-	size_t free_buffer_count{}, get{}, put{};
-
-	bool loop{false};
+	// timecode and format of the oldest buffer queued on a streamed source, timecode of the last stopped stream otherwise
+	time_ns timestamp{0};
+	AudioFrameFormat timestamp_format{AFF_Unsupported};
 };
 
 struct ALMixer {
-	std::mutex lock;
-	timer_handle update;
+	std::mutex lock; // held around every AL call and its error check, the AL error state is shared between threads
 
 	ALCdevice *device{nullptr};
 	ALCcontext *context{nullptr};
 
-	ALuint sources[max_source];
-	ALStream streams[max_source];
+	AudioConfig config;
+
+	std::vector<ALuint> sources;
+	std::vector<ALVoice> voices;
+
+	uint64_t start_order{0};
+	size_t stolen_count{0};
 };
 
 static ALMixer al_mixer;
 
+//
+enum AudioCommandType { ACT_Start, ACT_Seek, ACT_SetLoop };
+
+struct AudioCommand {
+	AudioCommandType type;
+
+	SourceRef src_ref;
+	uint32_t generation;
+
+	IAudioStreamer streamer;
+	AudioStreamRef stream_ref;
+
+	time_ns t;
+	bool loop;
+};
+
+/*
+	Bounded multiple producers, single consumer queue.
+
+	Each cell sequence tells producers and the consumer whether the cell is free to write or ready to read, so that neither ever blocks on a lock.
+*/
+struct AudioCommandQueue {
+	struct Cell {
+		std::atomic<size_t> sequence;
+		AudioCommand cmd;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask{0};
+
+	std::atomic<size_t> enqueue_pos{0}, dequeue_pos{0};
+};
+
+static void InitCommandQueue(AudioCommandQueue &queue, size_t size) {
+	queue.cells.reset(new AudioCommandQueue::Cell[size]);
+	queue.mask = size - 1;
+
+	for (size_t i = 0; i < size; ++i)
+		queue.cells[i].sequence.store(i, std::memory_order_relaxed);
+
+	queue.enqueue_pos.store(0, std::memory_order_relaxed);
+	queue.dequeue_pos.store(0, std::memory_order_relaxed);
+}
+
+static bool PushCommand(AudioCommandQueue &queue, const AudioCommand &cmd) {
+	auto pos = queue.enqueue_pos.load(std::memory_order_relaxed);
+
+	for (;;) {
+		auto &cell = queue.cells[pos & queue.mask];
+		const auto diff = intptr_t(cell.sequence.load(std::memory_order_acquire)) - intptr_t(pos);
+
+		if (diff == 0) {
+			if (queue.enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				cell.cmd = cmd;
+				cell.sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		} else if (diff < 0) {
+			return false; // queue full
+		} else {
+			pos = queue.enqueue_pos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+static bool PopCommand(AudioCommandQueue &queue, AudioCommand &cmd) {
+	const auto pos = queue.dequeue_pos.load(std::memory_order_relaxed);
+	auto &cell = queue.cells[pos & queue.mask];
+
+	if (intptr_t(cell.sequence.load(std::memory_order_acquire)) - intptr_t(pos + 1) < 0)
+		return false; // queue empty
+
+	cmd = cell.cmd;
+	cell.sequence.store(pos + queue.mask + 1, std::memory_order_release);
+	queue.dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+	return true;
+}
+
+//
+struct PCMBlock {
+	time_ns timestamp;
+	AudioFrameFormat format;
+	size_t size;
+};
+
+/// Fixed size PCM blocks decoded streams are written to, only accessed by the decode thread.
+struct PCMBlockPool {
+	size_t block_size{0};
+
+	std::vector<uint8_t> data;
+	std::vector<PCMBlock> blocks;
+	std::vector<uint32_t> free_blocks;
+};
+
+static void InitPCMBlockPool(PCMBlockPool &pool, size_t block_size, size_t block_count) {
+	pool.block_size = block_size;
+
+	pool.data.resize(block_size * block_count);
+	pool.blocks.resize(block_count);
+
+	pool.free_blocks.resize(block_count);
+	for (size_t i = 0; i < block_count; ++i)
+		pool.free_blocks[i] = uint32_t(block_count - 1 - i);
+}
+
+static uint32_t AllocPCMBlock(PCMBlockPool &pool, time_ns timestamp, AudioFrameFormat format) {
+	__ASSERT__(!pool.free_blocks.empty());
+
+	const auto idx = pool.free_blocks.back();
+	pool.free_blocks.pop_back();
+
+	pool.blocks[idx] = {timestamp, format, 0};
+	return idx;
+}
+
+static void FreePCMBlock(PCMBlockPool &pool, uint32_t idx) { pool.free_blocks.push_back(idx); }
+
+static uint8_t *GetPCMBlockData(PCMBlockPool &pool, uint32_t idx) { return pool.data.data() + size_t(idx) * pool.block_size; }
+
+//
+struct DecodeStream {
+	SourceRef src_ref;
+	uint32_t generation;
+
+	IAudioStreamer streamer;
+	AudioStreamRef ref;
+
+	bool loop{false}, eof{false};
+	size_t frame_count{0}; // frames decoded since the last seek
+
+	time_ns timestamp{0}; // timecode of the next decoded frame
+
+	std::deque<uint32_t> read_ahead; // decoded blocks not yet queued on the source
+	bool read_ahead_open{false}; // is the last read ahead block still being written to
+	size_t read_ahead_size{0};
+
+	// OpenAL buffers form a ring, buffers from get to put are queued on the source
+	std::vector<ALuint> buffers;
+	std::vector<time_ns> buffers_timestamp;
+	std::vector<AudioFrameFormat> buffers_format;
+	size_t get{0}, put{0}, queued{0};
+
+	bool restart{false}, pause_after_restart{false}; // set when queued buffers are dropped after seeking
+};
+
+struct AudioDecoder {
+	std::thread thread;
+	std::atomic<bool> running{false};
+
+	std::mutex wake_mutex;
+	std::condition_variable wake_condition;
+
+	std::mutex codec_lock; // audio streamers are not thread safe, may be held while acquiring the mixer lock but not the other way around
+
+	AudioCommandQueue commands;
+
+	PCMBlockPool pool;
+	std::vector<DecodeStream> streams;
+
+	std::atomic<size_t> underrun_count{0}, decoded_byte_count{0}, free_block_count{0};
+	std::atomic<time_ns> decode_time{0};
+};
+
+static AudioDecoder al_decoder;
+
 //
 static bool CheckALSuccess(const char *file = "unknown", ALuint line = 0) {
 	switch (alGetError()) {
@@ -114,146 +290,399 @@ static inline int AFF_ALFormat(AudioFrameFormat fmt) {
 	};
 }
 
+static inline size_t AFF_BytePerSecond(AudioFrameFormat fmt) { return AFF_Frequency[fmt] * AFF_ChannelCount[fmt] * AFF_Resolution[fmt] / 8; }
+
 //
-static void AllocStream(ALStream &stream) {
-	__ASSERT__(stream.buffers.empty());
+static bool IsValidSourceRef(SourceRef src_ref) { return src_ref >= 0 && size_t(src_ref) < al_mixer.sources.size(); }
 
-	stream.streamer = {};
-	stream.ref = InvalidAudioStreamRef;
+/// Stop a source and detach all its buffers, must be called with the mixer lock held.
+static void ResetSource(ALuint src) {
+	__AL_CALL(alSourceStop(src));
+	__AL_CALL(alSourcei(src, AL_BUFFER, 0));
+}
 
-	stream.free_buffer_count = 16;
-	stream.get = stream.put = 0;
+/// Release a source voice, the decode thread drops the stream bound to a released voice.
+static void ReleaseVoice(ALVoice &voice) {
+	if (voice.streamed)
+		voice.timestamp = voice.duration;
 
-	stream.buffers.resize(stream.free_buffer_count);
-	stream.buffers_timestamp.resize(stream.free_buffer_count);
-	stream.buffers_format.resize(stream.free_buffer_count);
+	voice.streamed = false;
+	++voice.generation;
+}
 
-	stream.loop = false;
+//
+static void WakeDecoder() { al_decoder.wake_condition.notify_one(); }
 
-	alGenBuffers(numeric_cast<ALsizei>(stream.buffers.size()), stream.buffers.data());
+static void PushDecoderCommand(const AudioCommand &cmd) {
+	while (!PushCommand(al_decoder.commands, cmd)) {
+		WakeDecoder(); // queue full, let the decode thread drain it
+		std::this_thread::yield();
+	}
+	WakeDecoder();
 }
 
-static void FreeStream(ALStream &stream) {
-	if (stream.ref != InvalidAudioStreamRef)
-		stream.streamer.Close(stream.ref);
+//
+static void CloseStream(IAudioStreamer &streamer, AudioStreamRef ref) {
+	std::lock_guard<std::mutex> lock(al_decoder.codec_lock);
+	streamer.Close(ref);
+}
 
-	stream.streamer = {};
-	stream.ref = InvalidAudioStreamRef;
+static void FlushReadAhead(DecodeStream &stream) {
+	for (auto idx : stream.read_ahead)
+		FreePCMBlock(al_decoder.pool, idx);
 
-	stream.buffers.clear();
-	stream.buffers_timestamp.clear();
-	stream.buffers_format.clear();
+	stream.read_ahead.clear();
+	stream.read_ahead_open = false;
+	stream.read_ahead_size = 0;
+}
 
-	stream.free_buffer_count = 0;
-	stream.get = stream.put = 0;
+/// Close a decoded stream, its voice is released if the stream still owns it.
+static void FreeDecodeStream(DecodeStream &stream) {
+	{
+		std::lock_guard<std::mutex> lock(al_mixer.lock);
 
-	stream.loop = false;
+		auto &voice = al_mixer.voices[stream.src_ref];
+		if (voice.generation == stream.generation) {
+			ResetSource(al_mixer.sources[stream.src_ref]);
+			ReleaseVoice(voice);
+		}
 
-	if (!stream.buffers.empty())
-		alDeleteBuffers(numeric_cast<ALsizei>(stream.buffers.size()), stream.buffers.data());
+		// buffers of a stream which lost its voice were detached when the voice was released
+		if (!stream.buffers.empty())
+			__AL_CALL(alDeleteBuffers(numeric_cast<ALsizei>(stream.buffers.size()), stream.buffers.data()));
+	}
+
+	FlushReadAhead(stream);
+	CloseStream(stream.streamer, stream.ref);
+
+	stream.buffers.clear();
+}
+
+static DecodeStream *GetDecodeStream(SourceRef src_ref, uint32_t generation) {
+	for (auto &stream : al_decoder.streams)
+		if (stream.src_ref == src_ref && stream.generation == generation)
+			return &stream;
+	return nullptr;
 }
 
 //
-static bool UpdateSourceStream(SourceRef src_ref) {
-	if (src_ref < 0 || src_ref >= max_source)
-		return true;
+static void StartDecodeStream(const AudioCommand &cmd) {
+	DecodeStream stream;
+
+	stream.src_ref = cmd.src_ref;
+	stream.generation = cmd.generation;
+	stream.streamer = cmd.streamer;
+	stream.ref = cmd.stream_ref;
+	stream.loop = cmd.loop;
+
+	const auto buffer_count = Max<size_t>(al_mixer.config.stream_buffer_count, 2);
+
+	stream.buffers.resize(buffer_count);
+	stream.buffers_timestamp.resize(buffer_count);
+	stream.buffers_format.resize(buffer_count);
+
+	bool buffers_ok;
+	{
+		std::lock_guard<std::mutex> lock(al_mixer.lock);
+		alGenBuffers(numeric_cast<ALsizei>(buffer_count), stream.buffers.data());
+		buffers_ok = __AL_OK;
+	}
+
+	if (!buffers_ok) {
+		stream.buffers.clear();
+		FreeDecodeStream(stream);
+		return;
+	}
+
+	al_decoder.streams.push_back(std::move(stream));
+}
+
+static void SeekDecodeStream(DecodeStream &stream, time_ns t) {
+	{
+		std::lock_guard<std::mutex> lock(al_decoder.codec_lock);
+		if (!stream.streamer.Seek(stream.ref, t))
+			return;
+		stream.timestamp = stream.streamer.GetTimeStamp(stream.ref);
+	}
+
+	FlushReadAhead(stream);
+	stream.eof = false;
+	stream.frame_count = 0;
 
+	// drop the buffers already queued so that playback resumes from the new position right away
 	std::lock_guard<std::mutex> lock(al_mixer.lock);
 
-	const auto src = al_mixer.sources[src_ref];
-	auto &stream = al_mixer.streams[src_ref];
+	auto &voice = al_mixer.voices[stream.src_ref];
+	if (voice.generation != stream.generation)
+		return;
+
+	const auto src = al_mixer.sources[stream.src_ref];
+
+	ALint state;
+	__AL_CALL(alGetSourcei(src, AL_SOURCE_STATE, &state));
+
+	if (state == AL_INITIAL)
+		return; // nothing queued yet
+
+	__AL_CALL(alSourceStop(src)); // all queued buffers are now processed
+
+	while (stream.queued) {
+		__AL_CALL(alSourceUnqueueBuffers(src, 1, &stream.buffers[stream.get]));
+		stream.get = (stream.get + 1) % stream.buffers.size();
+		--stream.queued;
+	}
+
+	stream.restart = true;
+	stream.pause_after_restart = state == AL_PAUSED;
+
+	voice.timestamp = stream.timestamp;
+}
+
+static void ProcessDecoderCommands() {
+	AudioCommand cmd;
+
+	while (PopCommand(al_decoder.commands, cmd)) {
+		if (cmd.type == ACT_Start) {
+			StartDecodeStream(cmd);
+		} else if (auto stream = GetDecodeStream(cmd.src_ref, cmd.generation)) {
+			if (cmd.type == ACT_Seek)
+				SeekDecodeStream(*stream, cmd.t);
+			else if (cmd.type == ACT_SetLoop)
+				stream->loop = cmd.loop;
+		}
+	}
+}
+
+//
+static void CloseReadAheadBlock(DecodeStream &stream) { stream.read_ahead_open = false; }
+
+/// Decode a frame from a stream to its read ahead blocks, return false if no progress was made.
+static bool DecodeStreamFrame(DecodeStream &stream) {
+	auto &pool = al_decoder.pool;
+
+	if (pool.free_blocks.size() < audio_max_frame_size / pool.block_size + 2)
+		return false; // not enough free blocks to store a frame
+
+	std::lock_guard<std::mutex> lock(al_decoder.codec_lock);
+
+	uintptr_t pcm_buffer;
+	int pcm_size;
+	AudioFrameFormat pcm_format;
+
+	if (!stream.streamer.GetFrame(stream.ref, &pcm_buffer, &pcm_size, &pcm_format)) {
+		CloseReadAheadBlock(stream);
+
+		// loop unless the stream failed to produce a single frame since it was last rewound
+		if (stream.loop && stream.frame_count > 0 && stream.streamer.Seek(stream.ref, 0)) {
+			stream.timestamp = 0;
+			stream.frame_count = 0;
+			return true;
+		}
+
+		stream.eof = true;
+		return false;
+	}
+
+	if (pcm_format == AFF_Unsupported || pcm_size <= 0 || size_t(pcm_size) > audio_max_frame_size) {
+		CloseReadAheadBlock(stream);
+		stream.eof = true;
+		return false;
+	}
+
+	++stream.frame_count;
+
+	// append the frame to the read ahead blocks
+	const auto *in = reinterpret_cast<const uint8_t *>(pcm_buffer);
+	size_t size = pcm_size;
+
+	while (size) {
+		if (!stream.read_ahead_open || pool.blocks[stream.read_ahead.back()].format != pcm_format ||
+			pool.blocks[stream.read_ahead.back()].size == pool.block_size) {
+			stream.read_ahead.push_back(AllocPCMBlock(pool, stream.timestamp, pcm_format));
+			stream.read_ahead_open = true;
+		}
+
+		const auto idx = stream.read_ahead.back();
+		auto &block = pool.blocks[idx];
+
+		const auto count = Min(size, pool.block_size - block.size);
+		memcpy(GetPCMBlockData(pool, idx) + block.size, in, count);
+
+		block.size += count;
+		in += count;
+		size -= count;
+
+		stream.timestamp += ByteToTimestamp(pcm_format, count);
+	}
+
+	stream.read_ahead_size += pcm_size;
+	al_decoder.decoded_byte_count += pcm_size;
+	return true;
+}
+
+static bool IsReadAheadFull(const DecodeStream &stream) {
+	if (stream.read_ahead.empty())
+		return false;
+
+	const auto format = al_decoder.pool.blocks[stream.read_ahead.front()].format;
+	return stream.read_ahead_size >= TimestampToByte(format, al_mixer.config.read_ahead);
+}
+
+/// Decode all streams ahead of playback one frame at a time so that no stream starves while another one is decoded.
+static void DecodeStreams() {
+	const auto t_start = time_now();
+
+	for (bool progress = true; progress;) {
+		progress = false;
+
+		for (auto &stream : al_decoder.streams)
+			if (!stream.eof && !IsReadAheadFull(stream))
+				progress |= DecodeStreamFrame(stream);
+	}
+
+	al_decoder.decode_time = al_decoder.decode_time + (time_now() - t_start);
+}
+
+//
+/// Move decoded blocks to the source buffer queue, must be called with the mixer lock held. Return false once the stream is done.
+static bool ServiceDecodeStream(DecodeStream &stream) {
+	auto &voice = al_mixer.voices[stream.src_ref];
+	if (voice.generation != stream.generation)
+		return false; // voice stopped or stolen
+
+	const auto src = al_mixer.sources[stream.src_ref];
+	const auto buffer_count = stream.buffers.size();
 
 	// un-queue processed buffers
-	ALint processed;
-	__AL_CALL_RET(alGetSourcei(src, AL_BUFFERS_PROCESSED, &processed));
-	if (processed < 0 || processed > numeric_cast<ALint>(stream.buffers.size())) {
+	ALint processed = 0;
+	__AL_CALL(alGetSourcei(src, AL_BUFFERS_PROCESSED, &processed));
+
+	if (processed < 0 || size_t(processed) > stream.queued) {
 		warn("Incoherent processed buffer count returned from the OpenAL back-end");
 		return false;
 	}
 
 	while (processed--) {
-		__AL_CALL_RET(alSourceUnqueueBuffers(src, 1, &stream.buffers[stream.get]));
-		stream.get = (stream.get + 1) % stream.buffers.size();
-		++stream.free_buffer_count;
+		__AL_CALL(alSourceUnqueueBuffers(src, 1, &stream.buffers[stream.get]));
+		stream.get = (stream.get + 1) % buffer_count;
+		--stream.queued;
 	}
 
-	// fill all available buffers
-	while (stream.free_buffer_count > 0) {
-		uint8_t *pcm_buffer;
-		int pcm_size;
-		AudioFrameFormat pcm_format;
+	// queue decoded blocks, the block being written to is only queued when the source is about to starve
+	auto &pool = al_decoder.pool;
 
-		if (stream.streamer.GetFrame(stream.ref, (uintptr_t *)&pcm_buffer, &pcm_size, &pcm_format)) {
-			stream.buffers_timestamp[stream.put] = stream.streamer.GetTimeStamp(stream.ref);
-			stream.buffers_format[stream.put] = pcm_format;
+	while (stream.queued < buffer_count && !stream.read_ahead.empty()) {
+		const auto idx = stream.read_ahead.front();
+		const auto &block = pool.blocks[idx];
 
-			__AL_CALL(
-				alBufferData(stream.buffers[stream.put], AFF_ALFormat(pcm_format), pcm_buffer, numeric_cast<ALsizei>(pcm_size), AFF_Frequency[pcm_format]));
-			__AL_CALL(alSourceQueueBuffers(src, 1, &stream.buffers[stream.put]));
+		if (stream.read_ahead_open && stream.read_ahead.size() == 1 && block.size < pool.block_size && stream.queued > 0 && !stream.eof)
+			break;
 
-			stream.put = (stream.put + 1) % stream.buffers.size();
-			--stream.free_buffer_count;
-		} else {
-			if (stream.streamer.IsEnded(stream.ref)) { // stream is EOF
-				if (stream.loop) { // handle loop
-					if (!stream.streamer.Seek(stream.ref, 0)) // FIXME seek to sample_start
-						return false;
-				} else {
-					break; // EOF
-				}
-			} else {
-				return false; // stream error
-			}
-		}
+		stream.buffers_timestamp[stream.put] = block.timestamp;
+		stream.buffers_format[stream.put] = block.format;
+
+		__AL_CALL(alBufferData(stream.buffers[stream.put], AFF_ALFormat(block.format), GetPCMBlockData(pool, idx), numeric_cast<ALsizei>(block.size),
+			numeric_cast<ALsizei>(AFF_Frequency[block.format])));
+		__AL_CALL(alSourceQueueBuffers(src, 1, &stream.buffers[stream.put]));
+
+		stream.put = (stream.put + 1) % buffer_count;
+		++stream.queued;
+
+		stream.read_ahead_size -= block.size;
+		stream.read_ahead.pop_front();
+		if (stream.read_ahead.empty())
+			stream.read_ahead_open = false;
+
+		FreePCMBlock(pool, idx);
+	}
+
+	if (stream.queued) {
+		voice.timestamp = stream.buffers_timestamp[stream.get];
+		voice.timestamp_format = stream.buffers_format[stream.get];
 	}
 
-	// handle stream starting or stalled
+	// handle stream starting, stalled or done
 	ALint state;
-	__AL_CALL_RET(alGetSourcei(src, AL_SOURCE_STATE, &state));
+	__AL_CALL(alGetSourcei(src, AL_SOURCE_STATE, &state));
 
-	if (state == AL_PAUSED)
-		return true; // source paused
+	if (state == AL_PAUSED || state == AL_PLAYING)
+		return true;
 
-	if (state == AL_STOPPED)
-		return false; // source stopped
+	if (stream.queued == 0)
+		return !stream.eof; // waiting for data
 
-	if (state != AL_PLAYING) {
-		ALint buffer_queued;
-		__AL_CALL_RET(alGetSourcei(src, AL_BUFFERS_QUEUED, &buffer_queued));
+	if (state == AL_STOPPED && !stream.restart)
+		++al_decoder.underrun_count; // the source ran out of buffers before the end of the stream
 
-		if (buffer_queued > 0) {
-			__AL_CALL_RET(alSourcePlay(src)); // stalled!
+	__AL_CALL(alSourcePlay(src));
+
+	if (stream.pause_after_restart)
+		__AL_CALL(alSourcePause(src));
+
+	stream.restart = stream.pause_after_restart = false;
+	return true;
+}
+
+static void ServiceDecodeStreams() {
+	for (size_t i = 0; i < al_decoder.streams.size();) {
+		bool running;
+		{
+			std::lock_guard<std::mutex> lock(al_mixer.lock);
+			running = ServiceDecodeStream(al_decoder.streams[i]);
+		}
+
+		if (!running) {
+			FreeDecodeStream(al_decoder.streams[i]);
+
+			if (i != al_decoder.streams.size() - 1)
+				al_decoder.streams[i] = std::move(al_decoder.streams.back());
+			al_decoder.streams.pop_back();
 		} else {
-			return false; // no buffer queue, source not playing -> we're done here
+			++i;
 		}
 	}
 
-	return true;
+	al_decoder.free_block_count = al_decoder.pool.free_blocks.size();
 }
 
-static void UpdateAudio() {
-	for (SourceRef src_ref = 0; src_ref < max_source; ++src_ref) {
-		if (al_mixer.sources[src_ref] == InvalidSourceRef)
-			continue;
+//
+static void AudioDecoderThread() {
+	set_thread_name("Harfang - audio decoder");
 
-		auto &stream = al_mixer.streams[src_ref];
+	while (al_decoder.running) {
+		ProcessDecoderCommands();
+		DecodeStreams();
+		ServiceDecodeStreams();
 
-		if (stream.ref != InvalidAudioStreamRef)
-			if (!UpdateSourceStream(src_ref))
-				StopSource(src_ref);
+		std::unique_lock<std::mutex> lock(al_decoder.wake_mutex);
+		al_decoder.wake_condition.wait_for(lock, std::chrono::nanoseconds(audio_decode_period));
 	}
+
+	// release all streams, including the ones waiting to start
+	AudioCommand cmd;
+	while (PopCommand(al_decoder.commands, cmd))
+		if (cmd.type == ACT_Start)
+			CloseStream(cmd.streamer, cmd.stream_ref);
+
+	for (auto &stream : al_decoder.streams)
+		FreeDecodeStream(stream);
+	al_decoder.streams.clear();
 }
 
 //
 bool IsAudioUp() { return al_mixer.device || al_mixer.context; }
 
-bool AudioInit() {
-	start_timer();
+bool AudioInit() { return AudioInit({}); }
 
+bool AudioInit(const AudioConfig &config) {
 	if (IsAudioUp())
 		return true;
 
-	al_mixer.device = alcOpenDevice(nullptr);
+	if (!config.device.empty())
+		al_mixer.device = alcOpenDevice(config.device.c_str());
+
+	if (!al_mixer.device)
+		al_mixer.device = alcOpenDevice(nullptr);
 
 	if (!al_mixer.device) {
 		al_mixer.device = alcOpenDevice("Generic Software");
@@ -270,19 +699,52 @@ bool AudioInit() {
 
 	al_mixer.context = alcCreateContext(al_mixer.device, nullptr);
 	alcMakeContextCurrent(al_mixer.context);
-	__AL_CALL_RET(alGenSources(max_source, al_mixer.sources));
 
-	al_mixer.update = run_periodic(UpdateAudio, audio_mixer_period); // start update thread
+	al_mixer.config = config;
+	al_mixer.config.max_source = Max<size_t>(config.max_source, 1);
+	al_mixer.config.pcm_block_size = Max<size_t>(config.pcm_block_size, 4096);
+	al_mixer.config.pcm_block_count = Max<size_t>(config.pcm_block_count, audio_max_frame_size / al_mixer.config.pcm_block_size + 2);
+
+	al_mixer.sources.resize(al_mixer.config.max_source);
+	al_mixer.voices.clear();
+	al_mixer.voices.resize(al_mixer.config.max_source);
+	al_mixer.stolen_count = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(al_mixer.lock);
+		__AL_CALL_RET(alGenSources(numeric_cast<ALsizei>(al_mixer.sources.size()), al_mixer.sources.data()));
+	}
+
+	// start the decode thread
+	InitCommandQueue(al_decoder.commands, audio_command_queue_size);
+	InitPCMBlockPool(al_decoder.pool, al_mixer.config.pcm_block_size, al_mixer.config.pcm_block_count);
+
+	al_decoder.underrun_count = 0;
+	al_decoder.decoded_byte_count = 0;
+	al_decoder.free_block_count = al_mixer.config.pcm_block_count;
+	al_decoder.decode_time = 0;
+
+	al_decoder.running = true;
+	al_decoder.thread = std::thread(AudioDecoderThread);
 	return true;
 }
 
 void AudioShutdown() {
-	cancel_periodic(al_mixer.update);
+	if (al_decoder.thread.joinable()) {
+		al_decoder.running = false;
+		WakeDecoder();
+		al_decoder.thread.join();
+	}
+
+	al_decoder.pool = {};
 
 	StopAllSources();
 
 	if (al_mixer.context) {
-		__AL_CALL(alDeleteSources(max_source, al_mixer.sources));
+		{
+			std::lock_guard<std::mutex> lock(al_mixer.lock);
+			__AL_CALL(alDeleteSources(numeric_cast<ALsizei>(al_mixer.sources.size()), al_mixer.sources.data()));
+		}
 		alcMakeContextCurrent(nullptr);
 		alcDestroyContext(al_mixer.context);
 		al_mixer.context = nullptr;
@@ -292,9 +754,14 @@ void AudioShutdown() {
 		alcCloseDevice(al_mixer.device);
 		al_mixer.device = nullptr;
 	}
+
+	al_mixer.sources.clear();
+	al_mixer.voices.clear();
 }
 
 void SetListener(const Mat4 &world, const Vec3 &velocity) {
+	std::lock_guard<std::mutex> lock(al_mixer.lock);
+
 	const auto T = GetT(world);
 	__AL_CALL(alListener3f(AL_POSITION, T.x, T.y, T.z));
 
@@ -306,23 +773,73 @@ void SetListener(const Mat4 &world, const Vec3 &velocity) {
 }
 
 //
-static SourceRef GetFreeSourceRef() {
-	for (SourceRef src_ref = 0; src_ref < max_source; ++src_ref) {
-		if (al_mixer.streams[src_ref].ref != InvalidAudioStreamRef)
-			continue; // streaming sources are locked FIXME unless stopped or what?
-
-		ALint state;
-		ALuint src = al_mixer.sources[src_ref];
-		alGetSourcei(src, AL_SOURCE_STATE, &state);
-
-		if (__AL_OK && (state == AL_INITIAL || state == AL_STOPPED)) {
-			__AL_CALL(alSourcei(src, AL_BUFFER, 0));
-			__AL_CALL(alSourceRewind(src));
-			return src_ref;
+static bool IsSourceFree(SourceRef src_ref) {
+	if (al_mixer.voices[src_ref].streamed)
+		return false; // streamed sources are owned by the decode thread until their voice is released
+
+	ALint state;
+	alGetSourcei(al_mixer.sources[src_ref], AL_SOURCE_STATE, &state);
+	return __AL_OK && (state == AL_INITIAL || state == AL_STOPPED);
+}
+
+/*
+	Acquire a source to play a sound, must be called with the mixer lock held.
+
+	If no source is free the oldest source with the lowest priority is stolen, provided its priority is not higher than the requested priority.
+	Streamed sources are limited to AudioConfig::max_streamed_source, past this limit a streamed source can only steal another streamed source.
+*/
+static SourceRef AcquireSource(int priority, bool streamed) {
+	const auto source_count = SourceRef(al_mixer.sources.size());
+
+	size_t streamed_count = 0;
+	for (const auto &voice : al_mixer.voices)
+		if (voice.streamed)
+			++streamed_count;
+
+	const bool steal_streamed = streamed && streamed_count >= al_mixer.config.max_streamed_source;
+
+	SourceRef src_ref = InvalidSourceRef;
+
+	if (!steal_streamed)
+		for (SourceRef i = 0; i < source_count; ++i)
+			if (IsSourceFree(i)) {
+				src_ref = i;
+				break;
+			}
+
+	if (src_ref == InvalidSourceRef) {
+		for (SourceRef i = 0; i < source_count; ++i) {
+			const auto &voice = al_mixer.voices[i];
+
+			if (voice.priority > priority || (steal_streamed && !voice.streamed))
+				continue;
+
+			if (src_ref == InvalidSourceRef || voice.priority < al_mixer.voices[src_ref].priority ||
+				(voice.priority == al_mixer.voices[src_ref].priority && voice.start_order < al_mixer.voices[src_ref].start_order))
+				src_ref = i;
 		}
+
+		if (src_ref == InvalidSourceRef)
+			return InvalidSourceRef;
+
+		++al_mixer.stolen_count;
 	}
 
-	return InvalidSourceRef;
+	const auto src = al_mixer.sources[src_ref];
+
+	ResetSource(src);
+	__AL_CALL(alSourceRewind(src));
+
+	auto &voice = al_mixer.voices[src_ref];
+	ReleaseVoice(voice);
+
+	voice.priority = priority;
+	voice.start_order = ++al_mixer.start_order;
+	voice.streamed = streamed;
+	voice.duration = 0;
+	voice.timestamp = 0;
+
+	return src_ref;
 }
 
 //
@@ -343,35 +860,54 @@ static SoundRef GetFreeSoundRef() {
 }
 
 void UnloadSound(SoundRef snd_ref) {
+	std::lock_guard<std::mutex> lock(al_mixer.lock);
+
 	if (snd_ref < 0 || snd_ref >= sounds.size())
 		return;
 
 	auto &sound = sounds[snd_ref];
-	alDeleteBuffers(numeric_cast<ALsizei>(sound.buffers.size()), sound.buffers.data());
+	__AL_CALL(alDeleteBuffers(numeric_cast<ALsizei>(sound.buffers.size()), sound.buffers.data()));
 	sound.buffers.clear();
 }
 
 //
 static SoundRef LoadSound(IAudioStreamer streamer, const char *path) {
-	const auto stream_ref = streamer.Open(path);
+	AudioStreamRef stream_ref;
+	{
+		std::lock_guard<std::mutex> lock(al_decoder.codec_lock);
+		stream_ref = streamer.Open(path);
+	}
+
 	if (stream_ref == InvalidAudioStreamRef)
 		return InvalidSoundRef;
 
-	const auto snd_ref = GetFreeSoundRef();
-	auto &sound = sounds[snd_ref];
+	SoundRef snd_ref;
+	{
+		std::lock_guard<std::mutex> lock(al_mixer.lock);
+		snd_ref = GetFreeSoundRef();
+	}
 
 	uintptr_t pcm_buffer;
 	int pcm_size;
 	AudioFrameFormat pcm_format;
 
-	while (streamer.GetFrame(stream_ref, &pcm_buffer, &pcm_size, &pcm_format)) {
+	for (;;) {
+		// only lock the streamers while decoding a frame so that streamed sources do not starve
+		std::lock_guard<std::mutex> lock(al_decoder.codec_lock);
+
+		if (!streamer.GetFrame(stream_ref, &pcm_buffer, &pcm_size, &pcm_format))
+			break;
+
+		std::lock_guard<std::mutex> mixer_lock(al_mixer.lock); // the frame is only valid while the codec lock is held
+
+		auto &sound = sounds[snd_ref];
 		sound.buffers.push_back(AL_INVALID_VALUE);
 		__AL_CALL(alGenBuffers(1, &sound.buffers.back()));
 		__AL_CALL(alBufferData(
 			sound.buffers.back(), AFF_ALFormat(pcm_format), (const ALvoid *)pcm_buffer, numeric_cast<ALsizei>(pcm_size), AFF_Frequency[pcm_format]));
 	}
 
-	streamer.Close(stream_ref);
+	CloseStream(streamer, stream_ref);
 	return snd_ref;
 }
 
@@ -419,7 +955,7 @@ template <typename State> SourceRef Play(SoundRef snd_ref, const State &state) {
 
 	const auto &snd = sounds[snd_ref];
 
-	const auto src_ref = GetFreeSourceRef();
+	const auto src_ref = AcquireSource(state.priority, false);
 	if (src_ref == InvalidSourceRef)
 		return InvalidSourceRef;
 
@@ -436,23 +972,46 @@ SourceRef PlaySpatialized(SoundRef snd_ref, const SpatializedSourceState &state)
 
 //
 template <typename State> SourceRef Stream(IAudioStreamer streamer, const char *path, const State &state) {
-	std::lock_guard<std::mutex> lock(al_mixer.lock);
+	// open the stream before acquiring a source so that a stream failing to open never steals one
+	AudioStreamRef stream_ref;
+	time_ns duration;
 
-	const auto src_ref = GetFreeSourceRef();
-	if (src_ref == InvalidSourceRef)
-		return InvalidSourceRef;
+	{
+		std::lock_guard<std::mutex> lock(al_decoder.codec_lock);
 
-	ALChannelSetState(al_mixer.sources[src_ref], state, true);
+		stream_ref = streamer.Open(path);
+		if (stream_ref == InvalidAudioStreamRef)
+			return InvalidSourceRef;
 
-	const auto stream_ref = streamer.Open(path);
-	if (stream_ref == InvalidAudioStreamRef)
+		duration = streamer.GetDuration(stream_ref);
+	}
+
+	SourceRef src_ref;
+	uint32_t generation;
+
+	{
+		std::lock_guard<std::mutex> lock(al_mixer.lock);
+
+		src_ref = AcquireSource(state.priority, true);
+
+		if (src_ref != InvalidSourceRef) {
+			ALChannelSetState(al_mixer.sources[src_ref], state, true);
+
+			auto &voice = al_mixer.voices[src_ref];
+			voice.duration = duration;
+			generation = voice.generation;
+		}
+	}
+
+	if (src_ref == InvalidSourceRef) {
+		CloseStream(streamer, stream_ref);
 		return InvalidSourceRef;
+	}
 
-	ALStream &stream = al_mixer.streams[src_ref];
-	AllocStream(stream);
-	stream.streamer = streamer;
-	stream.ref = stream_ref;
-	stream.loop = state.repeat == SR_Loop;
+	// the decode thread takes over the stream
+	AudioCommand cmd{ACT_Start, src_ref, generation, streamer, stream_ref};
+	cmd.loop = state.repeat == SR_Loop;
+	PushDecoderCommand(cmd);
 
 	return src_ref;
 }
@@ -469,70 +1028,64 @@ SourceRef StreamOGGAssetSpatialized(const char *path, const SpatializedSourceSta
 
 //
 time_ns GetSourceTimecode(SourceRef src_ref) {
-	if (src_ref < 0 || src_ref >= max_source)
+	std::lock_guard<std::mutex> lock(al_mixer.lock);
+	if (!IsValidSourceRef(src_ref))
 		return 0;
 
-	std::lock_guard<std::mutex> mixer_lock(al_mixer.lock);
-	const auto src = al_mixer.sources[src_ref];
-	auto &stream = al_mixer.streams[src_ref];
+	const auto &voice = al_mixer.voices[src_ref];
 
-	ALint byte_offset;
-	__AL_CALL(alGetSourcei(src, AL_BYTE_OFFSET, &byte_offset));
+	if (!voice.streamed || voice.timestamp_format == AFF_Unsupported)
+		return voice.timestamp;
 
-	if (stream.ref != InvalidAudioStreamRef) {
-		std::lock_guard<std::mutex> stream_lock(stream.lock);
-
-		const auto pcm_format = stream.buffers_format[stream.get];
-		const auto current_pos_us =
-			(int64_t(byte_offset) * 1000000LL) / (AFF_Frequency[pcm_format] * AFF_ChannelCount[pcm_format] * AFF_Resolution[pcm_format] / 8);
+	ALint byte_offset;
+	__AL_CALL(alGetSourcei(al_mixer.sources[src_ref], AL_BYTE_OFFSET, &byte_offset));
 
-		stream.timestamp = stream.buffers_timestamp[stream.get] + time_from_us(current_pos_us);
-	}
-	return stream.timestamp;
+	const auto current_pos_us = (int64_t(byte_offset) * 1000000LL) / int64_t(AFF_BytePerSecond(voice.timestamp_format));
+	return voice.timestamp + time_from_us(current_pos_us);
 }
 
 time_ns GetSourceDuration(SourceRef src_ref) {
-	std::lock_guard<std::mutex> mixer_lock(al_mixer.lock);
-	if (src_ref < 0 || src_ref >= max_source)
-		return 0;
-
-	ALStream &stream = al_mixer.streams[src_ref];
-	if (stream.ref == InvalidAudioStreamRef)
+	std::lock_guard<std::mutex> lock(al_mixer.lock);
+	if (!IsValidSourceRef(src_ref))
 		return 0;
 
-	std::lock_guard<std::mutex> stream_lock(stream.lock);
-	return stream.streamer.GetDuration(stream.ref);
+	const auto &voice = al_mixer.voices[src_ref];
+	return voice.streamed ? voice.duration : 0;
 }
 
 bool SetSourceTimecode(SourceRef src_ref, time_ns t) {
-	std::lock_guard<std::mutex> mixer_lock(al_mixer.lock);
-	if (src_ref < 0 || src_ref >= max_source)
-		return false;
+	AudioCommand cmd{ACT_Seek, src_ref};
+	cmd.t = t;
 
-	ALStream &stream = al_mixer.streams[src_ref];
-	if (stream.ref == InvalidAudioStreamRef)
-		return 0;
+	{
+		std::lock_guard<std::mutex> lock(al_mixer.lock);
+		if (!IsValidSourceRef(src_ref))
+			return false;
 
-	if (stream.streamer.Seek(stream.ref, t) == 0) {
-		return false;
+		const auto &voice = al_mixer.voices[src_ref];
+		if (!voice.streamed || t < 0 || t > voice.duration)
+			return false;
+
+		cmd.generation = voice.generation;
 	}
 
+	PushDecoderCommand(cmd); // seeking is asynchronous
 	return true;
 }
 
 void SetSourceVolume(SourceRef src_ref, float volume) {
-	if (src_ref < 0 || src_ref >= max_source)
+	std::lock_guard<std::mutex> lock(al_mixer.lock);
+	if (!IsValidSourceRef(src_ref))
 		return;
 
-	std::lock_guard<std::mutex> lock(al_mixer.lock);
 	__AL_CALL(alSourcef(al_mixer.sources[src_ref], AL_GAIN, volume));
 }
 
 void SetSourcePanning(SourceRef src_ref, float panning) {
-	if (src_ref < 0 || src_ref >= max_source)
+	std::lock_guard<std::mutex> lock(al_mixer.lock);
+	if (!IsValidSourceRef(src_ref))
 		return;
 
-	std::lock_guard<std::mutex> lock(al_mixer.lock);
 	const auto src = al_mixer.sources[src_ref];
 
 	__AL_CALL(alDistanceModel(AL_NONE));
@@ -540,25 +1093,32 @@ void SetSourcePanning(SourceRef src_ref, float panning) {
 }
 
 void SetSourceRepeat(SourceRef src_ref, SourceRepeat repeat) {
-	if (src_ref < 0 || src_ref >= max_source)
-		return;
+	AudioCommand cmd{ACT_SetLoop, src_ref};
+	cmd.loop = repeat == SR_Loop;
 
-	std::lock_guard<std::mutex> lock(al_mixer.lock);
-	const auto src = al_mixer.sources[src_ref];
+	{
+		std::lock_guard<std::mutex> lock(al_mixer.lock);
+		if (!IsValidSourceRef(src_ref))
+			return;
 
-	auto &stream = al_mixer.streams[src_ref];
+		const auto &voice = al_mixer.voices[src_ref];
+
+		if (!voice.streamed) {
+			__AL_CALL(alSourcei(al_mixer.sources[src_ref], AL_LOOPING, repeat == SR_Loop ? AL_TRUE : AL_FALSE));
+			return;
+		}
 
-	if (stream.ref == InvalidAudioStreamRef)
-		alSourcei(src, AL_LOOPING, repeat == SR_Loop ? AL_TRUE : AL_FALSE);
-	else
-		stream.loop = repeat == SR_Loop;
+		cmd.generation = voice.generation;
+	}
+
+	PushDecoderCommand(cmd);
 }
 
 void SetSourceTransform(SourceRef src_ref, const Mat4 &world, const Vec3 &velocity) {
-	if (src_ref < 0 || src_ref >= max_source)
+	std::lock_guard<std::mutex> lock(al_mixer.lock);
+	if (!IsValidSourceRef(src_ref))
 		return;
 
-	std::lock_guard<std::mutex> lock(al_mixer.lock);
 	const auto src = al_mixer.sources[src_ref];
 
 	const auto T = GetTranslation(world);
@@ -572,10 +1132,10 @@ void SetSourceTransform(SourceRef src_ref, const Mat4 &world, const Vec3 &veloci
 
 //
 SourceState GetSourceState(SourceRef src_ref) {
-	if (src_ref < 0 || src_ref >= max_source)
+	std::lock_guard<std::mutex> lock(al_mixer.lock);
+	if (!IsValidSourceRef(src_ref))
 		return SS_Invalid;
 
-	std::lock_guard<std::mutex> lock(al_mixer.lock);
 	const auto src = al_mixer.sources[src_ref];
 
 	ALint state;
@@ -588,43 +1148,65 @@ SourceState GetSourceState(SourceRef src_ref) {
 	if (state == AL_PAUSED)
 		return SS_Paused;
 	if (state == AL_STOPPED)
-		return SS_Stopped;
+		return al_mixer.voices[src_ref].streamed ? SS_Playing : SS_Stopped; // a stopped streamed source is waiting for more data
 
 	return SS_Invalid;
 }
 
 //
 void PauseSource(SourceRef src_ref) {
-	if (src_ref < 0 || src_ref >= max_source)
-		return;
-
 	std::lock_guard<std::mutex> lock(al_mixer.lock);
-	const auto src = al_mixer.sources[src_ref];
+	if (!IsValidSourceRef(src_ref))
+		return;
 
-	__AL_CALL(alSourcePause(src));
+	__AL_CALL(alSourcePause(al_mixer.sources[src_ref]));
 }
 
 void StopSource(SourceRef src_ref) {
-	if (src_ref < 0 || src_ref >= max_source)
+	std::lock_guard<std::mutex> lock(al_mixer.lock);
+	if (!IsValidSourceRef(src_ref))
 		return;
 
-	std::lock_guard<std::mutex> mixer_lock(al_mixer.lock);
-	const auto src = al_mixer.sources[src_ref];
-
-	__AL_CALL(alSourceStop(src));
-	__AL_CALL(alSourcei(src, AL_BUFFER, 0));
-
-	auto &stream = al_mixer.streams[src_ref];
+	ResetSource(al_mixer.sources[src_ref]);
 
-	if (stream.ref != InvalidAudioStreamRef) {
-		stream.timestamp = stream.streamer.GetDuration(stream.ref);
-		FreeStream(stream);
-	}
+	auto &voice = al_mixer.voices[src_ref];
+	if (voice.streamed)
+		ReleaseVoice(voice);
 }
 
 void StopAllSources() {
-	for (SourceRef src_ref = 0; src_ref < max_source; ++src_ref)
+	for (SourceRef src_ref = 0; src_ref < SourceRef(al_mixer.sources.size()); ++src_ref)
 		StopSource(src_ref);
 }
 
+//
+AudioStats GetAudioStats() {
+	AudioStats stats{};
+
+	{
+		std::lock_guard<std::mutex> lock(al_mixer.lock);
+
+		stats.source_count = al_mixer.sources.size();
+
+		for (SourceRef src_ref = 0; src_ref < SourceRef(al_mixer.sources.size()); ++src_ref) {
+			ALint state;
+			alGetSourcei(al_mixer.sources[src_ref], AL_SOURCE_STATE, &state);
+
+			if (__AL_OK && (state == AL_PLAYING || state == AL_PAUSED))
+				++stats.playing_source_count;
+			if (al_mixer.voices[src_ref].streamed)
+				++stats.streamed_source_count;
+		}
+
+		stats.stolen_source_count = al_mixer.stolen_count;
+		stats.pcm_block_count = al_mixer.config.pcm_block_count;
+	}
+
+	stats.underrun_count = al_decoder.underrun_count;
+	stats.free_pcm_block_count = al_decoder.free_block_count;
+	stats.decoded_byte_count = al_decoder.decoded_byte_count;
+	stats.decode_time = al_decoder.decode_time;
+	return stats;
+}
+
 } // namespace hg
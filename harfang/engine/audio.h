@@ -8,10 +8,28 @@
 
 #include <engine/audio_stream_interface.h>
 
+#include <string>
+
 namespace hg {
 
+//
+struct AudioConfig {
+	size_t max_source = 64; // OpenAL sources shared by played and streamed sounds
+	size_t max_streamed_source = 32; // streamed sources playing at the same time
+
+	size_t stream_buffer_count = 4; // OpenAL buffers queued per streamed source
+	time_ns read_ahead = time_from_ms(500); // PCM decoded ahead of playback per streamed source
+
+	size_t pcm_block_size = 16384; // decoded PCM is stored in blocks taken from a pool shared by all streams
+	size_t pcm_block_count = 512;
+
+	std::string device; // OpenAL device name, the default device is used if empty or if the device can not be opened
+};
+
 /// Initialize the audio system.
 bool AudioInit();
+/// Initialize the audio system, streamed sources are decoded ahead of playback by a dedicated thread.
+bool AudioInit(const AudioConfig &config);
 /// Shutdown the audio system.
 void AudioShutdown();
 bool IsAudioUp();
@@ -27,6 +45,8 @@ struct StereoSourceState {
 	SourceRepeat repeat{SR_Once};
 
 	float panning{0.f}; // from -1 to 1 with 0 as the center
+
+	int priority{0}; // when all sources are in use the oldest source with the lowest priority is stolen
 };
 
 struct SpatializedSourceState {
@@ -36,6 +56,8 @@ struct SpatializedSourceState {
 	SourceRepeat repeat{SR_Once};
 
 	Vec3 vel{}; // for Doppler effect
+
+	int priority{0}; // when all sources are in use the oldest source with the lowest priority is stolen
 };
 
 //
@@ -88,6 +110,19 @@ void PauseSource(SourceRef src_ref);
 void StopSource(SourceRef src_ref);
 void StopAllSources();
 
+//
+struct AudioStats {
+	size_t source_count, playing_source_count, streamed_source_count;
+	size_t stolen_source_count; // sources stolen to play a sound of equal or higher priority
+	size_t underrun_count; // streamed sources which ran out of decoded data during playback
+
+	size_t pcm_block_count, free_pcm_block_count;
+	size_t decoded_byte_count;
+	time_ns decode_time; // time spent decoding by the decode thread
+};
+
+AudioStats GetAudioStats();
+
 // [todo] loop point?
 
 } // namespace hg
@@ -33,7 +33,7 @@ static bool IsChildOf(Scene &scene, NodeRef node, ComponentRef transform) {
 
 //
 Transform Scene::CreateTransform() {
-	const auto ref = transforms.add_ref({});
+	const auto ref = TrackComponent_(NCI_Transform, transforms.add_ref({}));
 	if (ref.idx >= transform_worlds.size())
 		transform_worlds.resize(ref.idx + 64, Mat4::Identity); // so that GetWorld works straight away
 	return {scene_ref, ref};
@@ -223,7 +223,7 @@ void Transform::SetParentNode(const Node &n) {
 }
 
 Transform Scene::CreateTransform(const Vec3 &pos, const Vec3 &rot, const Vec3 &scl, NodeRef parent) {
-	return {scene_ref, transforms.add_ref({{pos, rot, scl}, parent})};
+	return {scene_ref, TrackComponent_(NCI_Transform, transforms.add_ref({{pos, rot, scl}, parent}))};
 }
 
 Transform Scene::CreateTransform(const Mat4 &mtx, NodeRef parent) {
@@ -266,6 +266,7 @@ void Scene::SetTransformWorldMatrix(ComponentRef ref, const Mat4 &world) {
 	if (auto trs = GetComponent_(transforms, ref)) {
 		if (ref.idx < transform_worlds.size()) {
 			transform_worlds[ref.idx] = world;
+			MarkSpatialIndexTransformDirty_(ref.idx);
 
 			const auto parent_trs_ref = GetNodeComponentRef_<NCI_Transform>(trs->parent);
 			const auto local = IsValidTransformRef(parent_trs_ref) ? InverseFast(transform_worlds[parent_trs_ref.idx]) * world : world;
@@ -303,7 +304,7 @@ void Transform::SetLocal(const Mat4 &local) {
 }
 
 //
-Camera Scene::CreateCamera() { return {scene_ref, cameras.add_ref({})}; }
+Camera Scene::CreateCamera() { return {scene_ref, TrackComponent_(NCI_Camera, cameras.add_ref({}))}; }
 void Scene::DestroyCamera(ComponentRef ref) { cameras.remove_ref(ref); }
 
 float Scene::GetCameraZNear(ComponentRef ref) const {
@@ -518,14 +519,16 @@ Vec2 Camera::GetCenterOffset() const {
     return {};
 }
 
-Camera Scene::CreateCamera(const float znear, const float zfar, const float fov) { return {scene_ref, cameras.add_ref({{znear, zfar}, fov, false})}; }
+Camera Scene::CreateCamera(const float znear, const float zfar, const float fov) {
+	return {scene_ref, TrackComponent_(NCI_Camera, cameras.add_ref({{znear, zfar}, fov, false}))};
+}
 
 Camera Scene::CreateOrthographicCamera(const float znear, const float zfar, const float size) {
-	return {scene_ref, cameras.add_ref({{znear, zfar}, Deg(45.f), true, size})};
+	return {scene_ref, TrackComponent_(NCI_Camera, cameras.add_ref({{znear, zfar}, Deg(45.f), true, size}))};
 }
 
 //
-Object Scene::CreateObject() { return {scene_ref, objects.add_ref({})}; }
+Object Scene::CreateObject() { return {scene_ref, TrackComponent_(NCI_Object, objects.add_ref({}))}; }
 void Scene::DestroyObject(ComponentRef ref) { objects.remove_ref(ref); }
 
 ModelRef Scene::GetObjectModel(ComponentRef ref) const {
@@ -539,6 +542,7 @@ ModelRef Scene::GetObjectModel(ComponentRef ref) const {
 void Scene::SetObjectModel(ComponentRef ref, const ModelRef &v) {
 	if (auto *c = GetComponent_(objects, ref)) {
 		c->model = v;
+		MarkSpatialIndexRescan_(); // the nodes using the component are unknown
 	} else {
 		warn("Invalid object component");
 	}
@@ -663,10 +667,13 @@ size_t Object::GetBoneCount() const {
 }
 
 void Scene::SetObjectBoneCount(ComponentRef ref, size_t count) {
-	if (auto *c = GetComponent_(objects, ref))
+	if (auto *c = GetComponent_(objects, ref)) {
+		if (c->bones.empty() != (count == 0))
+			MarkSpatialIndexRescan_(); // skinned objects are not bounded
 		c->bones.resize(count);
-	else
+	} else {
 		warn("Invalid object component");
+	}
 }
 
 void Object::SetBoneCount(size_t count) {
@@ -804,10 +811,12 @@ bool Object::GetMinMax(const PipelineResources &resources, MinMax &minmax) const
 	return false;
 }
 
-Object Scene::CreateObject(const ModelRef &model, std::vector<Material> materials) { return {scene_ref, objects.add_ref({model, std::move(materials)})}; }
+Object Scene::CreateObject(const ModelRef &model, std::vector<Material> materials) {
+	return {scene_ref, TrackComponent_(NCI_Object, objects.add_ref({model, std::move(materials)}))};
+}
 
 //
-Light Scene::CreateLight() { return {scene_ref, lights.add_ref({})}; }
+Light Scene::CreateLight() { return {scene_ref, TrackComponent_(NCI_Light, lights.add_ref({}))}; }
 void Scene::DestroyLight(ComponentRef ref) { lights.remove_ref(ref); }
 
 LightType Scene::GetLightType(ComponentRef ref) const {
@@ -819,10 +828,13 @@ LightType Scene::GetLightType(ComponentRef ref) const {
 }
 
 void Scene::SetLightType(ComponentRef ref, LightType v) {
-	if (auto *c = GetComponent_(lights, ref))
+	if (auto *c = GetComponent_(lights, ref)) {
+		if (c->type != v)
+			MarkSpatialIndexRescan_();
 		c->type = v;
-	else
+	} else {
 		warn("Invalid light component");
+	}
 }
 
 LightShadowType Scene::GetLightShadowType(ComponentRef ref) const {
@@ -1001,10 +1013,13 @@ float Scene::GetLightRadius(ComponentRef ref) const {
 }
 
 void Scene::SetLightRadius(ComponentRef ref, float v) {
-	if (auto *c = GetComponent_(lights, ref))
+	if (auto *c = GetComponent_(lights, ref)) {
+		if (c->radius != Max(v, 0.f))
+			MarkSpatialIndexRescan_();
 		c->radius = Max(v, 0.f);
-	else
+	} else {
 		warn("Invalid light component");
+	}
 }
 
 float Light::GetRadius() const {
@@ -1175,20 +1190,23 @@ void Light::SetShadowBias(float v) {
 //
 Light Scene::CreateLinearLight(const Color &diffuse, float diffuse_intensity, const Color &specular, float specular_intensity, float priority,
 	LightShadowType shadow_type, float shadow_bias, const Vec4 &pssm_split) {
-	return {scene_ref,
-		lights.add_ref({LT_Linear, shadow_type, diffuse, diffuse_intensity, specular, specular_intensity, 0, 0, 0, pssm_split, priority, shadow_bias})};
+	const auto ref =
+		lights.add_ref({LT_Linear, shadow_type, diffuse, diffuse_intensity, specular, specular_intensity, 0, 0, 0, pssm_split, priority, shadow_bias});
+	return {scene_ref, TrackComponent_(NCI_Light, ref)};
 }
 
 Light Scene::CreatePointLight(const float radius, const Color &diffuse, float diffuse_intensity, const Color &specular, float specular_intensity,
 	float priority, LightShadowType shadow_type, float shadow_bias) {
-	return {scene_ref,
-		lights.add_ref({LT_Point, shadow_type, diffuse, diffuse_intensity, specular, specular_intensity, radius, 0, 0, Vec4::Zero, priority, shadow_bias})};
+	const auto ref =
+		lights.add_ref({LT_Point, shadow_type, diffuse, diffuse_intensity, specular, specular_intensity, radius, 0, 0, Vec4::Zero, priority, shadow_bias});
+	return {scene_ref, TrackComponent_(NCI_Light, ref)};
 }
 
 Light Scene::CreateSpotLight(const float radius, const float inner_angle, const float outer_angle, const Color &diffuse, float diffuse_intensity,
 	const Color &specular, float specular_intensity, float priority, LightShadowType shadow_type, float shadow_bias) {
-	return {scene_ref, lights.add_ref({LT_Spot, shadow_type, diffuse, diffuse_intensity, specular, specular_intensity, radius, inner_angle, outer_angle,
-						   Vec4::Zero, priority, shadow_bias})};
+	const auto ref = lights.add_ref({LT_Spot, shadow_type, diffuse, diffuse_intensity, specular, specular_intensity, radius, inner_angle, outer_angle,
+		Vec4::Zero, priority, shadow_bias});
+	return {scene_ref, TrackComponent_(NCI_Light, ref)};
 }
 
 //
@@ -12,12 +12,216 @@
 
 #include <stb_truetype/stb_truetype.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cstring>
+#include <unordered_map>
+#include <utility>
 
 namespace hg {
 
-static Font LoadFont(const ReadProvider &ip, const Reader &ir, const char *name, float size, uint16_t resolution, int padding, const char *glyphs) {
+static const uint32_t invalid_cell = 0xffffffff;
+static const utf32_cp invalid_cp = 0xffffffff;
+static const size_t kerning_cache_size = 1024; // must be a power of 2
+
+struct FontCache {
+	~FontCache() {
+		if (IsRenderUp())
+			for (auto page : pages)
+				bgfx::destroy(page);
+	}
+
+	Data data; // font file, referenced by info
+	stbtt_fontinfo info;
+
+	float scale;
+	int padding;
+	uint16_t resolution, max_page_count;
+
+	int cell_width, cell_height; // atlas cell size, large enough for any glyph of the font
+	int cells_per_row, cells_per_page;
+
+	std::vector<bgfx::TextureHandle> pages;
+
+	struct CachedGlyph {
+		int index; // glyph index in the font, 0 if the font has no glyph for this codepoint
+		bool empty; // nothing to rasterize (eg. space)
+		uint32_t cell; // atlas cell holding the glyph or invalid_cell
+		Font::Glyph glyph;
+	};
+
+	std::unordered_map<utf32_cp, CachedGlyph> glyphs;
+
+	std::vector<utf32_cp> cell_cp; // codepoint in each atlas cell
+	std::vector<uint32_t> cell_last_use; // frame each atlas cell was last drawn
+	std::vector<uint32_t> free_cells;
+
+	std::vector<uint32_t> cell_prev, cell_next; // intrusive list of the cells holding a glyph, least recently used first
+	uint32_t lru_head{invalid_cell}, lru_tail{invalid_cell};
+
+	uint32_t frame{1}; // atlas frame, advanced by UpdateFontAtlas
+	uint32_t dropped_frame{0}; // last atlas frame a glyph was dropped during
+	size_t rasterized_count{0}, evicted_count{0}, dropped_count{0};
+
+	struct CachedKerning {
+		uint64_t key;
+		float kerning;
+	};
+
+	bool has_kerning;
+	std::vector<CachedKerning> kerning; // direct mapped on the codepoint pair
+
+	std::vector<uint8_t> cell_pixels;
+};
+
+static FontCache::CachedGlyph *GetCachedGlyph(FontCache &cache, utf32_cp cp) {
+	auto i = cache.glyphs.find(cp);
+
+	if (i == std::end(cache.glyphs)) {
+		FontCache::CachedGlyph cached{stbtt_FindGlyphIndex(&cache.info, cp), true, invalid_cell, {}};
+
+		if (cached.index) {
+			int advance, x0, y0, x1, y1;
+			stbtt_GetGlyphHMetrics(&cache.info, cached.index, &advance, nullptr);
+			stbtt_GetGlyphBitmapBox(&cache.info, cached.index, cache.scale, cache.scale, &x0, &y0, &x1, &y1);
+
+			// clip glyphs overflowing the font bounding box
+			x1 = Min(x1, x0 + cache.cell_width - cache.padding * 2);
+			y1 = Min(y1, y0 + cache.cell_height - cache.padding * 2);
+
+			cached.empty = x1 <= x0 || y1 <= y0;
+			cached.glyph.pc = {{0, 0, x1 - x0, y1 - y0}, {{float(x0), float(y0)}, {float(x1), float(y1)}}, float(advance) * cache.scale};
+		}
+
+		i = cache.glyphs.emplace(cp, cached).first;
+	}
+
+	return i->second.index ? &i->second : nullptr;
+}
+
+static void NewAtlasPage(FontCache &cache) {
+	const auto page = cache.pages.size();
+	cache.pages.push_back(bgfx::createTexture2D(cache.resolution, cache.resolution, false, 1, bgfx::TextureFormat::A8, BGFX_SAMPLER_NONE));
+
+	const auto cell_count = (page + 1) * cache.cells_per_page;
+	cache.cell_cp.resize(cell_count, invalid_cp);
+	cache.cell_last_use.resize(cell_count, 0);
+	cache.cell_prev.resize(cell_count, invalid_cell);
+	cache.cell_next.resize(cell_count, invalid_cell);
+
+	for (auto i = cell_count; i > page * cache.cells_per_page; --i)
+		cache.free_cells.push_back(numeric_cast<uint32_t>(i - 1)); // lowest cell index first
+}
+
+static void UnlinkAtlasCell(FontCache &cache, uint32_t cell) {
+	const auto prev = cache.cell_prev[cell], next = cache.cell_next[cell];
+
+	if (prev != invalid_cell)
+		cache.cell_next[prev] = next;
+	else
+		cache.lru_head = next;
+
+	if (next != invalid_cell)
+		cache.cell_prev[next] = prev;
+	else
+		cache.lru_tail = prev;
+
+	cache.cell_prev[cell] = cache.cell_next[cell] = invalid_cell;
+}
+
+/// Mark an atlas cell as drawn during the current frame, moving it to the most recently used end of the list.
+static void UseAtlasCell(FontCache &cache, uint32_t cell) {
+	if (cache.cell_last_use[cell] == cache.frame)
+		return; // already after all the cells drawn during previous frames
+
+	if (cache.lru_head == cell || cache.cell_prev[cell] != invalid_cell)
+		UnlinkAtlasCell(cache, cell);
+
+	cache.cell_prev[cell] = cache.lru_tail;
+	if (cache.lru_tail != invalid_cell)
+		cache.cell_next[cache.lru_tail] = cell;
+	else
+		cache.lru_head = cell;
+	cache.lru_tail = cell;
+
+	cache.cell_last_use[cell] = cache.frame;
+}
+
+static uint32_t AcquireAtlasCell(FontCache &cache) {
+	if (cache.free_cells.empty() && cache.pages.size() < cache.max_page_count)
+		NewAtlasPage(cache);
+
+	if (!cache.free_cells.empty()) {
+		const auto cell = cache.free_cells.back();
+		cache.free_cells.pop_back();
+		return cell;
+	}
+
+	// evict the least recently used glyph, glyphs drawn this frame must stay in place until the frame is rendered
+	const auto cell = cache.lru_head;
+	if (cell == invalid_cell || cache.cell_last_use[cell] == cache.frame)
+		return invalid_cell;
+
+	UnlinkAtlasCell(cache, cell);
+
+	cache.glyphs[cache.cell_cp[cell]].cell = invalid_cell;
+	cache.cell_cp[cell] = invalid_cp;
+	++cache.evicted_count;
+
+	return cell;
+}
+
+static bool RasterizeGlyph(FontCache &cache, utf32_cp cp, FontCache::CachedGlyph &cached) {
+	const auto cell = AcquireAtlasCell(cache);
+	if (cell == invalid_cell)
+		return false;
+
+	const auto page = cell / cache.cells_per_page, local = cell % cache.cells_per_page;
+	const int x = (local % cache.cells_per_row) * cache.cell_width, y = (local / cache.cells_per_row) * cache.cell_height;
+
+	auto &pc = cached.glyph.pc;
+	const int w = GetWidth(pc.box), h = GetHeight(pc.box);
+
+	// upload the whole cell so that the padding around the glyph is cleared
+	std::fill(std::begin(cache.cell_pixels), std::end(cache.cell_pixels), 0);
+	stbtt_MakeGlyphBitmap(&cache.info, cache.cell_pixels.data() + cache.padding * cache.cell_width + cache.padding, w, h, cache.cell_width, cache.scale,
+		cache.scale, cached.index);
+
+	bgfx::updateTexture2D(cache.pages[page], 0, 0, uint16_t(x), uint16_t(y), uint16_t(cache.cell_width), uint16_t(cache.cell_height),
+		bgfx::copy(cache.cell_pixels.data(), numeric_cast<uint32_t>(cache.cell_pixels.size())));
+
+	cached.cell = cell;
+	cached.glyph.page = numeric_cast<uint16_t>(page);
+	pc.box = {x + cache.padding, y + cache.padding, x + cache.padding + w, y + cache.padding + h};
+
+	cache.cell_cp[cell] = cp;
+	++cache.rasterized_count;
+	return true;
+}
+
+/// Make a glyph available in the atlas for the current frame, returns false if it cannot be drawn.
+static bool UseGlyph(FontCache &cache, utf32_cp cp, FontCache::CachedGlyph &cached) {
+	if (cached.empty)
+		return false;
+
+	if (cached.cell == invalid_cell && !RasterizeGlyph(cache, cp, cached)) {
+		if (cache.dropped_frame != cache.frame) // warn once per frame
+			warn(format("Font atlas is full, glyph %1 not drawn: call UpdateFontAtlas once per frame, increase the atlas resolution or maximum page count")
+					 .arg(cp)
+					 .c_str());
+
+		cache.dropped_frame = cache.frame;
+		++cache.dropped_count;
+		return false;
+	}
+
+	UseAtlasCell(cache, cached.cell);
+	return true;
+}
+
+//
+static Font LoadFont(
+	const ReadProvider &ip, const Reader &ir, const char *name, float size, uint16_t resolution, int padding, const char *glyphs, uint16_t max_page_count) {
 	ScopedReadHandle h(ip, name);
 
 	if (!ir.is_valid(h)) {
@@ -25,110 +229,124 @@ static Font LoadFont(const ReadProvider &ip, const Reader &ir, const char *name,
 		return {};
 	}
 
-	const auto data = LoadData(ir, h);
+	auto cache = std::make_shared<FontCache>();
+	cache->data = LoadData(ir, h);
 
-	if (data.Empty()) {
+	if (cache->data.Empty()) {
 		warn(format("Failed to read data from '%1'").arg(name));
 		return {};
 	}
 
-	const auto buffer = reinterpret_cast<const unsigned char *>(data.GetData());
-
-	// extract codepoint
-	if(!glyphs) {
-		glyphs = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789,;:!?./\\+-*()'\"&_={} ";
+	if (!stbtt_InitFont(&cache->info, reinterpret_cast<const unsigned char *>(cache->data.GetData()), 0)) {
+		warn(format("Failed to parse font '%1'").arg(name));
+		return {};
 	}
 
-	std::vector<utf32_cp> cps;
-	convert_utf8_to_utf32(glyphs, cps);
+	cache->scale = stbtt_ScaleForPixelHeight(&cache->info, size);
+	cache->padding = padding;
+	cache->resolution = resolution;
+	cache->max_page_count = Max<uint16_t>(max_page_count, 1);
 
-	// remove duplicates
-	std::sort(cps.begin(), cps.end());
-	cps.erase(std::unique(cps.begin(), cps.end()), cps.end());
+	int x0, y0, x1, y1;
+	stbtt_GetFontBoundingBox(&cache->info, &x0, &y0, &x1, &y1);
 
-	//
-	stbtt_fontinfo info;
-	stbtt_InitFont(&info, buffer, 0);
+	cache->cell_width = Min(int(std::ceil(float(x1 - x0) * cache->scale)) + 1 + padding * 2, int(resolution));
+	cache->cell_height = Min(int(std::ceil(float(y1 - y0) * cache->scale)) + 1 + padding * 2, int(resolution));
+	cache->cells_per_row = resolution / cache->cell_width;
+	cache->cells_per_page = cache->cells_per_row * (resolution / cache->cell_height);
+	cache->cell_pixels.resize(size_t(cache->cell_width) * cache->cell_height);
 
-	const auto scale = stbtt_ScaleForPixelHeight(&info, size);
-	int ascent;
-	stbtt_GetFontVMetrics(&info, &ascent, 0, 0);
+	cache->has_kerning = cache->info.kern || cache->info.gpos;
+	cache->kerning.resize(kerning_cache_size, {0xffffffffffffffff, 0.f});
 
-	//
-	stbtt_pack_context spc;
-	uint8_t *pixels = nullptr;
+	int ascent;
+	stbtt_GetFontVMetrics(&cache->info, &ascent, 0, 0);
 
 	Font font;
 	font.resolution = resolution;
-	font.ascent = float(ascent) * scale;
-	font.scale = scale;
+	font.ascent = float(ascent) * cache->scale;
+	font.scale = cache->scale;
 
-	auto new_page = [&]() {
-		__ASSERT__(pixels == nullptr);
-		pixels = new uint8_t[resolution * resolution];
-		stbtt_PackBegin(&spc, pixels, resolution, resolution, 0, padding, nullptr);
-	};
+	// rasterize requested glyphs up front
+	if (glyphs) {
+		std::vector<utf32_cp> cps;
+		convert_utf8_to_utf32(glyphs, cps);
 
-	auto commit_page = [&]() {
-		__ASSERT__(pixels != nullptr);
-		const auto *mem = bgfx::makeRef(pixels, resolution * resolution, [](void *ptr, void *) { delete[] reinterpret_cast<uint8_t *>(ptr); });
-		font.pages.push_back(bgfx::createTexture2D(resolution, resolution, false, 1, bgfx::TextureFormat::A8, BGFX_SAMPLER_NONE, mem));
-		pixels = nullptr;
-		stbtt_PackEnd(&spc);
-	};
+		for (auto cp : cps)
+			if (auto cached = GetCachedGlyph(*cache, cp))
+				UseGlyph(*cache, cp, *cached);
+	}
 
-	// stbtt_PackSetOversampling(&spc, 2, 2);
+	font.cache = cache;
+	return font;
+}
 
-	for (auto &cp : cps) {
-		if (!pixels)
-			new_page();
+//
+Font LoadFontFromFile(const char *path, float size, uint16_t resolution, int padding, const char *glyphs, uint16_t max_page_count) {
+	return LoadFont(g_file_read_provider, g_file_reader, path, size, resolution, padding, glyphs, max_page_count);
+}
 
-		stbtt_packedchar pc;
-		auto &glyph = font.glyphs[cp];
-		glyph.page = numeric_cast<uint16_t>(font.pages.size());
+Font LoadFontFromAssets(const char *name, float size, uint16_t resolution, int padding, const char *glyphs, uint16_t max_page_count) {
+	return LoadFont(g_assets_read_provider, g_assets_reader, name, size, resolution, padding, glyphs, max_page_count);
+}
 
-		int ret = stbtt_PackFontRange(&spc, buffer, 0, size, cp, 1, &pc);
-		glyph.pc = {{pc.x0, pc.y0, pc.x1, pc.y1}, {{pc.xoff, pc.yoff}, {pc.xoff2, pc.yoff2}}, pc.xadvance};
-		if (!ret)
-			commit_page();
-	}
+//
+void UpdateFontAtlas(const Font &font) {
+	if (font.cache)
+		++font.cache->frame;
+}
 
-	if (pixels)
-		commit_page();
+std::vector<bgfx::TextureHandle> GetFontPages(const Font &font) { return font.cache ? font.cache->pages : std::vector<bgfx::TextureHandle>{}; }
 
-	// transfer kerning
-	for (auto i : cps)
-		for (auto j : cps)
-			if (auto kerning = stbtt_GetCodepointKernAdvance(&info, i, j) * scale)
-				font.kerning[i][j] = kerning;
+bool GetFontGlyph(const Font &font, utf32_cp cp, Font::Glyph &glyph) {
+	if (!font.cache)
+		return false;
 
-	return font;
-}
+	const auto cached = GetCachedGlyph(*font.cache, cp);
+	if (!cached || (!cached->empty && !UseGlyph(*font.cache, cp, *cached)))
+		return false;
 
-//
-Font LoadFontFromFile(const char *path, float size, uint16_t resolution, int padding, const char *glyphs) {
-	return LoadFont(g_file_read_provider, g_file_reader, path, size, resolution, padding, glyphs);
+	glyph = cached->glyph;
+	return true;
 }
 
-Font LoadFontFromAssets(const char *name, float size, uint16_t resolution, int padding, const char *glyphs) {
-	return LoadFont(g_assets_read_provider, g_assets_reader, name, size, resolution, padding, glyphs);
+FontAtlasStats GetFontAtlasStats(const Font &font) {
+	FontAtlasStats stats{};
+
+	if (const auto cache = font.cache.get()) {
+		stats.page_count = cache->pages.size();
+		stats.cell_count = cache->cell_cp.size();
+		stats.glyph_count = stats.cell_count - cache->free_cells.size();
+		stats.rasterized_count = cache->rasterized_count;
+		stats.evicted_count = cache->evicted_count;
+		stats.dropped_count = cache->dropped_count;
+		stats.occupancy = stats.cell_count ? float(stats.glyph_count) / float(stats.cell_count) : 0.f;
+	}
+
+	return stats;
 }
 
 //
 float GetKerning(const Font &font, uint32_t cp0, uint32_t cp1) {
-	const auto i = font.kerning.find(cp0);
-	if (i == std::end(font.kerning))
+	if (!font.cache || !font.cache->has_kerning)
 		return 0.f;
 
-	const auto j = i->second.find(cp1);
-	if (j == std::end(i->second))
-		return 0.f;
+	auto &cache = *font.cache;
+
+	const auto key = (uint64_t(cp0) << 32) | cp1;
+	auto &cached = cache.kerning[((cp0 * 0x9e3779b1) ^ cp1) & (kerning_cache_size - 1)];
 
-	return j->second;
+	if (cached.key != key)
+		cached = {key, float(stbtt_GetCodepointKernAdvance(&cache.info, cp0, cp1)) * cache.scale};
+
+	return cached.kerning;
 }
 
 //
 static float ComputeTextWidth(const Font &font, const std::vector<utf32_cp> &cps) {
+	if (!font.cache)
+		return 0.f;
+
 	float width = 0.f;
 	float line_width = 0.f;
 	for (size_t i = 0; i < cps.size(); ++i) {
@@ -137,46 +355,37 @@ static float ComputeTextWidth(const Font &font, const std::vector<utf32_cp> &cps
 			width = Max(width, line_width);
 			line_width = 0.f;
 		}
-		const auto j = font.glyphs.find(cp);
-		if (j != std::end(font.glyphs)) {
-			line_width += j->second.pc.advance;
-		}
+		if (const auto cached = GetCachedGlyph(*font.cache, cp))
+			line_width += cached->glyph.pc.advance;
 	}
 	return Max(width, line_width);
 }
 
 //
-static void DrawText(bgfx::ViewId view_id, const Font &font, const std::vector<utf32_cp> &cps, bgfx::ProgramHandle program, const char *page_uniform,
-	uint8_t page_stage, const Mat4 *mtxs, size_t mtx_count, Vec3 pos, const std::vector<UniformSetValue> &values,
-	const std::vector<UniformSetTexture> &textures, RenderState state, uint32_t depth) {
-	const float xline = pos.x;
-
-	// prepare glyphs per page
-	bgfx::VertexLayout v_decl;
-	v_decl.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float).end();
-
-	struct Vert {
-		float pos[3];
-		float uv[2];
-	};
-
-	std::vector<std::vector<Vert>> pages_quads(font.pages.size());
-	for (auto &page_quads : pages_quads)
-		page_quads.reserve(256);
+static bgfx::VertexLayout GetTextVertexLayout() {
+	bgfx::VertexLayout layout;
+	layout.begin()
+		.add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float)
+		.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float)
+		.add(bgfx::Attrib::Color0, 4, bgfx::AttribType::Uint8, true)
+		.end();
+	return layout;
+}
 
+/// Append the quads of a single line of text to the vertices of each atlas page, `mtx` transforms the vertices if not null.
+/// The codepoints of all non-empty glyphs are appended to `glyph_cps` if not null, including glyphs that could not be drawn.
+static void BuildTextLineQuads(const Font &font, FontCache &cache, const std::vector<utf32_cp> &cps, Vec3 pos, const Mat4 *mtx, uint32_t color,
+	std::vector<std::vector<TextVertex>> &pages_vtx, std::vector<utf32_cp> *glyph_cps) {
 	for (size_t i = 0; i < cps.size(); ++i) {
 		const auto cp = cps[i];
 
-		if (cp == '\n') {
-			pos.x = xline;
-			pos.y += font.ascent;
-		}
-
-		const auto j = font.glyphs.find(cp);
-		if (j == std::end(font.glyphs))
+		const auto cached = GetCachedGlyph(cache, cp);
+		if (!cached)
 			continue;
 
-		const auto &glyph = j->second;
+		const bool visible = UseGlyph(cache, cp, *cached); // atlas location is only valid once the glyph is in use
+
+		const auto &glyph = cached->glyph;
 
 		stbtt_aligned_quad quad;
 		stbtt_packedchar pc = {(unsigned short)glyph.pc.box.sx, (unsigned short)glyph.pc.box.sy, (unsigned short)glyph.pc.box.ex,
@@ -189,32 +398,120 @@ static void DrawText(bgfx::ViewId view_id, const Font &font, const std::vector<u
 		if ((i + 1) < cps.size())
 			pos.x += GetKerning(font, cp, cps[i + 1]);
 
-		auto &page_quads = pages_quads[glyph.page];
+		if (glyph_cps && !cached->empty)
+			glyph_cps->push_back(cp);
+
+		if (!visible)
+			continue;
+
+		if (glyph.page >= pages_vtx.size())
+			pages_vtx.resize(glyph.page + 1);
+
+		auto &vtx = pages_vtx[glyph.page];
+
+		const Vec3 corners[4] = {{quad.x0, quad.y0, pos.z}, {quad.x0, quad.y1, pos.z}, {quad.x1, quad.y1, pos.z}, {quad.x1, quad.y0, pos.z}};
+		const float uvs[4][2] = {{quad.s0, quad.t0}, {quad.s0, quad.t1}, {quad.s1, quad.t1}, {quad.s1, quad.t0}};
+
+		for (int k = 0; k < 4; ++k) {
+			const auto p = mtx ? *mtx * corners[k] : corners[k];
+			vtx.push_back({{p.x, p.y, p.z}, {uvs[k][0], uvs[k][1]}, color});
+		}
+	}
+}
+
+/// Layout a possibly multi-line string and append its quads to the vertices of each atlas page.
+static void BuildTextQuads(const Font &font, const char *text, Vec3 pos, DrawTextHAlign halign, DrawTextVAlign valign, const Mat4 *mtx, uint32_t color,
+	std::vector<std::vector<TextVertex>> &pages_vtx, std::vector<utf32_cp> *glyph_cps = nullptr) {
+	auto &cache = *font.cache;
+
+	const auto xline = pos.x;
+
+	std::vector<utf32_cp> cps;
+	cps.reserve(256);
+
+	fRect box = ComputeTextRect(font, text);
+	const float width = GetWidth(box);
+	const float height = GetHeight(box);
+
+	if (valign == DTVA_Center)
+		pos.y -= -height * 0.5f;
+	else if (valign == DTVA_Bottom)
+		pos.y -= -height;
+	else // WVA_Top
+		;
+
+	while (*text) {
+		while (true) {
+			if (*text == '\n') {
+				++text;
+				break; // EOL
+			}
+
+			if (*text == '\0')
+				break; // EOS
+
+			utf32_cp cp;
+			text += utf8_to_utf32((const utf8_cp *)text, cp);
+			cps.push_back(cp);
+		}
+
+		if (halign != DTHA_Left) {
+			float line_width = ComputeTextWidth(font, cps);
+			if (halign == DTHA_Center) {
+				pos.x = xline - line_width / 2.f;
+			} else { // WHA_Right
+				pos.x = xline - line_width;
+			}
+		} else {
+			pos.x = xline;
+		}
+
+		if (!cps.empty()) {
+			BuildTextLineQuads(font, cache, cps, pos, mtx, color, pages_vtx, glyph_cps);
+			cps.clear();
+		}
 
-		page_quads.push_back({quad.x0, quad.y0, pos.z, quad.s0, quad.t0});
-		page_quads.push_back({quad.x0, quad.y1, pos.z, quad.s0, quad.t1});
-		page_quads.push_back({quad.x1, quad.y1, pos.z, quad.s1, quad.t1});
-		page_quads.push_back({quad.x1, quad.y0, pos.z, quad.s1, quad.t0});
+		pos.y += font.ascent;
+	}
+}
+
+template <typename T> static void FillQuadIndices(T *idx, uint32_t vtx_count) {
+	for (uint32_t j = 0; j < vtx_count; j += 4) {
+		const auto k = T(j);
+
+		*idx++ = k;
+		*idx++ = k + 1;
+		*idx++ = k + 2;
+
+		*idx++ = k + 2;
+		*idx++ = k + 3;
+		*idx++ = k;
 	}
+}
 
+/// Submit the vertices of each atlas page with a single draw call per page, `mtxs` is optional.
+static void SubmitTextQuads(bgfx::ViewId view_id, const FontCache &cache, const std::vector<std::vector<TextVertex>> &pages_vtx, bgfx::ProgramHandle program,
+	const char *page_uniform, uint8_t page_stage, const Mat4 *mtxs, size_t mtx_count, const std::vector<UniformSetValue> &values,
+	const std::vector<UniformSetTexture> &textures, RenderState state, uint32_t depth) {
+	const auto layout = GetTextVertexLayout();
 	const auto u_page = bgfx::createUniform(page_uniform, bgfx::UniformType::Sampler);
 
 	std::vector<bgfxMatrix4> bgfx_mtx(mtx_count);
 	for (size_t i = 0; i < mtx_count; ++i)
 		bgfx_mtx[i] = to_bgfx(mtxs[i]);
 
-	const auto i_mtx = bgfx::setTransform(bgfx_mtx.data(), uint16_t(mtx_count));
+	const auto i_mtx = mtx_count ? bgfx::setTransform(bgfx_mtx.data(), uint16_t(mtx_count)) : 0;
 
-	for (size_t i = 0; i < pages_quads.size(); ++i) {
-		const auto &page_quads = pages_quads[i];
-		if (page_quads.empty())
+	for (size_t i = 0; i < pages_vtx.size(); ++i) {
+		const auto &vtx = pages_vtx[i];
+		if (vtx.empty())
 			continue;
 
-		const uint32_t num_vertices = numeric_cast<uint32_t>(page_quads.size());
-		const uint32_t quad_count = num_vertices / 4;
-		const uint32_t num_indices = quad_count * 6;
+		const uint32_t num_vertices = numeric_cast<uint32_t>(vtx.size());
+		const uint32_t num_indices = num_vertices / 4 * 6;
+		const bool index32 = num_vertices > 65536;
 
-		if (num_vertices != bgfx::getAvailTransientVertexBuffer(num_vertices, v_decl) || num_indices != bgfx::getAvailTransientIndexBuffer(num_indices)) {
+		if (num_vertices != bgfx::getAvailTransientVertexBuffer(num_vertices, layout) || num_indices != bgfx::getAvailTransientIndexBuffer(num_indices, index32)) {
 			debug("Out of transient buffer space while rendering font, reduce the amount of text displayed in one call");
 			break;
 		}
@@ -222,28 +519,20 @@ static void DrawText(bgfx::ViewId view_id, const Font &font, const std::vector<u
 		bgfx::TransientVertexBuffer tvb;
 		bgfx::TransientIndexBuffer tib;
 
-		bgfx::allocTransientVertexBuffer(&tvb, num_vertices, v_decl);
-		bgfx::allocTransientIndexBuffer(&tib, num_indices);
+		bgfx::allocTransientVertexBuffer(&tvb, num_vertices, layout);
+		bgfx::allocTransientIndexBuffer(&tib, num_indices, index32);
 
-		auto vtx = reinterpret_cast<Vert *>(tvb.data);
-		std::copy(std::begin(page_quads), std::end(page_quads), vtx);
+		std::copy(std::begin(vtx), std::end(vtx), reinterpret_cast<TextVertex *>(tvb.data));
 
-		auto idx = reinterpret_cast<uint16_t *>(tib.data);
-		for (uint32_t j = 0; j < num_vertices; j += 4) {
-			uint16_t k = (uint16_t)j;
+		if (index32)
+			FillQuadIndices(reinterpret_cast<uint32_t *>(tib.data), num_vertices);
+		else
+			FillQuadIndices(reinterpret_cast<uint16_t *>(tib.data), num_vertices);
 
-			*idx++ = k;
-			*idx++ = k + 1;
-			*idx++ = k + 2;
+		if (mtx_count)
+			bgfx::setTransform(i_mtx, uint16_t(mtx_count));
 
-			*idx++ = k + 2;
-			*idx++ = k + 3;
-			*idx++ = k;
-		}
-
-		bgfx::setTransform(i_mtx);
-
-		bgfx::setTexture(page_stage, u_page, font.pages[i]);
+		bgfx::setTexture(page_stage, u_page, cache.pages[i]);
 
 		SetUniforms(values, textures);
 
@@ -276,9 +565,8 @@ static fRect ComputeTextRect(const Font &font, const std::vector<utf32_cp> &cps,
 			x = xpos;
 			rect.ey += font.ascent;
 		} else {
-			const auto j = font.glyphs.find(cp);
-			if (j != std::end(font.glyphs)) {
-				x += j->second.pc.advance;
+			if (const auto cached = font.cache ? GetCachedGlyph(*font.cache, cp) : nullptr) {
+				x += cached->glyph.pc.advance;
 				rect.ex = Max(x, rect.ex);
 			}
 		}
@@ -291,61 +579,213 @@ static fRect ComputeTextRect(const Font &font, const std::vector<utf32_cp> &cps,
 void DrawText(bgfx::ViewId view_id, const Font &font, const char *text, bgfx::ProgramHandle program, const char *page_uniform, uint8_t page_stage,
 	const Mat4 *mtxs, size_t mtx_count, Vec3 pos, DrawTextHAlign halign, DrawTextVAlign valign, const std::vector<UniformSetValue> &values,
 	const std::vector<UniformSetTexture> &textures, RenderState state, uint32_t depth) {
-	const auto xline = pos.x;
+	if (!font.cache)
+		return;
 
-	std::vector<utf32_cp> cps;
-	cps.reserve(256);
+	std::vector<std::vector<TextVertex>> pages_vtx;
+	BuildTextQuads(font, text, pos, halign, valign, nullptr, 0xffffffff, pages_vtx);
+	SubmitTextQuads(view_id, *font.cache, pages_vtx, program, page_uniform, page_stage, mtxs, mtx_count, values, textures, state, depth);
+}
 
-	fRect box = ComputeTextRect(font, text);
-	const float width = GetWidth(box);
-	const float height = GetHeight(box);
+void DrawText(bgfx::ViewId view_id, const Font &font, const char *text, bgfx::ProgramHandle program, const char *page_uniform, uint8_t page_stage, const Mat4 &mtx,
+	Vec3 pos, DrawTextHAlign halign, DrawTextVAlign valign, const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures,
+	RenderState state, uint32_t depth) {
+	DrawText(view_id, font, text, program, page_uniform, page_stage, &mtx, 1, pos, halign, valign, values, textures, state, depth);
+}
 
-	if (valign == DTVA_Center)
-		pos.y -= -height * 0.5f;
-	else if (valign == DTVA_Bottom)
-		pos.y -= -height;
-	else // WVA_Top
-		;
+//
+void AddTextToBatch(TextBatch &batch, const Font &font, const char *text, const Mat4 &mtx, Vec3 pos, const Color &color, DrawTextHAlign halign,
+	DrawTextVAlign valign) {
+	if (!font.cache)
+		return;
+
+	if (batch.font.cache != font.cache) {
+		if (!batch.font.cache) {
+			batch.font = font;
+		} else {
+			warn("Text batch can only hold text using a single font");
+			return;
+		}
+	}
 
-	while (*text) {
-		while (true) {
-			if (*text == '\n') {
-				++text;
-				break; // EOL
-			}
+	BuildTextQuads(font, text, pos, halign, valign, &mtx, ColorToABGR32(color), batch.pages);
+}
 
-			if (*text == '\0')
-				break; // EOS
+void DrawTextBatch(bgfx::ViewId view_id, const TextBatch &batch, bgfx::ProgramHandle program, const char *page_uniform, uint8_t page_stage,
+	const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, RenderState state, uint32_t depth) {
+	if (batch.font.cache)
+		SubmitTextQuads(view_id, *batch.font.cache, batch.pages, program, page_uniform, page_stage, nullptr, 0, values, textures, state, depth);
+}
 
-			utf32_cp cp;
-			text += utf8_to_utf32((const utf8_cp *)text, cp);
-			cps.push_back(cp);
+void ClearTextBatch(TextBatch &batch) {
+	batch.font = {};
+	for (auto &vtx : batch.pages)
+		vtx.clear(); // keep capacity for the next frame
+}
+
+//
+void SetRetainedText(RetainedText &text, const Font &font, const char *str, Vec3 pos, const Color &color, DrawTextHAlign halign, DrawTextVAlign valign) {
+	const auto abgr = ColorToABGR32(color);
+
+	if (text.font.cache == font.cache && text.text == str && text.pos == pos && text.color == abgr && text.halign == halign && text.valign == valign)
+		return;
+
+	text.font = font;
+	text.text = str;
+	text.pos = pos;
+	text.color = abgr;
+	text.halign = halign;
+	text.valign = valign;
+	text.dirty = true;
+}
+
+static void DestroyRetainedTextBuffers(RetainedText &text) {
+	for (auto &page : text.pages) {
+		bgfx::destroy(page.vtx);
+		bgfx::destroy(page.idx);
+	}
+	text.pages.clear();
+}
+
+RetainedText::~RetainedText() {
+	if (IsRenderUp())
+		DestroyRetainedTextBuffers(*this);
+}
+
+RetainedText::RetainedText(RetainedText &&other) noexcept { *this = std::move(other); }
+
+RetainedText &RetainedText::operator=(RetainedText &&other) noexcept {
+	if (this == &other)
+		return *this;
+
+	if (IsRenderUp())
+		DestroyRetainedTextBuffers(*this);
+
+	font = std::move(other.font);
+	text = std::move(other.text);
+	pos = other.pos;
+	color = other.color;
+	halign = other.halign;
+	valign = other.valign;
+	glyphs = std::move(other.glyphs);
+	pages = std::move(other.pages);
+	dirty = other.dirty;
+	revision = other.revision;
+
+	other.pages.clear(); // buffers now belong to this text
+	other.dirty = true;
+	return *this;
+}
+
+/// Returns true if all glyphs of the text are still at the atlas location its vertices were built for, mark them as used this frame.
+/// Glyphs that could not be drawn when the vertices were built are retried, the text must be rebuilt once they make it to the atlas.
+static bool UseRetainedTextGlyphs(FontCache &cache, const RetainedText &text) {
+	for (const auto &glyph : text.glyphs) {
+		const auto cached = GetCachedGlyph(cache, glyph.cp);
+		if (!cached)
+			return false;
+
+		if (glyph.cell == invalid_cell) {
+			if (UseGlyph(cache, glyph.cp, *cached))
+				return false;
+			continue;
 		}
 
-		if (halign != DTHA_Left) {
-			float line_width = ComputeTextWidth(font, cps);
-			if (halign == DTHA_Center) {
-				pos.x = xline - line_width / 2.f;
-			} else { // WHA_Right
-				pos.x = xline - line_width;
-			}
+		if (cached->cell != glyph.cell)
+			return false;
+
+		UseAtlasCell(cache, glyph.cell);
+	}
+	return true;
+}
+
+static void BuildRetainedText(RetainedText &text) {
+	auto &cache = *text.font.cache;
+
+	std::vector<std::vector<TextVertex>> pages_vtx;
+	std::vector<utf32_cp> glyph_cps;
+	BuildTextQuads(text.font, text.text.c_str(), text.pos, text.halign, text.valign, nullptr, text.color, pages_vtx, &glyph_cps);
+
+	std::sort(std::begin(glyph_cps), std::end(glyph_cps));
+	glyph_cps.erase(std::unique(std::begin(glyph_cps), std::end(glyph_cps)), std::end(glyph_cps));
+
+	text.glyphs.clear();
+	for (auto cp : glyph_cps)
+		text.glyphs.push_back({cp, GetCachedGlyph(cache, cp)->cell}); // invalid cell if the glyph could not be drawn
+
+	DestroyRetainedTextBuffers(text);
+
+	const auto layout = GetTextVertexLayout();
+
+	for (size_t i = 0; i < pages_vtx.size(); ++i) {
+		const auto &vtx = pages_vtx[i];
+		if (vtx.empty())
+			continue;
+
+		const auto num_vertices = numeric_cast<uint32_t>(vtx.size());
+		const auto num_indices = num_vertices / 4 * 6;
+
+		RetainedText::Page page;
+		page.page = numeric_cast<uint16_t>(i);
+		page.idx_count = num_indices;
+		page.vtx = bgfx::createVertexBuffer(bgfx::copy(vtx.data(), num_vertices * sizeof(TextVertex)), layout);
+
+		if (num_vertices > 65536) {
+			std::vector<uint32_t> idx(num_indices);
+			FillQuadIndices(idx.data(), num_vertices);
+			page.idx = bgfx::createIndexBuffer(bgfx::copy(idx.data(), num_indices * sizeof(uint32_t)), BGFX_BUFFER_INDEX32);
 		} else {
-			pos.x = xline;
+			std::vector<uint16_t> idx(num_indices);
+			FillQuadIndices(idx.data(), num_vertices);
+			page.idx = bgfx::createIndexBuffer(bgfx::copy(idx.data(), num_indices * sizeof(uint16_t)));
 		}
 
-		if (!cps.empty()) {
-			DrawText(view_id, font, cps, program, page_uniform, page_stage, mtxs, mtx_count, pos, values, textures, state, depth);
-			cps.clear();
-		}
+		text.pages.push_back(page);
+	}
 
-		pos.y += font.ascent;
+	text.dirty = false;
+	++text.revision;
+}
+
+void DrawRetainedText(bgfx::ViewId view_id, RetainedText &text, bgfx::ProgramHandle program, const char *page_uniform, uint8_t page_stage, const Mat4 &mtx,
+	const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, RenderState state, uint32_t depth) {
+	if (!text.font.cache)
+		return;
+
+	auto &cache = *text.font.cache;
+
+	// rebuild if the content changed or if one of its glyphs was evicted from the atlas
+	if (text.dirty || !UseRetainedTextGlyphs(cache, text))
+		BuildRetainedText(text);
+
+	if (text.pages.empty())
+		return;
+
+	const auto u_page = bgfx::createUniform(page_uniform, bgfx::UniformType::Sampler);
+	const auto bgfx_mtx = to_bgfx(mtx);
+
+	for (const auto &page : text.pages) {
+		bgfx::setTransform(bgfx_mtx.data());
+
+		bgfx::setTexture(page_stage, u_page, cache.pages[page.page]);
+
+		SetUniforms(values, textures);
+
+		bgfx::setVertexBuffer(0, page.vtx);
+		bgfx::setIndexBuffer(page.idx, 0, page.idx_count);
+
+		bgfx::setState(state.state, state.rgba);
+
+		bgfx::submit(view_id, program, depth);
 	}
+
+	bgfx::destroy(u_page);
 }
 
-void DrawText(bgfx::ViewId view_id, const Font &font, const char *text, bgfx::ProgramHandle program, const char *page_uniform, uint8_t page_stage, const Mat4 &mtx,
-	Vec3 pos, DrawTextHAlign halign, DrawTextVAlign valign, const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures,
-	RenderState state, uint32_t depth) {
-	DrawText(view_id, font, text, program, page_uniform, page_stage, &mtx, 1, pos, halign, valign, values, textures, state, depth);
+void DestroyRetainedText(RetainedText &text) {
+	DestroyRetainedTextBuffers(text);
+	text.glyphs.clear();
+	text.dirty = true;
 }
 
 //
@@ -2,18 +2,23 @@
 
 #pragma once
 
+#include "foundation/color.h"
 #include "foundation/rect.h"
 #include "foundation/utf8.h"
 #include "foundation/vector2.h"
 
 #include "engine/render_pipeline.h"
 
-#include <map>
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace hg {
 
-/// Font object for realtime rendering.
+struct FontCache;
+
+/// Font object for realtime rendering, glyphs are rasterized to the atlas pages on first use.
+/// The atlas pages, glyphs and kerning live in the font cache shared by all copies of a font, use GetFontPages, GetFontGlyph and GetKerning to access them.
 struct Font {
 	struct PackedChar {
 		iRect box;
@@ -26,15 +31,37 @@ struct Font {
 		PackedChar pc;
 	};
 
-	std::vector<bgfx::TextureHandle> pages;
-	std::map<utf32_cp, Glyph> glyphs;
-	std::map<utf32_cp, std::map<utf32_cp, float>> kerning;
+	std::shared_ptr<FontCache> cache; // font data, glyph atlas and kerning cache
 	uint16_t resolution;
 	float ascent, scale;
 };
 
-Font LoadFontFromFile(const char *path, float size = 16.f, uint16_t resolution = 1024, int padding = 1, const char *glyphs = nullptr);
-Font LoadFontFromAssets(const char *name, float size = 16.f, uint16_t resolution = 1024, int padding = 1, const char *glyphs = nullptr);
+/// Load a font, glyphs are rasterized to atlas pages of `resolution` x `resolution` pixels when first drawn and glyphs in the `glyphs` string on load.
+/// Once `max_page_count` pages are full the least recently used glyphs are evicted from the atlas.
+Font LoadFontFromFile(
+	const char *path, float size = 16.f, uint16_t resolution = 1024, int padding = 1, const char *glyphs = nullptr, uint16_t max_page_count = 4);
+Font LoadFontFromAssets(
+	const char *name, float size = 16.f, uint16_t resolution = 1024, int padding = 1, const char *glyphs = nullptr, uint16_t max_page_count = 4);
+
+/// Start a new frame in the font atlas, glyphs drawn during previous frames can be evicted from then on.
+/// Call this function once per frame after `bgfx::frame`, glyphs are never evicted from an atlas which is not updated.
+void UpdateFontAtlas(const Font &font);
+
+/// Return the atlas page textures of a font, pages are created as glyphs are rasterized.
+std::vector<bgfx::TextureHandle> GetFontPages(const Font &font);
+/// Get the atlas glyph of a codepoint, rasterizing it if needed. The glyph stays at this atlas location until the next call to UpdateFontAtlas.
+/// Returns false if the font has no glyph for this codepoint or if the atlas is full.
+bool GetFontGlyph(const Font &font, utf32_cp cp, Font::Glyph &glyph);
+
+struct FontAtlasStats {
+	size_t page_count, cell_count; // atlas pages and glyph cells available in those pages
+	size_t glyph_count; // glyphs currently in the atlas
+	size_t rasterized_count, evicted_count; // since the font was loaded
+	size_t dropped_count; // glyphs not drawn because all atlas cells were in use during the frame, since the font was loaded
+	float occupancy; // ratio of the atlas cells in use
+};
+
+FontAtlasStats GetFontAtlasStats(const Font &font);
 
 //
 enum DrawTextHAlign { DTHA_Left, DTHA_Center, DTHA_Right };
@@ -49,6 +76,74 @@ void DrawText(bgfx::ViewId view_id, const Font &font, const char *text, bgfx::Pr
 	Vec3 pos = {}, DrawTextHAlign halign = DTHA_Left, DrawTextVAlign valign = DTVA_Top, const std::vector<UniformSetValue> &values = {},
 	const std::vector<UniformSetTexture> &textures = {}, RenderState state = {}, uint32_t depth = 0);
 
+/// Vertex of a text quad, text is drawn using the Position, TexCoord0 and Color0 attributes.
+struct TextVertex {
+	float pos[3];
+	float uv[2];
+	uint32_t color; // ABGR
+};
+
+/// Accumulate strings drawn using the same font with their own transformation and color, a batch is drawn using a single draw call per atlas page.
+/// Text added to a batch must be drawn during the same frame.
+struct TextBatch {
+	Font font;
+	std::vector<std::vector<TextVertex>> pages; // vertices per atlas page
+};
+
+void AddTextToBatch(TextBatch &batch, const Font &font, const char *text, const Mat4 &mtx, Vec3 pos = {}, const Color &color = Color::White,
+	DrawTextHAlign halign = DTHA_Left, DrawTextVAlign valign = DTVA_Top);
+void DrawTextBatch(bgfx::ViewId view_id, const TextBatch &batch, bgfx::ProgramHandle program, const char *page_uniform, uint8_t page_stage,
+	const std::vector<UniformSetValue> &values = {}, const std::vector<UniformSetTexture> &textures = {}, RenderState state = {}, uint32_t depth = 0);
+/// Remove all text from a batch, call once the batch has been drawn.
+void ClearTextBatch(TextBatch &batch);
+
+/// Text whose vertices are kept in static buffers, they are only rebuilt when the text changes, when one of its glyphs is evicted from the font atlas or
+/// when a glyph that could not be drawn because the atlas was full makes it to the atlas.
+/// A retained text owns its GPU buffers, they are destroyed with it if the renderer is still up. It can be moved but not copied.
+struct RetainedText {
+	RetainedText() = default;
+	~RetainedText();
+
+	RetainedText(const RetainedText &) = delete;
+	RetainedText &operator=(const RetainedText &) = delete;
+
+	RetainedText(RetainedText &&other) noexcept;
+	RetainedText &operator=(RetainedText &&other) noexcept;
+
+	struct Glyph {
+		utf32_cp cp;
+		uint32_t cell; // atlas cell the vertices were built for, 0xffffffff if the glyph could not be drawn
+	};
+
+	struct Page {
+		uint16_t page;
+		bgfx::VertexBufferHandle vtx;
+		bgfx::IndexBufferHandle idx;
+		uint32_t idx_count;
+	};
+
+	Font font;
+	std::string text;
+	Vec3 pos{};
+	uint32_t color{0xffffffff}; // ABGR
+	DrawTextHAlign halign{DTHA_Left};
+	DrawTextVAlign valign{DTVA_Top};
+
+	std::vector<Glyph> glyphs;
+	std::vector<Page> pages;
+
+	bool dirty{true};
+	uint32_t revision{0}; // incremented each time the vertices are rebuilt
+};
+
+/// Set the content of a retained text, its vertices are only rebuilt if something changed.
+void SetRetainedText(RetainedText &text, const Font &font, const char *str, Vec3 pos = {}, const Color &color = Color::White, DrawTextHAlign halign = DTHA_Left,
+	DrawTextVAlign valign = DTVA_Top);
+void DrawRetainedText(bgfx::ViewId view_id, RetainedText &text, bgfx::ProgramHandle program, const char *page_uniform, uint8_t page_stage, const Mat4 &mtx,
+	const std::vector<UniformSetValue> &values = {}, const std::vector<UniformSetTexture> &textures = {}, RenderState state = {}, uint32_t depth = 0);
+/// Destroy the GPU buffers of a retained text ahead of its destruction, it is rebuilt when drawn again.
+void DestroyRetainedText(RetainedText &text);
+
 //
 float GetKerning(const Font &font, uint32_t cp0, uint32_t cp1);
 
@@ -10,8 +10,10 @@
 #include "foundation/file_rw_interface.h"
 #include "foundation/format.h"
 #include "foundation/math.h"
+#include "foundation/matrix3.h"
 #include "foundation/path_tools.h"
 #include "foundation/projection.h"
+#include "foundation/xxhash.h"
 
 #include <bgfx/bgfx.h>
 #include <math.h>
@@ -214,14 +216,70 @@ static Mat4 ComputeCropMatrix() {
 static const Vec4 frustum_corners[8] = {{-1.f, 1.f, 0.f, 1.f}, {1.f, 1.f, 0.f, 1.f}, {1.f, -1.f, 0.f, 1.f}, {-1.f, -1.f, 0.f, 1.f}, {-1.f, 1.f, 1.f, 1.f},
 	{1.f, 1.f, 1.f, 1.f}, {1.f, -1.f, 1.f, 1.f}, {-1.f, -1.f, 1.f, 1.f}};
 
-void GenerateLinearShadowMapForForwardPipeline(bgfx::ViewId &view_id, const ViewState &view_state, const std::vector<ModelDisplayList> &display_lists,
-	const std::vector<SkinnedModelDisplayList> &skinned_display_lists, const std::vector<Mat4> &mtxs, const ForwardPipelineLights &lights,
-	const ForwardPipeline &pipeline, const PipelineResources &res, ForwardPipelineShadowPassViewId &views, ForwardPipelineShadowData &shadow_data,
-	const char *debug_name) {
-	const bgfx::Caps *caps = bgfx::getCaps();
+//
+ForwardPipelineShadowMapCacheTarget::ForwardPipelineShadowMapCacheTarget(int size_, bgfx::TextureFormat::Enum format_) : size(size_), format(format_) {
+	texture = bgfx::createTexture2D(size, size, false, 1, format, BGFX_TEXTURE_RT);
+	bgfx::setName(texture, "shadow_map_cache");
+	framebuffer = bgfx::createFrameBuffer(1, &texture);
+}
 
-	std::fill(std::begin(views), std::end(views), 65535);
-	const auto &framebuffers_end = std::end(pipeline.framebuffers);
+ForwardPipelineShadowMapCacheTarget::~ForwardPipelineShadowMapCacheTarget() {
+	if (!IsRenderUp())
+		return;
+	bgfx::destroy(framebuffer);
+	bgfx::destroy(texture);
+}
+
+/// Return the cache depth map of a shadow map pass, a new map is created and the passes rendered to it are invalidated if the cache has none yet,
+/// shares it with a copy or the requested map changed.
+static const ForwardPipelineShadowMapCacheTarget &AcquireShadowMapCacheTarget(ForwardPipelineShadowMapCache &cache,
+	std::shared_ptr<ForwardPipelineShadowMapCacheTarget> &target, int size, bgfx::TextureFormat::Enum format, int first_pass, int last_pass) {
+	if (!target || target.use_count() > 1 || target->size != size || target->format != format) {
+		target = std::make_shared<ForwardPipelineShadowMapCacheTarget>(size, format);
+		for (int i = first_pass; i <= last_pass; ++i)
+			cache.entries[i].valid = false;
+	}
+	return *target;
+}
+
+static bool IsShadowMapCacheSupported(const ForwardPipeline &pipeline) {
+	return pipeline.cached_shadow_maps && (bgfx::getCaps()->supported & BGFX_CAPS_TEXTURE_BLIT); // fall back to direct rendering if blit is unavailable
+}
+
+//
+void UpdateForwardPipelineShadowMapCache(
+	ForwardPipelineShadowMapCache &cache, const std::vector<ModelDisplayList> &static_display_lists, const std::vector<Mat4> &mtxs) {
+	struct { // hash what the depth pass draws rather than the display list itself, material pointers change when their storage grows
+		uint16_t mdl_idx, lst_idx;
+		uint32_t prg_idx, prg_variant, mat_revision;
+		uint64_t state;
+	} key; // 24B, no padding
+
+	uint64_t hash = 0;
+	for (const auto &dl : static_display_lists) {
+		key.mdl_idx = dl.mdl_idx;
+		key.lst_idx = dl.lst_idx;
+		key.prg_idx = uint32_t(dl.mat->program.ref.idx);
+		key.prg_variant = dl.mat->variant_idx;
+		key.mat_revision = dl.mat->revision;
+		key.state = dl.mat->state.state;
+
+		hash = XXH64(&key, sizeof(key), hash);
+		hash = XXH64(&mtxs[dl.mtx_idx], sizeof(Mat4), hash);
+	}
+	cache.static_hash = hash;
+}
+
+void InvalidateForwardPipelineShadowMapCache(ForwardPipelineShadowMapCache &cache) {
+	for (auto &entry : cache.entries)
+		entry.valid = false;
+}
+
+//
+void ComputeLinearShadowMapViewsForForwardPipeline(const ViewState &view_state, const ForwardPipelineLights &lights, const ForwardPipeline &pipeline,
+	ForwardPipelineShadowMapViews &views, ForwardPipelineShadowData &shadow_data, ForwardPipelineShadowMapCache *cache) {
+	for (int i = FPSP_Slot0LinearSplit0; i <= FPSP_Slot0LinearSplit3; ++i)
+		views[i].active = false;
 
 	const auto &light = lights.lights[0];
 	if (light.type == FPLT_None)
@@ -231,164 +289,425 @@ void GenerateLinearShadowMapForForwardPipeline(bgfx::ViewId &view_id, const View
 		return;
 
 	// SLOT 0: linear light
-	const auto &linear_buffer = pipeline.framebuffers.find("linear_shadow_map");
-	if (linear_buffer != framebuffers_end) {
-		const int resolution = pipeline.shadow_map_resolution;
-
-		float near, far;
-		ExtractZRangeFromProjectionMatrix(view_state.proj, near, far);
-
-		Mat4 offset = {0.5f, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f};
-
-		const Mat4 world = InverseFast(view_state.view);
-		bool inv_result;
-		const Mat44 inv_proj = Inverse(view_state.proj, inv_result);
-
-		if (inv_result) {
-			Vec3 view_dir = GetZ(world);
-			Vec3 view_orig = GetT(world);
-			Vec3 light_up = GetY(light.world);
-			Vec3 light_dir = GetZ(light.world);
-			Mat4 inv_light_base = InverseFast(light.world);
-
-			// project frustum corners back to view space.
-			Vec3 corners[8];
-			for (int i = 0; i < 8; i++) {
-				Vec4 tmp = inv_proj * frustum_corners[i];
-				corners[i] = MakeVec3(tmp) / tmp.w;
-			}
-			// adjust to shadow range
-			float scale = light.pssm_split[3] / (corners[4].z - corners[0].z);
-			for (int i = 0; i < 4; i++)
-				corners[i + 4] = (corners[i + 4] - corners[i]) * scale;
-
-			// project back to world space
-			for (int i = 0; i < 8; i++)
-				corners[i] = world * corners[i];
-
-			const bgfx::Caps *caps = bgfx::getCaps();
-
-			float c0 = near;
-			for (int i = 0; i < 4; i++) {
-				const float c1 = light.pssm_split[i];
-
-				// compute split frustum and its center
-				Vec3 s[8], center = Vec3::Zero;
-				for (int j = 0; j < 4; j++) {
-					s[j] = corners[j] + (corners[j + 4] - corners[j]) * (c0 - near) / (light.pssm_split[3] - near);
-					s[j + 4] = corners[j] + (corners[j + 4] - corners[j]) * (c1 - near) / (light.pssm_split[3] - near);
-					center += s[j] + s[j + 4];
-				}
-				center /= 8.f;
-
-				// compute split radius
-				float radius = 0.f;
-				for (const auto v : s)
-					radius = Max(radius, Dist(center, v));
-
-				// [todo] find the most distant shadow caster for this slice
-				const float backup_dist = Mtr(200.f); // 4.f * radius;
-
-				Vec3 light_position = inv_light_base * (center - backup_dist * light_dir);
-
-				// stabilization (snap to shadow map texels)
-				light_position.x -= fmod(light_position.x, 2.f * radius / (float)resolution);
-				light_position.y -= fmod(light_position.y, 2.f * radius / (float)resolution);
-
-				Mat4 light_view = light.world;
-				SetTranslation(light_view, light.world * light_position);
-				const Mat4 inv_light = InverseFast(light_view);
-				const Mat44 light_projection = ComputeOrthographicProjectionMatrix(0.f, backup_dist + radius, 2.f * radius, Vec2::One);
-				const Mat4 crop_mtx = ComputeCropMatrix();
-
-				const Mat44 light_viewproj = light_projection * inv_light;
-
-				// select which part of the shadow map we will render to
-				offset.m[0][3] = (i & 1) ? 0.5f : 0.0f;
-				offset.m[1][3] = (i & 2) ? 0.5f : 0.0f;
-				shadow_data.linear_shadow_mtx[i] = offset * crop_mtx * light_viewproj;
+	if (pipeline.framebuffers.find("linear_shadow_map") == std::end(pipeline.framebuffers))
+		return;
+
+	const int resolution = pipeline.shadow_map_resolution;
+
+	float near, far;
+	ExtractZRangeFromProjectionMatrix(view_state.proj, near, far);
+
+	Mat4 offset = {0.5f, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f};
+
+	const Mat4 world = InverseFast(view_state.view);
+	bool inv_result;
+	const Mat44 inv_proj = Inverse(view_state.proj, inv_result);
+
+	if (!inv_result)
+		return;
+
+	Vec3 light_dir = GetZ(light.world);
+	Mat4 inv_light_base = InverseFast(light.world);
+
+	const bool use_cache = cache && IsShadowMapCacheSupported(pipeline);
+
+	// project frustum corners back to view space.
+	Vec3 corners[8];
+	for (int i = 0; i < 8; i++) {
+		Vec4 tmp = inv_proj * frustum_corners[i];
+		corners[i] = MakeVec3(tmp) / tmp.w;
+	}
+	// adjust to shadow range
+	float scale = light.pssm_split[3] / (corners[4].z - corners[0].z);
+	for (int i = 0; i < 4; i++)
+		corners[i + 4] = (corners[i + 4] - corners[i]) * scale;
+
+	// project back to world space
+	for (int i = 0; i < 8; i++)
+		corners[i] = world * corners[i];
+
+	float c0 = near;
+	for (int i = 0; i < 4; i++) {
+		const float c1 = light.pssm_split[i];
+
+		// compute split frustum and its center
+		Vec3 s[8], center = Vec3::Zero;
+		for (int j = 0; j < 4; j++) {
+			s[j] = corners[j] + (corners[j + 4] - corners[j]) * (c0 - near) / (light.pssm_split[3] - near);
+			s[j + 4] = corners[j] + (corners[j + 4] - corners[j]) * (c1 - near) / (light.pssm_split[3] - near);
+			center += s[j] + s[j + 4];
+		}
+		center /= 8.f;
+
+		// compute split radius
+		float radius = 0.f;
+		for (const auto v : s)
+			radius = Max(radius, Dist(center, v));
+
+		if (use_cache) {
+			const auto &entry = cache->entries[FPSP_Slot0LinearSplit0 + i];
+
+			// reuse the cached split view as long as it covers the split frustum
+			if (entry.valid && GetRMatrix(entry.light_world) == GetRMatrix(light.world) && Dist(center, entry.center) + radius <= entry.radius) {
+				shadow_data.linear_shadow_mtx[i] = entry.shadow_mtx;
 				shadow_data.linear_shadow_slice[i] = c1;
-				const auto frustum = MakeFrustum(light_projection, light_view);
+
+				views[FPSP_Slot0LinearSplit0 + i] = entry.view;
 
 				c0 = c1;
+				continue;
+			}
 
-				if (debug_name)
-					bgfx::setViewName(view_id, format("Shadow map slot 0 (slice %1) for %2").arg(i).arg(debug_name));
+			radius *= 1.f + cache->split_margin; // leave room for the view to move
+		}
 
-				uint16_t view_x = (i & 1) * resolution;
-				uint16_t view_y = ((i >> 1) & 1) * resolution;
+		// [todo] find the most distant shadow caster for this slice
+		const float backup_dist = Mtr(200.f); // 4.f * radius;
 
-				if (caps->originBottomLeft)
-					view_y = resolution - view_y;
+		Vec3 light_position = inv_light_base * (center - backup_dist * light_dir);
 
-				bgfx::touch(view_id);
-				bgfx::setViewMode(bgfx::ViewMode::Default);
-				bgfx::setViewRect(view_id, view_x, view_y, resolution, resolution);
-				bgfx::setViewClear(view_id, BGFX_CLEAR_DEPTH, 0x0, 1.f, 0);
-				bgfx::setViewTransform(view_id, to_bgfx(inv_light).data(), to_bgfx(light_projection).data());
-				bgfx::setViewFrameBuffer(view_id, linear_buffer->second);
+		// stabilization (snap to shadow map texels)
+		light_position.x -= fmod(light_position.x, 2.f * radius / (float)resolution);
+		light_position.y -= fmod(light_position.y, 2.f * radius / (float)resolution);
 
-				std::vector<ModelDisplayList> culled_display_lists = display_lists;
-				CullModelDisplayLists(frustum, culled_display_lists, mtxs, res);
+		Mat4 light_view = light.world;
+		SetTranslation(light_view, light.world * light_position);
+		const Mat4 inv_light = InverseFast(light_view);
+		const Mat44 light_projection = ComputeOrthographicProjectionMatrix(0.f, backup_dist + radius, 2.f * radius, Vec2::One);
+		const Mat4 crop_mtx = ComputeCropMatrix();
 
-				DrawModelDisplayLists(
-					view_id, culled_display_lists, 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs, res); // config idx is 9 for FPS_DepthOnly
+		const Mat44 light_viewproj = light_projection * inv_light;
 
-				// FIXME cull skinned models!
-				DrawSkinnedModelDisplayLists(
-					view_id, skinned_display_lists, 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs, res); // config idx is 9 for FPS_DepthOnly
+		// select which part of the shadow map we will render to
+		offset.m[0][3] = (i & 1) ? 0.5f : 0.0f;
+		offset.m[1][3] = (i & 2) ? 0.5f : 0.0f;
+		shadow_data.linear_shadow_mtx[i] = offset * crop_mtx * light_viewproj;
+		shadow_data.linear_shadow_slice[i] = c1;
 
-				views[FPSP_Slot0LinearSplit0 + i] = view_id++;
-			}
+		views[FPSP_Slot0LinearSplit0 + i] = {inv_light, light_projection, MakeFrustum(light_projection, light_view), true};
+
+		if (use_cache) {
+			auto &entry = cache->entries[FPSP_Slot0LinearSplit0 + i];
+
+			entry.light_world = light.world;
+			entry.center = center;
+			entry.radius = radius;
+			entry.view = views[FPSP_Slot0LinearSplit0 + i];
+			entry.shadow_mtx = shadow_data.linear_shadow_mtx[i];
+			entry.valid = false;
 		}
+
+		c0 = c1;
 	}
 }
 
-//
-void GenerateSpotShadowMapForForwardPipeline(bgfx::ViewId &view_id, const std::vector<ModelDisplayList> &display_lists,
+void ComputeSpotShadowMapViewForForwardPipeline(const ForwardPipelineLights &lights, const ForwardPipeline &pipeline, ForwardPipelineShadowMapViews &views,
+	ForwardPipelineShadowData &shadow_data, ForwardPipelineShadowMapCache *cache) {
+	views[FPSP_Slot1Spot].active = false;
+
+	const auto &light = lights.lights[1];
+	if (light.type == FPLT_None)
+		return;
+
+	// SLOT 1: spot light
+	if (pipeline.framebuffers.find("spot_shadow_map") == std::end(pipeline.framebuffers))
+		return;
+
+	const auto view = InverseFast(light.world);
+	const auto proj = ComputePerspectiveProjectionMatrix(0.1f, 100.f, FovToZoomFactor(2.f * light.outer_angle), {1.f, 1.f});
+	const auto crop_mtx = ComputeCropMatrix();
+	shadow_data.spot_shadow_mtx = crop_mtx * (proj * view);
+
+	views[FPSP_Slot1Spot] = {view, proj, MakeFrustum(proj, light.world), true};
+
+	if (cache && IsShadowMapCacheSupported(pipeline)) {
+		auto &entry = cache->entries[FPSP_Slot1Spot];
+
+		if (entry.light_world != light.world || entry.outer_angle != light.outer_angle) {
+			entry.light_world = light.world;
+			entry.outer_angle = light.outer_angle;
+			entry.view = views[FPSP_Slot1Spot];
+			entry.shadow_mtx = shadow_data.spot_shadow_mtx;
+			entry.valid = false;
+		}
+	}
+}
+
+/// Cull display lists against all active shadow map views in a single pass.
+static void CullShadowMapDisplayLists(const ForwardPipelineShadowMapViews &shadow_views, const std::vector<ModelDisplayList> &display_lists,
+	const std::vector<SkinnedModelDisplayList> &skinned_display_lists, const std::vector<Mat4> &mtxs, const PipelineResources &res,
+	ForwardPipelineShadowPassDisplayLists &culled_display_lists, ForwardPipelineShadowPassSkinnedDisplayLists &culled_skinned_display_lists) {
+	std::vector<Frustum> frustums;
+	std::vector<std::vector<ModelDisplayList> *> culled;
+	std::vector<std::vector<SkinnedModelDisplayList> *> culled_skinned;
+
+	for (int i = 0; i < FPSP_Count; ++i)
+		if (shadow_views[i].active) {
+			frustums.push_back(shadow_views[i].frustum);
+			culled.push_back(&culled_display_lists[i]);
+			culled_skinned.push_back(&culled_skinned_display_lists[i]);
+		}
+
+	std::vector<uint32_t> visibility;
+	CullModelDisplayLists(frustums, display_lists, mtxs, res, visibility, culled);
+	CullSkinnedModelDisplayLists(frustums, skinned_display_lists, mtxs, res, visibility, culled_skinned);
+}
+
+/// Setup a view to render a linear light shadow map split to its quarter of a shadow map atlas.
+static void SetLinearShadowMapSplitView(
+	bgfx::ViewId view_id, int split, const ForwardPipelineShadowMapView &shadow_view, bgfx::FrameBufferHandle fb, int resolution, uint16_t clear_flags) {
+	const bgfx::Caps *caps = bgfx::getCaps();
+
+	uint16_t view_x = (split & 1) * resolution;
+	uint16_t view_y = ((split >> 1) & 1) * resolution;
+
+	if (caps->originBottomLeft)
+		view_y = resolution - view_y;
+
+	bgfx::touch(view_id);
+	bgfx::setViewMode(bgfx::ViewMode::Default);
+	bgfx::setViewRect(view_id, view_x, view_y, resolution, resolution);
+	bgfx::setViewClear(view_id, clear_flags, 0x0, 1.f, 0);
+	bgfx::setViewTransform(view_id, to_bgfx(shadow_view.view).data(), to_bgfx(shadow_view.proj).data());
+	bgfx::setViewFrameBuffer(view_id, fb);
+}
+
+/// Setup a view to render the spot light shadow map.
+static void SetSpotShadowMapView(
+	bgfx::ViewId view_id, const ForwardPipelineShadowMapView &shadow_view, bgfx::FrameBufferHandle fb, int resolution, uint16_t clear_flags) {
+	bgfx::touch(view_id);
+	bgfx::setViewMode(bgfx::ViewMode::Default);
+	bgfx::setViewRect(view_id, 0, 0, resolution, resolution);
+	bgfx::setViewClear(view_id, clear_flags, 0x0, 1.f, 0);
+	bgfx::setViewTransform(view_id, to_bgfx(shadow_view.view).data(), to_bgfx(shadow_view.proj).data());
+	bgfx::setViewFrameBuffer(view_id, fb);
+}
+
+void GenerateLinearShadowMapForForwardPipeline(bgfx::ViewId &view_id, const ForwardPipelineShadowMapViews &shadow_views,
+	const ForwardPipelineShadowPassDisplayLists &display_lists, const ForwardPipelineShadowPassSkinnedDisplayLists &skinned_display_lists,
+	const std::vector<Mat4> &mtxs, const ForwardPipeline &pipeline, const PipelineResources &res, ForwardPipelineShadowPassViewId &views,
+	const char *debug_name) {
+	std::fill(std::begin(views), std::end(views), 65535);
+
+	// SLOT 0: linear light
+	const auto &linear_buffer = pipeline.framebuffers.find("linear_shadow_map");
+	if (linear_buffer == std::end(pipeline.framebuffers))
+		return;
+
+	for (int i = 0; i < 4; i++) {
+		const auto &shadow_view = shadow_views[FPSP_Slot0LinearSplit0 + i];
+		if (!shadow_view.active)
+			continue;
+
+		if (debug_name)
+			bgfx::setViewName(view_id, format("Shadow map slot 0 (slice %1) for %2").arg(i).arg(debug_name));
+
+		SetLinearShadowMapSplitView(view_id, i, shadow_view, linear_buffer->second, pipeline.shadow_map_resolution, BGFX_CLEAR_DEPTH);
+
+		DrawModelDisplayLists(view_id, display_lists[FPSP_Slot0LinearSplit0 + i], 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs,
+			res); // config idx is 9 for FPS_DepthOnly
+
+		DrawSkinnedModelDisplayLists(view_id, skinned_display_lists[FPSP_Slot0LinearSplit0 + i], 9, pipeline.uniform_values, pipeline.uniform_textures,
+			mtxs, res); // config idx is 9 for FPS_DepthOnly
+
+		views[FPSP_Slot0LinearSplit0 + i] = view_id++;
+	}
+}
+
+void GenerateLinearShadowMapForForwardPipeline(bgfx::ViewId &view_id, const ForwardPipelineShadowMapViews &shadow_views,
+	const ForwardPipelineShadowPassDisplayLists &static_display_lists, const ForwardPipelineShadowPassDisplayLists &display_lists,
+	const ForwardPipelineShadowPassSkinnedDisplayLists &skinned_display_lists, const std::vector<Mat4> &mtxs, const ForwardPipeline &pipeline,
+	const PipelineResources &res, ForwardPipelineShadowMapCache &cache, ForwardPipelineShadowPassViewId &views, const char *debug_name) {
+	std::fill(std::begin(views), std::end(views), 65535);
+
+	// SLOT 0: linear light
+	const auto &linear_buffer = pipeline.framebuffers.find("linear_shadow_map");
+	if (linear_buffer == std::end(pipeline.framebuffers))
+		return;
+
+	const bool use_cache = IsShadowMapCacheSupported(pipeline);
+
+	const int resolution = pipeline.shadow_map_resolution;
+
+	const ForwardPipelineShadowMapCacheTarget *cache_target =
+		use_cache ? &AcquireShadowMapCacheTarget(cache, cache.linear_target, resolution * 2, bgfx::TextureFormat::D32, FPSP_Slot0LinearSplit0,
+						FPSP_Slot0LinearSplit3)
+				  : nullptr; // this map is an atlas of 4 splits
+
+	// refresh stale cached splits
+	if (use_cache)
+		for (int i = 0; i < 4; i++) {
+			const auto &shadow_view = shadow_views[FPSP_Slot0LinearSplit0 + i];
+			auto &entry = cache.entries[FPSP_Slot0LinearSplit0 + i];
+
+			if (!shadow_view.active || (entry.valid && entry.static_hash == cache.static_hash))
+				continue;
+
+			if (debug_name)
+				bgfx::setViewName(view_id, format("Shadow map cache slot 0 (slice %1) for %2").arg(i).arg(debug_name));
+
+			SetLinearShadowMapSplitView(view_id, i, shadow_view, cache_target->framebuffer, resolution, BGFX_CLEAR_DEPTH);
+
+			DrawModelDisplayLists(view_id, static_display_lists[FPSP_Slot0LinearSplit0 + i], 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs,
+				res); // config idx is 9 for FPS_DepthOnly
+
+			entry.static_hash = cache.static_hash;
+			entry.valid = true;
+
+			++cache.refresh_count;
+			++view_id;
+		}
+
+	bool copy_cache = use_cache;
+
+	for (int i = 0; i < 4; i++) {
+		const auto &shadow_view = shadow_views[FPSP_Slot0LinearSplit0 + i];
+		if (!shadow_view.active)
+			continue;
+
+		if (debug_name)
+			bgfx::setViewName(view_id, format("Shadow map slot 0 (slice %1) for %2").arg(i).arg(debug_name));
+
+		SetLinearShadowMapSplitView(view_id, i, shadow_view, linear_buffer->second, resolution, use_cache ? BGFX_CLEAR_NONE : BGFX_CLEAR_DEPTH);
+
+		if (copy_cache) { // blits are executed before the view draw calls, copy the whole atlas once
+			bgfx::blit(view_id, pipeline.textures.at("linear_shadow_map"), 0, 0, cache_target->texture);
+			copy_cache = false;
+		}
+
+		if (!use_cache)
+			DrawModelDisplayLists(view_id, static_display_lists[FPSP_Slot0LinearSplit0 + i], 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs,
+				res); // config idx is 9 for FPS_DepthOnly
+
+		DrawModelDisplayLists(view_id, display_lists[FPSP_Slot0LinearSplit0 + i], 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs,
+			res); // config idx is 9 for FPS_DepthOnly
+
+		DrawSkinnedModelDisplayLists(view_id, skinned_display_lists[FPSP_Slot0LinearSplit0 + i], 9, pipeline.uniform_values, pipeline.uniform_textures,
+			mtxs, res); // config idx is 9 for FPS_DepthOnly
+
+		views[FPSP_Slot0LinearSplit0 + i] = view_id++;
+	}
+}
+
+void GenerateLinearShadowMapForForwardPipeline(bgfx::ViewId &view_id, const ViewState &view_state, const std::vector<ModelDisplayList> &display_lists,
 	const std::vector<SkinnedModelDisplayList> &skinned_display_lists, const std::vector<Mat4> &mtxs, const ForwardPipelineLights &lights,
 	const ForwardPipeline &pipeline, const PipelineResources &res, ForwardPipelineShadowPassViewId &views, ForwardPipelineShadowData &shadow_data,
 	const char *debug_name) {
-	const bgfx::Caps *caps = bgfx::getCaps();
+	ForwardPipelineShadowMapViews shadow_views;
+	ComputeLinearShadowMapViewsForForwardPipeline(view_state, lights, pipeline, shadow_views, shadow_data);
+
+	ForwardPipelineShadowPassDisplayLists culled_display_lists;
+	ForwardPipelineShadowPassSkinnedDisplayLists culled_skinned_display_lists;
+	CullShadowMapDisplayLists(shadow_views, display_lists, skinned_display_lists, mtxs, res, culled_display_lists, culled_skinned_display_lists);
 
+	GenerateLinearShadowMapForForwardPipeline(
+		view_id, shadow_views, culled_display_lists, culled_skinned_display_lists, mtxs, pipeline, res, views, debug_name);
+}
+
+//
+void GenerateSpotShadowMapForForwardPipeline(bgfx::ViewId &view_id, const ForwardPipelineShadowMapViews &shadow_views,
+	const ForwardPipelineShadowPassDisplayLists &display_lists, const ForwardPipelineShadowPassSkinnedDisplayLists &skinned_display_lists,
+	const std::vector<Mat4> &mtxs, const ForwardPipeline &pipeline, const PipelineResources &res, ForwardPipelineShadowPassViewId &views,
+	const char *debug_name) {
 	std::fill(std::begin(views), std::end(views), 65535);
-	const auto &framebuffers_end = std::end(pipeline.framebuffers);
 
-	const auto &light = lights.lights[1];
-	if (light.type == FPLT_None)
+	const auto &shadow_view = shadow_views[FPSP_Slot1Spot];
+	if (!shadow_view.active)
 		return;
 
 	// SLOT 1: spot light
 	const auto &spot_buffer = pipeline.framebuffers.find("spot_shadow_map");
-	if (spot_buffer != framebuffers_end) {
-		const auto view = InverseFast(light.world);
-		const auto proj = ComputePerspectiveProjectionMatrix(0.1f, 100.f, FovToZoomFactor(2.f * light.outer_angle), {1.f, 1.f});
-		const auto frustum = MakeFrustum(proj, light.world);
-		const auto crop_mtx = ComputeCropMatrix();
-		shadow_data.spot_shadow_mtx = crop_mtx * (proj * view);
+	if (spot_buffer == std::end(pipeline.framebuffers))
+		return;
 
-		if (debug_name)
-			bgfx::setViewName(view_id, format("Shadow map slot 1 for %1").arg(debug_name));
+	if (debug_name)
+		bgfx::setViewName(view_id, format("Shadow map slot 1 for %1").arg(debug_name));
 
-		bgfx::touch(view_id);
-		bgfx::setViewMode(bgfx::ViewMode::Default);
-		bgfx::setViewRect(view_id, 0, 0, pipeline.shadow_map_resolution, pipeline.shadow_map_resolution);
-		bgfx::setViewClear(view_id, BGFX_CLEAR_DEPTH, 0x0, 1.f, 0);
-		bgfx::setViewTransform(view_id, to_bgfx(view).data(), to_bgfx(proj).data());
-		bgfx::setViewFrameBuffer(view_id, spot_buffer->second);
+	SetSpotShadowMapView(view_id, shadow_view, spot_buffer->second, pipeline.shadow_map_resolution, BGFX_CLEAR_DEPTH);
 
-		std::vector<ModelDisplayList> culled_display_lists = display_lists;
-		CullModelDisplayLists(frustum, culled_display_lists, mtxs, res);
+	DrawModelDisplayLists(
+		view_id, display_lists[FPSP_Slot1Spot], 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs, res); // config idx is 9 for FPS_DepthOnly
 
-		DrawModelDisplayLists(
-			view_id, culled_display_lists, 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs, res); // config idx is 9 for FPS_DepthOnly
+	DrawSkinnedModelDisplayLists(view_id, skinned_display_lists[FPSP_Slot1Spot], 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs,
+		res); // config idx is 9 for FPS_DepthOnly
 
-		// FIXME cull skinned models!
-		DrawSkinnedModelDisplayLists(
-			view_id, skinned_display_lists, 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs, res); // config idx is 9 for FPS_DepthOnly
+	views[FPSP_Slot1Spot] = view_id++;
+}
+
+void GenerateSpotShadowMapForForwardPipeline(bgfx::ViewId &view_id, const ForwardPipelineShadowMapViews &shadow_views,
+	const ForwardPipelineShadowPassDisplayLists &static_display_lists, const ForwardPipelineShadowPassDisplayLists &display_lists,
+	const ForwardPipelineShadowPassSkinnedDisplayLists &skinned_display_lists, const std::vector<Mat4> &mtxs, const ForwardPipeline &pipeline,
+	const PipelineResources &res, ForwardPipelineShadowMapCache &cache, ForwardPipelineShadowPassViewId &views, const char *debug_name) {
+	std::fill(std::begin(views), std::end(views), 65535);
 
-		views[FPSP_Slot1Spot] = view_id++;
+	const auto &shadow_view = shadow_views[FPSP_Slot1Spot];
+	if (!shadow_view.active)
+		return;
+
+	// SLOT 1: spot light
+	const auto &spot_buffer = pipeline.framebuffers.find("spot_shadow_map");
+	if (spot_buffer == std::end(pipeline.framebuffers))
+		return;
+
+	const bool use_cache = IsShadowMapCacheSupported(pipeline);
+
+	const ForwardPipelineShadowMapCacheTarget *cache_target =
+		use_cache ? &AcquireShadowMapCacheTarget(
+						cache, cache.spot_target, pipeline.shadow_map_resolution, pipeline.spot_shadow_map_format, FPSP_Slot1Spot, FPSP_Slot1Spot)
+				  : nullptr;
+
+	// refresh stale cached map
+	auto &entry = cache.entries[FPSP_Slot1Spot];
+
+	if (use_cache && !(entry.valid && entry.static_hash == cache.static_hash)) {
+		if (debug_name)
+			bgfx::setViewName(view_id, format("Shadow map cache slot 1 for %1").arg(debug_name));
+
+		SetSpotShadowMapView(view_id, shadow_view, cache_target->framebuffer, pipeline.shadow_map_resolution, BGFX_CLEAR_DEPTH);
+
+		DrawModelDisplayLists(view_id, static_display_lists[FPSP_Slot1Spot], 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs,
+			res); // config idx is 9 for FPS_DepthOnly
+
+		entry.static_hash = cache.static_hash;
+		entry.valid = true;
+
+		++cache.refresh_count;
+		++view_id;
 	}
+
+	if (debug_name)
+		bgfx::setViewName(view_id, format("Shadow map slot 1 for %1").arg(debug_name));
+
+	SetSpotShadowMapView(view_id, shadow_view, spot_buffer->second, pipeline.shadow_map_resolution, use_cache ? BGFX_CLEAR_NONE : BGFX_CLEAR_DEPTH);
+
+	if (use_cache) // blits are executed before the view draw calls
+		bgfx::blit(view_id, pipeline.textures.at("spot_shadow_map"), 0, 0, cache_target->texture);
+	else
+		DrawModelDisplayLists(view_id, static_display_lists[FPSP_Slot1Spot], 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs,
+			res); // config idx is 9 for FPS_DepthOnly
+
+	DrawModelDisplayLists(
+		view_id, display_lists[FPSP_Slot1Spot], 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs, res); // config idx is 9 for FPS_DepthOnly
+
+	DrawSkinnedModelDisplayLists(view_id, skinned_display_lists[FPSP_Slot1Spot], 9, pipeline.uniform_values, pipeline.uniform_textures, mtxs,
+		res); // config idx is 9 for FPS_DepthOnly
+
+	views[FPSP_Slot1Spot] = view_id++;
+}
+
+void GenerateSpotShadowMapForForwardPipeline(bgfx::ViewId &view_id, const std::vector<ModelDisplayList> &display_lists,
+	const std::vector<SkinnedModelDisplayList> &skinned_display_lists, const std::vector<Mat4> &mtxs, const ForwardPipelineLights &lights,
+	const ForwardPipeline &pipeline, const PipelineResources &res, ForwardPipelineShadowPassViewId &views, ForwardPipelineShadowData &shadow_data,
+	const char *debug_name) {
+	ForwardPipelineShadowMapViews shadow_views;
+	ComputeSpotShadowMapViewForForwardPipeline(lights, pipeline, shadow_views, shadow_data);
+
+	ForwardPipelineShadowPassDisplayLists culled_display_lists;
+	ForwardPipelineShadowPassSkinnedDisplayLists culled_skinned_display_lists;
+	CullShadowMapDisplayLists(shadow_views, display_lists, skinned_display_lists, mtxs, res, culled_display_lists, culled_skinned_display_lists);
+
+	GenerateSpotShadowMapForForwardPipeline(
+		view_id, shadow_views, culled_display_lists, culled_skinned_display_lists, mtxs, pipeline, res, views, debug_name);
 }
 
 // Forward pipeline configurations
@@ -418,15 +737,20 @@ static const PipelineInfo forward_pipeline_info = {
 const PipelineInfo &GetForwardPipelineInfo() { return forward_pipeline_info; }
 
 //
-ForwardPipeline CreateForwardPipeline(int shadow_map_resolution, bool spot_16bit_shadow_map) {
+ForwardPipeline CreateForwardPipeline(int shadow_map_resolution, bool spot_16bit_shadow_map, bool cache_static_shadow_maps) {
 	ForwardPipeline pipeline;
 
 	pipeline.shadow_map_resolution = shadow_map_resolution;
+	pipeline.cached_shadow_maps = cache_static_shadow_maps && (bgfx::getCaps()->supported & BGFX_CAPS_TEXTURE_BLIT);
+
+	pipeline.spot_shadow_map_format = spot_16bit_shadow_map ? bgfx::TextureFormat::D16 : bgfx::TextureFormat::D32;
+	const uint64_t shadow_map_flags = BGFX_TEXTURE_RT | BGFX_SAMPLER_COMPARE_LEQUAL | (pipeline.cached_shadow_maps ? BGFX_TEXTURE_BLIT_DST : 0);
+
 	pipeline.textures = {
 		{"linear_shadow_map", bgfx::createTexture2D(pipeline.shadow_map_resolution * 2, pipeline.shadow_map_resolution * 2, false, 1, bgfx::TextureFormat::D32,
-								  BGFX_TEXTURE_RT | BGFX_SAMPLER_COMPARE_LEQUAL)}, // this map is an atlas of 4 splits
-		{"spot_shadow_map", bgfx::createTexture2D(pipeline.shadow_map_resolution, pipeline.shadow_map_resolution, false, 1,
-								spot_16bit_shadow_map ? bgfx::TextureFormat::D16 : bgfx::TextureFormat::D32, BGFX_TEXTURE_RT | BGFX_SAMPLER_COMPARE_LEQUAL)},
+								  shadow_map_flags)}, // this map is an atlas of 4 splits
+		{"spot_shadow_map",
+			bgfx::createTexture2D(pipeline.shadow_map_resolution, pipeline.shadow_map_resolution, false, 1, pipeline.spot_shadow_map_format, shadow_map_flags)},
 	};
 
 	for (auto &i : pipeline.textures)
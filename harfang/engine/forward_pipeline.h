@@ -4,16 +4,19 @@
 
 #include "engine/render_pipeline.h"
 #include "foundation/color.h"
+#include "foundation/frustum.h"
 #include "foundation/matrix4.h"
 #include "foundation/matrix44.h"
 #include "foundation/rect.h"
 #include "foundation/unit.h"
+#include "foundation/vector3.h"
 #include "foundation/vector4.h"
 
 #include <bgfx/bgfx.h>
 
 #include <array>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -82,11 +85,14 @@ struct ForwardPipelineFog {
 */
 struct ForwardPipeline : Pipeline {
 	int shadow_map_resolution{1024};
+	bool cached_shadow_maps{false}; // static shadow casters are rendered to cache depth maps, see ForwardPipelineShadowMapCache
+	bgfx::TextureFormat::Enum spot_shadow_map_format{bgfx::TextureFormat::D16};
 };
 
 /// Create a forward pipeline and its resources.
+/// Static shadow map caching requires the BGFX_CAPS_TEXTURE_BLIT capability and is silently disabled when it is not supported.
 /// @see DestroyForwardPipeline.
-ForwardPipeline CreateForwardPipeline(int shadow_map_resolution = 1024, bool spot_16bit_shadow_map = true);
+ForwardPipeline CreateForwardPipeline(int shadow_map_resolution = 1024, bool spot_16bit_shadow_map = true, bool cache_static_shadow_maps = false);
 /// Destroy a forward pipeline object.
 inline void DestroyForwardPipeline(ForwardPipeline &pipeline) { DestroyPipeline(pipeline); }
 
@@ -101,6 +107,114 @@ enum ForwardPipelineShadowPass { FPSP_Slot0LinearSplit0, FPSP_Slot0LinearSplit1,
 
 using ForwardPipelineShadowPassViewId = std::array<bgfx::ViewId, FPSP_Count>;
 
+/// View of a shadow map pass, only valid if the pass is active.
+struct ForwardPipelineShadowMapView {
+	Mat4 view;
+	Mat44 proj;
+	Frustum frustum;
+	bool active{false};
+};
+
+using ForwardPipelineShadowMapViews = std::array<ForwardPipelineShadowMapView, FPSP_Count>;
+/// Display lists culled against each shadow map pass view.
+using ForwardPipelineShadowPassDisplayLists = std::array<std::vector<ModelDisplayList>, FPSP_Count>;
+using ForwardPipelineShadowPassSkinnedDisplayLists = std::array<std::vector<SkinnedModelDisplayList>, FPSP_Count>;
+
+/// Static shadow casters depth cached for a shadow map pass.
+struct ForwardPipelineShadowMapCacheEntry {
+	Mat4 light_world; // light the cached depth was rendered for
+	float outer_angle{0.f}; // spot light only
+
+	Vec3 center; // linear split only, world bounding sphere covered by the cached depth
+	float radius{0.f};
+
+	ForwardPipelineShadowMapView view;
+	Mat44 shadow_mtx;
+
+	uint64_t static_hash{0}; // static shadow casters hash the cached depth was rendered with
+	bool valid{false};
+};
+
+/// Depth map a shadow map cache renders its static shadow casters to, released with the last cache referencing it.
+struct ForwardPipelineShadowMapCacheTarget {
+	ForwardPipelineShadowMapCacheTarget(int size, bgfx::TextureFormat::Enum format);
+	~ForwardPipelineShadowMapCacheTarget();
+
+	ForwardPipelineShadowMapCacheTarget(const ForwardPipelineShadowMapCacheTarget &) = delete;
+	ForwardPipelineShadowMapCacheTarget &operator=(const ForwardPipelineShadowMapCacheTarget &) = delete;
+
+	int size;
+	bgfx::TextureFormat::Enum format;
+
+	bgfx::TextureHandle texture = BGFX_INVALID_HANDLE;
+	bgfx::FrameBufferHandle framebuffer = BGFX_INVALID_HANDLE;
+};
+
+/*!
+	Static shadow map cache state.
+
+	When the pipeline is created with static shadow map caching, static shadow casters are rendered once per light and split to cache depth maps.
+	Each frame the cached depth is copied to the shadow maps and only the dynamic shadow casters are drawn over it. A cached pass is refreshed when:
+	- its light moves,
+	- a static shadow caster is added, removed or moved (see UpdateForwardPipelineShadowMapCache),
+	- for linear light splits, when the split frustum moves out of the area covered by the cached depth.
+
+	To leave room for the view to move, linear light splits are enlarged by `split_margin` times their radius when caching.
+
+	Linear light splits depend on the view they are computed for, use one cache per view. Each cache owns its depth maps, they are created on first
+	use and a copy of a cache creates its own depth maps the next time it is rendered to.
+*/
+struct ForwardPipelineShadowMapCache {
+	std::array<ForwardPipelineShadowMapCacheEntry, FPSP_Count> entries;
+	std::shared_ptr<ForwardPipelineShadowMapCacheTarget> linear_target, spot_target;
+
+	uint64_t static_hash{0};
+	float split_margin{0.1f};
+
+	uint32_t refresh_count{0}; // number of cached passes rendered
+};
+
+/// Update the static shadow casters hash of a shadow map cache, cached passes rendered with different static shadow casters are refreshed on their next use.
+void UpdateForwardPipelineShadowMapCache(
+	ForwardPipelineShadowMapCache &cache, const std::vector<ModelDisplayList> &static_display_lists, const std::vector<Mat4> &mtxs);
+/// Invalidate all cached passes of a shadow map cache.
+void InvalidateForwardPipelineShadowMapCache(ForwardPipelineShadowMapCache &cache);
+
+/// Compute the views of the linear light shadow map splits, the resulting frustums can be culled against in a single pass with the main view frustum.
+/// When a shadow map cache is specified the views of its valid cached splits are reused.
+void ComputeLinearShadowMapViewsForForwardPipeline(const ViewState &view_state, const ForwardPipelineLights &lights, const ForwardPipeline &pipeline,
+	ForwardPipelineShadowMapViews &views, ForwardPipelineShadowData &shadow_data, ForwardPipelineShadowMapCache *cache = nullptr);
+/// Compute the view of the spot light shadow map.
+void ComputeSpotShadowMapViewForForwardPipeline(const ForwardPipelineLights &lights, const ForwardPipeline &pipeline, ForwardPipelineShadowMapViews &views,
+	ForwardPipelineShadowData &shadow_data, ForwardPipelineShadowMapCache *cache = nullptr);
+
+/// Submit the linear light shadow map splits from display lists already culled against each split view.
+/// @see ComputeLinearShadowMapViewsForForwardPipeline.
+void GenerateLinearShadowMapForForwardPipeline(bgfx::ViewId &view_id, const ForwardPipelineShadowMapViews &shadow_views,
+	const ForwardPipelineShadowPassDisplayLists &display_lists, const ForwardPipelineShadowPassSkinnedDisplayLists &skinned_display_lists,
+	const std::vector<Mat4> &mtxs, const ForwardPipeline &pipeline, const PipelineResources &resources, ForwardPipelineShadowPassViewId &views,
+	const char *debug_name = nullptr);
+/// Submit the spot light shadow map from display lists already culled against its view.
+/// @see ComputeSpotShadowMapViewForForwardPipeline.
+void GenerateSpotShadowMapForForwardPipeline(bgfx::ViewId &view_id, const ForwardPipelineShadowMapViews &shadow_views,
+	const ForwardPipelineShadowPassDisplayLists &display_lists, const ForwardPipelineShadowPassSkinnedDisplayLists &skinned_display_lists,
+	const std::vector<Mat4> &mtxs, const ForwardPipeline &pipeline, const PipelineResources &resources, ForwardPipelineShadowPassViewId &views,
+	const char *debug_name = nullptr);
+
+/// Submit the linear light shadow map splits, static shadow casters are drawn to the pipeline shadow map cache when the cached split is stale.
+/// Dynamic shadow casters are drawn every frame over the cached depth.
+/// @see ComputeLinearShadowMapViewsForForwardPipeline and UpdateForwardPipelineShadowMapCache.
+void GenerateLinearShadowMapForForwardPipeline(bgfx::ViewId &view_id, const ForwardPipelineShadowMapViews &shadow_views,
+	const ForwardPipelineShadowPassDisplayLists &static_display_lists, const ForwardPipelineShadowPassDisplayLists &display_lists,
+	const ForwardPipelineShadowPassSkinnedDisplayLists &skinned_display_lists, const std::vector<Mat4> &mtxs, const ForwardPipeline &pipeline,
+	const PipelineResources &resources, ForwardPipelineShadowMapCache &cache, ForwardPipelineShadowPassViewId &views, const char *debug_name = nullptr);
+/// Submit the spot light shadow map, static shadow casters are drawn to the pipeline shadow map cache when the cached map is stale.
+/// @see ComputeSpotShadowMapViewForForwardPipeline and UpdateForwardPipelineShadowMapCache.
+void GenerateSpotShadowMapForForwardPipeline(bgfx::ViewId &view_id, const ForwardPipelineShadowMapViews &shadow_views,
+	const ForwardPipelineShadowPassDisplayLists &static_display_lists, const ForwardPipelineShadowPassDisplayLists &display_lists,
+	const ForwardPipelineShadowPassSkinnedDisplayLists &skinned_display_lists, const std::vector<Mat4> &mtxs, const ForwardPipeline &pipeline,
+	const PipelineResources &resources, ForwardPipelineShadowMapCache &cache, ForwardPipelineShadowPassViewId &views, const char *debug_name = nullptr);
+
 void GenerateLinearShadowMapForForwardPipeline(bgfx::ViewId &view_id, const ViewState &view_state, const std::vector<ModelDisplayList> &display_lists,
 	const std::vector<SkinnedModelDisplayList> &skinned_display_lists, const std::vector<Mat4> &mtxs, const ForwardPipelineLights &lights,
 	const ForwardPipeline &pipeline, const PipelineResources &resources, ForwardPipelineShadowPassViewId &views, ForwardPipelineShadowData &shadow_data,
@@ -10,6 +10,7 @@
 #include "foundation/math.h"
 #include "foundation/pack_float.h"
 #include "foundation/time.h"
+#include "foundation/worker_pool.h"
 
 #include "mikktspace.h"
 
@@ -42,148 +43,180 @@ std::vector<uint32_t> ComputePolygonIndex(const Geometry &geo) {
 	return out;
 }
 
-std::vector<VertexToPolygon> ComputeVertexToPolygon(const Geometry &geo) {
-	std::vector<VertexToPolygon> vtx_to_pol(geo.vtx.size());
+VertexPolygonAdjacency ComputeVertexPolygonAdjacency(const Geometry &geo) {
+	VertexPolygonAdjacency adj;
+	adj.offset.resize(geo.vtx.size() + 1, 0);
+
+	for (auto v : geo.binding)
+		++adj.offset[v + 1];
+	for (size_t i = 1; i < adj.offset.size(); ++i)
+		adj.offset[i] += adj.offset[i - 1];
+
+	adj.pol_index.resize(adj.offset.back());
+	adj.vtx_index.resize(adj.offset.back());
+
+	std::vector<uint32_t> cursor(std::begin(adj.offset), std::end(adj.offset) - 1);
 
 	size_t tt = 0;
-	for (auto &p : geo.pol) {
-		for (auto j = 0; j < p.vtx_count; ++j)
-			++vtx_to_pol[geo.binding[tt + j]].pol_count;
-		tt += p.vtx_count;
+	for (size_t i = 0; i < geo.pol.size(); ++i) {
+		for (uint8_t j = 0; j < geo.pol[i].vtx_count; ++j) {
+			const auto k = cursor[geo.binding[tt + j]]++;
+			adj.pol_index[k] = uint32_t(i);
+			adj.vtx_index[k] = j;
+		}
+		tt += geo.pol[i].vtx_count;
 	}
 
-	for (auto j = 0; j < geo.vtx.size(); ++j) {
-		vtx_to_pol[j].pol_index.resize(vtx_to_pol[j].pol_count);
-		vtx_to_pol[j].vtx_index.resize(vtx_to_pol[j].pol_count);
-		vtx_to_pol[j].pol_count = 0;
+	return adj;
+}
+
+// previous and next vertex of a polygon vertex, a single entry for polygons with less than 3 vertices
+static inline int GetPolygonVertexNeighbours(int vtx_index, int vtx_count, uint32_t neighbours[2]) {
+	neighbours[0] = uint32_t((vtx_index + vtx_count - 1) % vtx_count);
+	neighbours[1] = uint32_t((vtx_index + 1) % vtx_count);
+	return neighbours[0] != neighbours[1] ? 2 : 1;
+}
+
+VertexVertexAdjacency ComputeVertexVertexAdjacency(const Geometry &geo, const VertexPolygonAdjacency &vtx_to_pol) {
+	const auto vtx_count = vtx_to_pol.offset.size() - 1;
+
+	VertexVertexAdjacency adj;
+	adj.offset.resize(vtx_count + 1, 0);
+
+	uint32_t neighbours[2];
+
+	for (size_t v = 0; v < vtx_count; ++v) {
+		uint32_t count = 0;
+		for (auto k = vtx_to_pol.offset[v]; k < vtx_to_pol.offset[v + 1]; ++k)
+			count += GetPolygonVertexNeighbours(vtx_to_pol.vtx_index[k], geo.pol[vtx_to_pol.pol_index[k]].vtx_count, neighbours);
+		adj.offset[v + 1] = adj.offset[v] + count;
 	}
 
-	tt = 0;
-	for (auto i = 0; i < geo.pol.size(); ++i) {
-		for (auto j = 0; j < geo.pol[i].vtx_count; ++j) {
-			const auto v = geo.binding[tt + j];
-			vtx_to_pol[v].pol_index[vtx_to_pol[v].pol_count] = numeric_cast<uint32_t>(i);
-			vtx_to_pol[v].vtx_index[vtx_to_pol[v].pol_count] = j;
-			++vtx_to_pol[v].pol_count;
+	adj.vtx.resize(adj.offset.back());
+
+	parallel_for(vtx_count, 4096, [&](size_t begin, size_t end) {
+		uint32_t neighbours[2];
+
+		for (size_t v = begin; v < end; ++v) {
+			auto o = adj.offset[v];
+
+			for (auto k = vtx_to_pol.offset[v]; k < vtx_to_pol.offset[v + 1]; ++k) {
+				const auto pol_index = vtx_to_pol.pol_index[k];
+				const auto count = GetPolygonVertexNeighbours(vtx_to_pol.vtx_index[k], geo.pol[pol_index].vtx_count, neighbours);
+
+				for (int n = 0; n < count; ++n)
+					adj.vtx[o++] = {pol_index, neighbours[n]};
+			}
 		}
-		tt += geo.pol[i].vtx_count;
+	});
+
+	return adj;
+}
+
+static VertexPolygonAdjacency ToVertexPolygonAdjacency(const std::vector<VertexToPolygon> &vtx_to_pol) {
+	VertexPolygonAdjacency adj;
+	adj.offset.reserve(vtx_to_pol.size() + 1);
+	adj.offset.push_back(0);
+
+	for (const auto &v : vtx_to_pol)
+		adj.offset.push_back(adj.offset.back() + v.pol_count);
+
+	adj.pol_index.reserve(adj.offset.back());
+	adj.vtx_index.reserve(adj.offset.back());
+
+	for (const auto &v : vtx_to_pol) {
+		adj.pol_index.insert(std::end(adj.pol_index), std::begin(v.pol_index), std::begin(v.pol_index) + v.pol_count);
+		adj.vtx_index.insert(std::end(adj.vtx_index), std::begin(v.vtx_index), std::begin(v.vtx_index) + v.pol_count);
 	}
 
-	return vtx_to_pol;
+	return adj;
 }
 
-std::vector<VertexToVertex> ComputeVertexToVertex(const Geometry &geo, const std::vector<VertexToPolygon> &vtx_to_pol) {
-	std::vector<VertexToVertex> vtx_to_vtx(geo.vtx.size());
-
-	static const int __VertexToVertexTempListSize = 1024;
-	std::array<VertexToVertex::PolygonVertex, __VertexToVertexTempListSize> tmp_vtx_to_vtx;
-
-	for (auto pass = 0; pass < 2; ++pass)
-		for (auto v = 0; v < geo.vtx.size(); ++v) {
-			vtx_to_vtx[v].vtx_count = 0;
-
-			size_t vtx_vtx_count = 0, tt = 0;
-			for (auto p = 0; p < vtx_to_pol[v].pol_count; ++p) {
-				const uint32_t pol_index = vtx_to_pol[v].pol_index[p];
-
-				const auto &pol = geo.pol[pol_index];
-
-				int ci = 0;
-				for (; ci < pol.vtx_count; ++ci)
-					if (geo.binding[tt + ci] == v)
-						break;
-
-				for (auto _c = ci - 1; _c <= ci + 1; _c += 2) {
-					int vtx_index = _c;
-					if (vtx_index < 0)
-						vtx_index += pol.vtx_count;
-					if (vtx_index >= pol.vtx_count)
-						vtx_index -= pol.vtx_count;
-
-					// invalidate already registered candidate
-					bool insert = true;
-					for (auto nl = 0; nl < vtx_vtx_count; ++nl)
-						if (tmp_vtx_to_vtx[nl].pol_index == pol_index && tmp_vtx_to_vtx[nl].vtx_index == uint32_t(vtx_index)) {
-							insert = false;
-							break;
-						}
+//
+std::vector<VertexToPolygon> ComputeVertexToPolygon(const Geometry &geo) {
+	const auto adj = ComputeVertexPolygonAdjacency(geo);
 
-					if (insert) {
-						if (vtx_vtx_count == __VertexToVertexTempListSize) {
-							warn("Temporary list exceeded, vertex to vertex LUT corrupted");
-							vtx_vtx_count = __VertexToVertexTempListSize - 1;
-						}
+	std::vector<VertexToPolygon> vtx_to_pol(geo.vtx.size());
 
-						tmp_vtx_to_vtx[vtx_vtx_count].pol_index = pol_index;
-						tmp_vtx_to_vtx[vtx_vtx_count].vtx_index = vtx_index;
+	for (size_t v = 0; v < vtx_to_pol.size(); ++v) {
+		const auto begin = adj.offset[v], end = adj.offset[v + 1];
 
-						if (pass == 1) {
-							vtx_to_vtx[v].vtx[vtx_vtx_count].pol_index = pol_index;
-							vtx_to_vtx[v].vtx[vtx_vtx_count].vtx_index = vtx_index;
-						}
+		vtx_to_pol[v].pol_count = numeric_cast<uint16_t>(end - begin);
+		vtx_to_pol[v].pol_index.assign(std::begin(adj.pol_index) + begin, std::begin(adj.pol_index) + end);
+		vtx_to_pol[v].vtx_index.assign(std::begin(adj.vtx_index) + begin, std::begin(adj.vtx_index) + end);
+	}
 
-						++vtx_vtx_count;
-					}
-				}
+	return vtx_to_pol;
+}
 
-				tt += pol.vtx_count;
-			}
+std::vector<VertexToVertex> ComputeVertexToVertex(const Geometry &geo, const std::vector<VertexToPolygon> &vtx_to_pol) {
+	const auto adj = ComputeVertexVertexAdjacency(geo, ToVertexPolygonAdjacency(vtx_to_pol));
 
-			// allocate vertex container for this vertex
-			if (pass == 0)
-				vtx_to_vtx[v].vtx.reserve(vtx_vtx_count);
-		}
+	std::vector<VertexToVertex> vtx_to_vtx(vtx_to_pol.size());
+
+	for (size_t v = 0; v < vtx_to_vtx.size(); ++v) {
+		const auto begin = adj.offset[v], end = adj.offset[v + 1];
+
+		vtx_to_vtx[v].vtx_count = numeric_cast<uint16_t>(end - begin);
+		vtx_to_vtx[v].vtx.assign(std::begin(adj.vtx) + begin, std::begin(adj.vtx) + end);
+	}
 
 	return vtx_to_vtx;
 }
 
-std::vector<Vec3> ComputePolygonNormal(const Geometry &geo) {
+static std::vector<Vec3> ComputePolygonNormal(const Geometry &geo, const std::vector<uint32_t> &pol_index) {
 	std::vector<Vec3> out(geo.pol.size());
 
-	size_t tt = 0;
-	for (auto c = 0; c < geo.pol.size(); ++c) {
-		const auto &pol = geo.pol[c];
+	parallel_for(geo.pol.size(), 4096, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			const auto &pol = geo.pol[c];
+			const auto tt = pol_index[c];
 
-		if (pol.vtx_count > 2) {
-			const auto va = geo.vtx[geo.binding[tt + 2]] - geo.vtx[geo.binding[tt + 0]], vb = geo.vtx[geo.binding[tt + 1]] - geo.vtx[geo.binding[tt + 0]];
-			out[c] = Normalize(Cross(vb, va));
-		} else {
-			out[c] = {0, 0, 0};
+			if (pol.vtx_count > 2) {
+				const auto va = geo.vtx[geo.binding[tt + 2]] - geo.vtx[geo.binding[tt + 0]], vb = geo.vtx[geo.binding[tt + 1]] - geo.vtx[geo.binding[tt + 0]];
+				out[c] = Normalize(Cross(vb, va));
+			} else {
+				out[c] = {0, 0, 0};
+			}
 		}
-
-		tt += pol.vtx_count;
-	}
+	});
 
 	return out;
 }
 
+std::vector<Vec3> ComputePolygonNormal(const Geometry &geo) { return ComputePolygonNormal(geo, ComputePolygonIndex(geo)); }
+
 std::vector<Vec3> ComputeVertexNormal(const Geometry &geo, const std::vector<VertexToPolygon> &vtx_to_pol, float msa) {
-	const auto pol_normal = ComputePolygonNormal(geo);
+	return ComputeVertexNormal(geo, ToVertexPolygonAdjacency(vtx_to_pol), msa);
+}
+
+std::vector<Vec3> ComputeVertexNormal(const Geometry &geo, const VertexPolygonAdjacency &vtx_to_pol, float msa) {
+	const auto pol_index = ComputePolygonIndex(geo);
+	const auto pol_normal = ComputePolygonNormal(geo, pol_index);
 
 	std::vector<Vec3> out(geo.binding.size());
 
 	msa = Cos(msa);
 
-	size_t tt = 0;
-	for (auto cp = 0, ttp = 0; cp < geo.pol.size(); ++cp) {
-		const auto &pol = geo.pol[cp];
+	parallel_for(geo.pol.size(), 4096, [&](size_t begin, size_t end) {
+		for (size_t cp = begin; cp < end; ++cp) {
+			const auto tt = pol_index[cp];
 
-		for (auto cv = 0; cv < pol.vtx_count; ++cv) {
-			const auto gv = geo.binding[tt + cv];
+			for (auto cv = 0; cv < geo.pol[cp].vtx_count; ++cv) {
+				const auto gv = geo.binding[tt + cv];
 
-			auto normal = pol_normal[cp];
-			for (auto cg = 0; cg < vtx_to_pol[gv].pol_count; ++cg) {
-				const auto cc = vtx_to_pol[gv].pol_index[cg];
+				auto normal = pol_normal[cp];
+				for (auto k = vtx_to_pol.offset[gv]; k < vtx_to_pol.offset[gv + 1]; ++k) {
+					const auto cc = vtx_to_pol.pol_index[k];
 
-				if (cc != cp)
-					if (Dot(pol_normal[cp], pol_normal[cc]) >= msa)
-						normal += pol_normal[cc];
+					if (cc != cp)
+						if (Dot(pol_normal[cp], pol_normal[cc]) >= msa)
+							normal += pol_normal[cc];
+				}
+				out[tt + cv] = Normalize(normal);
 			}
-			out[ttp++] = Normalize(normal);
 		}
-
-		tt += pol.vtx_count;
-	}
+	});
 
 	return out;
 }
@@ -267,6 +300,77 @@ std::vector<Geometry::TangentFrame> ComputeVertexTangent(const Geometry &geo, co
 	return out;
 }
 
+std::vector<Geometry::TangentFrame> ComputeVertexTangent(
+	const Geometry &geo, const std::vector<Vec3> &vtx_normal, const VertexPolygonAdjacency &vtx_to_pol, uint32_t uv_index, float msa) {
+	std::vector<Geometry::TangentFrame> out(geo.binding.size());
+
+	if (uv_index >= geo.uv.size() || geo.uv[uv_index].size() < geo.binding.size())
+		return out;
+
+	const auto &uv = geo.uv[uv_index];
+
+	const auto pol_index = ComputePolygonIndex(geo);
+	const auto pol_normal = ComputePolygonNormal(geo, pol_index);
+
+	// tangent frame of each polygon from its first triangle
+	std::vector<Geometry::TangentFrame> pol_tangent(geo.pol.size());
+
+	parallel_for(geo.pol.size(), 4096, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			const auto tt = pol_index[c];
+
+			if (geo.pol[c].vtx_count < 3) {
+				pol_tangent[c] = {};
+				continue;
+			}
+
+			const auto e1 = geo.vtx[geo.binding[tt + 1]] - geo.vtx[geo.binding[tt]], e2 = geo.vtx[geo.binding[tt + 2]] - geo.vtx[geo.binding[tt]];
+			const auto d1 = uv[tt + 1] - uv[tt], d2 = uv[tt + 2] - uv[tt];
+
+			const float det = d1.x * d2.y - d2.x * d1.y;
+			if (Abs(det) < 0.000001f) {
+				pol_tangent[c] = {};
+				continue;
+			}
+
+			const float k = 1.f / det;
+			pol_tangent[c] = {(e1 * d2.y - e2 * d1.y) * k, (e2 * d1.x - e1 * d2.x) * k};
+		}
+	});
+
+	msa = Cos(msa);
+
+	parallel_for(geo.pol.size(), 4096, [&](size_t begin, size_t end) {
+		for (size_t cp = begin; cp < end; ++cp) {
+			const auto tt = pol_index[cp];
+
+			for (auto cv = 0; cv < geo.pol[cp].vtx_count; ++cv) {
+				const auto i = tt + cv, gv = geo.binding[i];
+
+				// accumulate the frames of the polygons sharing this vertex and its UV
+				auto frame = pol_tangent[cp];
+				for (auto k = vtx_to_pol.offset[gv]; k < vtx_to_pol.offset[gv + 1]; ++k) {
+					const auto cc = vtx_to_pol.pol_index[k];
+
+					if (cc != cp && Dot(pol_normal[cp], pol_normal[cc]) >= msa && uv[pol_index[cc] + vtx_to_pol.vtx_index[k]] == uv[i]) {
+						frame.T += pol_tangent[cc].T;
+						frame.B += pol_tangent[cc].B;
+					}
+				}
+
+				// orthogonalize against the vertex normal
+				const auto &N = vtx_normal[i];
+				const auto T = Normalize(frame.T - N * Dot(N, frame.T));
+				const float sign = Dot(Cross(N, T), frame.B) < 0.f ? -1.f : 1.f;
+
+				out[i] = {T, Cross(N, T) * sign};
+			}
+		}
+	});
+
+	return out;
+}
+
 //
 void ReverseTangentFrame(Geometry &geo, bool T, bool B) {
 	if (T)
@@ -280,29 +384,45 @@ void ReverseTangentFrame(Geometry &geo, bool T, bool B) {
 
 //
 void SmoothVertexColor(Geometry &geo, const std::vector<uint32_t> &pol_index, const std::vector<VertexToVertex> &vtx_to_vtx) {
+	VertexVertexAdjacency adj;
+	adj.offset.reserve(vtx_to_vtx.size() + 1);
+	adj.offset.push_back(0);
+
+	for (const auto &v : vtx_to_vtx) {
+		adj.vtx.insert(std::end(adj.vtx), std::begin(v.vtx), std::begin(v.vtx) + v.vtx_count);
+		adj.offset.push_back(uint32_t(adj.vtx.size()));
+	}
+
+	SmoothVertexColor(geo, pol_index, adj);
+}
+
+void SmoothVertexColor(Geometry &geo, const std::vector<uint32_t> &pol_index, const VertexVertexAdjacency &vtx_to_vtx) {
 	std::vector<Color> out(geo.color.size());
 
-	size_t tt = 0;
-	for (auto np = 0; np < geo.pol.size(); ++np) {
-		const auto &pol = geo.pol[np];
+	parallel_for(geo.pol.size(), 4096, [&](size_t begin, size_t end) {
+		for (size_t np = begin; np < end; ++np) {
+			const auto &pol = geo.pol[np];
+			const auto tt = pol_index[np];
+
+			for (auto nv = 0; nv < pol.vtx_count; ++nv) {
+				const size_t imv = geo.binding[tt + nv], iv = tt + nv;
 
-		for (auto nv = 0; nv < pol.vtx_count; ++nv) {
-			const size_t imv = geo.binding[tt + nv], iv = tt + nv;
+				out[iv] = geo.color[iv] * 4.f;
 
-			out[iv] = geo.color[iv] * 4.f;
+				float nrgb = 4.f;
+				for (auto k = vtx_to_vtx.offset[imv]; k < vtx_to_vtx.offset[imv + 1]; ++k) {
+					const auto &vv = vtx_to_vtx.vtx[k];
 
-			float nrgb = 4.f;
-			for (auto nvv = 0; nvv < vtx_to_vtx[imv].vtx_count; ++nvv)
-				if (geo.pol[vtx_to_vtx[imv].vtx[nvv].pol_index].material == geo.pol[np].material) {
-					out[iv] += geo.color[pol_index[vtx_to_vtx[imv].vtx[nvv].pol_index] + vtx_to_vtx[imv].vtx[nvv].vtx_index];
-					nrgb += 1.f;
+					if (geo.pol[vv.pol_index].material == pol.material) {
+						out[iv] += geo.color[pol_index[vv.pol_index] + vv.vtx_index];
+						nrgb += 1.f;
+					}
 				}
 
-			out[iv] /= float(nrgb);
+				out[iv] /= float(nrgb);
+			}
 		}
-
-		tt += pol.vtx_count;
-	}
+	});
 
 	geo.color = std::move(out);
 }
@@ -84,12 +84,46 @@ struct VertexToVertex {
 
 std::vector<VertexToVertex> ComputeVertexToVertex(const Geometry &geo, const std::vector<VertexToPolygon> &vtx_to_polygon);
 
+/*!
+	Vertex to polygon adjacency in compressed sparse row form.
+	The polygons using vertex i are stored in the [offset[i]; offset[i + 1][ range of pol_index/vtx_index.
+*/
+struct VertexPolygonAdjacency {
+	std::vector<uint32_t> offset; // vertex count + 1 entries
+	std::vector<uint32_t> pol_index; // polygon index in the geometry
+	std::vector<uint8_t> vtx_index; // vertex index in the polygon
+};
+
+VertexPolygonAdjacency ComputeVertexPolygonAdjacency(const Geometry &geo);
+
+/*!
+	Vertex to vertex adjacency in compressed sparse row form.
+	The polygon vertices connected by an edge to vertex i are stored in the [offset[i]; offset[i + 1][ range of vtx.
+*/
+struct VertexVertexAdjacency {
+	std::vector<uint32_t> offset; // vertex count + 1 entries
+	std::vector<VertexToVertex::PolygonVertex> vtx;
+};
+
+VertexVertexAdjacency ComputeVertexVertexAdjacency(const Geometry &geo, const VertexPolygonAdjacency &vtx_to_pol);
+
 //
 std::vector<Vec3> ComputePolygonNormal(const Geometry &geo);
 
 std::vector<Vec3> ComputeVertexNormal(const Geometry &geo, const std::vector<VertexToPolygon> &vtx_to_pol, float max_smoothing_angle = Deg(60.f));
+/// Compute per-polygon-vertex normals in parallel on the worker pool.
+std::vector<Vec3> ComputeVertexNormal(const Geometry &geo, const VertexPolygonAdjacency &vtx_to_pol, float max_smoothing_angle = Deg(60.f));
+
+/// Compute per-polygon-vertex tangent frames using MikkTSpace.
 std::vector<Geometry::TangentFrame> ComputeVertexTangent(
 	const Geometry &geo, const std::vector<Vec3> &vtx_normal, uint32_t uv_index = 0, float max_smoothing_angle = Deg(60.f));
+/*!
+	Compute per-polygon-vertex tangent frames in parallel on the worker pool.
+	Polygon tangents are averaged across polygons sharing a vertex with the same UV and within the smoothing angle.
+	Much faster than the MikkTSpace version on large geometries but does not produce the exact same frames.
+*/
+std::vector<Geometry::TangentFrame> ComputeVertexTangent(const Geometry &geo, const std::vector<Vec3> &vtx_normal, const VertexPolygonAdjacency &vtx_to_pol,
+	uint32_t uv_index = 0, float max_smoothing_angle = Deg(60.f));
 
 void ReverseTangentFrame(Geometry &geo, bool T, bool B);
 
@@ -98,6 +132,7 @@ bool Validate(const Geometry &geo);
 
 //
 void SmoothVertexColor(Geometry &geo, const std::vector<uint32_t> &pol_index, const std::vector<VertexToVertex> &vtx_to_vtx);
+void SmoothVertexColor(Geometry &geo, const std::vector<uint32_t> &pol_index, const VertexVertexAdjacency &vtx_to_vtx);
 
 //
 Model GeometryToModel(const Geometry &geo, ModelOptimisationLevel optimisation_level = MOL_None);
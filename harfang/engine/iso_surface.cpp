@@ -3,7 +3,12 @@
 #include "engine/iso_surface.h"
 #include "engine/model_builder.h"
 #include "foundation/math.h"
+#include "foundation/profiler.h"
+#include "foundation/worker_pool.h"
+
+#include <algorithm>
 #include <numeric>
+#include <unordered_map>
 
 namespace hg {
 
@@ -151,173 +156,281 @@ static int tri_table[256][16] = {{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
 	{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}};
 
 /*
-	Linearly interpolate the position where an iso surface cuts
-	an edge between two vertices, each with their own scalar value
+	Cell edges as the offset of their origin corner in the cell and their axis (0: x, 1: y, 2: z).
+	Each edge is shared by up to four cells, storing the vertex of an edge at its origin corner allows cells to reuse it.
 */
-static inline Vec3 VertexInterp(float isolevel, const Vec3 &p1, const Vec3 &p2, float valp1, float valp2) {
-	const float k = valp2 - valp1;
-	const float mu = k ? (isolevel - valp1) / k : 0.f;
-	return p1 + (p2 - p1) * mu;
-}
+static const int edge_origin[12][4] = {
+	{0, 0, 0, 2}, {0, 0, 1, 0}, {1, 0, 0, 2}, {0, 0, 0, 0}, {0, 1, 0, 2}, {0, 1, 1, 0}, {1, 1, 0, 2}, {0, 1, 0, 0}, {0, 0, 0, 1}, {0, 0, 1, 1}, {1, 0, 1, 1}, {1, 0, 0, 1}};
+
+static const uint32_t no_edge_vtx = 0xffffffff;
 
 /*
-	Sample the iso-field
+	Polygonize a block of cells, vertices are shared between the cells of the block.
 */
-static inline float SampleIsoSurface(const IsoSurface &surface, int width, int height, int depth, float x, float y, float z) {
-	const int h_offset = width * depth;
+static void PolygonizeIsoSurfaceChunk(IsoSurfaceChunk &chunk, const IsoSurface &surface, int width, int height, int depth, int x0, int y0, int z0, int nx,
+	int ny, int nz, float isolevel, const Vec3 &scale, std::vector<uint32_t> &edge_vtx) {
+	chunk.vtx.clear();
+	chunk.nrm.clear();
+	chunk.idx.clear();
+	chunk.border.clear();
 
-	const int ix = int(x), iy = int(y), iz = int(z);
-	const float *p0 = surface.data() + h_offset * iy + width * iz + ix; // origin
+	const int f_width = width + 2, f_height = height + 2, f_depth = depth + 2;
+	const int h_offset = f_width * f_depth;
 
-	const float fx = x - ix, fy = y - iy, fz = z - iz;
+	const float *val = surface.data();
 
-	const float v0_x = Lerp(p0[0], p0[1], fx);
-	const float v0_y = Lerp(p0[width + 0], p0[width + 1], fx);
-	const float v0 = Lerp(v0_x, v0_y, fz); // bottom bilinear
+	// edge vertex cache, one entry per axis for each corner of the block
+	const int c_width = nx + 1, c_depth = nz + 1;
+	edge_vtx.assign(size_t(c_width) * (ny + 1) * c_depth * 3, no_edge_vtx);
 
-	const float v1_x = Lerp(p0[h_offset + 0], p0[h_offset + 1], fx);
-	const float v1_y = Lerp(p0[h_offset + width + 0], p0[h_offset + width + 1], fx);
-	const float v1 = Lerp(v1_x, v1_y, fz); // top bilinear
+	const auto Value = [&](int x, int y, int z) { return val[y * h_offset + z * f_width + x]; };
 
-	return Lerp(v0, v1, fy);
-}
+	// central difference, pointing away from the higher values
+	const auto Gradient = [&](int x, int y, int z) {
+		return Vec3(Value(Max(x - 1, 0), y, z) - Value(Min(x + 1, f_width - 1), y, z), Value(x, Max(y - 1, 0), z) - Value(x, Min(y + 1, f_height - 1), z),
+			Value(x, y, Max(z - 1, 0)) - Value(x, y, Min(z + 1, f_depth - 1)));
+	};
 
-//
-bool IsoSurfaceToModel(ModelBuilder &builder, const IsoSurface &surface, int width, int height, int depth, uint16_t material, float isolevel, float scale_x,
-	float scale_y, float scale_z) {
-	// validate surface size
-	if (width < 3 || height < 3 || depth < 3)
-		return false;
+	const auto GetEdgeVertex = [&](int lx, int ly, int lz, int axis) {
+		auto &vtx_idx = edge_vtx[((size_t(ly) * c_depth + lz) * c_width + lx) * 3 + axis];
 
-	// validate surface data source
-	if (surface.size() < (width + 2) * (height + 2) * (depth + 2))
-		return false;
+		if (vtx_idx == no_edge_vtx) {
+			const int x = x0 + lx, y = y0 + ly, z = z0 + lz;
+			const int dx = axis == 0, dy = axis == 1, dz = axis == 2;
 
-	// setup unit cube
-	Vec3 cube[8] = {Vec3(0, 0, 0), Vec3(0, 0, scale_z), Vec3(scale_x, 0, scale_z), Vec3(scale_x, 0, 0), Vec3(0, scale_y, 0), Vec3(0, scale_y, scale_z),
-		Vec3(scale_x, scale_y, scale_z), Vec3(scale_x, scale_y, 0)};
+			const float v_a = Value(x, y, z), v_b = Value(x + dx, y + dy, z + dz);
+			const float k = v_b - v_a;
+			const float mu = k ? (isolevel - v_a) / k : 0.f;
 
-	// convert cells
-	Vec3 dt_xz(-scale_x * width, 0.f, scale_z);
-	Vec3 dt_zy(0.f, scale_y, -scale_z * depth);
+			const Vec3 n_a = Gradient(x, y, z), n_b = Gradient(x + dx, y + dy, z + dz);
 
-	const int f_width = width + 2, f_height = height + 2, f_depth = depth + 2;
-	const int h_offset = f_width * f_depth;
+			vtx_idx = uint32_t(chunk.vtx.size());
+			chunk.vtx.push_back({(float(x) + float(dx) * mu) * scale.x, (float(y) + float(dy) * mu) * scale.y, (float(z) + float(dz) * mu) * scale.z});
+			chunk.nrm.push_back(Normalize(n_a + (n_b - n_a) * mu));
+
+			// the neighbouring chunk computes the same vertex for an edge on the face they share
+			const bool on_border = (lx == 0 && x0 > 0) || (lx == nx && x0 + nx < width) || (ly == 0 && y0 > 0) || (ly == ny && y0 + ny < height) ||
+								   (lz == 0 && z0 > 0) || (lz == nz && z0 + nz < depth);
+			if (on_border)
+				chunk.border.push_back({vtx_idx, ((uint64_t(y) * (depth + 1) + z) * (width + 1) + x) * 3 + axis});
+		}
+
+		return vtx_idx;
+	};
 
-	int i = 0;
-	for (int h = 0; h < height; ++h) {
-		for (int d = 0; d < depth; ++d) {
-			for (int w = 0; w < width; ++w) {
-				// fetch cell values
-				const float *val = surface.data();
-
-				const float cell_val[8] = {
-					val[i + w],
-					val[i + w + f_width],
-					val[i + w + f_width + 1],
-					val[i + w + 1],
-					val[i + w + h_offset],
-					val[i + w + f_width + h_offset],
-					val[i + w + f_width + 1 + h_offset],
-					val[i + w + 1 + h_offset],
-				};
+	for (int ly = 0; ly < ny; ++ly)
+		for (int lz = 0; lz < nz; ++lz) {
+			int i = (y0 + ly) * h_offset + (z0 + lz) * f_width + x0;
 
+			for (int lx = 0; lx < nx; ++lx, ++i) {
 				/*
 					determine the index into the edge table which
 					tells us which vertices are inside of the surface
 				*/
 				int cubeindex = 0;
-				if (cell_val[0] < isolevel)
+				if (val[i] < isolevel)
 					cubeindex |= 1;
-				if (cell_val[1] < isolevel)
+				if (val[i + f_width] < isolevel)
 					cubeindex |= 2;
-				if (cell_val[2] < isolevel)
+				if (val[i + f_width + 1] < isolevel)
 					cubeindex |= 4;
-				if (cell_val[3] < isolevel)
+				if (val[i + 1] < isolevel)
 					cubeindex |= 8;
-				if (cell_val[4] < isolevel)
+				if (val[i + h_offset] < isolevel)
 					cubeindex |= 16;
-				if (cell_val[5] < isolevel)
+				if (val[i + f_width + h_offset] < isolevel)
 					cubeindex |= 32;
-				if (cell_val[6] < isolevel)
+				if (val[i + f_width + 1 + h_offset] < isolevel)
 					cubeindex |= 64;
-				if (cell_val[7] < isolevel)
+				if (val[i + 1 + h_offset] < isolevel)
 					cubeindex |= 128;
 
-				if (edge_table[cubeindex]) { // cube is intersecting the surface
-					Vec3 vertlist[12];
-
-					if (edge_table[cubeindex] & 1)
-						vertlist[0] = VertexInterp(isolevel, cube[0], cube[1], cell_val[0], cell_val[1]);
-					if (edge_table[cubeindex] & 2)
-						vertlist[1] = VertexInterp(isolevel, cube[1], cube[2], cell_val[1], cell_val[2]);
-					if (edge_table[cubeindex] & 4)
-						vertlist[2] = VertexInterp(isolevel, cube[2], cube[3], cell_val[2], cell_val[3]);
-					if (edge_table[cubeindex] & 8)
-						vertlist[3] = VertexInterp(isolevel, cube[3], cube[0], cell_val[3], cell_val[0]);
-					if (edge_table[cubeindex] & 16)
-						vertlist[4] = VertexInterp(isolevel, cube[4], cube[5], cell_val[4], cell_val[5]);
-					if (edge_table[cubeindex] & 32)
-						vertlist[5] = VertexInterp(isolevel, cube[5], cube[6], cell_val[5], cell_val[6]);
-					if (edge_table[cubeindex] & 64)
-						vertlist[6] = VertexInterp(isolevel, cube[6], cube[7], cell_val[6], cell_val[7]);
-					if (edge_table[cubeindex] & 128)
-						vertlist[7] = VertexInterp(isolevel, cube[7], cube[4], cell_val[7], cell_val[4]);
-					if (edge_table[cubeindex] & 256)
-						vertlist[8] = VertexInterp(isolevel, cube[0], cube[4], cell_val[0], cell_val[4]);
-					if (edge_table[cubeindex] & 512)
-						vertlist[9] = VertexInterp(isolevel, cube[1], cube[5], cell_val[1], cell_val[5]);
-					if (edge_table[cubeindex] & 1024)
-						vertlist[10] = VertexInterp(isolevel, cube[2], cube[6], cell_val[2], cell_val[6]);
-					if (edge_table[cubeindex] & 2048)
-						vertlist[11] = VertexInterp(isolevel, cube[3], cube[7], cell_val[3], cell_val[7]);
-
-					// create the triangle
-					const auto &tt = tri_table[cubeindex];
-
-					for (int i = 0; tt[i] != -1; i += 3) {
-						uint16_t i_vtx[3];
-
-						for (int j = 0; j < 3; ++j) {
-							const Vec3 pos = vertlist[tt[i + j]];
-
-							static const float K = 1.f;
-#if 1
-							const Vec3 nrm = {
-								SampleIsoSurface(surface, f_width, f_height, f_depth, pos.x, pos.y, pos.z) -
-									SampleIsoSurface(surface, f_width, f_height, f_depth, pos.x + K, pos.y, pos.z),
-								SampleIsoSurface(surface, f_width, f_height, f_depth, pos.x, pos.y, pos.z) -
-									SampleIsoSurface(surface, f_width, f_height, f_depth, pos.x, pos.y + K, pos.z),
-								SampleIsoSurface(surface, f_width, f_height, f_depth, pos.x, pos.y, pos.z) -
-									SampleIsoSurface(surface, f_width, f_height, f_depth, pos.x, pos.y, pos.z + K),
-							};
-#else
-							const Vec3 nrm = {};
-#endif
-							i_vtx[j] = builder.AddVertex({pos, Normalize(nrm)});
-						}
-
-						builder.AddTriangle(i_vtx[2], i_vtx[1], i_vtx[0]);
+				const int edges = edge_table[cubeindex];
+				if (!edges)
+					continue; // cube is not intersecting the surface
+
+				uint32_t vertlist[12];
+				for (int e = 0; e < 12; ++e)
+					if (edges & (1 << e)) {
+						const auto &o = edge_origin[e];
+						vertlist[e] = GetEdgeVertex(lx + o[0], ly + o[1], lz + o[2], o[3]);
 					}
-				}
 
-				for (int n = 0; n < 8; ++n)
-					cube[n].x += scale_x;
+				// create the triangles
+				const auto &tt = tri_table[cubeindex];
+
+				for (int t = 0; tt[t] != -1; t += 3) {
+					chunk.idx.push_back(vertlist[tt[t + 2]]);
+					chunk.idx.push_back(vertlist[tt[t + 1]]);
+					chunk.idx.push_back(vertlist[tt[t]]);
+				}
 			}
-			i += f_width;
+		}
+}
+
+static bool IsValidIsoSurface(const IsoSurface &surface, int width, int height, int depth) {
+	// validate surface size
+	if (width < 3 || height < 3 || depth < 3)
+		return false;
+
+	// validate surface data source
+	return surface.size() >= size_t(width + 2) * (height + 2) * (depth + 2);
+}
+
+//
+IsoSurfaceChunks NewIsoSurfaceChunks(int width, int height, int depth, int chunk_size) {
+	IsoSurfaceChunks chunks;
+
+	chunks.width = width;
+	chunks.height = height;
+	chunks.depth = depth;
+	chunks.chunk_size = Max(chunk_size, 1);
+
+	chunks.count_x = (width + chunks.chunk_size - 1) / chunks.chunk_size;
+	chunks.count_y = (height + chunks.chunk_size - 1) / chunks.chunk_size;
+	chunks.count_z = (depth + chunks.chunk_size - 1) / chunks.chunk_size;
+
+	chunks.chunks.resize(size_t(chunks.count_x) * chunks.count_y * chunks.count_z);
+	return chunks;
+}
 
-			for (int n = 0; n < 8; ++n)
-				cube[n] += dt_xz;
+void MarkIsoSurfaceChunksDirty(IsoSurfaceChunks &chunks) {
+	for (auto &chunk : chunks.chunks)
+		chunk.dirty = true;
+}
+
+void MarkIsoSurfaceChunksDirty(IsoSurfaceChunks &chunks, int x0, int y0, int z0, int x1, int y1, int z1) {
+	if (chunks.chunks.empty())
+		return;
+
+	/*
+		a value is a corner of the cells on both of its sides and the central difference normals of
+		the vertices on the edges around it also read it, widen the range of affected cells by two.
+	*/
+	const auto GetChunkRange = [&](int v0, int v1, int cell_count, int chunk_count, int &c0, int &c1) {
+		c0 = Clamp(v0 - 2, 0, cell_count - 1) / chunks.chunk_size;
+		c1 = Min(Clamp(v1 + 1, 0, cell_count - 1) / chunks.chunk_size, chunk_count - 1);
+		return v1 >= v0 && v1 + 1 >= 0 && v0 - 2 < cell_count;
+	};
+
+	int cx0, cx1, cy0, cy1, cz0, cz1;
+	if (!GetChunkRange(x0, x1, chunks.width, chunks.count_x, cx0, cx1) || !GetChunkRange(y0, y1, chunks.height, chunks.count_y, cy0, cy1) ||
+		!GetChunkRange(z0, z1, chunks.depth, chunks.count_z, cz0, cz1))
+		return;
+
+	for (int cy = cy0; cy <= cy1; ++cy)
+		for (int cz = cz0; cz <= cz1; ++cz)
+			for (int cx = cx0; cx <= cx1; ++cx)
+				chunks.chunks[(size_t(cy) * chunks.count_z + cz) * chunks.count_x + cx].dirty = true;
+}
+
+void MarkIsoSurfaceSphereDirty(IsoSurfaceChunks &chunks, float ox, float oy, float oz, float radius) {
+	const int f_width = chunks.width + 2, f_height = chunks.height + 2, f_depth = chunks.depth + 2;
+
+	const int x0 = Max(0, int(ox - radius)), x1 = Min(f_width - 1, int(ox + radius));
+	const int y0 = Max(0, int(oy - radius)), y1 = Min(f_height - 1, int(oy + radius));
+	const int z0 = Max(0, int(oz - radius)), z1 = Min(f_depth - 1, int(oz + radius));
+
+	if (x1 < x0 || y1 < y0 || z1 < z0)
+		return;
+
+	/*
+		IsoSurfaceSphere writes the rows of values r = z * f_height + y, which the polygonizer reads as model space y = r / f_depth and z = r % f_depth.
+		The rows written for a z slice are contiguous, mark the model space rows they cover.
+	*/
+	for (int z = z0; z <= z1; ++z) {
+		const int r0 = z * f_height + y0, r1 = z * f_height + y1;
+		const bool single_row = r0 / f_depth == r1 / f_depth;
+		MarkIsoSurfaceChunksDirty(chunks, x0, r0 / f_depth, single_row ? r0 % f_depth : 0, x1, r1 / f_depth, single_row ? r1 % f_depth : f_depth - 1);
+	}
+}
+
+size_t GetDirtyIsoSurfaceChunkCount(const IsoSurfaceChunks &chunks) {
+	return std::count_if(std::begin(chunks.chunks), std::end(chunks.chunks), [](const IsoSurfaceChunk &chunk) { return chunk.dirty; });
+}
+
+size_t UpdateIsoSurfaceChunks(IsoSurfaceChunks &chunks, const IsoSurface &surface, float isolevel, float scale_x, float scale_y, float scale_z) {
+	ProfilerPerfSection section("UpdateIsoSurfaceChunks");
+
+	if (!IsValidIsoSurface(surface, chunks.width, chunks.height, chunks.depth))
+		return 0;
+
+	std::vector<uint32_t> dirty;
+	dirty.reserve(chunks.chunks.size());
+
+	for (size_t i = 0; i < chunks.chunks.size(); ++i)
+		if (chunks.chunks[i].dirty)
+			dirty.push_back(uint32_t(i));
+
+	const Vec3 scale(scale_x, scale_y, scale_z);
+	const int cs = chunks.chunk_size;
+
+	parallel_for(dirty.size(), 1, [&](size_t begin, size_t end) {
+		std::vector<uint32_t> edge_vtx;
+
+		for (size_t j = begin; j < end; ++j) {
+			const int i = int(dirty[j]);
+			const int cx = i % chunks.count_x, cz = (i / chunks.count_x) % chunks.count_z, cy = i / (chunks.count_x * chunks.count_z);
+			const int x0 = cx * cs, y0 = cy * cs, z0 = cz * cs;
+
+			auto &chunk = chunks.chunks[i];
+			PolygonizeIsoSurfaceChunk(chunk, surface, chunks.width, chunks.height, chunks.depth, x0, y0, z0, Min(cs, chunks.width - x0),
+				Min(cs, chunks.height - y0), Min(cs, chunks.depth - z0), isolevel, scale, edge_vtx);
+			chunk.dirty = false;
+		}
+	});
+
+	return dirty.size();
+}
+
+bool IsoSurfaceChunksToModel(ModelBuilder &builder, const IsoSurfaceChunks &chunks, uint16_t material) {
+	size_t vtx_count = 0, idx_count = 0;
+	for (const auto &chunk : chunks.chunks) {
+		vtx_count += chunk.vtx.size();
+		idx_count += chunk.idx.size();
+	}
+
+	builder.ReserveCurrentList(vtx_count, idx_count);
+
+	std::unordered_map<uint64_t, VtxIdxType> border_vtx; // builder index of the vertices on the faces between chunks, by surface edge
+	std::vector<VtxIdxType> vtx_idx;
+
+	for (const auto &chunk : chunks.chunks) {
+		if (chunk.idx.empty())
+			continue;
+
+		vtx_idx.assign(chunk.vtx.size(), no_edge_vtx);
+
+		for (const auto &v : chunk.border) {
+			const auto i = border_vtx.find(v.edge);
+			if (i != std::end(border_vtx))
+				vtx_idx[v.vtx] = i->second; // already added by a neighbouring chunk
 		}
-		i += f_width * 2; // finish depth
 
-		for (int n = 0; n < 8; ++n)
-			cube[n] += dt_zy;
+		for (size_t i = 0; i < chunk.vtx.size(); ++i)
+			if (vtx_idx[i] == no_edge_vtx)
+				vtx_idx[i] = builder.AddUniqueVertex({chunk.vtx[i], chunk.nrm[i]});
+
+		for (const auto &v : chunk.border)
+			border_vtx.emplace(v.edge, vtx_idx[v.vtx]);
+
+		for (size_t i = 0; i < chunk.idx.size(); i += 3)
+			builder.AddTriangle(vtx_idx[chunk.idx[i]], vtx_idx[chunk.idx[i + 1]], vtx_idx[chunk.idx[i + 2]]);
 	}
 
 	return builder.EndList(material);
 }
 
+//
+bool IsoSurfaceToModel(ModelBuilder &builder, const IsoSurface &surface, int width, int height, int depth, uint16_t material, float isolevel, float scale_x,
+	float scale_y, float scale_z) {
+	if (!IsValidIsoSurface(surface, width, height, depth))
+		return false;
+
+	auto chunks = NewIsoSurfaceChunks(width, height, depth);
+	UpdateIsoSurfaceChunks(chunks, surface, isolevel, scale_x, scale_y, scale_z);
+	return IsoSurfaceChunksToModel(builder, chunks, material);
+}
 //
 IsoSurface NewIsoSurface(int width, int height, int depth) { return IsoSurface((width + 2) * (height * 2) * (depth + 2), 0.f); }
 
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include "foundation/vector3.h"
+
 #include <cstdint>
 #include <vector>
 
@@ -27,4 +29,53 @@ struct ModelBuilder;
 bool IsoSurfaceToModel(ModelBuilder &builder, const IsoSurface &surface, int width, int height, int depth, uint16_t material = 0, float isolevel = 0.5f,
 	float scale_x = 1.f, float scale_y = 1.f, float scale_z = 1.f);
 
+/// Vertex on a face shared with a neighbouring chunk, identified by the surface edge it lies on.
+struct IsoSurfaceChunkBorderVertex {
+	uint32_t vtx;
+	uint64_t edge;
+};
+
+/// Polygonized geometry of a block of iso surface cells.
+struct IsoSurfaceChunk {
+	std::vector<Vec3> vtx, nrm;
+	std::vector<uint32_t> idx;
+	std::vector<IsoSurfaceChunkBorderVertex> border; // vertices also produced by a neighbouring chunk
+	bool dirty{true};
+};
+
+/*!
+	Iso surface split in fixed size blocks of cells, each block is polygonized on its own so that only modified blocks need to be processed again.
+
+	Chunks are addressed in model space where the y axis is the slowest varying axis of the surface data (see IsoSurfaceToModel).
+	Vertices are shared between the cells of a chunk. Vertices on a face between two chunks are produced by both chunks and merged when the chunks
+	are added to a model.
+*/
+struct IsoSurfaceChunks {
+	int width{}, height{}, depth{}; // surface dimensions in cells
+	int chunk_size{};
+	int count_x{}, count_y{}, count_z{}; // chunk grid dimensions
+
+	std::vector<IsoSurfaceChunk> chunks; // x fastest, then z, then y
+};
+
+/// Split an iso surface in chunks of chunk_size^3 cells, all chunks start dirty.
+IsoSurfaceChunks NewIsoSurfaceChunks(int width, int height, int depth, int chunk_size = 32);
+
+/// Mark all chunks as dirty.
+void MarkIsoSurfaceChunksDirty(IsoSurfaceChunks &chunks);
+/// Mark the chunks affected by a change of the surface values in the [x0;x1]x[y0;y1]x[z0;z1] model space range of values as dirty.
+void MarkIsoSurfaceChunksDirty(IsoSurfaceChunks &chunks, int x0, int y0, int z0, int x1, int y1, int z1);
+/// Mark the chunks affected by a call to IsoSurfaceSphere with the same parameters as dirty.
+void MarkIsoSurfaceSphereDirty(IsoSurfaceChunks &chunks, float x, float y, float z, float radius);
+
+/// Return the number of dirty chunks.
+size_t GetDirtyIsoSurfaceChunkCount(const IsoSurfaceChunks &chunks);
+
+/// Polygonize all dirty chunks in parallel on the worker pool, return the number of chunks polygonized.
+size_t UpdateIsoSurfaceChunks(IsoSurfaceChunks &chunks, const IsoSurface &surface, float isolevel = 0.5f, float scale_x = 1.f, float scale_y = 1.f,
+	float scale_z = 1.f);
+
+/// Add the geometry of all chunks to a model builder as a single list, vertices on the faces between chunks are added once.
+bool IsoSurfaceChunksToModel(ModelBuilder &builder, const IsoSurfaceChunks &chunks, uint16_t material = 0);
+
 } // namespace hg
@@ -88,6 +88,18 @@ VtxIdxType ModelBuilder::AddVertex(const Vertex &vtx) {
 	return VtxIdxType(idx);
 }
 
+VtxIdxType ModelBuilder::AddUniqueVertex(const Vertex &vtx) {
+	auto &list = lists.back();
+	list.vtx.push_back(vtx);
+	return VtxIdxType(list.vtx.size() - 1);
+}
+
+void ModelBuilder::ReserveCurrentList(size_t vtx_count, size_t idx_count) {
+	auto &list = lists.back();
+	list.vtx.reserve(list.vtx.size() + vtx_count);
+	list.idx.reserve(list.idx.size() + idx_count);
+}
+
 //
 void ModelBuilder::AddTriangle(VtxIdxType a, VtxIdxType b, VtxIdxType c) {
 	auto &list = lists.back();
@@ -228,11 +240,19 @@ Model ModelBuilder::MakeModel(const bgfx::VertexLayout &decl, ModelOptimisationL
 			const auto vtx_hnd = bgfx::createVertexBuffer(bgfx::copy(vtx_data.data(), uint32_t(vtx_data.size())), decl);
 
 			model.bounds.push_back(minmax);
-			model.lists.push_back({idx_hnd, vtx_hnd, bones_table});
+			model.lists.push_back(
+				{idx_hnd, vtx_hnd, bones_table, ComputeDisplayListBonesBounds(decl, vtx_data.data(), uint32_t(vtx_data.size()), bones_table.size())});
 			model.mats.push_back(mat);
+
+			if (GetModelOccluderMaxTriangleCount())
+				AppendOccluderMesh(model.occluder, decl, vtx_data.data(), uint32_t(vtx_data.size()), idx_data.data(),
+					uint32_t(idx_data.size() * sizeof(VtxIdxType)), sizeof(VtxIdxType));
 		},
 		&model, optimisation_level, verbose);
 
+	if (model.occluder.idx.size() / 3 > GetModelOccluderMaxTriangleCount())
+		model.occluder = {};
+
 	return model;
 }
 
@@ -24,6 +24,10 @@ struct ModelBuilder {
 	ModelBuilder();
 
 	VtxIdxType AddVertex(const Vertex &v);
+	/// Add a vertex without looking for an identical vertex in the current list, use when the caller already shares its vertices.
+	VtxIdxType AddUniqueVertex(const Vertex &v);
+	/// Reserve storage in the current list ahead of adding a known amount of vertices and indices.
+	void ReserveCurrentList(size_t vtx_count, size_t idx_count);
 
 	void AddTriangle(VtxIdxType a, VtxIdxType b, VtxIdxType c);
 	void AddQuad(VtxIdxType a, VtxIdxType b, VtxIdxType c, VtxIdxType d);
@@ -0,0 +1,475 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#include "engine/occlusion_culling.h"
+
+#include "foundation/math.h"
+#include "foundation/profiler.h"
+#include "foundation/projection.h"
+#include "foundation/vector4.h"
+#include "foundation/worker_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace hg {
+
+static const int occlusion_buffer_band_height = 8; // rows rasterized by a single job
+static const float occlusion_guard_band = 2.f; // polygons are clipped to twice the view extent to keep screen coordinates small
+
+OcclusionBuffer CreateOcclusionBuffer(int width, int height) {
+	OcclusionBuffer buffer;
+
+	if (width < 1 || height < 1)
+		return buffer;
+
+	while (true) {
+		buffer.levels.push_back({width, height, std::vector<float>(size_t(width) * height, std::numeric_limits<float>::max())});
+
+		if (width == 1 && height == 1)
+			break;
+
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	}
+
+	return buffer;
+}
+
+bool IsValid(const OcclusionBuffer &buffer) { return !buffer.levels.empty(); }
+
+void ClearOcclusionBuffer(OcclusionBuffer &buffer, const Mat4 &view, const Mat44 &proj) {
+	buffer.view_proj = proj * view;
+	buffer.polygon_count = 0;
+
+	for (auto &level : buffer.levels)
+		std::fill(std::begin(level.depth), std::end(level.depth), std::numeric_limits<float>::max());
+}
+
+//
+static const int occluder_polygon_max_vertex_count = 9; // a quad clipped by the near and guard band planes
+
+/// Convex screen space polygon.
+struct OccluderPolygon {
+	float x[occluder_polygon_max_vertex_count], y[occluder_polygon_max_vertex_count], z[occluder_polygon_max_vertex_count]; // pixel coordinates and depth
+	int count;
+};
+
+static inline float GetNearPlaneDistance(const Vec4 &clip, bool homogeneous_depth) { return homogeneous_depth ? clip.z + clip.w : clip.z; }
+
+/// Signed distance of a clip space vertex to the near plane or one of the guard band planes, positive inside.
+static inline float GetClipPlaneDistance(const Vec4 &clip, int plane, bool homogeneous_depth) {
+	switch (plane) {
+		case 0:
+			return GetNearPlaneDistance(clip, homogeneous_depth);
+		case 1:
+			return clip.w * occlusion_guard_band - clip.x;
+		case 2:
+			return clip.w * occlusion_guard_band + clip.x;
+		case 3:
+			return clip.w * occlusion_guard_band - clip.y;
+		default:
+			return clip.w * occlusion_guard_band + clip.y;
+	}
+}
+
+/// Clip a convex polygon of 3 or 4 vertices against the near and guard band planes then output it as a screen space polygon.
+static void ClipOccluderPolygon(
+	const Vec4 *vtx, int vtx_count, int width, int height, bool homogeneous_depth, std::vector<OccluderPolygon> &out) {
+	Vec4 poly[2][occluder_polygon_max_vertex_count];
+	int count = vtx_count, src = 0;
+
+	std::copy(vtx, vtx + vtx_count, poly[0]);
+
+	for (int plane = 0; plane < 5 && count >= 3; ++plane) {
+		const Vec4 *in = poly[src];
+		Vec4 *clipped = poly[src ^ 1];
+		int clipped_count = 0;
+
+		bool is_clipped = false;
+		for (int i = 0; i < count; ++i)
+			if (GetClipPlaneDistance(in[i], plane, homogeneous_depth) < 0.f) {
+				is_clipped = true;
+				break;
+			}
+
+		if (!is_clipped)
+			continue;
+
+		for (int i = 0; i < count; ++i) {
+			const Vec4 &p = in[i], &q = in[(i + 1) % count];
+			const float dp = GetClipPlaneDistance(p, plane, homogeneous_depth), dq = GetClipPlaneDistance(q, plane, homogeneous_depth);
+
+			if (dp >= 0.f)
+				clipped[clipped_count++] = p;
+			if ((dp >= 0.f) != (dq >= 0.f))
+				clipped[clipped_count++] = p + (q - p) * (dp / (dp - dq));
+		}
+
+		count = clipped_count;
+		src ^= 1;
+	}
+
+	if (count < 3)
+		return;
+
+	OccluderPolygon polygon;
+	polygon.count = count;
+
+	for (int i = 0; i < count; ++i) {
+		const Vec4 &v = poly[src][i];
+		const float k = 1.f / v.w;
+		polygon.x[i] = (v.x * k * 0.5f + 0.5f) * float(width);
+		polygon.y[i] = (0.5f - v.y * k * 0.5f) * float(height);
+		polygon.z[i] = v.z * k;
+	}
+
+	out.push_back(polygon);
+}
+
+/*!
+	If triangle a and the following triangle b share an edge and form a planar convex quad output its vertex indices and return true.
+	Texels are only written when fully covered by a polygon, rasterizing such quads as a whole leaves no unwritten texels along their diagonal.
+*/
+static bool GetOccluderQuad(const OccluderMesh &mesh, const uint32_t *a, const uint32_t *b, uint32_t quad[4]) {
+	for (int k = 0; k < 3; ++k) {
+		const auto &p = mesh.vtx[a[k]], &q = mesh.vtx[a[(k + 1) % 3]];
+
+		for (int j = 0; j < 3; ++j)
+			if (mesh.vtx[b[j]] == q && mesh.vtx[b[(j + 1) % 3]] == p) { // same winding
+				quad[0] = a[k];
+				quad[1] = b[(j + 2) % 3];
+				quad[2] = a[(k + 1) % 3];
+				quad[3] = a[(k + 2) % 3];
+
+				const Vec3 v[4] = {mesh.vtx[quad[0]], mesh.vtx[quad[1]], mesh.vtx[quad[2]], mesh.vtx[quad[3]]};
+
+				const auto n_a = Cross(v[2] - v[0], v[3] - v[0]), n_b = Cross(v[1] - v[0], v[2] - v[0]);
+				const auto n_a_len2 = Len2(n_a), n_b_len2 = Len2(n_b);
+				if (Dot(n_a, n_b) <= 0.f || Len2(Cross(n_a, n_b)) > 1e-10f * n_a_len2 * n_b_len2)
+					return false; // not coplanar
+
+				for (int i = 0; i < 4; ++i)
+					if (Dot(Cross(v[(i + 1) % 4] - v[i], v[(i + 2) % 4] - v[(i + 1) % 4]), n_a) <= 0.f)
+						return false; // not convex
+
+				return true;
+			}
+	}
+	return false;
+}
+
+/// Transform an occluder mesh to screen space polygons, polygons entirely outside of the view are rejected.
+static void TransformOccluderMesh(
+	const OccluderMesh &mesh, const Mat44 &mvp, int width, int height, bool homogeneous_depth, std::vector<OccluderPolygon> &out) {
+	std::vector<Vec4> clip(mesh.vtx.size());
+	for (size_t i = 0; i < mesh.vtx.size(); ++i)
+		clip[i] = mvp * Vec4(mesh.vtx[i]);
+
+	const auto outcode = [homogeneous_depth](const Vec4 &v) {
+		return (GetNearPlaneDistance(v, homogeneous_depth) < 0.f ? 1 : 0) | (v.x > v.w ? 2 : 0) | (v.x < -v.w ? 4 : 0) | (v.y > v.w ? 8 : 0) |
+			   (v.y < -v.w ? 16 : 0);
+	};
+
+	for (size_t i = 0; i + 2 < mesh.idx.size();) {
+		uint32_t quad[4];
+		const bool is_quad = i + 5 < mesh.idx.size() && GetOccluderQuad(mesh, &mesh.idx[i], &mesh.idx[i + 3], quad);
+
+		const int vtx_count = is_quad ? 4 : 3;
+		const uint32_t *idx = is_quad ? quad : &mesh.idx[i];
+
+		i += is_quad ? 6 : 3;
+
+		Vec4 vtx[4];
+		int outcodes = 0xff;
+		for (int j = 0; j < vtx_count; ++j) {
+			vtx[j] = clip[idx[j]];
+			outcodes &= outcode(vtx[j]);
+		}
+
+		if (outcodes)
+			continue; // all vertices outside the same plane
+
+		ClipOccluderPolygon(vtx, vtx_count, width, height, homogeneous_depth, out);
+	}
+}
+
+/*!
+	Rasterize a convex screen space polygon to the rows [row_begin;row_end[ keeping the nearest depth, both faces are rasterized.
+	Rasterization is conservative: only texels entirely inside the polygon are written, with the farthest depth of the polygon over the texel.
+*/
+static void RasterizeOccluderPolygon(const OccluderPolygon &poly, OcclusionBufferLevel &level, int row_begin, int row_end) {
+	const int n = poly.count;
+
+	float area = 0.f, min_x = poly.x[0], max_x = poly.x[0], min_y = poly.y[0], max_y = poly.y[0];
+	for (int i = 0; i < n; ++i) {
+		const int j = (i + 1) % n;
+		area += poly.x[i] * poly.y[j] - poly.x[j] * poly.y[i];
+
+		min_x = Min(min_x, poly.x[i]);
+		max_x = Max(max_x, poly.x[i]);
+		min_y = Min(min_y, poly.y[i]);
+		max_y = Max(max_y, poly.y[i]);
+	}
+
+	if (std::fabs(area) < 1e-6f)
+		return;
+
+	const float orientation = area > 0.f ? 1.f : -1.f; // rasterize both faces
+
+	// texels entirely inside the polygon bounding box
+	const int px0 = Max(int(std::ceil(min_x)), 0);
+	const int px1 = Min(int(std::floor(max_x)) - 1, level.width - 1);
+	const int py0 = Max(int(std::ceil(min_y)), row_begin);
+	const int py1 = Min(int(std::floor(max_y)) - 1, row_end - 1);
+
+	if (px0 > px1 || py0 > py1)
+		return;
+
+	// depth plane from the largest triangle of the polygon fan
+	int k = 1;
+	float k_area = 0.f;
+	for (int i = 1; i < n - 1; ++i) {
+		const float a = std::fabs((poly.x[i] - poly.x[0]) * (poly.y[i + 1] - poly.y[0]) - (poly.x[i + 1] - poly.x[0]) * (poly.y[i] - poly.y[0]));
+		if (a > k_area) {
+			k = i;
+			k_area = a;
+		}
+	}
+
+	const float x0 = poly.x[0], y0 = poly.y[0], z0 = poly.z[0];
+	const float x1 = poly.x[k], y1 = poly.y[k], z1 = poly.z[k];
+	const float x2 = poly.x[k + 1], y2 = poly.y[k + 1], z2 = poly.z[k + 1];
+
+	const float det = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+	const float dzdx = ((z1 - z0) * (y2 - y0) - (z2 - z0) * (y1 - y0)) / det;
+	const float dzdy = ((z2 - z0) * (x1 - x0) - (z1 - z0) * (x2 - x0)) / det;
+
+	const float z_far = 0.5f * (std::fabs(dzdx) + std::fabs(dzdy)); // farthest depth over a texel relative to its center
+
+	/*
+		Edge functions, positive on the inner side of their edge. A texel is entirely inside an edge if the edge function at its center is greater than
+		its largest decrease toward one of the texel corners.
+	*/
+	float e_dx[occluder_polygon_max_vertex_count], e_dy[occluder_polygon_max_vertex_count], e_c[occluder_polygon_max_vertex_count];
+
+	for (int i = 0; i < n; ++i) {
+		const int j = (i + 1) % n;
+		e_dx[i] = (poly.y[i] - poly.y[j]) * orientation;
+		e_dy[i] = (poly.x[j] - poly.x[i]) * orientation;
+		e_c[i] = -(e_dx[i] * poly.x[i] + e_dy[i] * poly.y[i]) - 0.5f * (std::fabs(e_dx[i]) + std::fabs(e_dy[i]));
+	}
+
+	const auto is_texel_inside = [&](int px, float sy) {
+		const float sx = float(px) + 0.5f;
+		for (int i = 0; i < n; ++i)
+			if (e_dx[i] * sx + e_dy[i] * sy + e_c[i] < 0.f)
+				return false;
+		return true;
+	};
+
+	for (int py = py0; py <= py1; ++py) {
+		const float sy = float(py) + 0.5f;
+
+		// the texels inside a convex polygon form a single span, bound it from each edge then refine its ends
+		float span_x0 = float(px0), span_x1 = float(px1);
+
+		for (int i = 0; i < n; ++i) {
+			const float e = e_dx[i] * (float(px0) + 0.5f) + e_dy[i] * sy + e_c[i]; // at the first texel of the row
+
+			if (e_dx[i] > 0.f)
+				span_x0 = Max(span_x0, float(px0) + std::ceil(-e / e_dx[i]));
+			else if (e_dx[i] < 0.f)
+				span_x1 = Min(span_x1, float(px0) + std::floor(e / -e_dx[i]));
+			else if (e < 0.f)
+				span_x1 = span_x0 - 1.f;
+		}
+
+		if (span_x0 > span_x1)
+			continue;
+
+		int x_begin = int(span_x0), x_end = int(span_x1);
+
+		while (x_begin <= x_end && !is_texel_inside(x_begin, sy))
+			++x_begin;
+		while (x_end >= x_begin && !is_texel_inside(x_end, sy))
+			--x_end;
+
+		float z = z0 + dzdx * (float(x_begin) + 0.5f - x0) + dzdy * (sy - y0) + z_far;
+
+		float *row = level.depth.data() + size_t(py) * level.width;
+
+		for (int px = x_begin; px <= x_end; ++px) {
+			row[px] = Min(row[px], z);
+			z += dzdx;
+		}
+	}
+}
+
+/// Update the hierarchical depth levels from the first level.
+static void UpdateOcclusionBufferLevels(OcclusionBuffer &buffer) {
+	for (size_t l = 1; l < buffer.levels.size(); ++l) {
+		const auto &src = buffer.levels[l - 1];
+		auto &dst = buffer.levels[l];
+
+		for (int y = 0; y < dst.height; ++y) {
+			const float *r0 = src.depth.data() + size_t(Min(y * 2, src.height - 1)) * src.width;
+			const float *r1 = src.depth.data() + size_t(Min(y * 2 + 1, src.height - 1)) * src.width;
+
+			for (int x = 0; x < dst.width; ++x) {
+				const int x0 = Min(x * 2, src.width - 1), x1 = Min(x * 2 + 1, src.width - 1);
+				dst.depth[size_t(y) * dst.width + x] = Max(Max(r0[x0], r0[x1]), Max(r1[x0], r1[x1]));
+			}
+		}
+	}
+}
+
+template <typename F> static void _RasterizeOccluders(OcclusionBuffer &buffer, size_t count, F get_occluder) {
+	ProfilerPerfSection section("RasterizeOccluders");
+
+	if (!IsValid(buffer) || count == 0)
+		return;
+
+	auto &level = buffer.levels[0];
+	const bool homogeneous_depth = GetNDCInfos().homogeneous_depth;
+
+	// transform and clip occluders
+	std::vector<std::vector<OccluderPolygon>> polygons(count);
+
+	parallel_for(count, 4, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const OccluderMesh *mesh;
+			Mat4 world;
+			if (get_occluder(i, mesh, world))
+				TransformOccluderMesh(*mesh, buffer.view_proj * world, level.width, level.height, homogeneous_depth, polygons[i]);
+		}
+	});
+
+	for (const auto &polys : polygons)
+		buffer.polygon_count += uint32_t(polys.size());
+
+	// rasterize bands of rows in parallel
+	const int band_count = (level.height + occlusion_buffer_band_height - 1) / occlusion_buffer_band_height;
+
+	parallel_for(size_t(band_count), 1, [&](size_t begin, size_t end) {
+		for (size_t band = begin; band < end; ++band) {
+			const int row_begin = int(band) * occlusion_buffer_band_height;
+			const int row_end = Min(row_begin + occlusion_buffer_band_height, level.height);
+
+			for (const auto &polys : polygons)
+				for (const auto &poly : polys)
+					RasterizeOccluderPolygon(poly, level, row_begin, row_end);
+		}
+	});
+
+	UpdateOcclusionBufferLevels(buffer);
+}
+
+void RasterizeOccluders(OcclusionBuffer &buffer, const std::vector<const OccluderMesh *> &meshes, const std::vector<Mat4> &worlds) {
+	__ASSERT__(meshes.size() == worlds.size());
+
+	_RasterizeOccluders(buffer, meshes.size(), [&](size_t i, const OccluderMesh *&mesh, Mat4 &world) {
+		mesh = meshes[i];
+		world = worlds[i];
+		return mesh != nullptr;
+	});
+}
+
+void RasterizeOccluders(OcclusionBuffer &buffer, const std::vector<ModelOccluder> &occluders, const std::vector<Mat4> &mtxs, const PipelineResources &res) {
+	_RasterizeOccluders(buffer, occluders.size(), [&](size_t i, const OccluderMesh *&mesh, Mat4 &world) {
+		mesh = &res.models.Get_unsafe_(occluders[i].mdl_idx).occluder;
+		world = mtxs[occluders[i].mtx_idx];
+		return true;
+	});
+}
+
+//
+bool IsOccluded(const OcclusionBuffer &buffer, const MinMax &bounds) {
+	if (!IsValid(buffer))
+		return false;
+
+	const bool homogeneous_depth = GetNDCInfos().homogeneous_depth;
+	const auto &level0 = buffer.levels[0];
+
+	float min_x = std::numeric_limits<float>::max(), max_x = -std::numeric_limits<float>::max();
+	float min_y = std::numeric_limits<float>::max(), max_y = -std::numeric_limits<float>::max();
+	float min_z = std::numeric_limits<float>::max();
+
+	for (int i = 0; i < 8; ++i) {
+		const Vec4 corner(i & 1 ? bounds.mx.x : bounds.mn.x, i & 2 ? bounds.mx.y : bounds.mn.y, i & 4 ? bounds.mx.z : bounds.mn.z);
+		const Vec4 clip = buffer.view_proj * corner;
+
+		if (GetNearPlaneDistance(clip, homogeneous_depth) <= 0.f)
+			return false; // bounds cross the near plane
+
+		const float k = 1.f / clip.w;
+		const float x = (clip.x * k * 0.5f + 0.5f) * float(level0.width), y = (0.5f - clip.y * k * 0.5f) * float(level0.height);
+
+		min_x = Min(min_x, x);
+		max_x = Max(max_x, x);
+		min_y = Min(min_y, y);
+		max_y = Max(max_y, y);
+		min_z = Min(min_z, clip.z * k);
+	}
+
+	// pixels covered by the screen space bounds
+	const int px0 = int(std::floor(Max(min_x, 0.f))), px1 = int(std::floor(Min(max_x, float(level0.width - 1))));
+	const int py0 = int(std::floor(Max(min_y, 0.f))), py1 = int(std::floor(Min(max_y, float(level0.height - 1))));
+
+	if (px0 > px1 || py0 > py1)
+		return false; // outside of the view, leave it to frustum culling
+
+	// select the first level where the bounds cover at most 2x2 texels
+	size_t l = 0;
+	while (l + 1 < buffer.levels.size() && ((px1 >> l) - (px0 >> l) > 1 || (py1 >> l) - (py0 >> l) > 1))
+		++l;
+
+	const auto &level = buffer.levels[l];
+
+	for (int y = py0 >> l; y <= Min(py1 >> l, level.height - 1); ++y)
+		for (int x = px0 >> l; x <= Min(px1 >> l, level.width - 1); ++x)
+			if (min_z <= level.depth[size_t(y) * level.width + x] + buffer.depth_bias)
+				return false;
+
+	return true;
+}
+
+template <typename T, typename F>
+static void _CullDisplayLists(const OcclusionBuffer &buffer, std::vector<T> &display_lists, F get_bounds) {
+	ProfilerPerfSection section("CullDisplayLists (occlusion)");
+
+	if (!IsValid(buffer) || buffer.polygon_count == 0)
+		return; // nothing to occlude
+
+	std::vector<uint8_t> occluded(display_lists.size());
+
+	parallel_for(display_lists.size(), 64, [&](size_t begin, size_t end) {
+		MinMax bounds;
+		for (size_t i = begin; i < end; ++i)
+			occluded[i] = get_bounds(display_lists[i], bounds) && IsOccluded(buffer, bounds) ? 1 : 0;
+	});
+
+	size_t j = 0;
+	for (size_t i = 0; i < display_lists.size(); ++i)
+		if (!occluded[i])
+			display_lists[j++] = display_lists[i];
+
+	display_lists.resize(j);
+}
+
+void CullModelDisplayLists(const OcclusionBuffer &buffer, std::vector<ModelDisplayList> &display_lists, const std::vector<Mat4> &mtxs, const PipelineResources &res) {
+	_CullDisplayLists(buffer, display_lists, [&](const ModelDisplayList &display_list, MinMax &bounds) {
+		const auto &model = res.models.Get_unsafe_(display_list.mdl_idx);
+		bounds = mtxs[display_list.mtx_idx] * model.bounds[display_list.lst_idx];
+		return true;
+	});
+}
+
+void CullSkinnedModelDisplayLists(
+	const OcclusionBuffer &buffer, std::vector<SkinnedModelDisplayList> &display_lists, const std::vector<Mat4> &mtxs, const PipelineResources &res) {
+	_CullDisplayLists(buffer, display_lists, [&](const SkinnedModelDisplayList &display_list, MinMax &bounds) {
+		return ComputeSkinnedModelDisplayListBounds(display_list, mtxs, res, bounds);
+	});
+}
+
+} // namespace hg
@@ -0,0 +1,57 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#pragma once
+
+#include "engine/render_pipeline.h"
+
+#include <vector>
+
+namespace hg {
+
+struct OcclusionBufferLevel {
+	int width, height;
+	std::vector<float> depth;
+};
+
+/*!
+	Low resolution depth buffer rasterized on the CPU from occluder meshes. Display lists whose bounds are entirely behind the occluders can be culled
+	before they are submitted.
+
+	Depth is the clip space z/w, the first level holds the nearest occluder depth of each pixel and each following level holds the farthest depth of the
+	2x2 texel blocks of the previous level down to a single texel.
+
+	Occluders are rasterized conservatively, a texel is only written if it is entirely covered by an occluder polygon so that a display list peeking past
+	an occluder edge is never culled. Pairs of consecutive triangles forming a planar convex quad are rasterized as a single polygon.
+	@see NF_Occluder and SetModelOccluderMaxTriangleCount.
+*/
+struct OcclusionBuffer {
+	Mat44 view_proj;
+	std::vector<OcclusionBufferLevel> levels;
+
+	float depth_bias{1e-6f}; // depth a display list must be behind the occluders by to be culled
+	uint32_t polygon_count{0}; // polygons rasterized since the buffer was last cleared
+};
+
+/// Create an occlusion buffer, its resolution should remain low as it is rasterized on the CPU.
+OcclusionBuffer CreateOcclusionBuffer(int width = 256, int height = 128);
+bool IsValid(const OcclusionBuffer &buffer);
+
+/// Clear the occlusion buffer and set the view it is rasterized from.
+void ClearOcclusionBuffer(OcclusionBuffer &buffer, const Mat4 &view, const Mat44 &proj);
+
+/*!
+	Rasterize occluder meshes to the occlusion buffer, meshes are transformed in parallel on the worker pool then each job rasterizes all polygons to its
+	own band of rows. The hierarchical depth levels are updated once all meshes are rasterized.
+*/
+void RasterizeOccluders(OcclusionBuffer &buffer, const std::vector<const OccluderMesh *> &meshes, const std::vector<Mat4> &worlds);
+void RasterizeOccluders(OcclusionBuffer &buffer, const std::vector<ModelOccluder> &occluders, const std::vector<Mat4> &mtxs, const PipelineResources &res);
+
+/// Return true if a world bounding box is entirely hidden behind the occluders rasterized to the occlusion buffer.
+bool IsOccluded(const OcclusionBuffer &buffer, const MinMax &bounds);
+
+/// Remove display lists hidden behind the occluders rasterized to the occlusion buffer, display lists are tested in parallel on the worker pool.
+void CullModelDisplayLists(const OcclusionBuffer &buffer, std::vector<ModelDisplayList> &display_lists, const std::vector<Mat4> &mtxs, const PipelineResources &res);
+void CullSkinnedModelDisplayLists(
+	const OcclusionBuffer &buffer, std::vector<SkinnedModelDisplayList> &display_lists, const std::vector<Mat4> &mtxs, const PipelineResources &res);
+
+} // namespace hg
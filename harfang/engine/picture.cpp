@@ -1,6 +1,7 @@
 // HARFANG(R) Copyright (C) 2021 Emmanuel Julien, NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
 
 #include "engine/picture.h"
+#include "engine/picture_processing.h"
 
 #include <assert.h>
 
@@ -8,6 +9,7 @@
 #include "foundation/file.h"
 #include "foundation/math.h"
 #include "foundation/profiler.h"
+#include "foundation/worker_pool.h"
 
 #include "bimg/encode.h"
 #include "bx/allocator.h"
@@ -15,7 +17,8 @@
 
 #include "stb_image.h"
 #include "stb_image_write.h"
-#include "stb_image_resize.h"
+
+#include <atomic>
 
 namespace hg {
 
@@ -144,13 +147,7 @@ void Picture::Clear() {
 
 // TODO EJ implement these
 Picture Crop(const Picture &picture, uint16_t width, uint16_t height) { return picture; }
-Picture Resize(const Picture &picture, uint16_t width, uint16_t height) {
-	Picture pic(width, height, picture.GetFormat());
-	stbir_resize_uint8(picture.GetData(), picture.GetWidth(), picture.GetHeight(), picture.GetWidth() * size_of(picture.GetFormat()), 
-		pic.GetData(), pic.GetWidth(),	pic.GetHeight(), pic.GetWidth() * size_of(pic.GetFormat()), size_of(pic.GetFormat()));
-	
-	return pic;
-}
+Picture Resize(const Picture &picture, uint16_t width, uint16_t height) { return ResizePicture(picture, width, height); }
 
 //
 Color GetPixelRGBA(const Picture &pic, uint16_t x, uint16_t y) {
@@ -309,23 +306,55 @@ static bool SaveBimg(const Picture &pic, const char *path, bool fast, bimg::Text
 			return false;
 	}
 
-	uint16_t depth = 1; // not sure what it is
-	auto input = bimg::imageAlloc(
-		&allocator, input_format, pic.GetWidth(), pic.GetHeight(), depth, 1 /*_numLayers*/, false /*_cubeMap*/, false /*_hasMips*/, pic.GetData());
+	// BC blocks are stored row after row, strips of block rows are encoded in parallel then copied back to back
+	const auto &block_info = bimg::getBlockInfo(format);
+
+	const uint16_t strip_height = uint16_t(block_info.blockHeight) * 16;
+	const size_t strip_count = (pic.GetHeight() + strip_height - 1) / strip_height;
+	const size_t block_row_size = size_t(Max<uint32_t>((pic.GetWidth() + block_info.blockWidth - 1) / block_info.blockWidth, block_info.minBlockX)) * block_info.blockSize;
+	const size_t input_stride = size_t(pic.GetWidth()) * size_of(pic.GetFormat());
+
+	auto output = bimg::imageAlloc(&allocator, format, pic.GetWidth(), pic.GetHeight(), 1, 1, false, false);
+	std::atomic<bool> encoded{true};
+
+	parallel_for(strip_count, 1, [&](size_t begin, size_t end) {
+		for (auto i = begin; i < end; ++i) {
+			const auto y = uint16_t(i * strip_height);
+			const auto height = uint16_t(Min<int>(strip_height, pic.GetHeight() - y));
+
+			auto input = bimg::imageAlloc(&allocator, input_format, pic.GetWidth(), height, 1 /*_depth*/, 1 /*_numLayers*/, false /*_cubeMap*/,
+				false /*_hasMips*/, pic.GetData() + y * input_stride);
+			auto strip = bimg::imageEncode(&allocator, format, fast ? bimg::Quality::Fastest : bimg::Quality::Highest, *input);
+			bimg::imageFree(input);
 
-	auto output = bimg::imageEncode(&allocator, format, fast ? bimg::Quality::Fastest : bimg::Quality::Highest, *input);
+			const size_t offset = size_t(y / block_info.blockHeight) * block_row_size;
 
-	bimg::imageFree(input);
+			if (strip && offset + strip->m_size <= output->m_size)
+				std::copy(reinterpret_cast<const uint8_t *>(strip->m_data), reinterpret_cast<const uint8_t *>(strip->m_data) + strip->m_size,
+					reinterpret_cast<uint8_t *>(output->m_data) + offset);
+			else
+				encoded = false;
+
+			if (strip)
+				bimg::imageFree(strip);
+		}
+	});
+
+	if (!encoded) {
+		bimg::imageFree(output);
+		return false;
+	}
 
 	bx::FileWriter writer;
 	bx::Error err;
 	if (bx::open(&writer, path, false, &err)) {
 		bimg::imageWriteDds(&writer, *output, output->m_data, output->m_size, &err);
+		bx::close(&writer);
 	}
 
 	bimg::imageFree(output);
 
-	return true;
+	return err.isOk();
 }
 
 bool SaveBC6H(const Picture &pic, const char *path, bool fast) { return SaveBimg(pic, path, fast, bimg::TextureFormat::BC6H); }
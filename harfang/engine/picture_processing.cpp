@@ -0,0 +1,359 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#include "engine/picture_processing.h"
+
+#include "foundation/math.h"
+#include "foundation/profiler.h"
+#include "foundation/worker_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace hg {
+
+// sRGB transfer tables, 8 bit to linear and linear quantized to 12 bit to 8 bit sRGB
+struct SRGBTables {
+	SRGBTables() {
+		for (int i = 0; i < 256; ++i) {
+			const float v = float(i) / 255.f;
+			to_linear[i] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+		}
+
+		for (int i = 0; i < 4096; ++i) {
+			const float v = float(i) / 4095.f;
+			const float s = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.f / 2.4f) - 0.055f;
+			to_srgb[i] = uint8_t(Clamp(s, 0.f, 1.f) * 255.f + 0.5f);
+		}
+	}
+
+	float to_linear[256];
+	uint8_t to_srgb[4096];
+};
+
+static const SRGBTables &GetSRGBTables() {
+	static const SRGBTables tables;
+	return tables;
+}
+
+//
+static uint8_t ToUint8(float v) { return uint8_t(Clamp(v, 0.f, 1.f) * 255.f + 0.5f); }
+
+/// Decode a row of pixels to floats, channel count is preserved.
+static void LoadRow(const uint8_t *row, PictureFormat format, int width, float *out, const SRGBTables *srgb) {
+	if (format == PF_RGBA32F) {
+		std::copy(reinterpret_cast<const float *>(row), reinterpret_cast<const float *>(row) + width * 4, out);
+		return;
+	}
+
+	const int channel_count = int(GetChannelCount(format));
+	const int count = width * channel_count;
+
+	if (srgb) {
+		for (int i = 0; i < count; i += channel_count) {
+			out[i + 0] = srgb->to_linear[row[i + 0]];
+			out[i + 1] = srgb->to_linear[row[i + 1]];
+			out[i + 2] = srgb->to_linear[row[i + 2]];
+			if (channel_count == 4)
+				out[i + 3] = float(row[i + 3]) * (1.f / 255.f); // alpha is linear
+		}
+	} else {
+		for (int i = 0; i < count; ++i)
+			out[i] = float(row[i]) * (1.f / 255.f);
+	}
+}
+
+/// Encode a row of floats to pixels, channel count is preserved.
+static void StoreRow(const float *in, PictureFormat format, int width, uint8_t *row, const SRGBTables *srgb) {
+	if (format == PF_RGBA32F) {
+		std::copy(in, in + width * 4, reinterpret_cast<float *>(row));
+		return;
+	}
+
+	const int channel_count = int(GetChannelCount(format));
+	const int count = width * channel_count;
+
+	if (srgb) {
+		for (int i = 0; i < count; i += channel_count) {
+			row[i + 0] = srgb->to_srgb[int(Clamp(in[i + 0], 0.f, 1.f) * 4095.f + 0.5f)];
+			row[i + 1] = srgb->to_srgb[int(Clamp(in[i + 1], 0.f, 1.f) * 4095.f + 0.5f)];
+			row[i + 2] = srgb->to_srgb[int(Clamp(in[i + 2], 0.f, 1.f) * 4095.f + 0.5f)];
+			if (channel_count == 4)
+				row[i + 3] = ToUint8(in[i + 3]);
+		}
+	} else {
+		for (int i = 0; i < count; ++i)
+			row[i] = ToUint8(in[i]);
+	}
+}
+
+//
+static float MitchellNetravali(float x, float B, float C) {
+	x = Abs(x);
+	if (x < 1.f)
+		return ((12.f - 9.f * B - 6.f * C) * x * x * x + (-18.f + 12.f * B + 6.f * C) * x * x + (6.f - 2.f * B)) / 6.f;
+	if (x < 2.f)
+		return ((-B - 6.f * C) * x * x * x + (6.f * B + 30.f * C) * x * x + (-12.f * B - 48.f * C) * x + (8.f * B + 24.f * C)) / 6.f;
+	return 0.f;
+}
+
+static float FilterSupport(PictureFilter filter) {
+	if (filter == PFT_Box)
+		return 0.5f;
+	if (filter == PFT_Triangle)
+		return 1.f;
+	return 2.f;
+}
+
+static float EvaluateFilter(PictureFilter filter, float x) {
+	switch (filter) {
+		case PFT_Box:
+			return x >= -0.5f && x < 0.5f ? 1.f : 0.f;
+		case PFT_Triangle:
+			return Max(1.f - Abs(x), 0.f);
+		case PFT_CubicBSpline:
+			return MitchellNetravali(x, 1.f, 0.f);
+		case PFT_CatmullRom:
+			return MitchellNetravali(x, 0.f, 0.5f);
+		default:
+			return MitchellNetravali(x, 1.f / 3.f, 1.f / 3.f);
+	}
+}
+
+/*
+	Source pixels and weights contributing to each output pixel along one axis.
+
+	Source indices outside the picture are clamped to its edges.
+*/
+struct FilterContributions {
+	int max_count{0};
+	std::vector<int> first, count;
+	std::vector<float> weights; // max_count weights per output pixel
+};
+
+static FilterContributions ComputeFilterContributions(int src_size, int dst_size, PictureFilter filter) {
+	const float scale = float(dst_size) / float(src_size);
+	const float filter_scale = Max(1.f / scale, 1.f); // widen the filter when minifying
+	const float support = FilterSupport(filter) * filter_scale;
+
+	FilterContributions contribs;
+	contribs.max_count = int(std::ceil(support * 2.f)) + 2;
+	contribs.first.resize(dst_size);
+	contribs.count.resize(dst_size);
+	contribs.weights.resize(size_t(dst_size) * contribs.max_count, 0.f);
+
+	for (int i = 0; i < dst_size; ++i) {
+		const float center = (float(i) + 0.5f) / scale;
+
+		const int left = int(std::floor(center - support)), right = int(std::ceil(center + support));
+		const int first = Clamp(left, 0, src_size - 1), last = Clamp(right, 0, src_size - 1);
+
+		auto *weights = &contribs.weights[size_t(i) * contribs.max_count];
+
+		float sum = 0.f;
+		for (int j = left; j <= right; ++j) {
+			const float w = EvaluateFilter(filter, (float(j) + 0.5f - center) / filter_scale);
+			weights[Clamp(j, first, last) - first] += w;
+			sum += w;
+		}
+
+		int count = last - first + 1;
+		const float k = sum != 0.f ? 1.f / sum : 0.f;
+		for (int j = 0; j < count; ++j)
+			weights[j] *= k;
+
+		// trim zero weights on both ends
+		int start = 0;
+		while (start < count - 1 && weights[start] == 0.f)
+			++start;
+		while (count > start + 1 && weights[count - 1] == 0.f)
+			--count;
+
+		if (start)
+			std::copy(weights + start, weights + count, weights);
+
+		contribs.first[i] = first + start;
+		contribs.count[i] = count - start;
+	}
+
+	return contribs;
+}
+
+/// Filter a row of pixels horizontally, the channel count is a template parameter so that the inner loop is unrolled.
+template <int C> static void FilterRow(const float *in, float *out, int dst_w, const FilterContributions &contribs) {
+	for (int x = 0; x < dst_w; ++x, out += C) {
+		const auto *w = &contribs.weights[size_t(x) * contribs.max_count];
+		const auto *p = in + size_t(contribs.first[x]) * C;
+
+		float acc[C] = {};
+		for (int k = 0; k < contribs.count[x]; ++k, p += C)
+			for (int c = 0; c < C; ++c)
+				acc[c] += p[c] * w[k];
+
+		for (int c = 0; c < C; ++c)
+			out[c] = acc[c];
+	}
+}
+
+//
+static void Resize(const Picture &src, Picture &dst, PictureFilter filter, bool srgb) {
+	const int src_w = src.GetWidth(), src_h = src.GetHeight(), dst_w = dst.GetWidth(), dst_h = dst.GetHeight();
+	const auto format = src.GetFormat();
+
+	const int channel_count = int(GetChannelCount(format));
+	const size_t src_stride = size_t(src_w) * size_of(format), dst_stride = size_t(dst_w) * size_of(format);
+
+	const auto h_contribs = ComputeFilterContributions(src_w, dst_w, filter);
+	const auto v_contribs = ComputeFilterContributions(src_h, dst_h, filter);
+
+	const auto *tables = srgb && format != PF_RGBA32F ? &GetSRGBTables() : nullptr;
+
+	// output rows are processed in bands, each band filters horizontally the source rows it needs then filters them vertically
+	const int band_height = 32;
+	const int band_count = (dst_h + band_height - 1) / band_height;
+
+	parallel_for(size_t(band_count), 1, [&](size_t begin, size_t end) {
+		std::vector<float> src_row(size_t(src_w) * channel_count), dst_row(size_t(dst_w) * channel_count), band_rows;
+
+		for (auto band = begin; band < end; ++band) {
+			const int y0 = int(band) * band_height, y1 = Min(y0 + band_height, dst_h);
+
+			int sy0 = src_h, sy1 = 0;
+			for (int y = y0; y < y1; ++y) {
+				sy0 = Min(sy0, v_contribs.first[y]);
+				sy1 = Max(sy1, v_contribs.first[y] + v_contribs.count[y]);
+			}
+
+			const size_t band_row_size = size_t(dst_w) * channel_count;
+			band_rows.resize(size_t(sy1 - sy0) * band_row_size);
+
+			// horizontal pass
+			for (int sy = sy0; sy < sy1; ++sy) {
+				LoadRow(src.GetData() + sy * src_stride, format, src_w, src_row.data(), tables);
+
+				auto *out = &band_rows[size_t(sy - sy0) * band_row_size];
+
+				if (channel_count == 4)
+					FilterRow<4>(src_row.data(), out, dst_w, h_contribs);
+				else
+					FilterRow<3>(src_row.data(), out, dst_w, h_contribs);
+			}
+
+			// vertical pass
+			for (int y = y0; y < y1; ++y) {
+				const auto *w = &v_contribs.weights[size_t(y) * v_contribs.max_count];
+
+				std::fill(std::begin(dst_row), std::end(dst_row), 0.f);
+
+				for (int k = 0; k < v_contribs.count[y]; ++k) {
+					const auto *in = &band_rows[size_t(v_contribs.first[y] + k - sy0) * band_row_size];
+					for (size_t i = 0; i < band_row_size; ++i)
+						dst_row[i] += in[i] * w[k];
+				}
+
+				StoreRow(dst_row.data(), format, dst_w, dst.GetData() + y * dst_stride, tables);
+			}
+		}
+	});
+}
+
+Picture ResizePicture(const Picture &pic, uint16_t width, uint16_t height, PictureFilter filter, bool srgb) {
+	ProfilerPerfSection section("ResizePicture");
+
+	if (!pic.GetWidth() || !pic.GetHeight() || !width || !height || pic.GetFormat() == PF_None)
+		return {};
+
+	Picture out(width, height, pic.GetFormat());
+	Resize(pic, out, filter, srgb);
+	return out;
+}
+
+//
+static void ConvertRows(const Picture &src, Picture &dst, int y0, int y1) {
+	const size_t count = size_t(y1 - y0) * src.GetWidth();
+
+	const auto src_format = src.GetFormat(), dst_format = dst.GetFormat();
+
+	const uint8_t *in = src.GetData() + size_t(y0) * src.GetWidth() * size_of(src_format);
+	uint8_t *out = dst.GetData() + size_t(y0) * dst.GetWidth() * size_of(dst_format);
+
+	if (src_format == PF_RGB24 && dst_format == PF_RGBA32) {
+		for (size_t i = 0; i < count; ++i, in += 3, out += 4) {
+			out[0] = in[0];
+			out[1] = in[1];
+			out[2] = in[2];
+			out[3] = 255;
+		}
+	} else if (src_format == PF_RGBA32 && dst_format == PF_RGB24) {
+		for (size_t i = 0; i < count; ++i, in += 4, out += 3) {
+			out[0] = in[0];
+			out[1] = in[1];
+			out[2] = in[2];
+		}
+	} else if (dst_format == PF_RGBA32F) {
+		auto *f = reinterpret_cast<float *>(out);
+		const auto step = size_of(src_format);
+		for (size_t i = 0; i < count; ++i, in += step, f += 4) {
+			f[0] = float(in[0]) * (1.f / 255.f);
+			f[1] = float(in[1]) * (1.f / 255.f);
+			f[2] = float(in[2]) * (1.f / 255.f);
+			f[3] = step == 4 ? float(in[3]) * (1.f / 255.f) : 1.f;
+		}
+	} else if (src_format == PF_RGBA32F) {
+		const auto *f = reinterpret_cast<const float *>(in);
+		const auto step = size_of(dst_format);
+		for (size_t i = 0; i < count; ++i, f += 4, out += step) {
+			out[0] = ToUint8(f[0]);
+			out[1] = ToUint8(f[1]);
+			out[2] = ToUint8(f[2]);
+			if (step == 4)
+				out[3] = ToUint8(f[3]);
+		}
+	}
+}
+
+Picture ConvertPicture(const Picture &pic, PictureFormat format) {
+	ProfilerPerfSection section("ConvertPicture");
+
+	if (!pic.GetWidth() || !pic.GetHeight() || pic.GetFormat() == PF_None || format == PF_None)
+		return {};
+
+	if (pic.GetFormat() == format)
+		return MakePicture(pic.GetData(), pic.GetWidth(), pic.GetHeight(), format);
+
+	Picture out(pic.GetWidth(), pic.GetHeight(), format);
+
+	parallel_for(pic.GetHeight(), 64, [&](size_t begin, size_t end) { ConvertRows(pic, out, int(begin), int(end)); });
+	return out;
+}
+
+//
+size_t GetMipCount(uint16_t width, uint16_t height) {
+	size_t count = 1;
+	for (auto size = Max(width, height); size > 1; size /= 2)
+		++count;
+	return count;
+}
+
+std::vector<Picture> GenerateMipChain(const Picture &pic, PictureFilter filter, bool srgb) {
+	ProfilerPerfSection section("GenerateMipChain");
+
+	std::vector<Picture> mips;
+
+	if (!pic.GetWidth() || !pic.GetHeight() || pic.GetFormat() == PF_None)
+		return mips;
+
+	const auto count = GetMipCount(pic.GetWidth(), pic.GetHeight());
+	mips.reserve(count);
+
+	mips.push_back(MakePicture(pic.GetData(), pic.GetWidth(), pic.GetHeight(), pic.GetFormat()));
+
+	for (size_t i = 1; i < count; ++i) {
+		const auto &prev = mips.back();
+		const auto width = uint16_t(Max(prev.GetWidth() / 2, 1)), height = uint16_t(Max(prev.GetHeight() / 2, 1));
+		mips.push_back(ResizePicture(prev, width, height, filter, srgb));
+	}
+
+	return mips;
+}
+
+} // namespace hg
@@ -0,0 +1,27 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#pragma once
+
+#include "engine/picture.h"
+
+#include <vector>
+
+namespace hg {
+
+enum PictureFilter { PFT_Box, PFT_Triangle, PFT_CubicBSpline, PFT_CatmullRom, PFT_Mitchell };
+
+/// Resize a picture, the output picture has the same format as the input picture.
+/// Output rows are filtered in bands on the worker pool. If `srgb` is true the color channels of 8 bit formats are filtered in linear space.
+Picture ResizePicture(const Picture &pic, uint16_t width, uint16_t height, PictureFilter filter = PFT_Mitchell, bool srgb = false);
+
+/// Convert a picture to another format, alpha is set to 1 when converting from RGB24.
+Picture ConvertPicture(const Picture &pic, PictureFormat format);
+
+/// Return the full mip chain of a picture down to 1x1, the first level is a copy of the input picture.
+/// Each level is filtered from the previous one, in linear space if `srgb` is true.
+std::vector<Picture> GenerateMipChain(const Picture &pic, PictureFilter filter = PFT_Box, bool srgb = false);
+
+/// Number of levels in the mip chain of a picture of the given size.
+size_t GetMipCount(uint16_t width, uint16_t height);
+
+} // namespace hg
@@ -5,6 +5,7 @@
 #include "engine/file_format.h"
 #include "engine/meta.h"
 
+#include "foundation/byte_sort.h"
 #include "foundation/file.h"
 #include "foundation/file_rw_interface.h"
 #include "foundation/format.h"
@@ -17,6 +18,8 @@
 #include "foundation/profiler.h"
 #include "foundation/projection.h"
 #include "foundation/time.h"
+#include "foundation/worker_pool.h"
+#include "foundation/xxhash.h"
 
 #include "platform/window_system.h"
 
@@ -28,6 +31,10 @@
 
 #include <json.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
 #include <set>
 
 using json = nlohmann::json;
@@ -49,6 +56,9 @@ namespace hg {
 
 static bool bgfx_is_up = false;
 
+static int render_worker_count = 0;
+static bool render_started_workers = false;
+
 static bgfx::UniformHandle u_previous_model = BGFX_INVALID_HANDLE;
 
 bgfxMatrix4 to_bgfx(const Mat44 &m) {
@@ -151,9 +161,14 @@ UniformSetTexture::~UniformSetTexture() {
 }
 
 //
-void SetMaterialProgram(Material &mat, PipelineProgramRef prg) { mat.program = prg; }
+void SetMaterialProgram(Material &mat, PipelineProgramRef prg) {
+	mat.program = prg;
+	++mat.revision;
+}
 
 void SetMaterialValue(Material &mat, const char *name, float val) {
+	++mat.revision;
+
 	const auto &i = mat.values.find(name);
 
 	if (i == std::end(mat.values)) {
@@ -168,6 +183,8 @@ void SetMaterialValue(Material &mat, const char *name, float val) {
 }
 
 void SetMaterialValue(Material &mat, const char *name, const Vec2 &val) {
+	++mat.revision;
+
 	const auto &i = mat.values.find(name);
 
 	if (i == std::end(mat.values)) {
@@ -182,6 +199,8 @@ void SetMaterialValue(Material &mat, const char *name, const Vec2 &val) {
 }
 
 void SetMaterialValue(Material &mat, const char *name, const Vec3 &val) {
+	++mat.revision;
+
 	const auto &i = mat.values.find(name);
 
 	if (i == std::end(mat.values)) {
@@ -196,6 +215,8 @@ void SetMaterialValue(Material &mat, const char *name, const Vec3 &val) {
 }
 
 void SetMaterialValue(Material &mat, const char *name, const Vec4 &val) {
+	++mat.revision;
+
 	const auto &i = mat.values.find(name);
 
 	if (i == std::end(mat.values)) {
@@ -210,6 +231,8 @@ void SetMaterialValue(Material &mat, const char *name, const Vec4 &val) {
 }
 
 void SetMaterialValue(Material &mat, const char *name, const Mat3 &m) {
+	++mat.revision;
+
 	const auto &i = mat.values.find(name);
 	const auto m_ = to_bgfx(m);
 
@@ -226,6 +249,8 @@ void SetMaterialValue(Material &mat, const char *name, const Mat3 &m) {
 }
 
 void SetMaterialValue(Material &mat, const char *name, const Mat4 &m) {
+	++mat.revision;
+
 	const auto &i = mat.values.find(name);
 	const auto m_ = to_bgfx(m);
 
@@ -242,6 +267,8 @@ void SetMaterialValue(Material &mat, const char *name, const Mat4 &m) {
 }
 
 void SetMaterialValue(Material &mat, const char *name, const Mat44 &m) {
+	++mat.revision;
+
 	const auto &i = mat.values.find(name);
 	const auto m_ = to_bgfx(m);
 
@@ -258,6 +285,8 @@ void SetMaterialValue(Material &mat, const char *name, const Mat44 &m) {
 }
 
 void SetMaterialTexture(Material &mat, const char *name, TextureRef tex, uint8_t stage) {
+	++mat.revision;
+
 	const auto &i = mat.textures.find(name);
 
 	if (i == std::end(mat.textures)) {
@@ -279,6 +308,7 @@ bool SetMaterialTextureRef(Material &mat, const char *name, TextureRef tex) {
 		return false;
 
 	i->second.texture = tex;
+	++mat.revision;
 	return true;
 }
 
@@ -726,6 +756,8 @@ std::vector<PipelineProgramFeature> LoadPipelineProgramFeatures(const Reader &ir
 				features.push_back(OptionalSkinning);
 			else if (feat == "OptionalAlphaCut")
 				features.push_back(OptionalAlphaCut);
+			else if (feat == "OptionalInstancing")
+				features.push_back(OptionalInstancing);
 			else if (!silent)
 				warn(format("Ignoring unknown pipeline shader feature '%1' in '%2'").arg(feat).arg(name));
 		}
@@ -842,6 +874,13 @@ PipelineProgram LoadPipelineProgram(
 	prg.ip = ip;
 	prg.ir = ir;
 
+	static std::atomic<uint32_t> revision_counter{0}; // programs can be loaded from any thread
+	prg.revision = ++revision_counter;
+
+	for (size_t i = 0, k = 1; i < prg.features.size(); k *= GetPipelineProgramFeatureStateCount(prg.features[i++]))
+		if (prg.features[i] == OptionalInstancing)
+			prg.instancing_variant_offset = uint32_t(k);
+
 	return prg;
 }
 
@@ -933,6 +972,8 @@ std::vector<int> GetMaterialPipelineProgramFeatureStates(const Material &mat, co
 			states.push_back(mat.flags & MF_EnableSkinning ? 1 : 0);
 		else if (feat == OptionalAlphaCut)
 			states.push_back(mat.flags & MF_EnableAlphaCut ? 1 : 0);
+		else if (feat == OptionalInstancing)
+			states.push_back(0); // instanced variant is selected when drawing
 	}
 
 	return states;
@@ -1019,6 +1060,7 @@ void UpdateMaterialPipelineProgramVariant(Material &mat, const PipelineResources
 		const auto &prg = resources.programs.Get_unsafe_(mat.program.ref.idx);
 		const auto states = GetMaterialPipelineProgramFeatureStates(mat, prg.features);
 		mat.variant_idx = GetPipelineProgramVariantIndex(prg.features, states);
+		++mat.revision;
 	}
 }
 
@@ -1154,6 +1196,44 @@ void UpdateTextureFromPicture(Texture &tex, const Picture &pic) {
 }
 
 //
+/// Create a texture from a parsed image, the texture takes ownership of the image. A placeholder texture is created if the image is invalid.
+static Texture CreateTextureFromImage(bimg::ImageContainer *container, const char *name, uint64_t flags, bgfx::TextureInfo *info, bool silent) {
+	bgfx::TextureHandle handle = BGFX_INVALID_HANDLE;
+
+	if (container) {
+		const auto *mem = bgfx::makeRef(
+			container->m_data, container->m_size, [](void *ptr, void *user) { BX_ALIGNED_FREE(&g_allocator, user, 16); }, container);
+
+		if (container->m_cubeMap) {
+			handle = bgfx::createTextureCube(
+				uint16_t(container->m_width), 1 < container->m_numMips, container->m_numLayers, bgfx::TextureFormat::Enum(container->m_format), flags, mem);
+		} else if (1 < container->m_depth) {
+			handle = bgfx::createTexture3D(uint16_t(container->m_width), uint16_t(container->m_height), uint16_t(container->m_depth), 1 < container->m_numMips,
+				bgfx::TextureFormat::Enum(container->m_format), flags, mem);
+		} else if (bgfx::isTextureValid(0, false, container->m_numLayers, bgfx::TextureFormat::Enum(container->m_format), flags)) {
+			handle = bgfx::createTexture2D(uint16_t(container->m_width), uint16_t(container->m_height), 1 < container->m_numMips, container->m_numLayers,
+				bgfx::TextureFormat::Enum(container->m_format), flags, mem);
+		}
+
+		if (info)
+			bgfx::calcTextureSize(*info, uint16_t(container->m_width), uint16_t(container->m_height), uint16_t(container->m_depth), container->m_cubeMap,
+				1 < container->m_numMips, container->m_numLayers, bgfx::TextureFormat::Enum(container->m_format));
+	}
+
+	if (!bgfx::isValid(handle)) {
+		if (!silent)
+			warn(format("Failed to load texture '%1', unsupported format").arg(name).c_str());
+
+		static const uint32_t dummy = 0xff00ffff;
+		handle = bgfx::createTexture2D(1, 1, false, 1, bgfx::TextureFormat::RGBA8, BGFX_SAMPLER_NONE, bgfx::copy(&dummy, 4));
+	}
+
+	if (bgfx::isValid(handle))
+		bgfx::setName(handle, name);
+
+	return MakeTexture(handle, flags);
+}
+
 Texture LoadTexture(
 	const Reader &ir, const ReadProvider &ip, const char *name, uint64_t flags, bgfx::TextureInfo *info, bimg::Orientation::Enum *orientation, bool silent) {
 	ProfilerPerfSection section("LoadTexture", name);
@@ -1161,47 +1241,16 @@ Texture LoadTexture(
 	if (!silent)
 		log(format("Loading texture '%1'").arg(name).c_str());
 
-	bgfx::TextureHandle handle = BGFX_INVALID_HANDLE;
-
 	const auto data = LoadData(ir, ScopedReadHandle(ip, name, silent));
 
-	if (data.GetSize() > 0) {
-		if (auto container = bimg::imageParse(&g_allocator, data.GetData(), numeric_cast<uint32_t>(data.GetSize()), bimg::TextureFormat::Count)) {
-			const auto *mem = bgfx::makeRef(
-				container->m_data, container->m_size, [](void *ptr, void *user) { BX_ALIGNED_FREE(&g_allocator, user, 16); }, container);
-
-			if (container->m_cubeMap) {
-				handle = bgfx::createTextureCube(
-					uint16_t(container->m_width), 1 < container->m_numMips, container->m_numLayers, bgfx::TextureFormat::Enum(container->m_format), flags, mem);
-			} else if (1 < container->m_depth) {
-				handle = bgfx::createTexture3D(uint16_t(container->m_width), uint16_t(container->m_height), uint16_t(container->m_depth),
-					1 < container->m_numMips, bgfx::TextureFormat::Enum(container->m_format), flags, mem);
-			} else if (bgfx::isTextureValid(0, false, container->m_numLayers, bgfx::TextureFormat::Enum(container->m_format), flags)) {
-				handle = bgfx::createTexture2D(uint16_t(container->m_width), uint16_t(container->m_height), 1 < container->m_numMips, container->m_numLayers,
-					bgfx::TextureFormat::Enum(container->m_format), flags, mem);
-			}
-
-			if (info)
-				bgfx::calcTextureSize(*info, uint16_t(container->m_width), uint16_t(container->m_height), uint16_t(container->m_depth), container->m_cubeMap,
-					1 < container->m_numMips, container->m_numLayers, bgfx::TextureFormat::Enum(container->m_format));
-		}
-
-		if (!bgfx::isValid(handle)) {
-			if (!silent)
-				warn(format("Failed to load texture '%1', unsupported format").arg(name).c_str());
-
-			static const uint32_t dummy = 0xff00ffff;
-			handle = bgfx::createTexture2D(1, 1, false, 1, bgfx::TextureFormat::RGBA8, BGFX_SAMPLER_NONE, bgfx::copy(&dummy, 4));
-		}
-
-		if (bgfx::isValid(handle))
-			bgfx::setName(handle, name);
-	} else {
+	if (data.GetSize() == 0) {
 		if (!silent)
 			warn(format("Failed to load texture '%1', could not load data").arg(name).c_str());
+		return MakeTexture(BGFX_INVALID_HANDLE, flags);
 	}
 
-	return MakeTexture(handle, flags);
+	auto container = bimg::imageParse(&g_allocator, data.GetData(), numeric_cast<uint32_t>(data.GetSize()), bimg::TextureFormat::Count);
+	return CreateTextureFromImage(container, name, flags, info, silent);
 }
 
 Texture LoadTextureFromFile(const char *name, uint64_t flags, bgfx::TextureInfo *info, bimg::Orientation::Enum *orientation, bool silent) {
@@ -1615,6 +1664,32 @@ bgfx::VertexLayout VertexLayoutPosFloatNormUInt8TexCoord0UInt8() {
 	return vtx_layout;
 }
 
+
+// load queues are kept by decreasing priority, queuing order otherwise
+template <typename T> static bool IsLoadQueueSorted(const std::deque<T> &loads) {
+	return std::is_sorted(std::begin(loads), std::end(loads), [](const T &a, const T &b) { return a.priority > b.priority; });
+}
+
+template <typename T> static void SortLoadQueue(std::deque<T> &loads, bool &sorted) {
+	if (!sorted)
+		std::stable_sort(std::begin(loads), std::end(loads), [](const T &a, const T &b) { return a.priority > b.priority; });
+	sorted = true;
+}
+
+template <typename T> static void QueueLoad(std::deque<T> &loads, bool &sorted, T &&load) {
+	if (!loads.empty() && load.priority > loads.back().priority)
+		sorted = false;
+	loads.push_back(std::move(load));
+}
+
+template <typename T, typename R> static void SetLoadPriority(std::deque<T> &loads, bool &sorted, R ref, float priority) {
+	for (auto &load : loads)
+		if (load.ref == ref && load.priority != priority) {
+			load.priority = priority;
+			sorted = false;
+		}
+}
+
 //
 size_t ProcessModelLoadQueue(PipelineResources &res, time_ns t_budget, bool silent) {
 	ProfilerPerfSection section("ProcessModelLoadQueue");
@@ -1623,18 +1698,19 @@ size_t ProcessModelLoadQueue(PipelineResources &res, time_ns t_budget, bool sile
 
 	const auto t_start = time_now();
 
+	SortLoadQueue(res.model_loads, res.model_loads_sorted);
+
 	while (!res.model_loads.empty()) {
 		const auto &m = res.model_loads.front();
 
 		if (res.models.IsValidRef(m.ref)) {
-			auto &mdl = res.models.Get(m.ref);
 			const auto name = res.models.GetName(m.ref);
 			if (!silent)
 				debug(format("Queued model load '%1'").arg(name));
 
 			ModelInfo info;
 			ScopedReadHandle h(m.ip, name.c_str(), silent);
-			mdl = LoadModel(m.ir, h, name.c_str(), &info, silent);
+			res.models.Update(m.ref, LoadModel(m.ir, h, name.c_str(), &info, silent)); // bumps the models revision, see Scene::UpdateSpatialIndex
 			res.model_infos[m.ref.ref] = info;
 		}
 
@@ -1656,10 +1732,12 @@ ModelRef QueueLoadModel(const Reader &ir, const ReadProvider &ip, const char *na
 		return ref;
 
 	ref = resources.models.Add(name, {});
-	resources.model_loads.push_back({ir, ip, ref});
+	QueueLoad(resources.model_loads, resources.model_loads_sorted, ModelLoad{ir, ip, ref});
 	return ref;
 }
 
+void SetModelLoadPriority(PipelineResources &res, ModelRef ref, float priority) { SetLoadPriority(res.model_loads, res.model_loads_sorted, ref, priority); }
+
 ModelRef QueueLoadModelFromFile(const char *path, PipelineResources &resources) { return QueueLoadModel(g_file_reader, g_file_read_provider, path, resources); }
 
 ModelRef QueueLoadModelFromAssets(const char *name, PipelineResources &resources) {
@@ -1721,6 +1799,7 @@ Model LoadModel(const Reader &ir, const Handle &h, const char *name, ModelInfo *
 	ir.read(h, &vs_decl, sizeof(bgfx::VertexLayout)); // read vertex declaration
 
 	uint32_t tri_count{};
+	const auto occluder_max_tri_count = GetModelOccluderMaxTriangleCount();
 
 	while (true) {
 		uint8_t idx_type_size = 2; // legacy is 16 bit indices
@@ -1744,6 +1823,10 @@ Model LoadModel(const Reader &ir, const Handle &h, const char *name, ModelInfo *
 		ir.read(h, idx_mem->data, idx_mem->size);
 		tri_count += (size / idx_type_size) / 3;
 
+		std::vector<uint8_t> occluder_idx; // bgfx owns the index memory before the vertex data is read
+		if (tri_count <= occluder_max_tri_count)
+			occluder_idx.assign(idx_mem->data, idx_mem->data + idx_mem->size);
+
 		const auto idx_hnd = bgfx::createIndexBuffer(idx_mem, idx_type_size == 4 ? BGFX_BUFFER_INDEX32 : BGFX_BUFFER_NONE);
 		if (!bgfx::isValid(idx_hnd)) {
 			warn(format("%1: failed to create index buffer").arg(name));
@@ -1757,6 +1840,17 @@ Model LoadModel(const Reader &ir, const Handle &h, const char *name, ModelInfo *
 		const auto vtx_mem = bgfx::alloc(size);
 		ir.read(h, vtx_mem->data, vtx_mem->size);
 
+		// bones table
+		const auto bones_table_size = Read<uint32_t>(ir, h);
+		std::vector<uint16_t> bones_table;
+		bones_table.resize(bones_table_size);
+		ir.read(h, bones_table.data(), bones_table.size() * sizeof(bones_table[0]));
+
+		auto bones_bounds = ComputeDisplayListBonesBounds(vs_decl, vtx_mem->data, vtx_mem->size, bones_table.size()); // before bgfx owns the memory
+
+		if (!occluder_idx.empty())
+			AppendOccluderMesh(model.occluder, vs_decl, vtx_mem->data, vtx_mem->size, occluder_idx.data(), uint32_t(occluder_idx.size()), idx_type_size);
+
 		const auto vtx_hnd = bgfx::createVertexBuffer(vtx_mem, vs_decl);
 		if (!bgfx::isValid(vtx_hnd)) {
 			warn(format("%1: failed to create vertex buffer").arg(name));
@@ -1765,18 +1859,15 @@ Model LoadModel(const Reader &ir, const Handle &h, const char *name, ModelInfo *
 		}
 		bgfx::setName(vtx_hnd, name);
 
-		// bones table
-		size = Read<uint32_t>(ir, h);
-		std::vector<uint16_t> bones_table;
-		bones_table.resize(size);
-		ir.read(h, bones_table.data(), bones_table.size() * sizeof(bones_table[0]));
-
 		//
-		model.lists.push_back({idx_hnd, vtx_hnd, std::move(bones_table)});
+		model.lists.push_back({idx_hnd, vtx_hnd, std::move(bones_table), std::move(bones_bounds)});
 		model.bounds.push_back(Read<MinMax>(ir, h));
 		model.mats.push_back(Read<uint16_t>(ir, h));
 	}
 
+	if (tri_count > occluder_max_tri_count)
+		model.occluder = {};
+
 	if (info) {
 		info->vs_decl = vs_decl;
 		info->tri_count = tri_count;
@@ -1988,6 +2079,8 @@ void Destroy(Material &material) {
 			bgfx::destroy(i.second.uniform);
 		i.second.uniform = BGFX_INVALID_HANDLE;
 	}
+
+	++material.revision;
 }
 
 //
@@ -1999,10 +2092,17 @@ void PipelineResources::DestroyAll() {
 		models.DestroyAll();
 	}
 
+	if (bgfx_is_up)
+		for (auto &t : texture_loads)
+			if (bgfx::isValid(t.pending))
+				bgfx::destroy(t.pending);
+
 	texture_loads.clear();
+	texture_loads_sorted = true;
 	texture_infos.clear();
 
 	model_loads.clear();
+	model_loads_sorted = true;
 }
 
 //
@@ -2031,60 +2131,238 @@ static bgfx::ProgramHandle RequestPipelineProgramVariantConfigProgram(const Pipe
 	return BGFX_INVALID_HANDLE;
 }
 
-// OK
-static void _RenderPipelineStageDisplayList(bgfx::ViewId view_id, const DisplayList &display_list, const Material &mat, uint8_t pipeline_config_idx,
-	const PipelineResources &res, const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, uint32_t depth) {
-	const auto &prg = res.programs.Get_unsafe_(mat.program.ref.idx);
+//
+struct MaterialBindings {
+	struct Value {
+		bgfx::UniformHandle uniform;
+		uint32_t offset; // in data
+		uint16_t count;
+	};
 
-	const auto prg_h = RequestPipelineProgramVariantConfigProgram(prg, mat.variant_idx, pipeline_config_idx);
-	if (!bgfx::isValid(prg_h))
-		return;
+	struct Texture {
+		bgfx::UniformHandle uniform;
+		TextureRef texture;
+		uint8_t channel;
+	};
 
-	// material values/fallback to shader default
-	std::vector<uint16_t> uniforms_set;
-	uniforms_set.reserve(32);
+	std::vector<float> data;
+	std::vector<Value> values;
+	std::vector<Texture> textures;
+
+	PipelineProgramRef program;
+	uint32_t program_revision{0}, material_revision{0};
+	uint64_t hash{0}; // hash of the bound values and textures, used to find identical materials
+};
+
+// baked to a new object so that the copies of a material sharing the previous bindings are left untouched
+static void BakeMaterialBindings(const Material &mat, const PipelineProgram &prg) {
+	auto bindings = std::make_shared<MaterialBindings>();
 
+	// material values/fallback to shader default
 	for (const auto &i : mat.values) {
-		bgfx::setUniform(i.second.uniform, i.second.value.data(), i.second.count);
-		uniforms_set.push_back(i.second.uniform.idx);
+		bindings->values.push_back({i.second.uniform, uint32_t(bindings->data.size()), i.second.count});
+		bindings->data.insert(std::end(bindings->data), std::begin(i.second.value), std::end(i.second.value));
 	}
 
-	for (const auto &u : prg.vec4_uniforms)
-		if (std::find(std::begin(uniforms_set), std::end(uniforms_set), u.handle.idx) == std::end(uniforms_set))
-			bgfx::setUniform(u.handle, &u.value.x); // not set, set from shader default
+	const auto value_count = bindings->values.size();
+
+	for (const auto &u : prg.vec4_uniforms) {
+		const auto end = std::begin(bindings->values) + value_count;
+		if (std::find_if(std::begin(bindings->values), end, [&](const MaterialBindings::Value &v) { return v.uniform.idx == u.handle.idx; }) == end) {
+			bindings->values.push_back({u.handle, uint32_t(bindings->data.size()), 1});
+			bindings->data.insert(std::end(bindings->data), {u.value.x, u.value.y, u.value.z, u.value.w});
+		}
+	}
 
 	// material texture/fallback to shader default
-	uniforms_set.clear();
+	for (const auto &i : mat.textures)
+		bindings->textures.push_back({i.second.uniform, i.second.texture, i.second.channel});
 
-	for (const auto &i : mat.textures) {
-		const auto &tex = res.textures.Get(i.second.texture);
-		if (bgfx::isValid(tex.handle))
-			bgfx::setTexture(i.second.channel, i.second.uniform, tex.handle, uint32_t(tex.flags)); // only retain the BGFX_SAMPLER_XXX bits of the texture flag
-		uniforms_set.push_back(i.second.uniform.idx);
+	const auto texture_count = bindings->textures.size();
+
+	for (const auto &u : prg.texture_uniforms) {
+		const auto end = std::begin(bindings->textures) + texture_count;
+		if (std::find_if(std::begin(bindings->textures), end, [&](const MaterialBindings::Texture &t) { return t.uniform.idx == u.handle.idx; }) == end)
+			bindings->textures.push_back({u.handle, u.tex_ref, u.channel});
 	}
 
-	for (const auto &u : prg.texture_uniforms)
-		if (std::find(std::begin(uniforms_set), std::end(uniforms_set), u.handle.idx) == std::end(uniforms_set)) {
-			const auto &tex = res.textures.Get(u.tex_ref);
-			if (bgfx::isValid(tex.handle))
-				bgfx::setTexture(u.channel, u.handle, tex.handle, uint32_t(tex.flags)); // not set, set from shader default
+	bindings->program = mat.program;
+	bindings->program_revision = prg.revision;
+	bindings->material_revision = mat.revision;
+
+	bindings->hash = XXH64(bindings->data.data(), bindings->data.size() * sizeof(float), 0);
+	for (const auto &v : bindings->values)
+		bindings->hash = XXH64(&v.uniform.idx, sizeof(v.uniform.idx), bindings->hash);
+	for (const auto &t : bindings->textures) {
+		const uint32_t tex[] = {t.uniform.idx, t.texture.ref.idx, t.texture.ref.gen, t.channel};
+		bindings->hash = XXH64(tex, sizeof(tex), bindings->hash);
+	}
+
+	mat.bindings = std::move(bindings);
+}
+
+static const MaterialBindings &GetMaterialBindings(const Material &mat, const PipelineProgram &prg) {
+	const auto &bindings = mat.bindings;
+	if (!bindings || bindings->material_revision != mat.revision || bindings->program != mat.program || bindings->program_revision != prg.revision)
+		BakeMaterialBindings(mat, prg);
+	return *mat.bindings;
+}
+
+/// Return true if two materials with up to date bindings set the same state.
+static bool IsSameMaterialState(const Material &ma, const Material &mb) {
+	if (&ma == &mb)
+		return true;
+
+	if (ma.program != mb.program || ma.variant_idx != mb.variant_idx || ma.state.state != mb.state.state || ma.state.rgba != mb.state.rgba)
+		return false;
+
+	if (ma.bindings == mb.bindings) // copies of the same material
+		return true;
+
+	const auto &ba = *ma.bindings, &bb = *mb.bindings;
+	if (ba.hash != bb.hash || ba.data != bb.data || ba.values.size() != bb.values.size() || ba.textures.size() != bb.textures.size())
+		return false;
+
+	for (size_t i = 0; i < ba.values.size(); ++i)
+		if (ba.values[i].uniform.idx != bb.values[i].uniform.idx || ba.values[i].count != bb.values[i].count)
+			return false;
+
+	for (size_t i = 0; i < ba.textures.size(); ++i)
+		if (ba.textures[i].uniform.idx != bb.textures[i].uniform.idx || ba.textures[i].texture != bb.textures[i].texture ||
+			ba.textures[i].channel != bb.textures[i].channel)
+			return false;
+
+	return true;
+}
+
+static void SetMaterialBindings(bgfx::Encoder &encoder, const MaterialBindings &bindings, const PipelineResources &res, DisplayListSubmitStats &stats) {
+	for (const auto &v : bindings.values)
+		encoder.setUniform(v.uniform, bindings.data.data() + v.offset, v.count);
+
+	stats.uniform_change_count += uint32_t(bindings.values.size());
+
+	for (const auto &t : bindings.textures) {
+		const auto &tex = res.textures.Get(t.texture);
+		if (bgfx::isValid(tex.handle)) {
+			encoder.setTexture(t.channel, t.uniform, tex.handle, uint32_t(tex.flags)); // only retain the BGFX_SAMPLER_XXX bits of the texture flag
+			++stats.texture_change_count;
 		}
+	}
+}
+
+static void SetUniforms(
+	bgfx::Encoder &encoder, const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, DisplayListSubmitStats &stats) {
+	for (auto &v : values)
+		encoder.setUniform(v.uniform, v.value.data(), v.count);
+	for (auto &t : textures)
+		encoder.setTexture(t.stage, t.uniform, t.texture.handle, uint32_t(t.texture.flags)); // only retain the BGFX_SAMPLER_XXX bits of the texture flag
+
+	stats.uniform_change_count += uint32_t(values.size());
+	stats.texture_change_count += uint32_t(textures.size());
+}
+
+static DisplayListSubmitStats display_list_submit_stats;
+
+/// Encoder state left by the last display list draw of a run, see DisplayListSubmitStats.
+struct DisplayListEncoderState {
+	const DisplayList *display_list{nullptr}; // buffers kept from the last draw, null if the last draw ended its run
+	uint16_t program{bgfx::kInvalidHandle};
+};
+
+/*
+	Submit a display list draw. If keep_state is true the next draw on this encoder continues the run: the material uniforms and textures are left bound
+	and only its transform, render state and buffers, if they differ, are set.
+	Uniforms are discarded after each draw, otherwise bgfx would submit the uniforms set since the start of the run again with every draw of the run.
+*/
+static bool _RenderPipelineStageDisplayList(bgfx::Encoder &encoder, bgfx::ViewId view_id, const DisplayList &display_list, const Material &mat,
+	uint8_t pipeline_config_idx, const PipelineResources &res, const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures,
+	uint32_t depth, DisplayListEncoderState &state, bool keep_state, DisplayListSubmitStats &stats) {
+	const auto &prg = res.programs.Get_unsafe_(mat.program.ref.idx);
+
+	const auto prg_h = RequestPipelineProgramVariantConfigProgram(prg, mat.variant_idx, pipeline_config_idx);
+	if (!bgfx::isValid(prg_h)) {
+		state.display_list = nullptr;
+		return false;
+	}
+
+	if (state.display_list == nullptr) { // first draw of a run
+		SetMaterialBindings(encoder, GetMaterialBindings(mat, prg), res, stats);
+		SetUniforms(encoder, values, textures, stats);
+	} else {
+		++stats.elided_state_count;
+	}
+
+	encoder.setState(mat.state.state, mat.state.rgba); // discarded with the uniforms
+
+	if (state.display_list != &display_list) {
+		encoder.setIndexBuffer(display_list.index_buffer);
+		encoder.setVertexBuffer(0, display_list.vertex_buffer);
+	}
+
+	if (state.program != prg_h.idx) {
+		state.program = prg_h.idx;
+		++stats.program_change_count;
+	}
+
+	encoder.submit(view_id, prg_h, depth, keep_state ? BGFX_DISCARD_TRANSFORM | BGFX_DISCARD_STATE : BGFX_DISCARD_ALL);
+	++stats.draw_count;
+
+	state.display_list = keep_state ? &display_list : nullptr;
+	return true;
+}
+
+static bool _RenderPipelineStageDisplayListInstanced(bgfx::Encoder &encoder, bgfx::ViewId view_id, const DisplayList &display_list, const Material &mat,
+	uint8_t pipeline_config_idx, const PipelineResources &res, const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures,
+	const bgfx::InstanceDataBuffer &idb, DisplayListSubmitStats &stats) {
+	const auto &prg = res.programs.Get_unsafe_(mat.program.ref.idx);
+
+	const auto prg_h = RequestPipelineProgramVariantConfigProgram(prg, mat.variant_idx + prg.instancing_variant_offset, pipeline_config_idx);
+	if (!bgfx::isValid(prg_h))
+		return false;
+
+	SetMaterialBindings(encoder, GetMaterialBindings(mat, prg), res, stats);
+	SetUniforms(encoder, values, textures, stats);
+	++stats.program_change_count;
+
+	encoder.setInstanceDataBuffer(&idb);
+	encoder.setIndexBuffer(display_list.index_buffer);
+	encoder.setVertexBuffer(0, display_list.vertex_buffer);
 
-	DrawDisplayList(view_id, display_list.index_buffer, display_list.vertex_buffer, prg_h, values, textures, mat.state, depth);
+	encoder.setState(mat.state.state, mat.state.rgba);
+	encoder.submit(view_id, prg_h);
+	++stats.draw_count;
+	return true;
+}
+
+/*
+	Resolve the program variant and bake the material bindings of a display list before it is submitted from a job.
+	Both are lazily updated on first use and must not be written to while jobs read them.
+*/
+static void _PrepareDisplayListSubmit(const Material &mat, uint8_t pipeline_config_idx, const PipelineResources &res) {
+	const auto &prg = res.programs.Get_unsafe_(mat.program.ref.idx);
+	RequestPipelineProgramVariantConfigProgram(prg, mat.variant_idx, pipeline_config_idx);
+	GetMaterialBindings(mat, prg);
 }
 
 static void _RenderDisplayLists(bgfx::ViewId view_id, const std::vector<DisplayList> &lists, const std::vector<uint32_t> &depths, const Material *mats,
 	uint8_t pipeline_config_idx, const PipelineResources &res, const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures,
 	const bgfxMatrix4 *mtxs, size_t mtx_count) {
-	const auto i_mtx = bgfx::setTransform(mtxs, uint16_t(mtx_count));
+	auto encoder = bgfx::begin();
+
+	const auto i_mtx = encoder->setTransform(mtxs, uint16_t(mtx_count));
 
 	const auto lists_size = lists.size();
 	__ASSERT__(lists_size == depths.size());
 
+	DisplayListEncoderState state;
+
 	for (size_t i = 0; i < lists_size; ++i) {
-		bgfx::setTransform(i_mtx);
-		_RenderPipelineStageDisplayList(view_id, lists[i], mats[i], pipeline_config_idx, res, values, textures, depths[i]);
+		encoder->setTransform(i_mtx);
+		_RenderPipelineStageDisplayList(
+			*encoder, view_id, lists[i], mats[i], pipeline_config_idx, res, values, textures, depths[i], state, false, display_list_submit_stats);
 	}
+
+	bgfx::end(encoder);
 }
 
 static void _RenderDisplayLists(bgfx::ViewId view_id, const std::vector<DisplayList> &lists, const std::vector<uint32_t> &depths, const Material &mat,
@@ -2103,37 +2381,469 @@ void CullModelDisplayLists(const Frustum &frustum, std::vector<ModelDisplayList>
 	display_lists.resize(std::distance(std::begin(display_lists), i));
 }
 
+/*
+	Test each display list bounds against all frustums and output the display lists visible from each frustum in order.
+	A display list for which get_bounds returns false is considered visible from all frustums.
+*/
+template <typename T, typename F>
+static void _CullDisplayLists(const std::vector<Frustum> &frustums, const std::vector<T> &display_lists, std::vector<uint32_t> &visibility,
+	const std::vector<std::vector<T> *> &culled_display_lists, F get_bounds) {
+	const auto frustum_count = frustums.size();
+	__ASSERT__(frustum_count <= 32);
+	__ASSERT__(culled_display_lists.size() == frustum_count);
+
+	for (auto culled : culled_display_lists)
+		if (culled)
+			culled->clear();
+
+	const auto count = display_lists.size();
+	visibility.resize(count);
+
+	MinMax bounds;
+
+	for (size_t i = 0; i < count; ++i) {
+		const auto &display_list = display_lists[i];
+		const bool has_bounds = get_bounds(display_list, bounds);
+
+		uint32_t mask = 0;
+		for (size_t j = 0; j < frustum_count; ++j)
+			if (!has_bounds || TestVisibility(frustums[j], bounds) != V_Outside) {
+				mask |= 1 << j;
+				if (culled_display_lists[j])
+					culled_display_lists[j]->push_back(display_list);
+			}
+
+		visibility[i] = mask;
+	}
+}
+
+void CullModelDisplayLists(const std::vector<Frustum> &frustums, const std::vector<ModelDisplayList> &display_lists, const std::vector<Mat4> &mtxs,
+	const PipelineResources &res, std::vector<uint32_t> &visibility, const std::vector<std::vector<ModelDisplayList> *> &culled_display_lists) {
+	_CullDisplayLists(frustums, display_lists, visibility, culled_display_lists, [&](const ModelDisplayList &display_list, MinMax &bounds) {
+		const auto &model = res.models.Get_unsafe_(display_list.mdl_idx);
+		bounds = mtxs[display_list.mtx_idx] * model.bounds[display_list.lst_idx];
+		return true;
+	});
+}
+
+//
+static uint32_t model_occluder_max_tri_count = 0;
+
+void SetModelOccluderMaxTriangleCount(uint32_t count) { model_occluder_max_tri_count = count; }
+uint32_t GetModelOccluderMaxTriangleCount() { return model_occluder_max_tri_count; }
+
+void AppendOccluderMesh(OccluderMesh &occluder, const bgfx::VertexLayout &decl, const void *vtx_data, uint32_t vtx_size, const void *idx_data,
+	uint32_t idx_size, uint8_t idx_type_size) {
+	if (!decl.has(bgfx::Attrib::Position))
+		return;
+
+	const auto base = uint32_t(occluder.vtx.size());
+	const auto vtx_count = vtx_size / decl.getStride();
+
+	occluder.vtx.reserve(base + vtx_count);
+	for (uint32_t v = 0; v < vtx_count; ++v) {
+		float pos[4];
+		bgfx::vertexUnpack(pos, bgfx::Attrib::Position, decl, vtx_data, v);
+		occluder.vtx.push_back({pos[0], pos[1], pos[2]});
+	}
+
+	const auto idx_count = (idx_size / idx_type_size) / 3 * 3;
+
+	occluder.idx.reserve(occluder.idx.size() + idx_count);
+	for (uint32_t i = 0; i < idx_count; ++i) {
+		const auto idx = idx_type_size == 4 ? reinterpret_cast<const uint32_t *>(idx_data)[i] : reinterpret_cast<const uint16_t *>(idx_data)[i];
+		occluder.idx.push_back(base + (idx < vtx_count ? idx : 0));
+	}
+}
+
+//
+std::vector<MinMax> ComputeDisplayListBonesBounds(const bgfx::VertexLayout &decl, const void *vtx_data, uint32_t vtx_size, size_t bone_count) {
+	std::vector<MinMax> bounds(bone_count);
+
+	if (!decl.has(bgfx::Attrib::Position) || !decl.has(bgfx::Attrib::Indices) || !decl.has(bgfx::Attrib::Weight))
+		return bounds;
+
+	uint8_t idx_num;
+	bgfx::AttribType::Enum idx_type;
+	bool idx_normalized, idx_as_int;
+	decl.decode(bgfx::Attrib::Indices, idx_num, idx_type, idx_normalized, idx_as_int);
+
+	const auto stride = decl.getStride();
+	const auto vtx_count = vtx_size / stride;
+
+	for (uint32_t v = 0; v < vtx_count; ++v) {
+		float pos[4], idx[4], weight[4];
+		bgfx::vertexUnpack(pos, bgfx::Attrib::Position, decl, vtx_data, v);
+		bgfx::vertexUnpack(weight, bgfx::Attrib::Weight, decl, vtx_data, v);
+
+		if (idx_type == bgfx::AttribType::Uint8) { // raw bone slot, regardless of the attribute normalization flag
+			const auto p = reinterpret_cast<const uint8_t *>(vtx_data) + v * stride + decl.getOffset(bgfx::Attrib::Indices);
+			for (int k = 0; k < 4; ++k)
+				idx[k] = k < idx_num ? float(p[k]) : 0.f;
+		} else {
+			bgfx::vertexUnpack(idx, bgfx::Attrib::Indices, decl, vtx_data, v);
+		}
+
+		const Vec3 P{pos[0], pos[1], pos[2]};
+
+		for (int k = 0; k < 4; ++k) {
+			if (weight[k] <= 0.f)
+				continue;
+
+			const auto j = size_t(idx[k]);
+			if (j < bone_count) {
+				bounds[j].mn = Min(bounds[j].mn, P);
+				bounds[j].mx = Max(bounds[j].mx, P);
+			}
+		}
+	}
+
+	return bounds;
+}
+
+bool ComputeSkinnedModelDisplayListBounds(const SkinnedModelDisplayList &display_list, const std::vector<Mat4> &mtxs, const PipelineResources &res, MinMax &bounds) {
+	const auto &model = res.models.Get_unsafe_(display_list.mdl_idx);
+	const auto &bones_bounds = model.lists[display_list.lst_idx].bones_bounds;
+
+	if (bones_bounds.size() != display_list.bone_count)
+		return false; // no bone bounds for this display list
+
+	bounds = {};
+
+	for (uint16_t j = 0; j < display_list.bone_count; ++j) {
+		const auto &bone_bounds = bones_bounds[j];
+		if (bone_bounds.mn.x > bone_bounds.mx.x)
+			continue; // bone does not influence any vertex
+
+		const auto bone_world = (mtxs[display_list.mtx_idxs[j]] * model.bind_pose[display_list.bones_idxs[j]]) * bone_bounds;
+
+		bounds.mn = Min(bounds.mn, bone_world.mn);
+		bounds.mx = Max(bounds.mx, bone_world.mx);
+	}
+
+	return bounds.mn.x <= bounds.mx.x;
+}
+
+void CullSkinnedModelDisplayLists(
+	const Frustum &frustum, std::vector<SkinnedModelDisplayList> &display_lists, const std::vector<Mat4> &mtxs, const PipelineResources &res) {
+	const auto i = std::remove_if(std::begin(display_lists), std::end(display_lists), [&](const SkinnedModelDisplayList &display_list) {
+		MinMax bounds;
+		return ComputeSkinnedModelDisplayListBounds(display_list, mtxs, res, bounds) && TestVisibility(frustum, bounds) == V_Outside;
+	});
+	display_lists.resize(std::distance(std::begin(display_lists), i));
+}
+
+void CullSkinnedModelDisplayLists(const std::vector<Frustum> &frustums, const std::vector<SkinnedModelDisplayList> &display_lists,
+	const std::vector<Mat4> &mtxs, const PipelineResources &res, std::vector<uint32_t> &visibility,
+	const std::vector<std::vector<SkinnedModelDisplayList> *> &culled_display_lists) {
+	_CullDisplayLists(frustums, display_lists, visibility, culled_display_lists, [&](const SkinnedModelDisplayList &display_list, MinMax &bounds) {
+		return ComputeSkinnedModelDisplayListBounds(display_list, mtxs, res, bounds);
+	});
+}
+
 //
-static void _DrawModelDisplayLists(bgfx::ViewId view_id, const std::vector<ModelDisplayList> &display_lists, const std::vector<uint32_t> *depths,
-	uint8_t pipeline_config_idx, const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, const std::vector<Mat4> &mtxs,
-	const std::vector<Mat4> *prv_mtxs, const PipelineResources &res) {
+static int display_list_submit_job_count = 1;
+static const size_t display_list_submit_min_job_size = 128; // smaller batches are not worth the cost of an encoder
+
+void SetDisplayListSubmitJobCount(int count) { display_list_submit_job_count = count < 1 ? 1 : count; }
+int GetDisplayListSubmitJobCount() { return display_list_submit_job_count; }
+
+DisplayListSubmitStats GetDisplayListSubmitStats() { return display_list_submit_stats; }
+void ResetDisplayListSubmitStats() { display_list_submit_stats = {}; }
+
+static std::vector<DisplayListSubmitRecord> *display_list_submit_record = nullptr;
+
+void SetDisplayListSubmitRecord(std::vector<DisplayListSubmitRecord> *record) { display_list_submit_record = record; }
+
+static void AccumulateDisplayListSubmitStats(DisplayListSubmitStats &stats, const DisplayListSubmitStats &job_stats) {
+	stats.draw_count += job_stats.draw_count;
+	stats.program_change_count += job_stats.program_change_count;
+	stats.texture_change_count += job_stats.texture_change_count;
+	stats.uniform_change_count += job_stats.uniform_change_count;
+	stats.elided_state_count += job_stats.elided_state_count;
+}
+
+/// Return the number of jobs to split the submission of count display lists across, 1 if they are to be submitted from the calling thread.
+static size_t ComputeDisplayListSubmitJobCount(size_t count) {
+	auto job_count = std::min(size_t(display_list_submit_job_count), count / display_list_submit_min_job_size);
+
+	const auto max_encoders = bgfx::getCaps()->limits.maxEncoders; // 1 if bgfx is not built multithreaded
+	job_count = std::min(job_count, size_t(max_encoders > 1 ? max_encoders - 1 : 0)); // the first encoder belongs to the API thread
+
+	return job_count > 1 ? job_count : 1;
+}
+
+/*
+	Split [0;count[ in job_count contiguous ranges, each submitted by a job running on the worker pool through its own encoder.
+	A job failing to acquire an encoder leaves its range to be submitted from the calling thread once all jobs are done.
+	submit accumulates its statistics to the provided structure and appends its draws to record if it is not null.
+*/
+static void SubmitDisplayLists(size_t count, size_t job_count,
+	const std::function<void(bgfx::Encoder &encoder, size_t begin, size_t end, DisplayListSubmitStats &stats, std::vector<DisplayListSubmitRecord> *record)>
+		&submit) {
+	if (job_count <= 1) {
+		auto encoder = bgfx::begin();
+		submit(*encoder, 0, count, display_list_submit_stats, display_list_submit_record);
+		bgfx::end(encoder);
+		return;
+	}
+
+	struct Job {
+		size_t begin, end;
+		DisplayListSubmitStats stats;
+		std::vector<DisplayListSubmitRecord> record;
+		bool submitted;
+	};
+
+	std::vector<Job> jobs(job_count);
+
+	for (size_t j = 0; j < job_count; ++j) {
+		jobs[j].begin = count * j / job_count;
+		jobs[j].end = count * (j + 1) / job_count;
+		jobs[j].submitted = false;
+	}
+
+	const bool record = display_list_submit_record != nullptr;
+
+	job_counter counter;
+
+	for (auto &job : jobs)
+		run_job(
+			[&submit, &job, record]() {
+				if (auto encoder = bgfx::begin(true)) {
+					submit(*encoder, job.begin, job.end, job.stats, record ? &job.record : nullptr);
+					bgfx::end(encoder);
+					job.submitted = true;
+				}
+			},
+			counter);
+
+	wait_jobs(counter);
+
+	for (auto &job : jobs) {
+		if (!job.submitted) {
+			auto encoder = bgfx::begin();
+			submit(*encoder, job.begin, job.end, job.stats, record ? &job.record : nullptr);
+			bgfx::end(encoder);
+			++display_list_submit_stats.fallback_job_count;
+		}
+
+		AccumulateDisplayListSubmitStats(display_list_submit_stats, job.stats);
+
+		if (record)
+			display_list_submit_record->insert(std::end(*display_list_submit_record), std::begin(job.record), std::end(job.record));
+	}
+
+	display_list_submit_stats.job_count += uint32_t(job_count);
+}
+
+//
+static std::mutex display_list_instancing_stats_mutex;
+static DisplayListInstancingStats display_list_instancing_stats;
+
+DisplayListInstancingStats GetDisplayListInstancingStats() {
+	std::lock_guard<std::mutex> lock(display_list_instancing_stats_mutex);
+	return display_list_instancing_stats;
+}
+
+void ResetDisplayListInstancingStats() {
+	std::lock_guard<std::mutex> lock(display_list_instancing_stats_mutex);
+	display_list_instancing_stats = {};
+}
+
+static void AccumulateDisplayListInstancingStats(const DisplayListInstancingStats &stats) {
+	std::lock_guard<std::mutex> lock(display_list_instancing_stats_mutex);
+	display_list_instancing_stats.instanced_draw_count += stats.instanced_draw_count;
+	display_list_instancing_stats.instance_count += stats.instance_count;
+	display_list_instancing_stats.saved_draw_count += stats.saved_draw_count;
+}
+
+static const uint16_t display_list_instance_stride = sizeof(float) * 12; // world matrix rows
+
+static bool IsSameModelDisplayListInstance(const ModelDisplayList &a, const ModelDisplayList &b) {
+	return a.mdl_idx == b.mdl_idx && a.lst_idx == b.lst_idx && IsSameMaterialState(*a.mat, *b.mat);
+}
+
+/*
+	Group display lists using a program with an instanced variant by model list and material and submit each group as a single draw.
+	Group order does not matter as no depth is provided. Display lists left to draw are output to non_instanced.
+*/
+static void _DrawModelDisplayListsInstanced(bgfx::ViewId view_id, const std::vector<ModelDisplayList> &display_lists, uint8_t pipeline_config_idx,
+	const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, const std::vector<Mat4> &mtxs, const PipelineResources &res,
+	std::vector<uint32_t> &non_instanced, DisplayListSubmitStats &stats) {
+	std::vector<uint32_t> instanced;
+	instanced.reserve(display_lists.size());
+
+	DisplayListInstancingStats instancing_stats;
+
+	for (uint32_t i = 0; i < display_lists.size(); ++i) {
+		const auto &dl = display_lists[i];
+		__ASSERT__(dl.mat != nullptr);
+
+		const auto &prg = res.programs.Get_unsafe_(dl.mat->program.ref.idx);
+
+		if (prg.instancing_variant_offset) {
+			GetMaterialBindings(*dl.mat, prg); // bake before comparing
+			instanced.push_back(i);
+		} else {
+			non_instanced.push_back(i);
+		}
+	}
+
+	std::sort(std::begin(instanced), std::end(instanced), [&](uint32_t i, uint32_t j) {
+		const auto &a = display_lists[i], &b = display_lists[j];
+		if (a.mdl_idx != b.mdl_idx)
+			return a.mdl_idx < b.mdl_idx;
+		if (a.lst_idx != b.lst_idx)
+			return a.lst_idx < b.lst_idx;
+		if (a.mat->bindings->hash != b.mat->bindings->hash)
+			return a.mat->bindings->hash < b.mat->bindings->hash;
+		return i < j;
+	});
+
+	auto encoder = bgfx::begin();
+
+	for (size_t first = 0; first < instanced.size();) {
+		const auto &dl = display_lists[instanced[first]];
+
+		size_t last = first + 1;
+		while (last < instanced.size() && IsSameModelDisplayListInstance(dl, display_lists[instanced[last]]))
+			++last;
+
+		auto count = uint32_t(last - first);
+		if (count > 1)
+			count = bgfx::getAvailInstanceDataBuffer(count, display_list_instance_stride);
+
+		if (count > 1) {
+			bgfx::InstanceDataBuffer idb;
+			bgfx::allocInstanceDataBuffer(&idb, count, display_list_instance_stride);
+
+			auto data = reinterpret_cast<float *>(idb.data);
+			for (uint32_t i = 0; i < count; ++i, data += 12)
+				memcpy(data, mtxs[display_lists[instanced[first + i]].mtx_idx].m, sizeof(float) * 12);
+
+			const auto &mdl = res.models.Get_unsafe_(dl.mdl_idx);
+
+			if (_RenderPipelineStageDisplayListInstanced(
+					*encoder, view_id, mdl.lists[dl.lst_idx], *dl.mat, pipeline_config_idx, res, values, textures, idb, stats)) {
+				++instancing_stats.instanced_draw_count;
+				instancing_stats.instance_count += count;
+				instancing_stats.saved_draw_count += count - 1;
+
+				first += count; // the rest of the group, if any, is processed as a new group
+				continue;
+			}
+		}
+
+		// single display list, out of instance data or missing instanced program, draw one by one
+		for (; first < last; ++first)
+			non_instanced.push_back(instanced[first]);
+	}
+
+	bgfx::end(encoder);
+
+	AccumulateDisplayListInstancingStats(instancing_stats);
+}
+
+/*
+	Compute the depth of each draw when no explicit draw order is given, draws of a run of consecutive display lists using the same material state share
+	the index + 1 of the run first draw. bgfx keeps draws with equal sort keys in submission order so a run is executed in sequence, whatever the view
+	mode, and all but its first draw can skip setting the material and pipeline state.
+	Material bindings must be up to date.
+*/
+template <typename T>
+static void ComputeDisplayListRunDepths(const std::vector<T> &display_lists, const uint32_t *idxs, size_t count, std::vector<uint32_t> &run_depths) {
+	run_depths.resize(count);
+
+	for (size_t j = 0; j < count; ++j) {
+		const auto &mat = *display_lists[idxs ? idxs[j] : j].mat;
+		const bool same_run = j > 0 && IsSameMaterialState(*display_lists[idxs ? idxs[j - 1] : j - 1].mat, mat);
+		run_depths[j] = same_run ? run_depths[j - 1] : uint32_t(j + 1);
+	}
+}
+
+/*
+	Submit display_lists[idxs[i]] for i in [begin;end[, or display_lists[i] if idxs is null.
+	Draws use the provided depths, or the run depths if depths is null, see ComputeDisplayListRunDepths.
+*/
+static void _SubmitModelDisplayLists(bgfx::Encoder &encoder, bgfx::ViewId view_id, const std::vector<ModelDisplayList> &display_lists,
+	const uint32_t *idxs, size_t begin, size_t end, const std::vector<uint32_t> *depths, const uint32_t *run_depths, uint8_t pipeline_config_idx,
+	const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, const std::vector<Mat4> &mtxs,
+	const std::vector<Mat4> *prv_mtxs, const PipelineResources &res, DisplayListSubmitStats &stats, std::vector<DisplayListSubmitRecord> *record) {
 	bgfxMatrix4 _mtx;
 	uint32_t mtx_idx = 0xffffffff, i_mtx = 0xffffffff; // last set_matrix
 
-	const auto dl_size = display_lists.size();
-	__ASSERT__(depths == nullptr || dl_size == depths->size());
+	DisplayListEncoderState state;
 
-	for (size_t i = 0; i < dl_size; ++i) {
+	for (size_t j = begin; j < end; ++j) {
+		const auto i = idxs ? idxs[j] : j;
 		const auto &dl = display_lists[i];
 
 		if (mtx_idx == dl.mtx_idx) {
-			bgfx::setTransform(i_mtx, 1); // reuse last cache index
+			encoder.setTransform(i_mtx, 1); // reuse last cache index
 		} else {
 			mtx_idx = dl.mtx_idx;
 			_mtx = to_bgfx(mtxs[mtx_idx]);
-			i_mtx = bgfx::setTransform(&_mtx, 1);
+			i_mtx = encoder.setTransform(&_mtx, 1);
 		}
 
 		if (prv_mtxs) {
 			_mtx = to_bgfx((*prv_mtxs)[dl.mtx_idx]);
-			bgfx::setUniform(u_previous_model, &_mtx, 1);
+			encoder.setUniform(u_previous_model, &_mtx, 1);
 		}
 
 		const auto &mdl = res.models.Get_unsafe_(dl.mdl_idx);
 		__ASSERT__(dl.mat != nullptr);
 
-		_RenderPipelineStageDisplayList(view_id, mdl.lists[dl.lst_idx], *dl.mat, pipeline_config_idx, res, values, textures, depths ? (*depths)[i] : 0);
+		const bool keep_state = run_depths && j + 1 < end && run_depths[j + 1] == run_depths[j];
+		const auto depth = depths ? (*depths)[i] : run_depths[j];
+
+		if (_RenderPipelineStageDisplayList(
+				encoder, view_id, mdl.lists[dl.lst_idx], *dl.mat, pipeline_config_idx, res, values, textures, depth, state, keep_state, stats) &&
+			record)
+			record->push_back({dl.mat, dl.mtx_idx, depth, dl.mdl_idx, dl.lst_idx, keep_state});
+	}
+}
+
+static void _DrawModelDisplayLists(bgfx::ViewId view_id, const std::vector<ModelDisplayList> &display_lists, const std::vector<uint32_t> *depths,
+	uint8_t pipeline_config_idx, const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, const std::vector<Mat4> &mtxs,
+	const std::vector<Mat4> *prv_mtxs, const PipelineResources &res) {
+	__ASSERT__(depths == nullptr || display_lists.size() == depths->size());
+
+	const uint32_t *idxs = nullptr; // draw all display lists
+	size_t count = display_lists.size();
+
+	/*
+		bgfx limits instance data to 5 vec4 which leaves no room for the previous world matrix next to the world matrix.
+		Passes requiring previous matrices or an explicit draw order are drawn one display list at a time.
+	*/
+	std::vector<uint32_t> non_instanced;
+
+	if (depths == nullptr && prv_mtxs == nullptr && (bgfx::getCaps()->supported & BGFX_CAPS_INSTANCING)) {
+		non_instanced.reserve(display_lists.size());
+
+		_DrawModelDisplayListsInstanced(view_id, display_lists, pipeline_config_idx, values, textures, mtxs, res, non_instanced, display_list_submit_stats);
+
+		idxs = non_instanced.data();
+		count = non_instanced.size();
 	}
+
+	const auto job_count = ComputeDisplayListSubmitJobCount(count);
+
+	if (job_count > 1 || depths == nullptr)
+		for (size_t j = 0; j < count; ++j)
+			_PrepareDisplayListSubmit(*display_lists[idxs ? idxs[j] : j].mat, pipeline_config_idx, res);
+
+	std::vector<uint32_t> run_depths;
+
+	if (depths == nullptr)
+		ComputeDisplayListRunDepths(display_lists, idxs, count, run_depths);
+
+	SubmitDisplayLists(
+		count, job_count, [&](bgfx::Encoder &encoder, size_t begin, size_t end, DisplayListSubmitStats &stats, std::vector<DisplayListSubmitRecord> *record) {
+			_SubmitModelDisplayLists(encoder, view_id, display_lists, idxs, begin, end, depths, depths ? nullptr : run_depths.data(), pipeline_config_idx,
+				values, textures, mtxs, prv_mtxs, res, stats, record);
+		});
 }
 
 void DrawModelDisplayLists(bgfx::ViewId view_id, const std::vector<ModelDisplayList> &display_lists, uint8_t pipeline_config_idx,
@@ -2154,15 +2864,84 @@ void DrawModelDisplayLists(bgfx::ViewId view_id, const std::vector<ModelDisplayL
 }
 
 //
-static void _DrawSkinnedModelDisplayLists(bgfx::ViewId view_id, const std::vector<SkinnedModelDisplayList> &display_lists, const std::vector<uint32_t> *depths,
-	uint8_t pipeline_config_idx, const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, const std::vector<Mat4> &mtxs,
-	const std::vector<Mat4> *prv_mtxs, const PipelineResources &res) {
+std::vector<uint32_t> ComputeModelDisplayListMaterialSortIds(const std::vector<ModelDisplayList> &display_lists) {
+	struct MaterialSortState {
+		uint32_t program, variant;
+		uint64_t hash;
+
+		bool operator<(const MaterialSortState &o) const {
+			return program != o.program ? program < o.program : (variant != o.variant ? variant < o.variant : hash < o.hash);
+		}
+		bool operator==(const MaterialSortState &o) const { return program == o.program && variant == o.variant && hash == o.hash; }
+	};
+
+	const auto count = display_lists.size();
+
+	std::vector<MaterialSortState> states(count);
+	for (size_t i = 0; i < count; ++i) {
+		const auto &mat = *display_lists[i].mat;
+		const uint64_t state[] = {mat.state.state, mat.state.rgba};
+		states[i] = {uint32_t(mat.program.ref.idx), mat.variant_idx, XXH64(state, sizeof(state), mat.bindings ? mat.bindings->hash : 0)};
+	}
+
+	auto unique_states = states;
+	std::sort(std::begin(unique_states), std::end(unique_states));
+	unique_states.erase(std::unique(std::begin(unique_states), std::end(unique_states)), std::end(unique_states));
+
+	__ASSERT__(unique_states.size() <= (1 << 24)); // material sort id range, see ComputeModelDisplayListSortKey
+
+	std::vector<uint32_t> ids(count);
+	for (size_t i = 0; i < count; ++i)
+		ids[i] = uint32_t(std::lower_bound(std::begin(unique_states), std::end(unique_states), states[i]) - std::begin(unique_states));
+	return ids;
+}
+
+uint64_t ComputeModelDisplayListSortKey(const ModelDisplayList &display_list, uint32_t material_id, const Mat4 &view, const std::vector<Mat4> &mtxs) {
+	__ASSERT__(material_id < (1 << 24));
+
+	const uint64_t material = material_id; // 24 bit
+	const uint64_t model = (uint64_t(display_list.mdl_idx) << 8) | (display_list.lst_idx & 0xff); // 24 bit, lists past 256 only lose batching
+	const uint64_t depth = to_bytesort_float((view * GetT(mtxs[display_list.mtx_idx])).z) >> 16; // 16 bit, sign, exponent and 7 bit of mantissa
+
+	return (material << 40) | (model << 16) | depth;
+}
+
+void SortModelDisplayLists(std::vector<ModelDisplayList> &display_lists, const Mat4 &view, const std::vector<Mat4> &mtxs, const PipelineResources &res) {
+	const auto count = display_lists.size();
+	if (count < 2)
+		return;
+
+	for (const auto &dl : display_lists) // sort keys use the material bindings hash
+		GetMaterialBindings(*dl.mat, res.programs.Get_unsafe_(dl.mat->program.ref.idx));
+
+	const auto material_ids = ComputeModelDisplayListMaterialSortIds(display_lists);
+
+	std::vector<bytesort_entry<uint64_t, uint32_t>> keys(count), swap(count);
+
+	parallel_for(count, 1024, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+			keys[i] = {ComputeModelDisplayListSortKey(display_lists[i], material_ids[i], view, mtxs), uint32_t(i)};
+	});
+
+	const auto sorted = bytesort(count, keys.data(), swap.data());
+
+	std::vector<ModelDisplayList> sorted_display_lists(count);
+	for (size_t i = 0; i < count; ++i)
+		sorted_display_lists[i] = display_lists[sorted[i].o];
+
+	display_lists = std::move(sorted_display_lists);
+}
+
+//
+static void _SubmitSkinnedModelDisplayLists(bgfx::Encoder &encoder, bgfx::ViewId view_id, const std::vector<SkinnedModelDisplayList> &display_lists,
+	size_t begin, size_t end, const std::vector<uint32_t> *depths, const uint32_t *run_depths, uint8_t pipeline_config_idx,
+	const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, const std::vector<Mat4> &mtxs,
+	const std::vector<Mat4> *prv_mtxs, const PipelineResources &res, DisplayListSubmitStats &stats, std::vector<DisplayListSubmitRecord> *record) {
 	bgfxMatrix4 _mtx[max_skinned_model_matrix_count] = {0};
 
-	const auto dl_size = display_lists.size();
-	__ASSERT__(depths == nullptr || dl_size == depths->size());
+	DisplayListEncoderState state;
 
-	for (size_t i = 0; i < dl_size; ++i) {
+	for (size_t i = begin; i < end; ++i) {
 		const auto &dl = display_lists[i];
 
 		__ASSERT__(dl.bone_count <= max_skinned_model_matrix_count);
@@ -2172,21 +2951,51 @@ static void _DrawSkinnedModelDisplayLists(bgfx::ViewId view_id, const std::vecto
 		for (int j = 0; j < dl.bone_count; ++j)
 			_mtx[j] = to_bgfx(mtxs[dl.mtx_idxs[j]] * mdl.bind_pose[dl.bones_idxs[j]]);
 
-		bgfx::setTransform(_mtx, dl.bone_count); // TODO [EJ] implement matrix caching here
+		encoder.setTransform(_mtx, dl.bone_count); // TODO [EJ] implement matrix caching here
 
 		if (prv_mtxs) {
 			for (int j = 0; j < dl.bone_count; ++j)
 				_mtx[j] = to_bgfx((*prv_mtxs)[dl.mtx_idxs[j]] * mdl.bind_pose[dl.bones_idxs[j]]);
 
-			bgfx::setUniform(u_previous_model, _mtx, dl.bone_count);
+			encoder.setUniform(u_previous_model, _mtx, dl.bone_count);
 		}
 
 		__ASSERT__(dl.mat != nullptr);
 
-		_RenderPipelineStageDisplayList(view_id, mdl.lists[dl.lst_idx], *dl.mat, pipeline_config_idx, res, values, textures, depths ? (*depths)[i] : 0);
+		const bool keep_state = run_depths && i + 1 < end && run_depths[i + 1] == run_depths[i];
+		const auto depth = depths ? (*depths)[i] : run_depths[i];
+
+		if (_RenderPipelineStageDisplayList(
+				encoder, view_id, mdl.lists[dl.lst_idx], *dl.mat, pipeline_config_idx, res, values, textures, depth, state, keep_state, stats) &&
+			record)
+			record->push_back({dl.mat, dl.mtx_idxs[0], depth, dl.mdl_idx, dl.lst_idx, keep_state});
 	}
 }
 
+static void _DrawSkinnedModelDisplayLists(bgfx::ViewId view_id, const std::vector<SkinnedModelDisplayList> &display_lists, const std::vector<uint32_t> *depths,
+	uint8_t pipeline_config_idx, const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, const std::vector<Mat4> &mtxs,
+	const std::vector<Mat4> *prv_mtxs, const PipelineResources &res) {
+	const auto dl_size = display_lists.size();
+	__ASSERT__(depths == nullptr || dl_size == depths->size());
+
+	const auto job_count = ComputeDisplayListSubmitJobCount(dl_size);
+
+	if (job_count > 1 || depths == nullptr)
+		for (const auto &dl : display_lists)
+			_PrepareDisplayListSubmit(*dl.mat, pipeline_config_idx, res);
+
+	std::vector<uint32_t> run_depths;
+
+	if (depths == nullptr)
+		ComputeDisplayListRunDepths(display_lists, nullptr, dl_size, run_depths);
+
+	SubmitDisplayLists(
+		dl_size, job_count, [&](bgfx::Encoder &encoder, size_t begin, size_t end, DisplayListSubmitStats &stats, std::vector<DisplayListSubmitRecord> *record) {
+			_SubmitSkinnedModelDisplayLists(encoder, view_id, display_lists, begin, end, depths, depths ? nullptr : run_depths.data(), pipeline_config_idx,
+				values, textures, mtxs, prv_mtxs, res, stats, record);
+		});
+}
+
 void DrawSkinnedModelDisplayLists(bgfx::ViewId view_id, const std::vector<SkinnedModelDisplayList> &display_lists, uint8_t pipeline_config_idx,
 	const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, const std::vector<Mat4> &mtxs, const PipelineResources &res) {
 	_DrawSkinnedModelDisplayLists(view_id, display_lists, nullptr, pipeline_config_idx, values, textures, mtxs, nullptr, res);
@@ -2245,6 +3054,130 @@ MaterialRef LoadMaterialRefFromAssets(
 }
 
 //
+static size_t GetImageMipChainSize(const bimg::ImageContainer &image, uint8_t mip) {
+	bimg::ImageMip image_mip;
+	if (!bimg::imageGetRawData(image, 0, mip, image.m_data, image.m_size, image_mip))
+		return image.m_size;
+	return image.m_size - size_t(image_mip.m_data - static_cast<const uint8_t *>(image.m_data));
+}
+
+static bool IsStreamable(const bimg::ImageContainer &image) {
+	return !image.m_cubeMap && image.m_depth == 1 && image.m_numLayers == 1 && image.m_numMips > 1 &&
+		   bgfx::isTextureValid(0, true, 1, bgfx::TextureFormat::Enum(image.m_format), 0);
+}
+
+/// Advance a queued texture load by at most budget bytes, return true once the texture is complete.
+static bool StreamTextureLoad(PipelineResources &res, TextureLoad &t, size_t budget, size_t &uploaded, bool silent) {
+	auto &tex = res.textures.Get(t.ref);
+	const auto name = res.textures.GetName(t.ref);
+
+	if (!t.image) {
+		if (!silent)
+			debug(format("Queued texture load '%1'").arg(name));
+
+		const auto data = LoadData(t.ir, ScopedReadHandle(t.ip, name.c_str(), silent));
+
+		if (data.GetSize() == 0) {
+			if (!silent)
+				warn(format("Failed to load texture '%1', could not load data").arg(name).c_str());
+			return true;
+		}
+
+		auto image = bimg::imageParse(&g_allocator, data.GetData(), numeric_cast<uint32_t>(data.GetSize()), bimg::TextureFormat::Count);
+
+		if (!image || !IsStreamable(*image) || image->m_size <= budget) {
+			uploaded += image ? image->m_size : 0;
+
+			bgfx::TextureInfo info;
+			tex = CreateTextureFromImage(image, name.c_str(), tex.flags, &info, silent);
+			res.texture_infos[t.ref.ref] = info;
+			return true;
+		}
+
+		t.image = std::shared_ptr<bimg::ImageContainer>(image, bimg::imageFree);
+
+		const auto tex_format = bgfx::TextureFormat::Enum(image->m_format);
+
+		// create a low resolution texture from the smallest mips fitting the budget
+		uint8_t mip = image->m_numMips - 1;
+		while (mip > 1 && GetImageMipChainSize(*image, mip - 1) <= budget)
+			--mip;
+
+		bimg::ImageMip image_mip;
+		bimg::imageGetRawData(*image, 0, mip, image->m_data, image->m_size, image_mip);
+
+		const auto chain_size = GetImageMipChainSize(*image, mip);
+		const auto handle = bgfx::createTexture2D(uint16_t(Max(image->m_width >> mip, 1u)), uint16_t(Max(image->m_height >> mip, 1u)),
+			mip < image->m_numMips - 1, 1, tex_format, tex.flags, bgfx::copy(image_mip.m_data, numeric_cast<uint32_t>(chain_size)));
+		uploaded += chain_size;
+
+		if (bgfx::isValid(handle))
+			bgfx::setName(handle, name.c_str());
+		tex = MakeTexture(handle, tex.flags);
+
+		// the full resolution texture is uploaded from its smallest mip up, starting with what is left of the budget
+		t.pending = bgfx::createTexture2D(uint16_t(image->m_width), uint16_t(image->m_height), true, 1, tex_format, tex.flags);
+		t.mip = image->m_numMips - 1;
+		t.row = 0;
+
+		bgfx::TextureInfo info;
+		bgfx::calcTextureSize(info, uint16_t(image->m_width), uint16_t(image->m_height), 1, false, true, 1, tex_format);
+		res.texture_infos[t.ref.ref] = info;
+	}
+
+	const auto &image = *t.image;
+	const auto &block_info = bimg::getBlockInfo(image.m_format);
+
+	while (uploaded < budget) {
+		bimg::ImageMip image_mip;
+		bimg::imageGetRawData(image, 0, t.mip, image.m_data, image.m_size, image_mip);
+
+		const uint32_t mip_width = Max(image.m_width >> t.mip, 1u), mip_height = Max(image.m_height >> t.mip, 1u);
+
+		const uint32_t block_row_count = Max(image_mip.m_height / block_info.blockHeight, 1u);
+		const uint32_t block_row_size = image_mip.m_size / block_row_count;
+
+		// upload as many block rows as the budget allows, at least one
+		const uint32_t row_count = uint32_t(Max(Min<size_t>((budget - uploaded) / block_row_size, block_row_count - t.row), size_t(1)));
+
+		const uint32_t y = t.row * block_info.blockHeight;
+		const uint32_t height = Min(row_count * block_info.blockHeight, mip_height - Min(y, mip_height));
+
+		bgfx::updateTexture2D(t.pending, 0, t.mip, 0, uint16_t(y), uint16_t(mip_width), uint16_t(height),
+			bgfx::copy(image_mip.m_data + t.row * block_row_size, row_count * block_row_size));
+		uploaded += row_count * block_row_size;
+
+		t.row += row_count;
+
+		if (t.row < block_row_count)
+			continue;
+
+		if (t.mip == 0) {
+			if (bgfx::isValid(tex.handle))
+				bgfx::destroy(tex.handle);
+
+			bgfx::setName(t.pending, name.c_str());
+			tex = MakeTexture(t.pending, tex.flags);
+
+			t.pending = BGFX_INVALID_HANDLE;
+			t.image.reset();
+			return true;
+		}
+
+		--t.mip;
+		t.row = 0;
+	}
+
+	return false;
+}
+
+static void DropTextureLoad(TextureLoad &t) {
+	if (bgfx::isValid(t.pending))
+		bgfx::destroy(t.pending);
+	t.pending = BGFX_INVALID_HANDLE;
+	t.image.reset();
+}
+
 size_t ProcessTextureLoadQueue(PipelineResources &res, time_ns t_budget, bool silent) {
 	ProfilerPerfSection section("ProcessTextureLoadQueue");
 
@@ -2252,23 +3185,34 @@ size_t ProcessTextureLoadQueue(PipelineResources &res, time_ns t_budget, bool si
 
 	const auto t_start = time_now();
 
-	while (!res.texture_loads.empty()) {
-		const auto &t = res.texture_loads.front();
+	SortLoadQueue(res.texture_loads, res.texture_loads_sorted);
 
-		if (res.textures.IsValidRef(t.ref)) {
-			auto &tex = res.textures.Get(t.ref);
-			const auto name = res.textures.GetName(t.ref);
-			debug(format("Queued texture load '%1'").arg(name));
+	auto &stats = res.texture_load_stats;
+	stats.uploaded_size = 0;
 
-			bgfx::TextureInfo info;
-			tex = LoadTexture(t.ir, t.ip, name.c_str(), tex.flags, &info, nullptr, silent);
-			res.texture_infos[t.ref.ref] = info;
-		}
+	while (!res.texture_loads.empty()) {
+		auto &t = res.texture_loads.front();
 
-		res.texture_loads.pop_front();
+		if (!res.textures.IsValidRef(t.ref)) {
+			DropTextureLoad(t); // texture destroyed while queued
+			res.texture_loads.pop_front();
+			continue;
+		}
 
 		++processed;
 
+		if (StreamTextureLoad(res, t, res.texture_upload_budget, stats.uploaded_size, silent)) {
+			const auto latency = time_now() - t.t_queued;
+			stats.total_latency += latency;
+			stats.max_latency = Max(stats.max_latency, latency);
+			++stats.completed_count;
+
+			res.texture_loads.pop_front();
+		}
+
+		if (stats.uploaded_size >= res.texture_upload_budget)
+			break;
+
 		const auto elapsed = time_now() - t_start;
 		if (elapsed >= t_budget)
 			break;
@@ -2277,13 +3221,53 @@ size_t ProcessTextureLoadQueue(PipelineResources &res, time_ns t_budget, bool si
 	return processed;
 }
 
+void SetTextureLoadPriority(PipelineResources &res, TextureRef ref, float priority) {
+	SetLoadPriority(res.texture_loads, res.texture_loads_sorted, ref, priority);
+}
+
+void UpdateTextureLoadPriorities(PipelineResources &res, const std::vector<ModelDisplayList> &display_lists, const std::vector<Mat4> &mtxs, const Vec3 &view_pos) {
+	if (res.texture_loads.empty())
+		return;
+
+	std::map<gen_ref, TextureLoad *> loads;
+	for (auto &t : res.texture_loads) {
+		t.priority = 0.f;
+		loads[t.ref.ref] = &t;
+	}
+
+	for (const auto &dl : display_lists) {
+		const auto &bounds = res.models.Get_unsafe_(dl.mdl_idx).bounds;
+		if (dl.lst_idx >= bounds.size())
+			continue;
+
+		// approximate the display list size on screen from its bounding sphere
+		const auto world_bounds = mtxs[dl.mtx_idx] * bounds[dl.lst_idx];
+		const float radius = Len(world_bounds.mx - world_bounds.mn) * 0.5f;
+		const float priority = radius / Max(Dist(view_pos, (world_bounds.mn + world_bounds.mx) * 0.5f), radius, 0.001f);
+
+		for (const auto &i : dl.mat->textures) {
+			const auto load = loads.find(i.second.texture.ref);
+			if (load != std::end(loads))
+				load->second->priority = Max(load->second->priority, priority);
+		}
+	}
+
+	res.texture_loads_sorted = IsLoadQueueSorted(res.texture_loads); // a linear check, the queue is only sorted if the priorities changed its order
+}
+
 TextureRef QueueLoadTexture(const Reader &ir, const ReadProvider &ip, const char *name, uint64_t flags, PipelineResources &resources) {
 	auto ref = resources.textures.Has(name);
 	if (ref != InvalidTextureRef)
 		return ref;
 
 	ref = resources.textures.Add(name, {flags, bgfx::kInvalidHandle});
-	resources.texture_loads.push_back({ir, ip, ref});
+
+	TextureLoad load;
+	load.ir = ir;
+	load.ip = ip;
+	load.ref = ref;
+	load.t_queued = time_now();
+	QueueLoad(resources.texture_loads, resources.texture_loads_sorted, std::move(load));
 	return ref;
 }
 
@@ -2645,6 +3629,8 @@ static void DumpRenderPipelineInfos() {
 //
 bool IsRenderUp() { return bgfx_is_up; }
 
+void SetRenderWorkerCount(int count) { render_worker_count = count; }
+
 bool RenderInit(Window *window, bgfx::RendererType::Enum type, bgfx::CallbackI *callback) {
 	bgfx::PlatformData pd;
 	bx::memSet(&pd, 0, sizeof(pd));
@@ -2652,6 +3638,10 @@ bool RenderInit(Window *window, bgfx::RendererType::Enum type, bgfx::CallbackI *
 	pd.nwh = GetWindowHandle(window);
 	bgfx::setPlatformData(pd);
 
+#if BGFX_CONFIG_MULTITHREADED
+	bgfx::renderFrame(); // render from the calling thread, jobs can still submit through their own encoder
+#endif
+
 	bgfx::Init init;
 	// bx::memSet(&init, 0, sizeof(bgfx::Init));
 
@@ -2672,7 +3662,6 @@ bool RenderInit(Window *window, bgfx::RendererType::Enum type, bgfx::CallbackI *
 	init.resolution.height = h;
 
 	init.resolution.maxFrameLatency = 1; // 0 is default (3) for DX11
-	// bgfx::renderFrame();
 
 	//
 	if (!bgfx::init(init))
@@ -2685,6 +3674,11 @@ bool RenderInit(Window *window, bgfx::RendererType::Enum type, bgfx::CallbackI *
 	const bgfx::Caps *caps = bgfx::getCaps();
 	SetNDCInfos(caps->originBottomLeft, caps->homogeneousDepth);
 
+	if (render_worker_count >= 0 && get_worker_count() == 0) {
+		start_workers(render_worker_count);
+		render_started_workers = true;
+	}
+
 	bgfx_is_up = true;
 	return true;
 }
@@ -2726,6 +3720,11 @@ Window *RenderInit(
 }
 
 void RenderShutdown() {
+	if (render_started_workers) {
+		stop_workers();
+		render_started_workers = false;
+	}
+
 	bgfx::shutdown();
 	bgfx_is_up = false;
 }
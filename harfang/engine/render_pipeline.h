@@ -24,6 +24,7 @@
 #include <deque>
 #include <functional>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -66,6 +67,11 @@ Mat4 ComputeBillboardMat4(const Vec3 &pos, const ViewState &view_state, const Ve
 //
 struct Window;
 
+/**
+	@short Initialize the renderer, the calling thread becomes the API thread and must be used for all subsequent calls to Frame and RenderShutdown.
+	When bgfx is built multithreaded (see the HG_ENABLE_BGFX_MULTITHREADED CMake option) `bgfx::renderFrame()` is called before `bgfx::init()` so that bgfx
+	renders from the calling thread instead of spawning its own render thread. An application initializing bgfx by itself must do the same.
+*/
 bool RenderInit(Window *window, bgfx::RendererType::Enum type, bgfx::CallbackI *callback = nullptr);
 bool RenderInit(Window *window, bgfx::CallbackI *callback = nullptr);
 
@@ -82,6 +88,14 @@ void RenderShutdown();
 
 bool IsRenderUp();
 
+/**
+	@short Set the number of workers started by RenderInit.
+	A count of 0 starts one worker per logical thread minus the calling thread, a negative count does not start the worker pool.
+	@note A worker pool started before RenderInit is left untouched, RenderShutdown only stops the worker pool started by RenderInit.
+	@see start_workers.
+*/
+void SetRenderWorkerCount(int count);
+
 /// Fit the backbuffer to the specified window client area dimensions, return true if resizing was carried out.
 bool RenderResetToWindow(Window *win, int &width, int &height, uint32_t reset_flags = 0);
 
@@ -148,6 +162,8 @@ enum PipelineProgramFeature {
 	OptionalSkinning, // ENABLE_SKINNING
 	OptionalAlphaCut, // ENABLE_ALPHA_CUT
 
+	OptionalInstancing, // ENABLE_INSTANCING
+
 	Count,
 };
 
@@ -199,6 +215,9 @@ struct PipelineProgram {
 	PipelineInfo pipeline;
 	ReadProvider ip;
 	Reader ir;
+
+	uint32_t revision{0}; // unique per loaded program, used to detect a program update by baked material bindings
+	uint32_t instancing_variant_offset{0}; // added to a variant index to select its instanced version, 0 if the program has no OptionalInstancing feature
 };
 
 PipelineProgram LoadPipelineProgram(
@@ -221,8 +240,12 @@ struct DisplayList { // 4B
 	bgfx::IndexBufferHandle index_buffer;
 	bgfx::VertexBufferHandle vertex_buffer;
 	std::vector<uint16_t> bones_table;
+	std::vector<MinMax> bones_bounds; // bind pose bounds of the vertices influenced by each bones table entry, empty if an entry influences no vertex
 };
 
+/// Compute the bind pose bounds of the vertices influenced by each of the bone_count entries of a display list bones table.
+std::vector<MinMax> ComputeDisplayListBonesBounds(const bgfx::VertexLayout &decl, const void *vtx_data, uint32_t vtx_size, size_t bone_count);
+
 /// Create an empty texture.
 /// @see CreateTextureFromPicture and UpdateTextureFromPicture.
 Texture CreateTexture(int width, int height, const char *name, uint64_t flags, bgfx::TextureFormat::Enum format = bgfx::TextureFormat::RGBA8);
@@ -313,7 +336,10 @@ static const int MF_AmbientUV1 = 0x08;
 static const int MF_NormalMapInWorldSpace = 0x10;
 static const int MF_EnableAlphaCut = 0x20;
 
-struct Material { // 56B
+struct MaterialBindings;
+
+/// @note Values, textures and program must be modified through the SetMaterialXXX functions so that the material bindings are rebuilt.
+struct Material { // 72B (+heap)
 	PipelineProgramRef program;
 	uint32_t variant_idx{0};
 
@@ -339,6 +365,11 @@ struct Material { // 56B
 	RenderState state;
 
 	uint8_t flags{0};
+
+	uint32_t revision{0}; // bumped when values, textures or program change
+
+	/// Material values and textures merged with the program default uniforms, rebuilt on draw when outdated. Shared by copies of the material.
+	mutable std::shared_ptr<const MaterialBindings> bindings;
 };
 
 Material CreateMaterial(PipelineProgramRef prg);
@@ -415,12 +446,31 @@ bgfx::VertexLayout VertexLayoutPosFloatColorUInt8();
 bgfx::VertexLayout VertexLayoutPosFloatTexCoord0UInt8();
 bgfx::VertexLayout VertexLayoutPosFloatNormUInt8TexCoord0UInt8();
 
+/// Position only copy of a model geometry kept in system memory to be rasterized by the software occlusion culling.
+struct OccluderMesh {
+	std::vector<Vec3> vtx;
+	std::vector<uint32_t> idx; // triangle list
+};
+
+/// Append a display list geometry to an occluder mesh.
+void AppendOccluderMesh(OccluderMesh &occluder, const bgfx::VertexLayout &decl, const void *vtx_data, uint32_t vtx_size, const void *idx_data,
+	uint32_t idx_size, uint8_t idx_type_size);
+
+/*!
+	Set the maximum triangle count of a model for an occluder mesh to be kept when it is loaded or built, 0 (default) does not keep any occluder mesh.
+	@see Model::occluder and NF_Occluder.
+*/
+void SetModelOccluderMaxTriangleCount(uint32_t count);
+/// Return the maximum triangle count of a model for an occluder mesh to be kept when it is loaded or built.
+uint32_t GetModelOccluderMaxTriangleCount();
+
 //
-struct Model { // 96B (+heap)
+struct Model { // 144B (+heap)
 	std::vector<MinMax> bounds; // minmax/list
 	std::vector<DisplayList> lists;
 	std::vector<uint16_t> mats; // material/list
 	std::vector<Mat4> bind_pose; // bind pose matrices
+	OccluderMesh occluder; // empty unless the model triangle count is within GetModelOccluderMaxTriangleCount()
 };
 
 struct ModelInfo {
@@ -443,12 +493,30 @@ struct TextureLoad {
 	Reader ir;
 	ReadProvider ip;
 	TextureRef ref;
+
+	float priority{0.f}; // higher priority loads are processed first
+	time_ns t_queued{0};
+
+	// large 2D textures are streamed over several frames, a low resolution version is created from their smallest mips first, then the full resolution
+	// texture is uploaded mip by mip starting from the smallest one and replaces it once complete
+	std::shared_ptr<bimg::ImageContainer> image;
+	bgfx::TextureHandle pending = BGFX_INVALID_HANDLE;
+	uint8_t mip{0}; // next mip to upload to the pending texture
+	uint32_t row{0}; // next block row to upload in this mip
+};
+
+struct TextureLoadStats {
+	size_t uploaded_size{0}; // bytes uploaded by the last call to ProcessTextureLoadQueue
+	size_t completed_count{0};
+	time_ns total_latency{0}, max_latency{0}; // time between queuing and completing a texture load
 };
 
 struct ModelLoad {
 	Reader ir;
 	ReadProvider ip;
 	ModelRef ref;
+
+	float priority{0.f}; // higher priority loads are processed first
 };
 
 struct PipelineResources {
@@ -461,17 +529,30 @@ struct PipelineResources {
 	ResourceCache<Model, ModelRef> models;
 
 	std::deque<TextureLoad> texture_loads;
+	bool texture_loads_sorted{true}; // cleared when a priority change requires sorting the queue again
 	std::map<gen_ref, bgfx::TextureInfo> texture_infos;
 
+	size_t texture_upload_budget{16 * 1024 * 1024}; // maximum size of the texture data uploaded by each call to ProcessTextureLoadQueue
+	TextureLoadStats texture_load_stats;
+
 	std::deque<ModelLoad> model_loads;
+	bool model_loads_sorted{true};
 	std::map<gen_ref, ModelInfo> model_infos;
 
 	void DestroyAll();
 };
 
-//
+/*!
+	Process queued texture loads by decreasing priority until either the time budget or the upload budget of the resources is exceeded, return the number
+	of loads processed. Large 2D textures are streamed across several calls, other textures are uploaded at once.
+	The queue is only sorted again when a priority changed since the previous call.
+	@see PipelineResources::texture_upload_budget and SetTextureLoadPriority.
+*/
 size_t ProcessTextureLoadQueue(PipelineResources &resources, time_ns t_budget = time_from_ms(4), bool silent = false);
 
+/// Set the priority of a queued texture load, this function has no effect if the texture is not queued for loading.
+void SetTextureLoadPriority(PipelineResources &resources, TextureRef ref, float priority);
+
 TextureRef QueueLoadTexture(const Reader &ir, const ReadProvider &ip, const char *name, uint64_t flags, PipelineResources &resources);
 TextureRef QueueLoadTextureFromFile(const char *path, uint64_t flags, PipelineResources &resources);
 TextureRef QueueLoadTextureFromAssets(const char *name, uint64_t flags, PipelineResources &resources);
@@ -479,8 +560,10 @@ TextureRef QueueLoadTextureFromAssets(const char *name, uint64_t flags, Pipeline
 TextureRef SkipLoadOrQueueTextureLoad(
 	const Reader &ir, const ReadProvider &ip, const char *path, PipelineResources &resources, bool queue_load, bool do_not_load, bool silent = false);
 
-//
+/// Process queued model loads by decreasing priority until the time budget is exceeded, return the number of loads processed.
 size_t ProcessModelLoadQueue(PipelineResources &resources, time_ns t_budget = time_from_ms(4), bool silent = false);
+/// Set the priority of a queued model load, this function has no effect if the model is not queued for loading.
+void SetModelLoadPriority(PipelineResources &resources, ModelRef ref, float priority);
 ModelRef QueueLoadModel(const Reader &ir, const ReadProvider &ip, const char *name, PipelineResources &resources);
 
 ModelRef QueueLoadModelFromFile(const char *path, PipelineResources &resources);
@@ -581,8 +664,30 @@ struct ModelDisplayList { // 16B
 	uint16_t lst_idx; // 2
 };
 
+/// Model occluding other display lists in the software occlusion culling.
+/// @see OcclusionBuffer.
+struct ModelOccluder {
+	uint32_t mtx_idx;
+	uint16_t mdl_idx;
+};
+
 void CullModelDisplayLists(const Frustum &frustum, std::vector<ModelDisplayList> &display_lists, const std::vector<Mat4> &mtxs, const PipelineResources &res);
 
+/*!
+	Cull display lists against up to 32 frustums in a single pass, the world bound of each display list is computed once and tested against all frustums.
+	visibility receives a bitmask per display list with bit n set if it is visible from frustums[n]. Display lists visible from frustums[n] are output in
+	order to culled_display_lists[n], a null entry skips the output for this frustum.
+*/
+void CullModelDisplayLists(const std::vector<Frustum> &frustums, const std::vector<ModelDisplayList> &display_lists, const std::vector<Mat4> &mtxs,
+	const PipelineResources &res, std::vector<uint32_t> &visibility, const std::vector<std::vector<ModelDisplayList> *> &culled_display_lists);
+
+/*!
+	Set the priority of queued texture loads from their use by a set of display lists, textures covering a larger part of the view are loaded first.
+	Textures not used by any display list are reset to the lowest priority.
+*/
+void UpdateTextureLoadPriorities(
+	PipelineResources &resources, const std::vector<ModelDisplayList> &display_lists, const std::vector<Mat4> &mtxs, const Vec3 &view_pos);
+
 void DrawModelDisplayLists(bgfx::ViewId view_id, const std::vector<ModelDisplayList> &display_lists, uint8_t pipeline_config_idx,
 	const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, const std::vector<Mat4> &mtxs, const PipelineResources &res);
 void DrawModelDisplayLists(bgfx::ViewId view_id, const std::vector<ModelDisplayList> &display_lists, const std::vector<uint32_t> &depths,
@@ -592,6 +697,80 @@ void DrawModelDisplayLists(bgfx::ViewId view_id, const std::vector<ModelDisplayL
 	const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, const std::vector<Mat4> &mtxs,
 	const std::vector<Mat4> &prv_mtxs, const PipelineResources &res);
 
+/*!
+	Display lists drawn without depth sort keys are grouped by model list and identical material, groups are submitted as a single instanced draw if
+	the material program declares the OptionalInstancing feature. The instance world matrix is passed as three rows in i_data0 to i_data2.
+*/
+struct DisplayListInstancingStats {
+	uint32_t instanced_draw_count{0}; // instanced draws submitted
+	uint32_t instance_count{0}; // display lists drawn through instanced draws
+	uint32_t saved_draw_count{0}; // draws saved by instancing
+};
+
+/// Return the display list instancing statistics accumulated since the last call to ResetDisplayListInstancingStats().
+DisplayListInstancingStats GetDisplayListInstancingStats();
+/// Reset the display list instancing statistics, call once per frame to get per frame statistics.
+void ResetDisplayListInstancingStats();
+
+/*!
+	Display lists can be submitted by jobs running on the worker pool, each job submitting a contiguous range of display lists through its own bgfx
+	encoder. Draws are submitted with the same state and sort key as from a single thread so the rendered frame is identical.
+
+	Display lists drawn without depth sort keys are submitted in runs of consecutive display lists using the same material state. Draws of a run share
+	the same sort key so that bgfx executes them in sequence, only the first draw of a run sets the material and pipeline uniforms and textures.
+	Sort display lists with SortModelDisplayLists to get the longest runs.
+	@see start_workers.
+*/
+struct DisplayListSubmitStats {
+	uint32_t draw_count{0}; // draws submitted
+	uint32_t job_count{0}; // jobs used to submit display lists
+	uint32_t fallback_job_count{0}; // jobs which could not acquire an encoder and were submitted from the calling thread
+
+	uint32_t program_change_count{0}; // draws using a different program than the previous draw from the same encoder
+	uint32_t texture_change_count{0}; // textures set
+	uint32_t uniform_change_count{0}; // uniforms set
+	uint32_t elided_state_count{0}; // draws which did not set any material or pipeline uniform and texture
+};
+
+/// Set the maximum number of jobs used to submit a batch of display lists, 1 (default) submits from the calling thread only.
+void SetDisplayListSubmitJobCount(int count);
+/// Return the maximum number of jobs used to submit a batch of display lists.
+int GetDisplayListSubmitJobCount();
+
+/// Return the display list submission statistics accumulated since the last call to ResetDisplayListSubmitStats().
+DisplayListSubmitStats GetDisplayListSubmitStats();
+/// Reset the display list submission statistics, call once per frame to get per frame statistics.
+void ResetDisplayListSubmitStats();
+
+/// Draw submitted by DrawModelDisplayLists or DrawSkinnedModelDisplayLists, see SetDisplayListSubmitRecord.
+struct DisplayListSubmitRecord {
+	const Material *mat;
+	uint32_t mtx_idx; // first matrix of a skinned display list
+	uint32_t depth;
+	uint16_t mdl_idx, lst_idx;
+	bool keep_state; // material and pipeline state left bound for the next draw from the same encoder
+};
+
+/*!
+	Record the draws submitted by DrawModelDisplayLists and DrawSkinnedModelDisplayLists, pass nullptr to stop recording. Draws submitted by jobs are
+	appended in job order once all jobs are done so the record is in the same order whatever the job count. Instanced draws are not recorded.
+*/
+void SetDisplayListSubmitRecord(std::vector<DisplayListSubmitRecord> *record);
+
+/*!
+	Compute the material sort id of each display list, ids are dense and ordered by program, program variant then material state.
+	The material bindings must be up to date.
+	@see ComputeModelDisplayListSortKey.
+*/
+std::vector<uint32_t> ComputeModelDisplayListMaterialSortIds(const std::vector<ModelDisplayList> &display_lists);
+/*!
+	Compute the sort key of a display list: material sort id (24 bit), model list (24 bit) then front-to-back view depth (16 bit) from most to least significant.
+	@see ComputeModelDisplayListMaterialSortIds, SortModelDisplayLists.
+*/
+uint64_t ComputeModelDisplayListSortKey(const ModelDisplayList &display_list, uint32_t material_id, const Mat4 &view, const std::vector<Mat4> &mtxs);
+/// Sort display lists to minimize state changes when drawing them, sort keys are computed in parallel on the worker pool then radix sorted.
+void SortModelDisplayLists(std::vector<ModelDisplayList> &display_lists, const Mat4 &view, const std::vector<Mat4> &mtxs, const PipelineResources &res);
+
 //
 struct SkinnedModelDisplayList { // 782B
 	const Material *mat; // 8
@@ -602,6 +781,20 @@ struct SkinnedModelDisplayList { // 782B
 	uint16_t lst_idx; // 2
 };
 
+/*!
+	Compute the world bounds of a skinned display list by expanding the bind pose bounds of each bone by its current matrix.
+	Return false if the display list has no bone bounds, it must then be considered visible.
+*/
+bool ComputeSkinnedModelDisplayListBounds(const SkinnedModelDisplayList &display_list, const std::vector<Mat4> &mtxs, const PipelineResources &res, MinMax &bounds);
+
+void CullSkinnedModelDisplayLists(
+	const Frustum &frustum, std::vector<SkinnedModelDisplayList> &display_lists, const std::vector<Mat4> &mtxs, const PipelineResources &res);
+/// Cull skinned display lists against up to 32 frustums in a single pass.
+/// @see CullModelDisplayLists.
+void CullSkinnedModelDisplayLists(const std::vector<Frustum> &frustums, const std::vector<SkinnedModelDisplayList> &display_lists,
+	const std::vector<Mat4> &mtxs, const PipelineResources &res, std::vector<uint32_t> &visibility,
+	const std::vector<std::vector<SkinnedModelDisplayList> *> &culled_display_lists);
+
 void DrawSkinnedModelDisplayLists(bgfx::ViewId view_id, const std::vector<SkinnedModelDisplayList> &display_lists, uint8_t pipeline_config_idx,
 	const std::vector<UniformSetValue> &values, const std::vector<UniformSetTexture> &textures, const std::vector<Mat4> &mtxs, const PipelineResources &res);
 void DrawSkinnedModelDisplayLists(bgfx::ViewId view_id, const std::vector<SkinnedModelDisplayList> &display_lists, const std::vector<uint32_t> &depths,
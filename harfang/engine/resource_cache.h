@@ -49,6 +49,7 @@ public:
 		if (resources.is_valid(ref.ref)) {
 			_destroy(resources[ref.ref.idx].T_);
 			resources[ref.ref.idx].T_ = res;
+			++revision;
 		}
 	}
 
@@ -56,6 +57,7 @@ public:
 		if (resources.is_valid(ref.ref)) {
 			_destroy(resources[ref.ref.idx].T_);
 			resources[ref.ref.idx].T_ = std::move(res);
+			++revision;
 		}
 	}
 
@@ -64,6 +66,7 @@ public:
 			_destroy(resources[ref.ref.idx].T_);
 			name_to_ref.erase(resources[ref.ref.idx].name); // drop from cache
 			resources.remove_ref(ref.ref);
+			++revision;
 		}
 	}
 
@@ -72,8 +75,12 @@ public:
 			_destroy(i.T_);
 		resources.clear();
 		name_to_ref.clear();
+		++revision;
 	}
 
+	/// Return a counter bumped each time a resource is updated or destroyed, adding resources leaves it unchanged.
+	uint32_t GetRevision() const { return revision; }
+
 	bool IsValidRef(R ref) const { return resources.is_valid(ref.ref); }
 
 	// get a resource index for code that does not carry a full reference to the resource.
@@ -138,6 +145,8 @@ private:
 	std::map<const std::string, R> name_to_ref;
 
 	void (*_destroy)(T &) = nullptr;
+
+	uint32_t revision{0};
 };
 
 } // namespace hg
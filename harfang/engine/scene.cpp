@@ -13,10 +13,15 @@
 #include "foundation/format.h"
 #include "foundation/log.h"
 #include "foundation/pack_float.h"
+#include "foundation/profiler.h"
 #include "foundation/string.h"
 
 #include "json/json.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
 #include <numeric>
 #include <set>
 
@@ -39,14 +44,21 @@ void Scene::SetProbe(TextureRef irradiance, TextureRef radiance, TextureRef brdf
 }
 
 //
-static void _ResizeComponents(std::vector<ComponentRef> &cs) {
-	ptrdiff_t i;
-	for (i = cs.size() - 1; i >= 0; --i)
-		if (cs[i] != invalid_gen_ref)
-			break;
-	cs.resize(i + 1);
+static void _ResizeComponents(gen_ref_list_table<ComponentRef> &table, NodeRef ref) {
+	const auto cs = table.get(ref);
+
+	size_t count = cs.size();
+	while (count > 0 && cs[count - 1] == invalid_gen_ref)
+		--count;
+
+	table.resize(ref, count);
 }
 
+//
+static std::atomic<uint32_t> scripts_revision_counter{0};
+
+void Scene::BumpScriptsRevision() { scripts_revision = ++scripts_revision_counter; } // unique across all scenes
+
 //
 void Scene::Clear() {
 	// physic world
@@ -79,161 +91,205 @@ void Scene::Clear() {
 	scene_scripts.clear();
 	node_scripts.clear();
 
+	BumpScriptsRevision();
+
+	// garbage collection
+	for (auto &counts : component_ref_counts)
+		counts.clear();
+
+	garbage_components.clear();
+	garbage_components_capacity = garbage_queue_min_capacity;
+	garbage_views.clear();
+
+	anim_ref_counts.clear();
+	garbage_anims.clear();
+	garbage_anims_capacity = garbage_queue_min_capacity;
+
 	//
 	current_camera = {};
 	transform_worlds.clear();
 
+	object_index = {};
+	light_index = {};
+
+	spatial_index_built = spatial_index_rescan = spatial_index_shared_transforms = false;
+	spatial_index_dirty_nodes.clear();
+	spatial_index_dirty_transforms.clear();
+	spatial_index_transform_nodes.clear();
+
 	environment = {};
 
 	//
 	key_values.clear();
 }
 
-size_t Scene::GarbageCollectPass() {
-	size_t removed_count = 0;
+//
+template <typename C> static void AcquireRef(std::vector<C> &counts, gen_ref ref) {
+	if (ref.idx == invalid_gen_ref.idx)
+		return;
 
-#define GC_Components(LIST, IDX, ON_REMOVE)                                                                                                                    \
-	{                                                                                                                                                          \
-		std::vector<bool> is_refd(LIST.capacity(), false);                                                                                                     \
-                                                                                                                                                               \
-		for (const auto &n : nodes) {                                                                                                                          \
-			const auto ref = n.components[IDX];                                                                                                                \
-			if (LIST.is_valid(ref))                                                                                                                            \
-				is_refd[ref.idx] = true;                                                                                                                       \
-		}                                                                                                                                                      \
-                                                                                                                                                               \
-		for (size_t i = 0; i < is_refd.size(); ++i)                                                                                                            \
-			if (!is_refd[i] && LIST.is_used(uint32_t(i))) {                                                                                                    \
-				ON_REMOVE(LIST.get_ref(uint32_t(i)));                                                                                                          \
-				++removed_count;                                                                                                                               \
-			}                                                                                                                                                  \
-	}
-
-	GC_Components(transforms, NCI_Transform, DestroyTransform);
-	GC_Components(cameras, NCI_Camera, DestroyCamera);
-	GC_Components(lights, NCI_Light, DestroyLight);
-	GC_Components(objects, NCI_Object, DestroyObject);
-	GC_Components(rigid_bodies, NCI_RigidBody, DestroyRigidBody);
-
-	// cleanup collisions
-	{
-		std::vector<bool> is_refd(collisions.capacity(), false);
-
-		for (auto i = std::begin(node_collisions); i != std::end(node_collisions);) {
-			if (nodes.is_valid(i->first)) {
-				auto &node_collisions = i->second;
-
-				for (auto &ref : node_collisions)
-					if (collisions.is_valid(ref))
-						is_refd[ref.idx] = true;
-					else
-						ref = InvalidComponentRef;
+	if (ref.idx >= counts.size())
+		counts.resize(ref.idx + 1);
 
-				++i;
-			} else {
-				i = node_collisions.erase(i);
-			}
-		}
+	auto &count = counts[ref.idx];
+	if (count.gen != ref.gen)
+		count = {ref.gen, 0}; // first reference to an object reusing this slot
 
-		for (size_t i = 0; i < is_refd.size(); ++i)
-			if (!is_refd[i] && collisions.is_used(uint32_t(i))) {
-				DestroyCollision(collisions.get_ref(uint32_t(i)));
-				++removed_count;
-			}
-	}
+	++count.count;
+}
 
-	// cleanup instances
-	{
-		std::vector<bool> is_refd(instances.capacity(), false);
+template <typename C> static bool ReleaseRef(std::vector<C> &counts, gen_ref ref) { // return true on last reference release
+	if (ref.idx >= counts.size())
+		return false;
 
-		for (auto i = std::begin(node_instance); i != std::end(node_instance);) {
-			if (nodes.is_valid(i->first) && instances.is_valid(i->second)) {
-				is_refd[i->second.idx] = true;
-				++i;
-			} else {
-				i = node_instance.erase(i);
-			}
-		}
+	auto &count = counts[ref.idx];
+	if (count.gen != ref.gen || count.count == 0)
+		return false;
 
-		for (size_t i = 0; i < is_refd.size(); ++i)
-			if (!is_refd[i] && instances.is_used(uint32_t(i))) {
-				DestroyInstance(instances.get_ref(uint32_t(i)));
-				++removed_count;
-			}
-	}
+	return --count.count == 0;
+}
 
-	// cleanup instance views
-	{
-		for (auto i = std::begin(node_instance_view); i != std::end(node_instance_view);) {
-			bool is_node_instance_view_still_valid = true;
+template <typename C> static bool IsReferenced(const std::vector<C> &counts, gen_ref ref) {
+	return ref.idx < counts.size() && counts[ref.idx].gen == ref.gen && counts[ref.idx].count > 0;
+}
 
-			const auto j = node_instance.find(i->first);
+// remove the entries which are no longer garbage candidates and duplicate entries, then grow the queue capacity so that compaction cost is amortized
+template <typename T, typename P, typename L> static void CompactGarbageQueue(std::vector<T> &queue, size_t &capacity, size_t min_capacity, P is_candidate, L less) {
+	queue.erase(std::remove_if(std::begin(queue), std::end(queue), [&](const T &v) { return !is_candidate(v); }), std::end(queue));
+	std::sort(std::begin(queue), std::end(queue), less);
+	queue.erase(std::unique(std::begin(queue), std::end(queue), [&](const T &a, const T &b) { return !less(a, b) && !less(b, a); }), std::end(queue));
+	capacity = Max(min_capacity, queue.size() * 2);
+}
 
-			if (j == std::end(node_instance)) {
-				is_node_instance_view_still_valid = false; // node not found
-			} else {
-				if (!instances.is_valid(j->second))
-					is_node_instance_view_still_valid = false; // node references an invalid component
-			}
+//
+ComponentRef Scene::TrackComponent_(uint8_t list, ComponentRef ref) {
+	QueueGarbageComponent_(list, ref);
+	return ref;
+}
 
-			if (is_node_instance_view_still_valid) {
-				++i;
-			} else {
-				DestroyViewContent(i->second);
-				i = node_instance_view.erase(i);
-			}
-		}
-	}
+void Scene::QueueGarbageComponent_(uint8_t list, ComponentRef ref) {
+	if (garbage_components.size() >= garbage_components_capacity)
+		CompactGarbageComponents_();
+	garbage_components.push_back({ref, list});
+}
 
-	// cleanup scripts
-	{
-		std::vector<bool> is_refd(scripts.capacity(), false);
+void Scene::CompactGarbageComponents_() {
+	CompactGarbageQueue(
+		garbage_components, garbage_components_capacity, garbage_queue_min_capacity,
+		[this](const Garbage_ &garbage) { return !IsComponentReferenced_(garbage.list, garbage.ref) && IsValidComponent_(garbage.list, garbage.ref); },
+		[](const Garbage_ &a, const Garbage_ &b) { return a.list == b.list ? a.ref < b.ref : a.list < b.list; });
+}
 
-		for (auto i : scene_scripts)
-			if (scripts.is_valid(i))
-				is_refd[i.idx] = true;
+void Scene::AcquireComponent_(uint8_t list, ComponentRef ref) { AcquireRef(component_ref_counts[list], ref); }
 
-		for (auto i = std::begin(node_scripts); i != std::end(node_scripts);) {
-			if (nodes.is_valid(i->first)) {
-				for (auto j : i->second)
-					if (scripts.is_valid(j))
-						is_refd[j.idx] = true;
-				++i;
-			} else {
-				i = node_scripts.erase(i);
-			}
-		}
+void Scene::ReleaseComponent_(uint8_t list, ComponentRef ref) {
+	if (ReleaseRef(component_ref_counts[list], ref))
+		QueueGarbageComponent_(list, ref);
+}
 
-		for (size_t i = 0; i < is_refd.size(); ++i)
-			if (!is_refd[i] && scripts.is_used(uint32_t(i))) {
-				DestroyScript(scripts.get_ref(uint32_t(i)));
-				++removed_count;
-			}
+bool Scene::IsComponentReferenced_(uint8_t list, ComponentRef ref) const { return IsReferenced(component_ref_counts[list], ref); }
+
+bool Scene::IsValidComponent_(uint8_t list, ComponentRef ref) const {
+	switch (list) {
+		case NCI_Transform:
+			return transforms.is_valid(ref);
+		case NCI_Camera:
+			return cameras.is_valid(ref);
+		case NCI_Object:
+			return objects.is_valid(ref);
+		case NCI_Light:
+			return lights.is_valid(ref);
+		case NCI_RigidBody:
+			return rigid_bodies.is_valid(ref);
+		case GCL_Collision:
+			return collisions.is_valid(ref);
+		case GCL_Script:
+			return scripts.is_valid(ref);
+		case GCL_Instance:
+			return instances.is_valid(ref);
+		default:
+			return false;
 	}
+}
 
-	// cleanup anims
-	{ removed_count += GarbageCollectAnims(); }
+void Scene::AcquireNodeComponents_(NodeRef ref) {
+	if (const auto node_ = GetNode_(ref))
+		for (int i = 0; i < NCI_Count; ++i)
+			AcquireComponent_(uint8_t(i), node_->components[i]);
 
-	return removed_count;
+	for (const auto &cref : node_collisions.get(ref))
+		AcquireComponent_(GCL_Collision, cref);
+	for (const auto &cref : node_scripts.get(ref))
+		AcquireComponent_(GCL_Script, cref);
+
+	if (const auto cref = node_instance.find(ref))
+		AcquireComponent_(GCL_Instance, *cref);
+}
+
+template <typename T, typename F> static bool DestroyComponent(const generational_vector_list<T> &list, ComponentRef ref, F destroy) {
+	if (!list.is_valid(ref))
+		return false; // already destroyed
+	destroy(ref);
+	return true;
 }
 
-size_t Scene::GarbageCollect() {
+bool Scene::DestroyGarbageComponent_(const Garbage_ &garbage) {
+	if (IsComponentReferenced_(garbage.list, garbage.ref))
+		return false; // reattached since it was queued
+
+	switch (garbage.list) {
+		case NCI_Transform:
+			return DestroyComponent(transforms, garbage.ref, [this](ComponentRef ref) { DestroyTransform(ref); });
+		case NCI_Camera:
+			return DestroyComponent(cameras, garbage.ref, [this](ComponentRef ref) { DestroyCamera(ref); });
+		case NCI_Object:
+			return DestroyComponent(objects, garbage.ref, [this](ComponentRef ref) { DestroyObject(ref); });
+		case NCI_Light:
+			return DestroyComponent(lights, garbage.ref, [this](ComponentRef ref) { DestroyLight(ref); });
+		case NCI_RigidBody:
+			return DestroyComponent(rigid_bodies, garbage.ref, [this](ComponentRef ref) { DestroyRigidBody(ref); });
+		case GCL_Collision:
+			return DestroyComponent(collisions, garbage.ref, [this](ComponentRef ref) { DestroyCollision(ref); });
+		case GCL_Script:
+			return DestroyComponent(scripts, garbage.ref, [this](ComponentRef ref) { DestroyScript(ref); });
+		case GCL_Instance:
+			return DestroyComponent(instances, garbage.ref, [this](ComponentRef ref) { DestroyInstance(ref); });
+		default:
+			return false;
+	}
+}
+
+//
+size_t Scene::GarbageCollect() { return GarbageCollect(std::numeric_limits<time_ns>::max()); }
+
+size_t Scene::GarbageCollect(time_ns t_budget) {
+	ProfilerPerfSection section("Scene::GarbageCollect");
+
 	const auto t_start = time_now();
+	size_t removed_count = 0, processed_count = 0;
 
-	// n-pass to cleanup node/component
-	size_t total_removed = 0, pass_count = 0;
+	const auto is_over_budget = [&]() { return (++processed_count % 16) == 0 && (time_now() - t_start) >= t_budget; };
 
-	for (;; ++pass_count) {
-		const size_t pass_removed = GarbageCollectPass();
-		if (pass_removed == 0)
-			break;
-		total_removed += pass_removed;
-	}
+	// destroying the content of an instance view destroys its nodes, queuing their components
+	while (!garbage_views.empty() || !garbage_components.empty()) {
+		if (!garbage_views.empty()) {
+			const auto view = std::move(garbage_views.back());
+			garbage_views.pop_back();
+			DestroyViewContent(view);
+		} else {
+			const auto garbage = garbage_components.back();
+			garbage_components.pop_back();
+			if (DestroyGarbageComponent_(garbage))
+				++removed_count;
+		}
 
-	// stats
-	const auto t_total = time_now() - t_start;
+		if (is_over_budget())
+			return removed_count;
+	}
 
-	return total_removed;
+	// cleanup anims
+	removed_count += GarbageCollectAnims();
+	return removed_count;
 }
 
 //
@@ -271,6 +327,9 @@ void Scene::ComputeTransformWorldMatrix(uint32_t idx) {
 			world = transform_worlds[parent_ref.idx] * world;
 		}
 
+		if (idx >= previous_transform_worlds.size() || previous_transform_worlds[idx] != world)
+			MarkSpatialIndexTransformDirty_(idx);
+
 		transform_worlds_updated[idx] = true;
 		transform_worlds[idx] = world;
 	}
@@ -318,30 +377,56 @@ void Scene::Update(time_ns dt) {
 void Scene::GetModelDisplayLists(std::vector<ModelDisplayList> &out_opaque, std::vector<ModelDisplayList> &out_transparent,
 	std::vector<SkinnedModelDisplayList> &out_opaque_skinned, std::vector<SkinnedModelDisplayList> &out_transparent_skinned,
 	const PipelineResources &resources) const {
+	GetModelDisplayLists_(nullptr, out_opaque, nullptr, out_transparent, out_opaque_skinned, out_transparent_skinned, resources);
+}
+
+void Scene::GetModelDisplayLists(std::vector<ModelDisplayList> &out_opaque, std::vector<ModelDisplayList> &out_static_opaque,
+	std::vector<ModelDisplayList> &out_transparent, std::vector<SkinnedModelDisplayList> &out_opaque_skinned,
+	std::vector<SkinnedModelDisplayList> &out_transparent_skinned, const PipelineResources &resources) const {
+	GetModelDisplayLists_(nullptr, out_opaque, &out_static_opaque, out_transparent, out_opaque_skinned, out_transparent_skinned, resources);
+}
+
+void Scene::GetModelDisplayLists(const std::vector<NodeRef> &node_refs, std::vector<ModelDisplayList> &out_opaque,
+	std::vector<ModelDisplayList> &out_transparent, std::vector<SkinnedModelDisplayList> &out_opaque_skinned,
+	std::vector<SkinnedModelDisplayList> &out_transparent_skinned, const PipelineResources &resources) const {
+	GetModelDisplayLists_(&node_refs, out_opaque, nullptr, out_transparent, out_opaque_skinned, out_transparent_skinned, resources);
+}
+
+void Scene::GetModelDisplayLists_(const std::vector<NodeRef> *node_refs, std::vector<ModelDisplayList> &out_opaque,
+	std::vector<ModelDisplayList> *out_static_opaque, std::vector<ModelDisplayList> &out_transparent,
+	std::vector<SkinnedModelDisplayList> &out_opaque_skinned, std::vector<SkinnedModelDisplayList> &out_transparent_skinned,
+	const PipelineResources &resources) const {
+	const auto node_count = node_refs ? node_refs->size() : nodes.size();
+
 	out_opaque.clear();
-	out_opaque.reserve(nodes.size());
+	out_opaque.reserve(node_count);
+
+	if (out_static_opaque)
+		out_static_opaque->clear();
 
 	out_transparent.clear();
-	out_transparent.reserve(nodes.size());
+	out_transparent.reserve(node_count);
 
 	out_opaque_skinned.clear();
 	out_transparent_skinned.clear();
 
-	for (const auto &node : nodes) {
+	const auto get_node_display_lists = [&](const Node_ &node) {
 		if (node.flags & (NF_Disabled | NF_InstanceDisabled))
-			continue;
+			return;
 
 		const ComponentRef trs_ref = node.components[NCI_Transform];
 		if (!transforms.is_valid(trs_ref))
-			continue; // [EJ12102020] FIXME this is not required for a skinned object
+			return; // [EJ12102020] FIXME this is not required for a skinned object
 
 		const Object_ *obj_ = GetComponent_(objects, node.components[NCI_Object]);
 		if (!obj_)
-			continue;
+			return;
 
 		const uint16_t mdl_idx = resources.models.GetValidatedRefIndex(obj_->model);
 		const Model &mdl = resources.models.Get_unsafe_(mdl_idx);
 
+		auto &out_node_opaque = out_static_opaque && (node.flags & NF_Static) ? *out_static_opaque : out_opaque;
+
 		const auto total_bone_count = obj_->bones.size();
 
 		const bool obj_has_valid_skin = total_bone_count > 0 && total_bone_count == mdl.bind_pose.size();
@@ -360,7 +445,7 @@ void Scene::GetModelDisplayLists(std::vector<ModelDisplayList> &out_opaque, std:
 					if (is_transparent)
 						out_transparent.push_back({mat, trs_ref.idx, mdl_idx, uint16_t(i)}); // worlds vector entries map 1:1 to the transform_ vector_list
 					else
-						out_opaque.push_back({mat, trs_ref.idx, mdl_idx, uint16_t(i)}); // worlds vector entries map 1:1 to the transform_ vector_list
+						out_node_opaque.push_back({mat, trs_ref.idx, mdl_idx, uint16_t(i)}); // worlds vector entries map 1:1 to the transform_ vector_list
 				} else {
 					SkinnedModelDisplayList dl;
 					dl.mat = mat;
@@ -400,9 +485,264 @@ void Scene::GetModelDisplayLists(std::vector<ModelDisplayList> &out_opaque, std:
 				}
 			}
 		}
+	};
+
+	if (node_refs) {
+		for (const auto &ref : *node_refs)
+			if (nodes.is_valid(ref))
+				get_node_display_lists(nodes[ref.idx]);
+	} else {
+		for (const auto &node : nodes)
+			get_node_display_lists(node);
+	}
+}
+
+void Scene::GetModelOccluders(std::vector<ModelOccluder> &out_occluders, const PipelineResources &resources) const {
+	out_occluders.clear();
+
+	for (const auto &node : nodes) {
+		if ((node.flags & (NF_Occluder | NF_Disabled | NF_InstanceDisabled)) != NF_Occluder)
+			continue;
+
+		const ComponentRef trs_ref = node.components[NCI_Transform];
+		if (!transforms.is_valid(trs_ref))
+			continue;
+
+		const Object_ *obj_ = GetComponent_(objects, node.components[NCI_Object]);
+		if (!obj_ || !obj_->bones.empty())
+			continue; // occluder meshes are not skinned
+
+		const uint16_t mdl_idx = resources.models.GetValidatedRefIndex(obj_->model);
+		if (!resources.models.Get_unsafe_(mdl_idx).occluder.idx.empty())
+			out_occluders.push_back({trs_ref.idx, mdl_idx}); // worlds vector entries map 1:1 to the transform_ vector_list
 	}
 }
 
+//
+template <typename I, typename F>
+static void UpdateSpatialIndexEntry(I &index, uint32_t idx, NodeRef ref, const Mat4 &world, uint32_t shape, bool force, F compute_bounds) {
+	auto &entry = index.entries[idx];
+
+	if (!force && entry.proxy != AABBTree::invalid_proxy && entry.ref == ref && entry.shape == shape && entry.world == world)
+		return; // up to date
+
+	if (entry.unbounded) {
+		index.unbounded.erase(std::find(std::begin(index.unbounded), std::end(index.unbounded), entry.ref));
+		entry.unbounded = false;
+	}
+
+	entry.bounds = compute_bounds();
+
+	if (entry.proxy == AABBTree::invalid_proxy)
+		entry.proxy = index.tree.Insert(entry.bounds, idx);
+	else
+		index.tree.Move(entry.proxy, entry.bounds);
+
+	entry.ref = ref;
+	entry.world = world;
+	entry.shape = shape;
+}
+
+template <typename I> static void RemoveSpatialIndexEntry(I &index, uint32_t idx) {
+	auto &entry = index.entries[idx];
+
+	if (entry.proxy != AABBTree::invalid_proxy) {
+		index.tree.Remove(entry.proxy);
+		entry.proxy = AABBTree::invalid_proxy;
+	}
+
+	if (entry.unbounded) {
+		index.unbounded.erase(std::find(std::begin(index.unbounded), std::end(index.unbounded), entry.ref));
+		entry.unbounded = false;
+	}
+}
+
+template <typename I> static void SetSpatialIndexEntryUnbounded(I &index, uint32_t idx, NodeRef ref) {
+	auto &entry = index.entries[idx];
+
+	if (entry.unbounded && entry.ref == ref)
+		return;
+
+	RemoveSpatialIndexEntry(index, idx);
+
+	index.unbounded.push_back(ref);
+	entry.ref = ref;
+	entry.unbounded = true;
+}
+
+template <typename I> static bool IsSpatialIndexEntryUsed(const I &index, uint32_t idx) {
+	return idx < index.entries.size() && (index.entries[idx].proxy != AABBTree::invalid_proxy || index.entries[idx].unbounded);
+}
+
+void Scene::MarkSpatialIndexNodeDirty_(uint32_t idx) {
+	if (!spatial_index_built || spatial_index_rescan)
+		return;
+
+	if (spatial_index_dirty_nodes.size() < nodes.capacity())
+		spatial_index_dirty_nodes.push_back(idx);
+	else
+		spatial_index_rescan = true; // cheaper than visiting the same nodes several times
+}
+
+void Scene::MarkSpatialIndexTransformDirty_(uint32_t idx) {
+	if (!spatial_index_built || spatial_index_rescan)
+		return;
+
+	if (spatial_index_dirty_transforms.size() < transforms.capacity())
+		spatial_index_dirty_transforms.push_back(idx);
+	else
+		spatial_index_rescan = true;
+}
+
+void Scene::UpdateSpatialIndexNode_(uint32_t i, const PipelineResources &resources, bool force) {
+	const auto ref = nodes.get_ref(i);
+
+	if (ref == InvalidNodeRef) { // destroyed node
+		RemoveSpatialIndexEntry(object_index, i);
+		RemoveSpatialIndexEntry(light_index, i);
+		return;
+	}
+
+	const auto &node = nodes[i];
+
+	const ComponentRef trs_ref = node.components[NCI_Transform];
+	const bool is_indexable = !(node.flags & (NF_Disabled | NF_InstanceDisabled)) && transforms.is_valid(trs_ref) && trs_ref.idx < transform_worlds.size();
+
+	// object
+	const Object_ *obj_ = is_indexable ? GetComponent_(objects, node.components[NCI_Object]) : nullptr;
+
+	if (obj_ && !obj_->bones.empty()) {
+		SetSpatialIndexEntryUnbounded(object_index, i, ref); // bind pose bounds do not follow the bones
+	} else if (obj_ && !resources.models.Get(obj_->model).bounds.empty()) {
+		const auto mdl_idx = resources.models.GetValidatedRefIndex(obj_->model);
+		const auto &world = transform_worlds[trs_ref.idx];
+
+		UpdateSpatialIndexEntry(object_index, i, ref, world, mdl_idx, force, [&]() {
+			MinMax bounds;
+			for (const auto &list_bounds : resources.models.Get_unsafe_(mdl_idx).bounds)
+				bounds = Union(bounds, world * list_bounds);
+			return bounds;
+		});
+	} else {
+		RemoveSpatialIndexEntry(object_index, i);
+	}
+
+	// light
+	const Light_ *lgt_ = is_indexable ? GetComponent_(lights, node.components[NCI_Light]) : nullptr;
+
+	if (lgt_ && (lgt_->type == LT_Linear || lgt_->radius <= 0.f)) {
+		SetSpatialIndexEntryUnbounded(light_index, i, ref);
+	} else if (lgt_) {
+		const auto &world = transform_worlds[trs_ref.idx];
+
+		uint32_t shape;
+		memcpy(&shape, &lgt_->radius, sizeof(shape));
+
+		UpdateSpatialIndexEntry(light_index, i, ref, world, shape, force, [&]() {
+			const auto pos = GetT(world);
+			const Vec3 radius(lgt_->radius, lgt_->radius, lgt_->radius);
+			return MinMax(pos - radius, pos + radius);
+		});
+	} else {
+		RemoveSpatialIndexEntry(light_index, i);
+	}
+
+	// map the node transform back to the node for dirty transforms
+	if (is_indexable && (IsSpatialIndexEntryUsed(object_index, i) || IsSpatialIndexEntryUsed(light_index, i))) {
+		auto &trs_node = spatial_index_transform_nodes[trs_ref.idx];
+
+		if (trs_node != i && trs_node < nodes.capacity() && nodes.is_used(trs_node) && nodes[trs_node].components[NCI_Transform] == trs_ref &&
+			(IsSpatialIndexEntryUsed(object_index, trs_node) || IsSpatialIndexEntryUsed(light_index, trs_node)))
+			spatial_index_shared_transforms = true;
+
+		trs_node = i;
+	}
+}
+
+void Scene::UpdateSpatialIndex(const PipelineResources &resources) {
+	const auto capacity = nodes.capacity();
+
+	object_index.entries.resize(capacity);
+	light_index.entries.resize(capacity);
+	spatial_index_transform_nodes.resize(transforms.capacity(), 0xffffffff);
+
+	const bool models_changed = resources.models.GetRevision() != spatial_index_model_revision; // a model might have been reloaded in place
+
+	if (!spatial_index_built || spatial_index_rescan || models_changed || (spatial_index_shared_transforms && !spatial_index_dirty_transforms.empty())) {
+		spatial_index_shared_transforms = false;
+
+		for (uint32_t i = 0; i < capacity; ++i)
+			UpdateSpatialIndexNode_(i, resources, models_changed);
+	} else {
+		for (auto i : spatial_index_dirty_nodes)
+			UpdateSpatialIndexNode_(i, resources, false);
+
+		for (auto trs_idx : spatial_index_dirty_transforms) {
+			const auto i = trs_idx < spatial_index_transform_nodes.size() ? spatial_index_transform_nodes[trs_idx] : 0xffffffff;
+			if (i < capacity && nodes.is_used(i) && nodes[i].components[NCI_Transform].idx == trs_idx)
+				UpdateSpatialIndexNode_(i, resources, false);
+		}
+	}
+
+	spatial_index_dirty_nodes.clear();
+	spatial_index_dirty_transforms.clear();
+
+	spatial_index_built = true;
+	spatial_index_rescan = false;
+	spatial_index_model_revision = resources.models.GetRevision();
+}
+
+bool Scene::IsSpatialIndexUpToDate(const PipelineResources &resources) const {
+	return spatial_index_built && !spatial_index_rescan && spatial_index_dirty_nodes.empty() && spatial_index_dirty_transforms.empty() &&
+		   spatial_index_model_revision == resources.models.GetRevision();
+}
+
+void Scene::OutputSpatialIndexQuery_(const SpatialIndex &index, const std::vector<uint32_t> &idxs, std::vector<NodeRef> &out_nodes) const {
+	out_nodes.clear();
+	out_nodes.reserve(idxs.size() + index.unbounded.size());
+
+	for (auto idx : idxs)
+		out_nodes.push_back(index.entries[idx].ref);
+
+	out_nodes.insert(std::end(out_nodes), std::begin(index.unbounded), std::end(index.unbounded));
+}
+
+void Scene::QueryObjectNodes(const Frustum &frustum, std::vector<NodeRef> &out_nodes) const {
+	std::vector<uint32_t> idxs;
+	object_index.tree.Query(frustum, idxs);
+	OutputSpatialIndexQuery_(object_index, idxs, out_nodes);
+}
+
+void Scene::QueryObjectNodes(const MinMax &bounds, std::vector<NodeRef> &out_nodes) const {
+	std::vector<uint32_t> idxs;
+	object_index.tree.Query(bounds, idxs);
+	OutputSpatialIndexQuery_(object_index, idxs, out_nodes);
+}
+
+void Scene::QueryObjectNodes(const Vec3 &center, float radius, std::vector<NodeRef> &out_nodes) const {
+	std::vector<uint32_t> idxs;
+	object_index.tree.Query(center, radius, idxs);
+	OutputSpatialIndexQuery_(object_index, idxs, out_nodes);
+}
+
+void Scene::QueryLightNodes(const Frustum &frustum, std::vector<NodeRef> &out_nodes) const {
+	std::vector<uint32_t> idxs;
+	light_index.tree.Query(frustum, idxs);
+	OutputSpatialIndexQuery_(light_index, idxs, out_nodes);
+}
+
+void Scene::QueryLightNodes(const MinMax &bounds, std::vector<NodeRef> &out_nodes) const {
+	std::vector<uint32_t> idxs;
+	light_index.tree.Query(bounds, idxs);
+	OutputSpatialIndexQuery_(light_index, idxs, out_nodes);
+}
+
+void Scene::QueryLightNodes(const Vec3 &center, float radius, std::vector<NodeRef> &out_nodes) const {
+	std::vector<uint32_t> idxs;
+	light_index.tree.Query(center, radius, idxs);
+	OutputSpatialIndexQuery_(light_index, idxs, out_nodes);
+}
+
 //
 std::vector<Node> Scene::GetLights() const {
 	std::vector<Node> lights;
@@ -465,8 +805,41 @@ std::vector<NodeRef> NodesChildren::GetChildren(NodeRef node) const {
 }
 
 //
-Node Scene::CreateNode(std::string name) { return {scene_ref, nodes.add_ref({std::move(name)})}; }
-void Scene::DestroyNode(NodeRef ref) { nodes.remove_ref(ref); }
+Node Scene::CreateNode(std::string name) {
+	const auto ref = nodes.add_ref({std::move(name)});
+	MarkSpatialIndexNodeDirty_(ref.idx);
+	return {scene_ref, ref};
+}
+
+void Scene::DestroyNode(NodeRef ref) {
+	if (nodes.is_valid(ref))
+		MarkSpatialIndexNodeDirty_(ref.idx);
+
+	if (const auto node_ = GetNode_(ref))
+		for (int i = 0; i < NCI_Count; ++i)
+			ReleaseComponent_(uint8_t(i), node_->components[i]);
+
+	for (const auto &cref : node_collisions.get(ref))
+		ReleaseComponent_(GCL_Collision, cref);
+	node_collisions.erase(ref);
+
+	for (const auto &cref : node_scripts.get(ref))
+		ReleaseComponent_(GCL_Script, cref);
+	if (node_scripts.erase(ref))
+		BumpScriptsRevision();
+
+	if (const auto cref = node_instance.find(ref)) {
+		ReleaseComponent_(GCL_Instance, *cref);
+		node_instance.erase(ref);
+	}
+
+	if (const auto view = node_instance_view.find(ref)) {
+		garbage_views.push_back(std::move(*view)); // instance content is destroyed by the garbage collector
+		node_instance_view.erase(ref);
+	}
+
+	nodes.remove_ref(ref);
+}
 
 //
 void Scene::EnableNode_(NodeRef ref, bool through_instance) {
@@ -476,14 +849,14 @@ void Scene::EnableNode_(NodeRef ref, bool through_instance) {
 	}
 
 	nodes[ref.idx].flags &= through_instance ? ~NF_InstanceDisabled : ~NF_Disabled;
+	MarkSpatialIndexNodeDirty_(ref.idx);
 
 	// enable instance content
 	if (nodes[ref.idx].flags & (NF_Disabled | NF_InstanceDisabled)) // [EJ11262019] only if fully enabled
 		return;
 
-	const auto i = node_instance_view.find(ref);
-	if (i != std::end(node_instance_view))
-		for (auto &instantiated_node_ref : i->second.nodes)
+	if (const auto view = node_instance_view.find(ref))
+		for (auto &instantiated_node_ref : view->nodes)
 			EnableNode_(instantiated_node_ref, true);
 }
 
@@ -494,11 +867,11 @@ void Scene::DisableNode_(NodeRef ref, bool through_instance) {
 	}
 
 	nodes[ref.idx].flags |= through_instance ? NF_InstanceDisabled : NF_Disabled;
+	MarkSpatialIndexNodeDirty_(ref.idx);
 
 	// disable instance content
-	const auto i = node_instance_view.find(ref);
-	if (i != std::end(node_instance_view))
-		for (auto &instantiated_node_ref : i->second.nodes)
+	if (const auto view = node_instance_view.find(ref))
+		for (auto &instantiated_node_ref : view->nodes)
 			DisableNode_(instantiated_node_ref, true);
 }
 
@@ -547,11 +920,11 @@ NodeRef Scene::GetNodeEx_(const std::vector<NodeRef> &refs, const std::string &p
 			if (mode == 0) {
 				return ref; // look no further
 			} else if (mode == 1) {
-				const auto &i = node_instance_view.find(ref); // look in instance
-				if (i == std::end(node_instance_view))
+				const auto view = node_instance_view.find(ref); // look in instance
+				if (!view)
 					return InvalidNodeRef; // not an instance
 
-				const auto &scene_view = i->second;
+				const auto &scene_view = *view;
 
 				std::vector<NodeRef> roots;
 				for (const auto &i : scene_view.nodes)
@@ -730,22 +1103,30 @@ uint32_t Scene::GetNodeFlags(NodeRef ref) const {
 }
 
 void Scene::SetNodeFlags(NodeRef ref, uint32_t flags) {
-	if (auto node_ = GetNode_(ref))
+	if (auto node_ = GetNode_(ref)) {
 		node_->flags = flags;
-	else
+		MarkSpatialIndexNodeDirty_(ref.idx);
+	} else {
 		warn("Invalid node");
+	}
 }
 
 //
 ComponentRef Scene::GetNodeTransformRef(NodeRef ref) const { return GetNodeComponentRef_<NCI_Transform>(ref); }
 
-void Scene::SetNodeTransform(NodeRef ref, ComponentRef cref) {
-	if (auto node_ = this->GetNode_(ref))
-		node_->components[NCI_Transform] = cref;
-	else
+void Scene::SetNodeComponent_(NodeRef ref, NodeComponentIdx idx, ComponentRef cref) {
+	if (auto node_ = this->GetNode_(ref)) {
+		AcquireComponent_(uint8_t(idx), cref);
+		ReleaseComponent_(uint8_t(idx), node_->components[idx]);
+		node_->components[idx] = cref;
+		MarkSpatialIndexNodeDirty_(ref.idx);
+	} else {
 		warn("Invalid node");
+	}
 }
 
+void Scene::SetNodeTransform(NodeRef ref, ComponentRef cref) { SetNodeComponent_(ref, NCI_Transform, cref); }
+
 //
 Mat4 Scene::GetNodeWorldMatrix(NodeRef ref) const {
 	if (auto node_ = this->GetNode_(ref)) {
@@ -773,6 +1154,7 @@ void Scene::SetNodeWorldMatrix(NodeRef ref, const Mat4 &world) {
 			if (trs_ref.idx < transform_worlds.size()) {
 				transform_worlds[trs_ref.idx] = world;
 				transform_worlds_updated[trs_ref.idx] = true;
+				MarkSpatialIndexTransformDirty_(trs_ref.idx);
 			} else {
 				warn("Invalid node transform index");
 			}
@@ -806,49 +1188,52 @@ Mat4 Scene::ComputeNodeWorldMatrix(NodeRef ref) const {
 	return Mat4::Identity;
 }
 
+void Scene::SetNodesWorldMatrix(const std::vector<NodeRef> &refs, const std::vector<Mat4> &worlds) {
+	if (refs.size() != worlds.size())
+		warn(format("Node and world matrix count mismatch (%1 nodes, %2 matrices)").arg(refs.size()).arg(worlds.size()).c_str());
+
+	const auto count = std::min(refs.size(), worlds.size());
+	size_t invalid_count = 0;
+
+	for (size_t i = 0; i < count; ++i) {
+		const auto trs_ref = GetNodeComponentRef_<NCI_Transform>(refs[i]);
+
+		if (transforms.is_valid(trs_ref) && trs_ref.idx < transform_worlds.size()) {
+			transform_worlds[trs_ref.idx] = worlds[i];
+			transform_worlds_updated[trs_ref.idx] = true;
+			MarkSpatialIndexTransformDirty_(trs_ref.idx);
+		} else {
+			++invalid_count;
+		}
+	}
+
+	if (invalid_count)
+		warn(format("Invalid node or node transform for %1 of %2 nodes").arg(invalid_count).arg(count).c_str()); // one warning per batch
+}
+
 //
 ComponentRef Scene::GetNodeCameraRef(NodeRef ref) const { return GetNodeComponentRef_<NCI_Camera>(ref); }
 
-void Scene::SetNodeCamera(NodeRef ref, ComponentRef cref) {
-	if (auto node_ = this->GetNode_(ref))
-		node_->components[NCI_Camera] = cref;
-	else
-		warn("Invalid node");
-}
+void Scene::SetNodeCamera(NodeRef ref, ComponentRef cref) { SetNodeComponent_(ref, NCI_Camera, cref); }
 
 //
 ComponentRef Scene::GetNodeObjectRef(NodeRef ref) const { return GetNodeComponentRef_<NCI_Object>(ref); }
 
-void Scene::SetNodeObject(NodeRef ref, ComponentRef cref) {
-	if (auto node_ = this->GetNode_(ref))
-		node_->components[NCI_Object] = cref;
-	else
-		warn("Invalid node");
-}
+void Scene::SetNodeObject(NodeRef ref, ComponentRef cref) { SetNodeComponent_(ref, NCI_Object, cref); }
 
 //
 ComponentRef Scene::GetNodeLightRef(NodeRef ref) const { return GetNodeComponentRef_<NCI_Light>(ref); }
 
-void Scene::SetNodeLight(NodeRef ref, ComponentRef cref) {
-	if (auto node_ = this->GetNode_(ref))
-		node_->components[NCI_Light] = cref;
-	else
-		warn("Invalid node");
-}
+void Scene::SetNodeLight(NodeRef ref, ComponentRef cref) { SetNodeComponent_(ref, NCI_Light, cref); }
 
 //
 ComponentRef Scene::GetNodeRigidBodyRef(NodeRef ref) const { return GetNodeComponentRef_<NCI_RigidBody>(ref); }
 
-void Scene::SetNodeRigidBody(NodeRef ref, ComponentRef cref) {
-	if (auto node_ = this->GetNode_(ref))
-		node_->components[NCI_RigidBody] = cref;
-	else
-		warn("Invalid node");
-}
+void Scene::SetNodeRigidBody(NodeRef ref, ComponentRef cref) { SetNodeComponent_(ref, NCI_RigidBody, cref); }
 
 ComponentRef Scene::GetNodeCollisionRef(NodeRef ref, size_t idx) const {
-	auto i = nodes.is_valid(ref) ? node_collisions.find(ref) : std::end(node_collisions);
-	return i != std::end(node_collisions) && idx < i->second.size() ? i->second[idx] : InvalidComponentRef;
+	const auto collisions = node_collisions.get(ref);
+	return nodes.is_valid(ref) && idx < collisions.size() ? collisions[idx] : InvalidComponentRef;
 }
 
 Collision Scene::GetNodeCollision(NodeRef ref, size_t idx) const {
@@ -858,8 +1243,14 @@ Collision Scene::GetNodeCollision(NodeRef ref, size_t idx) const {
 
 void Scene::SetNodeCollision(NodeRef ref, size_t idx, const Collision &collision) {
 	if (nodes.is_valid(ref)) {
-		node_collisions[ref].resize(idx + 1);
-		node_collisions[ref][idx] = collision.ref;
+		const auto collisions = node_collisions.get(ref);
+
+		AcquireComponent_(GCL_Collision, collision.ref);
+		for (size_t slot_idx = idx; slot_idx < collisions.size(); ++slot_idx)
+			ReleaseComponent_(GCL_Collision, collisions[slot_idx]);
+
+		node_collisions.resize(ref, idx + 1);
+		node_collisions.get(ref)[idx] = collision.ref;
 	} else {
 		warn("Invalid node");
 	}
@@ -867,13 +1258,15 @@ void Scene::SetNodeCollision(NodeRef ref, size_t idx, const Collision &collision
 
 void Scene::RemoveNodeCollision(NodeRef ref, ComponentRef cref) {
 	if (nodes.is_valid(ref)) {
-		auto &collisions = node_collisions[ref];
+		const auto collisions = node_collisions.get(ref);
 
 		for (size_t slot_idx = 0; slot_idx < collisions.size(); ++slot_idx)
-			if (collisions[slot_idx] == cref)
+			if (collisions[slot_idx] == cref) {
+				ReleaseComponent_(GCL_Collision, cref);
 				collisions[slot_idx] = invalid_gen_ref;
+			}
 
-		_ResizeComponents(collisions);
+		_ResizeComponents(node_collisions, ref);
 	} else {
 		warn("Invalid node");
 	}
@@ -881,20 +1274,22 @@ void Scene::RemoveNodeCollision(NodeRef ref, ComponentRef cref) {
 
 void Scene::RemoveNodeCollision(NodeRef ref, size_t slot_idx) {
 	if (nodes.is_valid(ref)) {
-		auto &collisions = node_collisions[ref];
+		const auto collisions = node_collisions.get(ref);
 
 		if (slot_idx < collisions.size())
-			if (collisions[slot_idx] != invalid_gen_ref)
+			if (collisions[slot_idx] != invalid_gen_ref) {
+				ReleaseComponent_(GCL_Collision, collisions[slot_idx]);
 				collisions[slot_idx] = invalid_gen_ref;
+			}
 
-		_ResizeComponents(collisions);
+		_ResizeComponents(node_collisions, ref);
 	} else {
 		warn("Invalid node");
 	}
 }
 
 //
-RigidBody Scene::CreateRigidBody() { return {scene_ref, rigid_bodies.add_ref({})}; }
+RigidBody Scene::CreateRigidBody() { return {scene_ref, TrackComponent_(NCI_RigidBody, rigid_bodies.add_ref({}))}; }
 
 void Scene::DestroyRigidBody(ComponentRef ref) { rigid_bodies.remove_ref(ref); }
 
@@ -989,7 +1384,7 @@ void Scene::SetRigidBodyRollingFriction(ComponentRef ref, float rolling_friction
 }
 
 //
-Collision Scene::CreateCollision() { return {scene_ref, collisions.add_ref({})}; }
+Collision Scene::CreateCollision() { return {scene_ref, TrackComponent_(GCL_Collision, collisions.add_ref({}))}; }
 void Scene::DestroyCollision(ComponentRef ref) { collisions.remove_ref(ref); }
 
 void Scene::SetCollisionType(ComponentRef ref, CollisionType type) {
@@ -1129,8 +1524,7 @@ std::string Scene::GetCollisionResource(ComponentRef ref) {
 
 //
 size_t Scene::GetNodeCollisionCount(NodeRef ref) const {
-	auto i = nodes.is_valid(ref) ? node_collisions.find(ref) : std::end(node_collisions);
-	return i != std::end(node_collisions) ? i->second.size() : 0;
+	return nodes.is_valid(ref) ? node_collisions.get(ref).size() : 0;
 }
 
 //
@@ -1194,7 +1588,7 @@ Collision Scene::CreateMeshConvexCollision(const std::string &path, float mass)
 }
 
 //
-Instance Scene::CreateInstance() { return {scene_ref, instances.add_ref({})}; }
+Instance Scene::CreateInstance() { return {scene_ref, TrackComponent_(GCL_Instance, instances.add_ref({}))}; }
 void Scene::DestroyInstance(ComponentRef ref) { instances.remove_ref(ref); }
 
 void Scene::SetInstancePath(ComponentRef ref, const std::string &path) {
@@ -1263,17 +1657,26 @@ Instance Scene::GetNodeInstance(NodeRef ref) const {
 }
 
 ComponentRef Scene::GetNodeInstanceRef(NodeRef ref) const {
-	const auto i = node_instance.find(ref);
-	if (i != std::end(node_instance))
-		return i->second;
-	return InvalidComponentRef;
+	const auto cref = node_instance.find(ref);
+	return cref ? *cref : InvalidComponentRef;
 }
 
 void Scene::SetNodeInstance(NodeRef ref, ComponentRef cref) {
-	if (cref == InvalidComponentRef)
+	AcquireComponent_(GCL_Instance, cref);
+
+	if (const auto prev_cref = node_instance.find(ref))
+		ReleaseComponent_(GCL_Instance, *prev_cref);
+
+	if (cref == InvalidComponentRef) {
 		node_instance.erase(ref);
-	else
+
+		if (const auto view = node_instance_view.find(ref)) {
+			garbage_views.push_back(std::move(*view)); // instance content is destroyed by the garbage collector
+			node_instance_view.erase(ref);
+		}
+	} else {
 		node_instance[ref] = cref;
+	}
 }
 
 void Scene::DestroyViewContent(const SceneView &view) {
@@ -1288,11 +1691,10 @@ void Scene::DestroyViewContent(const SceneView &view) {
 void Scene::NodeDestroyInstance(NodeRef ref) {
 	NodeStopOnInstantiateAnim(ref);
 
-	const auto i = node_instance_view.find(ref);
-
-	if (i != std::end(node_instance_view)) {
-		DestroyViewContent(i->second);
-		node_instance_view.erase(i);
+	if (const auto i = node_instance_view.find(ref)) {
+		const auto view = std::move(*i); // destroying the view content modifies the instance view table
+		node_instance_view.erase(ref);
+		DestroyViewContent(view);
 	} else {
 		warn("Invalid node instance view");
 	}
@@ -1307,21 +1709,22 @@ bool Scene::NodeSetupInstance(
 		return true;
 
 	const auto i = node_instance.find(ref);
-	if (i == std::end(node_instance))
+	if (!i)
 		return false;
 
+	const auto cref = *i; // loading the instance might reallocate the instance table
 	const auto host_is_enabled = IsNodeEnabled(ref);
 
-	if (instances.is_valid(i->second)) {
+	if (instances.is_valid(cref)) {
 		LoadSceneContext ctx = {recursion_level};
 
 		{
-			const auto &i_ = instances[i->second.idx];
+			const auto &i_ = instances[cref.idx];
 			if (!LoadScene(ir, ScopedReadHandle(ip, i_.name.c_str(), flags & LSSF_Silent), i_.name.c_str(), *this, ir, ip, resources, pipeline, ctx, flags))
 				return false;
 		}
 
-		auto &i_ = instances[i->second.idx]; // [EJ12102019] LoadScene might reallocate instances buffer so fetch i_ anew
+		auto &i_ = instances[cref.idx]; // [EJ12102019] LoadScene might reallocate instances buffer so fetch i_ anew
 
 		for (auto node : ctx.view.nodes) {
 			auto &n = nodes[node.idx];
@@ -1352,36 +1755,36 @@ ScenePlayAnimRef Scene::NodeStartOnInstantiateAnim(NodeRef ref) {
 
 	const auto i = node_instance.find(ref);
 
-	if (i == std::end(node_instance))
+	if (!i)
 		return InvalidScenePlayAnimRef; // no instance on node
 
-	if (!instances.is_valid(i->second))
+	if (!instances.is_valid(*i))
 		return InvalidScenePlayAnimRef; // invalid instance ref
 
-	auto &i_ = instances[i->second.idx];
+	auto &i_ = instances[i->idx];
 
 	if (i_.anim.empty())
 		return InvalidScenePlayAnimRef; // no anim to play on instantiation
 
 	const auto i_view = node_instance_view.find(ref);
 
-	if (i_view == std::end(node_instance_view))
+	if (!i_view)
 		return InvalidScenePlayAnimRef; // no instance view
 
-	const auto anim_ref = i_view->second.GetSceneAnim(*this, i_.anim);
+	const auto anim_ref = i_view->GetSceneAnim(*this, i_.anim);
 	return i_.play_anim_ref = PlayAnim(anim_ref, i_.loop_mode);
 }
 
 void Scene::NodeStopOnInstantiateAnim(NodeRef ref) {
 	const auto i = node_instance.find(ref);
 
-	if (i == std::end(node_instance))
+	if (!i)
 		return; // no instance on node
 
-	if (!instances.is_valid(i->second))
+	if (!instances.is_valid(*i))
 		return; // invalid instance ref
 
-	auto &i_ = instances[i->second.idx];
+	auto &i_ = instances[i->idx];
 
 	StopAnim(i_.play_anim_ref);
 	i_.play_anim_ref = InvalidScenePlayAnimRef;
@@ -1397,12 +1800,12 @@ bool Scene::NodeSetupInstanceFromAssets(NodeRef ref, PipelineResources &resource
 
 const SceneView &Scene::GetNodeInstanceSceneView(NodeRef ref) const {
 	static SceneView dummy_view;
-	const auto i = node_instance_view.find(ref);
-	if (i == std::end(node_instance_view)) {
+	const auto view = node_instance_view.find(ref);
+	if (!view) {
 		warn(format("No instance scene view on node (%1:%2)").arg(ref.idx).arg(ref.gen).c_str());
 		return dummy_view;
 	}
-	return i->second;
+	return *view;
 }
 
 Instance Scene::CreateInstance(const std::string &path) {
@@ -1416,14 +1819,16 @@ void Scene::NodeMoveInstance(NodeRef from, NodeRef to) {
 		return;
 
 	NodeDestroyInstance(to); // drop current target instance scene view if any
-	node_instance.erase(to); // drop current target instance component if any
 
-	const bool tgt_disabled = nodes[to.idx].flags & NF_Disabled;
+	if (const auto cref = node_instance.find(to)) {
+		ReleaseComponent_(GCL_Instance, *cref);
+		node_instance.erase(to); // drop current target instance component if any
+	}
 
-	const auto &i = node_instance_view.find(from);
+	const bool tgt_disabled = nodes[to.idx].flags & NF_Disabled;
 
-	if (i != std::end(node_instance_view)) {
-		for (auto n : i->second.nodes) {
+	if (const auto i = node_instance_view.find(from)) {
+		for (auto n : i->nodes) {
 			// re-parent instantiated nodes to the target node
 			const auto trsf_ref = GetNodeComponentRef_<NCI_Transform>(n);
 			if (trsf_ref != InvalidComponentRef)
@@ -1433,13 +1838,16 @@ void Scene::NodeMoveInstance(NodeRef from, NodeRef to) {
 			// update disable flag
 			tgt_disabled ? DisableNode_(n, true) : EnableNode_(n, true);
 		}
-		node_instance_view[to] = std::move(i->second); // transfer instance view
+		auto view = std::move(*i);
+		node_instance_view.erase(from); // drop from source
+		node_instance_view[to] = std::move(view); // transfer instance view
 	}
-	node_instance_view.erase(i); // drop from source
 
-	if (node_instance.find(from) != std::end(node_instance))
-		node_instance[to] = node_instance[from];
-	node_instance.erase(from); // drop from source
+	if (const auto cref = node_instance.find(from)) {
+		const auto instance_ref = *cref;
+		node_instance.erase(from); // drop from source
+		node_instance[to] = instance_ref; // transfer the instance component reference
+	}
 }
 
 //
@@ -1509,10 +1917,13 @@ Node CreateInstanceFromAssets(
 }
 
 //
-Script Scene::CreateScript() { return {scene_ref, scripts.add_ref({})}; }
-Script Scene::CreateScript(const std::string &path) { return {scene_ref, scripts.add_ref({path})}; }
+Script Scene::CreateScript() { return {scene_ref, TrackComponent_(GCL_Script, scripts.add_ref({}))}; }
+Script Scene::CreateScript(const std::string &path) { return {scene_ref, TrackComponent_(GCL_Script, scripts.add_ref({path}))}; }
 
-void Scene::DestroyScript(ComponentRef ref) { scripts.remove_ref(ref); }
+void Scene::DestroyScript(ComponentRef ref) {
+	scripts.remove_ref(ref);
+	BumpScriptsRevision();
+}
 
 void Scene::SetScriptPath(ComponentRef ref, const std::string &path) {
 	if (auto s = GetComponent_(scripts, ref))
@@ -1578,8 +1989,7 @@ size_t Scene::GetNodeScriptCount(NodeRef ref) const {
 		return 0;
 	}
 
-	const auto i = node_scripts.find(ref);
-	return i != std::end(node_scripts) ? i->second.size() : 0;
+	return node_scripts.get(ref).size();
 }
 
 Script Scene::GetNodeScript(NodeRef ref, size_t idx) const {
@@ -1588,14 +1998,21 @@ Script Scene::GetNodeScript(NodeRef ref, size_t idx) const {
 }
 
 ComponentRef Scene::GetNodeScriptRef(NodeRef ref, size_t idx) const {
-	auto i = nodes.is_valid(ref) ? node_scripts.find(ref) : std::end(node_scripts);
-	return i != std::end(node_scripts) && idx < i->second.size() ? i->second[idx] : InvalidComponentRef;
+	const auto scripts = node_scripts.get(ref);
+	return nodes.is_valid(ref) && idx < scripts.size() ? scripts[idx] : InvalidComponentRef;
 }
 
 void Scene::SetNodeScript(NodeRef ref, size_t idx, const Script &script) {
 	if (nodes.is_valid(ref)) {
-		node_scripts[ref].resize(idx + 1);
-		node_scripts[ref][idx] = script.ref;
+		const auto scripts = node_scripts.get(ref);
+
+		AcquireComponent_(GCL_Script, script.ref);
+		for (size_t slot_idx = idx; slot_idx < scripts.size(); ++slot_idx)
+			ReleaseComponent_(GCL_Script, scripts[slot_idx]);
+
+		node_scripts.resize(ref, idx + 1);
+		node_scripts.get(ref)[idx] = script.ref;
+		BumpScriptsRevision();
 	} else {
 		warn("Invalid node");
 	}
@@ -1603,13 +2020,16 @@ void Scene::SetNodeScript(NodeRef ref, size_t idx, const Script &script) {
 
 void Scene::RemoveNodeScript(NodeRef ref, ComponentRef cref) {
 	if (nodes.is_valid(ref)) {
-		auto &scripts = node_scripts[ref];
+		const auto scripts = node_scripts.get(ref);
 
 		for (size_t slot_idx = 0; slot_idx < scripts.size(); ++slot_idx)
-			if (scripts[slot_idx] == cref)
+			if (scripts[slot_idx] == cref) {
+				ReleaseComponent_(GCL_Script, cref);
 				scripts[slot_idx] = invalid_gen_ref;
+			}
 
-		_ResizeComponents(scripts);
+		_ResizeComponents(node_scripts, ref);
+		BumpScriptsRevision();
 	} else {
 		warn("Invalid node");
 	}
@@ -1617,13 +2037,16 @@ void Scene::RemoveNodeScript(NodeRef ref, ComponentRef cref) {
 
 void Scene::RemoveNodeScript(NodeRef ref, size_t slot_idx) {
 	if (nodes.is_valid(ref)) {
-		auto &scripts = node_scripts[ref];
+		const auto scripts = node_scripts.get(ref);
 
 		if (slot_idx < scripts.size())
-			if (scripts[slot_idx] != invalid_gen_ref)
+			if (scripts[slot_idx] != invalid_gen_ref) {
+				ReleaseComponent_(GCL_Script, scripts[slot_idx]);
 				scripts[slot_idx] = invalid_gen_ref;
+			}
 
-		_ResizeComponents(scripts);
+		_ResizeComponents(node_scripts, ref);
+		BumpScriptsRevision();
 	} else {
 		warn("Invalid node");
 	}
@@ -1648,8 +2071,13 @@ std::vector<ComponentRef> Scene::GetScriptRefs() const {
 size_t Scene::GetScriptCount() const { return scene_scripts.size(); }
 
 void Scene::SetScript(size_t slot_idx, const Script &script) {
+	AcquireComponent_(GCL_Script, script.ref);
+	for (size_t i = slot_idx; i < scene_scripts.size(); ++i)
+		ReleaseComponent_(GCL_Script, scene_scripts[i]);
+
 	scene_scripts.resize(slot_idx + 1);
 	scene_scripts[slot_idx] = script.ref;
+	BumpScriptsRevision();
 }
 
 Script Scene::GetScript(size_t slot_idx) const { return slot_idx < scene_scripts.size() ? Script{scene_ref, scene_scripts[slot_idx]} : Script{}; }
@@ -1725,6 +2153,30 @@ void DumpSceneMemoryFootprint() {
 	log(format("sizeof(Instance): %1").arg(sizeof(Instance)).c_str());
 }
 
+template <typename T> static size_t GetEquivalentMapNodeSize() { return 4 * sizeof(void *) + sizeof(NodeRef) + sizeof(T); } // color and links, key, value
+
+template <typename T> static void LogSideTableFootprint(const char *name, const gen_ref_table<T> &table) {
+	const auto map_size = table.size() * GetEquivalentMapNodeSize<T>();
+	log(format("%1: %2 entries, %3 bytes (%4 bytes as a std::map)").arg(name).arg(table.size()).arg(table.memory_footprint()).arg(map_size).c_str());
+}
+
+template <typename T> static void LogSideTableFootprint(const char *name, const gen_ref_list_table<T> &table) {
+	size_t map_size = table.size() * GetEquivalentMapNodeSize<std::vector<T>>();
+	for (const auto &i : table)
+		map_size += i.second.size() * sizeof(T); // one heap allocation per list
+
+	log(format("%1: %2 entries, %3 bytes (%4 bytes as a std::map)").arg(name).arg(table.size()).arg(table.memory_footprint()).arg(map_size).c_str());
+}
+
+void DumpSceneMemoryFootprint(const Scene &scene) {
+	log(format("nodes: %1 (capacity %2)").arg(scene.nodes.size()).arg(scene.nodes.capacity()).c_str());
+
+	LogSideTableFootprint("node_collisions", scene.node_collisions);
+	LogSideTableFootprint("node_scripts", scene.node_scripts);
+	LogSideTableFootprint("node_instance", scene.node_instance);
+	LogSideTableFootprint("node_instance_view", scene.node_instance_view);
+}
+
 //
 bool SaveSceneBinaryToFile(const char *path, const Scene &scene, const PipelineResources &resources, uint32_t flags, bool debug) {
 #ifdef ENABLE_BINARY_DEBUG_HANDLE
@@ -1867,24 +2319,143 @@ std::vector<Node> NodeRefsToNodes(const Scene &scene, const std::vector<NodeRef>
 }
 
 //
-std::vector<NodeRef> DuplicateNodes(Scene &scene, const std::vector<NodeRef> &nodes, const Reader &deps_ir, const ReadProvider &deps_ip,
+template <typename T> static ComponentRef CloneComponent(generational_vector_list<T> &list, ComponentRef ref, std::map<ComponentRef, ComponentRef> &clones) {
+	if (!list.is_valid(ref))
+		return InvalidComponentRef;
+
+	const auto i = clones.find(ref);
+	if (i != std::end(clones))
+		return i->second; // component shared by several nodes of the selection
+
+	T clone = list[ref.idx]; // copy before adding as the list storage might be reallocated
+	return clones[ref] = list.add_ref(std::move(clone));
+}
+
+std::vector<NodeRef> Scene::CloneNodes(const std::vector<NodeRef> &refs, size_t copy_count, const Reader &deps_ir, const ReadProvider &deps_ip,
 	PipelineResources &resources, const PipelineInfo &pipeline) {
-	Data data;
+	ProfilerPerfSection section("Scene::CloneNodes");
 
-	if (!scene.SaveNodes_binary(g_data_writer, DataWriteHandle(data), nodes, resources)) {
-		warn("Failed to duplicate nodes, an error occurred while saving the node selection");
-		return {};
-	}
+	// instantiated nodes are created when setting up the instance of their duplicated host
+	std::vector<NodeRef> src_refs;
+	src_refs.reserve(refs.size());
 
-	data.Rewind();
+	for (const auto &ref : refs)
+		if (const auto *node_ = GetNode_(ref))
+			if (!(node_->flags & NF_Instantiated))
+				src_refs.push_back(ref);
 
-	LoadSceneContext ctx;
-	if (!scene.LoadNodes_binary(g_data_reader, DataReadHandle(data), "DuplicateNodes", deps_ir, deps_ip, resources, pipeline, ctx)) {
-		warn("Failed to duplicate nodes, an error occurred while loading the node selection");
-		return {};
+	std::vector<NodeRef> out;
+	out.reserve(src_refs.size() * copy_count);
+
+	std::vector<NodeRef> nodes_to_disable, nodes_with_instance;
+	std::vector<ComponentRef> new_transforms;
+
+	std::map<NodeRef, NodeRef> node_refs;
+	std::array<std::map<ComponentRef, ComponentRef>, NCI_Count> component_refs;
+	std::map<ComponentRef, ComponentRef> collision_refs, script_refs, instance_refs;
+
+	const auto RemapNodeRef = [&](NodeRef &ref) {
+		if (ref != InvalidNodeRef) {
+			const auto i = node_refs.find(ref);
+			ref = i != std::end(node_refs) ? i->second : InvalidNodeRef;
+		}
+	};
+
+	for (size_t copy = 0; copy < copy_count; ++copy) {
+		node_refs.clear();
+		for (auto &i : component_refs)
+			i.clear();
+		collision_refs.clear();
+		script_refs.clear();
+		instance_refs.clear();
+
+		for (const auto &src_ref : src_refs) {
+			const auto src = nodes[src_ref.idx]; // copy as the node list storage might be reallocated
+
+			Node_ node_;
+			node_.name = src.name;
+			node_.flags = src.flags & NF_SerializedMask & ~NF_Disabled;
+
+			node_.components[NCI_Transform] = CloneComponent(transforms, src.components[NCI_Transform], component_refs[NCI_Transform]);
+			node_.components[NCI_Camera] = CloneComponent(cameras, src.components[NCI_Camera], component_refs[NCI_Camera]);
+			node_.components[NCI_Object] = CloneComponent(objects, src.components[NCI_Object], component_refs[NCI_Object]);
+			node_.components[NCI_Light] = CloneComponent(lights, src.components[NCI_Light], component_refs[NCI_Light]);
+			node_.components[NCI_RigidBody] = CloneComponent(rigid_bodies, src.components[NCI_RigidBody], component_refs[NCI_RigidBody]);
+
+			const auto ref = nodes.add_ref(std::move(node_));
+			node_refs[src_ref] = ref;
+			out.push_back(ref);
+
+			if (src.flags & NF_Disabled)
+				nodes_to_disable.push_back(ref);
+
+			if (node_collisions.contains(src_ref)) {
+				node_collisions.resize(ref, node_collisions.get(src_ref).size()); // might move the source list in the pool
+
+				const auto src_collisions = node_collisions.get(src_ref), dst_collisions = node_collisions.get(ref);
+				for (size_t j = 0; j < src_collisions.size(); ++j)
+					dst_collisions[j] = CloneComponent(collisions, src_collisions[j], collision_refs);
+			}
+
+			if (!node_scripts.get(src_ref).empty()) {
+				node_scripts.resize(ref, node_scripts.get(src_ref).size());
+
+				const auto src_scripts = node_scripts.get(src_ref), dst_scripts = node_scripts.get(ref);
+				for (size_t j = 0; j < src_scripts.size(); ++j)
+					dst_scripts[j] = CloneComponent(scripts, src_scripts[j], script_refs);
+				BumpScriptsRevision();
+			}
+
+			{
+				const auto i = node_instance.find(src_ref);
+				if (i && instances.is_valid(*i)) {
+					const auto instance_ref = CloneComponent(instances, *i, instance_refs);
+					instances[instance_ref.idx].play_anim_ref = InvalidScenePlayAnimRef;
+
+					node_instance[ref] = instance_ref;
+					nodes_with_instance.push_back(ref);
+				}
+			}
+
+			AcquireNodeComponents_(ref);
+		}
+
+		// remap parent and bone references to the duplicates of this copy
+		for (const auto &i : component_refs[NCI_Transform]) {
+			RemapNodeRef(transforms[i.second.idx].parent);
+			new_transforms.push_back(i.second);
+		}
+
+		for (const auto &i : component_refs[NCI_Object])
+			for (auto &bone : objects[i.second.idx].bones)
+				RemapNodeRef(bone);
+	}
+
+	for (const auto &ref : nodes_with_instance) {
+		NodeSetupInstance(ref, deps_ir, deps_ip, resources, pipeline);
+		NodeStartOnInstantiateAnim(ref);
 	}
 
-	return ctx.view.nodes;
+	for (const auto &ref : nodes_to_disable)
+		DisableNode(ref);
+
+	ReadyWorldMatrices();
+
+	for (const auto &ref : new_transforms)
+		ComputeTransformWorldMatrix(ref.idx);
+
+	return out;
+}
+
+//
+std::vector<NodeRef> DuplicateNodes(Scene &scene, const std::vector<NodeRef> &nodes, const Reader &deps_ir, const ReadProvider &deps_ip,
+	PipelineResources &resources, const PipelineInfo &pipeline) {
+	return scene.CloneNodes(nodes, 1, deps_ir, deps_ip, resources, pipeline);
+}
+
+std::vector<NodeRef> DuplicateNodes(Scene &scene, const std::vector<NodeRef> &nodes, size_t copy_count, const Reader &deps_ir, const ReadProvider &deps_ip,
+	PipelineResources &resources, const PipelineInfo &pipeline) {
+	return scene.CloneNodes(nodes, copy_count, deps_ir, deps_ip, resources, pipeline);
 }
 
 static std::vector<NodeRef> GetNodeAndchildren(const Scene &scene, const std::vector<NodeRef> &refs) {
@@ -1979,14 +2550,41 @@ std::vector<ScenePlayAnimRef> Scene::GetPlayingAnimRefs() const {
 
 //
 void Scene::StopAllAnims() { play_anims.clear(); }
-bool Scene::GetMinMax(const PipelineResources &resources, MinMax &minmax) const { return GetNodesMinMax(GetNodesWithComponent(NCI_Object), resources, minmax); }
+bool Scene::GetMinMax(const PipelineResources &resources, MinMax &minmax) const {
+	if (!IsSpatialIndexUpToDate(resources)) {
+		std::vector<Node> enabled_nodes;
+		for (const auto &node : GetNodesWithComponent(NCI_Object))
+			if (node.IsEnabled())
+				enabled_nodes.push_back(node);
+		return GetNodesMinMax(enabled_nodes, resources, minmax);
+	}
+
+	// bounded objects from the index, skinned objects from their bind pose
+	std::vector<Node> unbounded_nodes;
+	for (const auto &ref : object_index.unbounded)
+		unbounded_nodes.push_back(GetNode(ref));
+
+	bool has_minmax = GetNodesMinMax(unbounded_nodes, resources, minmax);
+
+	for (const auto &entry : object_index.entries)
+		if (entry.proxy != AABBTree::invalid_proxy) {
+			minmax = has_minmax ? Union(minmax, entry.bounds) : entry.bounds;
+			has_minmax = true;
+		}
+
+	return has_minmax;
+}
 
 //
 const AnimRef InvalidAnimRef;
 
 time_ns UnspecifiedAnimTime = std::numeric_limits<time_ns>::max();
 
-AnimRef Scene::AddAnim(Anim anim) { return anims.add_ref(std::move(anim)); }
+AnimRef Scene::AddAnim(Anim anim) {
+	const auto ref = anims.add_ref(std::move(anim));
+	QueueGarbageAnim_(ref); // collected if no scene animation references it
+	return ref;
+}
 
 std::vector<AnimRef> Scene::GetAnims() const {
 	std::vector<AnimRef> refs;
@@ -2204,20 +2802,19 @@ void Scene::EvaluateBoundAnim(const BoundToNodeAnim &bound_anim, time_ns t) {
 
 				auto &mat = obj->materials[mt.slot_idx];
 
-				auto i = mat.values.find(mt.value);
-				if (i == std::end(mat.values))
+				if (mat.values.find(mt.value) == std::end(mat.values))
 					continue; // invalid material value name
 
 				Vec4 v;
 				if (Evaluate(anim.vec4_tracks[mt.track_idx], t, v))
-					i->second.value = {v.x, v.y, v.z, v.w};
+					SetMaterialValue(mat, mt.value.c_str(), v); // bumps the material revision so that its bindings are rebuilt
 			}
 		}
 
 		if (!anim.instance_anim_track.keys.empty()) {
-			auto i = node_instance_view.find(bound_anim.node);
+			const auto view = node_instance_view.find(bound_anim.node);
 
-			if (i != std::end(node_instance_view)) {
+			if (view) {
 				int kf = numeric_cast<int>(anim.instance_anim_track.keys.size()) - 1;
 				for (; kf >= 0; --kf) // grab closest keys to the evaluation time
 					if (t >= anim.instance_anim_track.keys[kf].t)
@@ -2225,7 +2822,7 @@ void Scene::EvaluateBoundAnim(const BoundToNodeAnim &bound_anim, time_ns t) {
 
 				if (kf != bound_anim.bound_to_node_instance_anim.kf) {
 					const auto ref =
-						kf >= 0 ? i->second.GetSceneAnim(*this, anim.instance_anim_track.keys[kf].v.anim_name) : InvalidSceneAnimRef; // get new kf anim
+						kf >= 0 ? view->GetSceneAnim(*this, anim.instance_anim_track.keys[kf].v.anim_name) : InvalidSceneAnimRef; // get new kf anim
 
 					if (ref != InvalidSceneAnimRef)
 						bound_anim.bound_to_node_instance_anim.bound_anim = std::make_shared<SceneBoundAnim>(BindAnim(ref));
@@ -2242,7 +2839,7 @@ void Scene::EvaluateBoundAnim(const BoundToNodeAnim &bound_anim, time_ns t) {
 
 					// handle negative time scale and loop mode (both require anim time range)
 					if (key.v.t_scale < 0.f || key.v.loop_mode == ALM_Loop) {
-						const auto ref = i->second.GetSceneAnim(*this, anim.instance_anim_track.keys[kf].v.anim_name);
+						const auto ref = view->GetSceneAnim(*this, anim.instance_anim_track.keys[kf].v.anim_name);
 
 						if (const auto anim = GetSceneAnim(ref)) {
 							// handle negative t scale
@@ -2272,29 +2869,53 @@ void Scene::EvaluateBoundAnim(const BoundToNodeAnim &bound_anim, time_ns t) {
 //
 const SceneAnimRef InvalidSceneAnimRef;
 
-SceneAnimRef Scene::AddSceneAnim(SceneAnim anim) { return scene_anims.add_ref(std::move(anim)); }
-void Scene::DestroySceneAnim(SceneAnimRef ref) { scene_anims.remove_ref(ref); }
+SceneAnimRef Scene::AddSceneAnim(SceneAnim anim) {
+	AcquireSceneAnimAnims_(anim);
+	return scene_anims.add_ref(std::move(anim));
+}
 
-size_t Scene::GarbageCollectAnims() {
-	std::vector<bool> is_refd(anims.capacity(), false);
+void Scene::DestroySceneAnim(SceneAnimRef ref) {
+	if (scene_anims.is_valid(ref))
+		ReleaseSceneAnimAnims_(scene_anims[ref.idx]);
+	scene_anims.remove_ref(ref);
+}
+
+void Scene::AcquireSceneAnimAnims_(const SceneAnim &scene_anim) {
+	AcquireRef(anim_ref_counts, scene_anim.scene_anim);
+	for (const auto &node_anim : scene_anim.node_anims)
+		AcquireRef(anim_ref_counts, node_anim.anim);
+}
 
-	for (const auto &scene_anim : scene_anims) {
-		if (scene_anim.scene_anim != InvalidAnimRef)
-			is_refd[scene_anim.scene_anim.idx] = true;
+void Scene::ReleaseSceneAnimAnims_(const SceneAnim &scene_anim) {
+	if (ReleaseRef(anim_ref_counts, scene_anim.scene_anim))
+		QueueGarbageAnim_(scene_anim.scene_anim);
+	for (const auto &node_anim : scene_anim.node_anims)
+		if (ReleaseRef(anim_ref_counts, node_anim.anim))
+			QueueGarbageAnim_(node_anim.anim);
+}
 
-		for (const auto &node_anim : scene_anim.node_anims)
-			if (node_anim.anim != InvalidAnimRef)
-				is_refd[node_anim.anim.idx] = true;
-	}
+void Scene::QueueGarbageAnim_(AnimRef ref) {
+	if (garbage_anims.size() >= garbage_anims_capacity)
+		CompactGarbageAnims_();
+	garbage_anims.push_back(ref);
+}
 
+void Scene::CompactGarbageAnims_() {
+	CompactGarbageQueue(
+		garbage_anims, garbage_anims_capacity, garbage_queue_min_capacity,
+		[this](AnimRef ref) { return !IsReferenced(anim_ref_counts, ref) && anims.is_valid(ref); }, [](AnimRef a, AnimRef b) { return a < b; });
+}
+
+size_t Scene::GarbageCollectAnims() {
 	size_t removed_count = 0;
 
-	for (size_t i = 0; i < is_refd.size(); ++i)
-		if (!is_refd[i] && anims.is_used(uint32_t(i))) {
-			anims.remove(uint32_t(i));
+	for (const auto &ref : garbage_anims)
+		if (!IsReferenced(anim_ref_counts, ref) && anims.is_valid(ref)) {
+			anims.remove_ref(ref);
 			++removed_count;
 		}
 
+	garbage_anims.clear();
 	return removed_count;
 }
 
@@ -2595,9 +3216,8 @@ void SetAnimableNodePropertyVec4(Scene &scene, NodeRef ref, const std::string &n
 				if (slot_idx < obj.GetMaterialCount()) {
 					auto &mat = obj.GetMaterial(slot_idx);
 
-					auto i = mat.values.find(value);
-					if (i != std::end(mat.values))
-						i->second.value = {v.x, v.y, v.z, v.w};
+					if (mat.values.find(value) != std::end(mat.values))
+						SetMaterialValue(mat, value.c_str(), v);
 				}
 			}
 		}
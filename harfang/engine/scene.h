@@ -8,8 +8,10 @@
 #include "engine/node.h"
 #include "engine/render_pipeline.h"
 
+#include "foundation/aabb_tree.h"
 #include "foundation/easing.h"
 #include "foundation/frustum.h"
+#include "foundation/gen_ref_table.h"
 #include "foundation/generational_vector_list.h"
 #include "foundation/matrix4.h"
 #include "foundation/matrix44.h"
@@ -19,6 +21,7 @@
 #include "foundation/time.h"
 #include "foundation/unit.h"
 
+#include <array>
 #include <functional>
 #include <limits>
 #include <memory>
@@ -165,6 +168,8 @@ enum NodeComponentIdx { NCI_Transform, NCI_Camera, NCI_Object, NCI_Light, NCI_Ri
 // serialized node flags
 static const uint32_t NF_SerializedMask = 0x0000ffff;
 static const uint32_t NF_Disabled = 0x00000001; // node is disabled
+static const uint32_t NF_Static = 0x00000002; // node does not move, its opaque models can be cached in static shadow maps
+static const uint32_t NF_Occluder = 0x00000004; // node model occludes other models in the software occlusion culling
 // non-serialized node flags
 static const uint32_t NF_Instantiated = 0x00010000; // node was instantiated
 static const uint32_t NF_InstanceDisabled = 0x00020000; // node is disabled through the node that instantiated it
@@ -186,6 +191,15 @@ public:
 		and perform a single call to this function to improve performance.
 	**/
 	size_t GarbageCollect();
+	/**
+		@short Clear orphaned scene content within a time budget.
+
+		Destroying a node or detaching a component from a node queues the components it no longer references. This method destroys queued components
+		until the budget is exhausted, content left in the queue is collected by the next call.
+	**/
+	size_t GarbageCollect(time_ns t_budget);
+	/// Return the number of components and instance views queued for destruction.
+	size_t GetPendingGarbageCount() const { return garbage_components.size() + garbage_views.size() + garbage_anims.size(); }
 
 	// node
 	Node CreateNode(std::string name = {});
@@ -283,6 +297,10 @@ public:
 	/// This function is slow but useful when scene matrices are not yet up-to-date.
 	Mat4 ComputeNodeWorldMatrix(NodeRef ref) const;
 
+	/// Set the world matrix of a list of nodes, invalid nodes are skipped and reported by a single warning.
+	/// @see SetNodeWorldMatrix
+	void SetNodesWorldMatrix(const std::vector<NodeRef> &refs, const std::vector<Mat4> &worlds);
+
 	//
 	void StorePreviousWorldMatrices();
 	void ReadyWorldMatrices();
@@ -565,7 +583,10 @@ public:
 	Script GetScript(size_t slot_idx) const;
 
 	const std::vector<ComponentRef> &GetSceneScripts() const { return scene_scripts; }
-	const std::map<NodeRef, std::vector<ComponentRef>> &GetNodeScripts() const { return node_scripts; }
+	const gen_ref_list_table<ComponentRef> &GetNodeScripts() const { return node_scripts; }
+
+	/// Return a counter incremented each time a script component is created, destroyed or attached/detached from the scene or a node.
+	uint32_t GetScriptsRevision() const { return scripts_revision; }
 
 	/// Holds the canvas properties of a scene, see the `canvas` member of class Scene.
 	struct Canvas {
@@ -612,8 +633,40 @@ public:
 	void GetModelDisplayLists(std::vector<ModelDisplayList> &out_opaque, std::vector<ModelDisplayList> &out_transparent,
 		std::vector<SkinnedModelDisplayList> &out_opaque_skinned, std::vector<SkinnedModelDisplayList> &out_transparent_skinned,
 		const PipelineResources &resources) const;
+	/// Same as above but opaque display lists of nodes flagged NF_Static are output to out_static_opaque.
+	void GetModelDisplayLists(std::vector<ModelDisplayList> &out_opaque, std::vector<ModelDisplayList> &out_static_opaque,
+		std::vector<ModelDisplayList> &out_transparent, std::vector<SkinnedModelDisplayList> &out_opaque_skinned,
+		std::vector<SkinnedModelDisplayList> &out_transparent_skinned, const PipelineResources &resources) const;
+	/// Same as above but only output the display lists of a set of nodes.
+	/// @see QueryObjectNodes.
+	void GetModelDisplayLists(const std::vector<NodeRef> &node_refs, std::vector<ModelDisplayList> &out_opaque,
+		std::vector<ModelDisplayList> &out_transparent, std::vector<SkinnedModelDisplayList> &out_opaque_skinned,
+		std::vector<SkinnedModelDisplayList> &out_transparent_skinned, const PipelineResources &resources) const;
+	/// Return the models of nodes flagged NF_Occluder which have an occluder mesh.
+	void GetModelOccluders(std::vector<ModelOccluder> &out_occluders, const PipelineResources &resources) const;
+
+	// spatial index
+	/*!
+		Update the spatial index over the world bounds of enabled object and light nodes, call after Update() for queries to reflect the current world
+		matrices. Only the nodes created, destroyed, enabled, disabled or given a new component and the nodes whose world matrix changed since the
+		previous update are visited. Changing an object model, a light type or radius or reloading a model revisits all nodes.
+		Skinned objects, linear lights and lights with an infinite radius are not indexed and are returned by all queries.
+	*/
+	void UpdateSpatialIndex(const PipelineResources &resources);
+	/// Return true if the spatial index reflects the current scene state, false if it was never updated or the scene changed since.
+	bool IsSpatialIndexUpToDate(const PipelineResources &resources) const;
 
-	//
+	/// Return the object nodes whose world bounds intersect a frustum, a box or a sphere. Queries are conservative and may return nodes close to the volume.
+	void QueryObjectNodes(const Frustum &frustum, std::vector<NodeRef> &out_nodes) const;
+	void QueryObjectNodes(const MinMax &bounds, std::vector<NodeRef> &out_nodes) const;
+	void QueryObjectNodes(const Vec3 &center, float radius, std::vector<NodeRef> &out_nodes) const;
+
+	/// Return the light nodes whose range intersects a frustum, a box or a sphere. Queries are conservative and may return lights close to the volume.
+	void QueryLightNodes(const Frustum &frustum, std::vector<NodeRef> &out_nodes) const;
+	void QueryLightNodes(const MinMax &bounds, std::vector<NodeRef> &out_nodes) const;
+	void QueryLightNodes(const Vec3 &center, float radius, std::vector<NodeRef> &out_nodes) const;
+
+	/// Return the world bounds of the enabled object nodes, read from the spatial index when it is up to date.
 	bool GetMinMax(const PipelineResources &resources, MinMax &minmax) const;
 
 	// low-level animation
@@ -660,6 +713,12 @@ public:
 
 	SceneAnimRef DuplicateSceneAnim(SceneAnimRef ref);
 
+	/**
+		@short Destroy the animations no longer referenced by a scene animation.
+
+		A scene animation references its animations from AddSceneAnim to DestroySceneAnim. Animations assigned to a scene animation modified in
+		place through GetSceneAnim are not counted. Only the animations queued since the previous call are checked.
+	**/
 	size_t GarbageCollectAnims();
 
 	// scene meta
@@ -670,6 +729,17 @@ public:
 	std::string GetValue(const std::string &key) const;
 	void SetValue(const std::string &key, const std::string &value);
 
+	/*!
+		Duplicate a selection of nodes copy_count times by copying their components in memory, resources are shared with the original nodes.
+		Return the duplicates of each copy one after the other, in the selection order.
+
+		Components shared by nodes of the selection are shared by their duplicates in each copy. Parent and bone references to nodes of the selection are
+		remapped to their duplicates, references to nodes outside of the selection are cleared. Instantiated nodes are skipped and the instance of each
+		duplicated instance node is setup anew.
+	*/
+	std::vector<NodeRef> CloneNodes(const std::vector<NodeRef> &refs, size_t copy_count, const Reader &deps_ir, const ReadProvider &deps_ip,
+		PipelineResources &resources, const PipelineInfo &pipeline);
+
 	// serialization (member as we directly access low-level structures for better performances)
 	bool Save_binary(const Writer &iw, const Handle &h, const PipelineResources &resources, uint32_t flags = LSSF_All,
 		const std::vector<NodeRef> *nodes_to_save = nullptr) const;
@@ -689,10 +759,44 @@ private:
 	std::map<std::string, std::string> key_values;
 
 	friend void DumpSceneMemoryFootprint();
+	friend void DumpSceneMemoryFootprint(const Scene &scene);
 
 	intrusive_shared_ptr_st<SceneRef> scene_ref;
 
-	size_t GarbageCollectPass();
+	// reference counting and deferred destruction of components
+	static const uint8_t GCL_Collision = NCI_Count, GCL_Script = NCI_Count + 1, GCL_Instance = NCI_Count + 2, GCL_Count = NCI_Count + 3;
+
+	struct ComponentRefCount_ {
+		uint32_t gen{0xffffffff}; // generation of the component the count applies to
+		uint32_t count{0};
+	};
+
+	std::array<std::vector<ComponentRefCount_>, GCL_Count> component_ref_counts; // indexed by component list then component index
+
+	struct Garbage_ {
+		ComponentRef ref;
+		uint8_t list;
+	};
+
+	static const size_t garbage_queue_min_capacity = 256;
+
+	std::vector<Garbage_> garbage_components; // components which might no longer be referenced
+	size_t garbage_components_capacity{garbage_queue_min_capacity}; // the queue is compacted when it reaches this size
+	std::vector<SceneView> garbage_views; // instance views of destroyed or detached instances
+
+	/// Queue a newly created component so that it is collected if it is never attached to a node.
+	ComponentRef TrackComponent_(uint8_t list, ComponentRef ref);
+	void QueueGarbageComponent_(uint8_t list, ComponentRef ref);
+	/// Drop queued components which were attached or destroyed since they were queued, and duplicate entries.
+	void CompactGarbageComponents_();
+	bool IsValidComponent_(uint8_t list, ComponentRef ref) const;
+	void AcquireComponent_(uint8_t list, ComponentRef ref);
+	void ReleaseComponent_(uint8_t list, ComponentRef ref);
+	void AcquireNodeComponents_(NodeRef ref); // after node components were written directly
+	bool IsComponentReferenced_(uint8_t list, ComponentRef ref) const;
+	bool DestroyGarbageComponent_(const Garbage_ &garbage);
+
+	void SetNodeComponent_(NodeRef ref, NodeComponentIdx idx, ComponentRef cref);
 
 	// nodes
 	struct Node_ { // 52B
@@ -711,6 +815,11 @@ private:
 	void EnableNode_(NodeRef ref, bool through_instance);
 	void DisableNode_(NodeRef ref, bool through_instance);
 
+	void GetModelDisplayLists_(const std::vector<NodeRef> *node_refs, std::vector<ModelDisplayList> &out_opaque,
+		std::vector<ModelDisplayList> *out_static_opaque, std::vector<ModelDisplayList> &out_transparent,
+		std::vector<SkinnedModelDisplayList> &out_opaque_skinned, std::vector<SkinnedModelDisplayList> &out_transparent_skinned,
+		const PipelineResources &resources) const;
+
 	// component helpers
 	template <int I> inline ComponentRef GetNodeComponentRef_(NodeRef ref) const {
 		auto node_ = this->GetNode_(ref);
@@ -799,7 +908,7 @@ private:
 	};
 
 	generational_vector_list<Collision_> collisions;
-	std::map<NodeRef, std::vector<ComponentRef>> node_collisions;
+	gen_ref_list_table<ComponentRef> node_collisions;
 
 	//
 	struct Script_ {
@@ -810,7 +919,11 @@ private:
 	generational_vector_list<Script_> scripts;
 
 	std::vector<ComponentRef> scene_scripts;
-	std::map<NodeRef, std::vector<ComponentRef>> node_scripts;
+	gen_ref_list_table<ComponentRef> node_scripts;
+
+	uint32_t scripts_revision{0};
+
+	void BumpScriptsRevision();
 
 	//
 	struct Instance_ {
@@ -822,8 +935,8 @@ private:
 
 	generational_vector_list<Instance_> instances; // create/destroy
 
-	std::map<NodeRef, ComponentRef> node_instance; // node to instance component
-	std::map<NodeRef, SceneView> node_instance_view; // node to instance scene view
+	gen_ref_table<ComponentRef> node_instance; // node to instance component
+	gen_ref_table<SceneView> node_instance_view; // node to instance scene view
 
 	//
 	friend void LoadComponent(Transform_ *data_, const Reader &ir, const Handle &h);
@@ -874,10 +987,52 @@ private:
 	std::vector<Mat4> previous_transform_worlds;
 	std::vector<bool> previous_transform_worlds_updated;
 
+	//
+	struct SpatialIndexEntry {
+		NodeRef ref;
+		int32_t proxy{AABBTree::invalid_proxy};
+		Mat4 world; // world matrix and shape the proxy bounds were computed from
+		uint32_t shape;
+		MinMax bounds; // proxy bounds before enlargement
+		bool unbounded{false}; // listed in unbounded instead of having a proxy
+	};
+
+	struct SpatialIndex {
+		AABBTree tree;
+		std::vector<SpatialIndexEntry> entries; // per node index
+		std::vector<NodeRef> unbounded; // nodes returned by all queries
+	};
+
+	SpatialIndex object_index, light_index;
+
+	// changes since the previous spatial index update, only tracked once the index is built
+	bool spatial_index_built{false}, spatial_index_rescan{false};
+	uint32_t spatial_index_model_revision{0};
+	std::vector<uint32_t> spatial_index_dirty_nodes, spatial_index_dirty_transforms; // overflowing the node or transform count triggers a rescan
+	std::vector<uint32_t> spatial_index_transform_nodes; // indexed node of each transform
+	bool spatial_index_shared_transforms{false}; // a transform is used by several indexed nodes, dirty transforms trigger a rescan
+
+	void MarkSpatialIndexNodeDirty_(uint32_t idx);
+	void MarkSpatialIndexTransformDirty_(uint32_t idx);
+	void MarkSpatialIndexRescan_() { spatial_index_rescan = spatial_index_built; }
+
+	void UpdateSpatialIndexNode_(uint32_t idx, const PipelineResources &resources, bool force);
+
+	void OutputSpatialIndexQuery_(const SpatialIndex &index, const std::vector<uint32_t> &idxs, std::vector<NodeRef> &out_nodes) const;
+
 	//
 	generational_vector_list<Anim> anims;
 	generational_vector_list<SceneAnim> scene_anims;
 
+	std::vector<ComponentRefCount_> anim_ref_counts; // references to anims held by scene anims, indexed by anim index
+	std::vector<AnimRef> garbage_anims; // anims which might no longer be referenced
+	size_t garbage_anims_capacity{garbage_queue_min_capacity};
+
+	void QueueGarbageAnim_(AnimRef ref);
+	void CompactGarbageAnims_();
+	void AcquireSceneAnimAnims_(const SceneAnim &scene_anim);
+	void ReleaseSceneAnimAnims_(const SceneAnim &scene_anim);
+
 	//
 	static constexpr uint8_t SPAF_Paused = 0x1;
 
@@ -981,6 +1136,10 @@ bool LoadSceneFromAssets(
 //
 std::vector<NodeRef> DuplicateNodes(Scene &scene, const std::vector<NodeRef> &nodes, const Reader &deps_ir, const ReadProvider &deps_ip,
 	PipelineResources &resources, const PipelineInfo &pipeline);
+/// Duplicate a list of nodes copy_count times, return the duplicated nodes of each copy one after the other.
+/// @see Scene::CloneNodes.
+std::vector<NodeRef> DuplicateNodes(Scene &scene, const std::vector<NodeRef> &nodes, size_t copy_count, const Reader &deps_ir, const ReadProvider &deps_ip,
+	PipelineResources &resources, const PipelineInfo &pipeline);
 
 /// Duplicate each node of a list. Resources will be loaded from the local filesystem.
 std::vector<Node> DuplicateNodesFromFile(Scene &scene, const std::vector<Node> &nodes, PipelineResources &resources, const PipelineInfo &pipeline);
@@ -998,6 +1157,8 @@ std::vector<Node> DuplicateNodeAndChildrenFromAssets(Scene &scene, Node node, Pi
 
 //
 void DumpSceneMemoryFootprint();
+/// Log the memory used by the per-node side tables of a scene and an estimate of the memory they would use if stored in std::map.
+void DumpSceneMemoryFootprint(const Scene &scene);
 
 //
 bool GetAnimableNodePropertyBool(const Scene &scene, NodeRef ref, const std::string &name);
@@ -10,6 +10,8 @@
 #include "foundation/log.h"
 #include "foundation/rw_interface.h"
 #include "foundation/vector3.h"
+#include "foundation/worker_pool.h"
+#include "foundation/xxhash.h"
 
 #include <btBulletDynamicsCommon.h>
 
@@ -22,15 +24,19 @@
 
 #include <Serialize/BulletWorldImporter/btBulletWorldImporter.h>
 
+#include <cstring>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 
 namespace hg {
 
 btRigidBody *SceneBullet3Physics::GetNodeBody(NodeRef ref, const char *func) const {
-	const auto i = nodes.find(ref);
+	const auto idx = GetBodyIdx(ref);
 
-	if (i != std::end(nodes))
-		return i->second.body;
+	if (idx != invalid_body_idx)
+		return bodies[idx].body;
 
 	if (func)
 		warn(format("Node physics missing when calling %1 for NodeRef %2:%3").arg(func).arg(ref.gen).arg(ref.idx));
@@ -226,17 +232,167 @@ static void __DeleteRigidBody(const btRigidBody *body) {
 	delete body;
 }
 
+//
+struct Bullet3CollisionTree {
+	std::vector<char> content; // serialized data as loaded, compared on a cache hit
+	std::unique_ptr<btBulletWorldImporter> importer; // owns the shape, its mesh and its BVH
+	btCollisionShape *shape{nullptr};
+	int ref_count{0};
+};
+
+using Bullet3CollisionTreeKey = std::pair<unsigned long long, size_t>; // content hash and size
+
+static std::mutex collision_tree_cache_mutex;
+static std::multimap<Bullet3CollisionTreeKey, Bullet3CollisionTree> collision_tree_cache;
+
+static Bullet3CollisionTreeKey GetCollisionTreeKey(const void *data, size_t size) { return {XXH64(data, size, 0), size}; }
+
+// must be called with the cache mutex held
+static Bullet3CollisionTree *FindCachedCollisionTree(const Bullet3CollisionTreeKey &key, const void *data) {
+	const auto range = collision_tree_cache.equal_range(key);
+	for (auto i = range.first; i != range.second; ++i)
+		if (memcmp(i->second.content.data(), data, key.second) == 0) // hash collision otherwise
+			return &i->second;
+	return nullptr;
+}
+
+/*
+	A collision tree is only parsed once per process no matter how many physics worlds use it, the serialized BVH
+	stored by bulletc is restored as is.
+*/
+static btCollisionShape *AcquireCachedCollisionTree(const Bullet3CollisionTreeKey &key, const void *data) {
+	std::lock_guard<std::mutex> lock(collision_tree_cache_mutex);
+
+	auto tree = FindCachedCollisionTree(key, data);
+	if (!tree)
+		return nullptr;
+
+	++tree->ref_count;
+	return tree->shape;
+}
+
+// the importer parses in place, `data` is modified
+static btCollisionShape *AcquireCollisionTree(const char *name, const Bullet3CollisionTreeKey &key, std::vector<char> &data) {
+	std::lock_guard<std::mutex> lock(collision_tree_cache_mutex);
+
+	auto tree = FindCachedCollisionTree(key, data.data());
+
+	if (!tree) {
+		std::vector<char> content(data); // keep the content as loaded before parsing modifies it
+		std::unique_ptr<btBulletWorldImporter> importer(new btBulletWorldImporter);
+
+		if (!importer->loadFileFromMemory(data.data(), int(data.size())) || !importer->getNumCollisionShapes()) {
+			error(format("Failed to load Bullet3 collision tree '%1'").arg(name));
+			importer->deleteAllData();
+			return nullptr;
+		}
+
+		tree = &collision_tree_cache.emplace(key, Bullet3CollisionTree{})->second;
+		tree->content = std::move(content);
+		tree->shape = importer->getCollisionShapeByIndex(0);
+		tree->importer = std::move(importer);
+	}
+
+	++tree->ref_count;
+	return tree->shape;
+}
+
+static void ReleaseCollisionTree(const btCollisionShape *shape) {
+	if (!shape)
+		return;
+
+	std::lock_guard<std::mutex> lock(collision_tree_cache_mutex);
+
+	for (auto i = std::begin(collision_tree_cache); i != std::end(collision_tree_cache); ++i)
+		if (i->second.shape == shape) {
+			if (--i->second.ref_count == 0) {
+				i->second.importer->deleteAllData();
+				collision_tree_cache.erase(i);
+			}
+			break;
+		}
+}
+
+size_t GetBullet3CollisionTreeCacheSize() {
+	std::lock_guard<std::mutex> lock(collision_tree_cache_mutex);
+	return collision_tree_cache.size();
+}
+
+//
+void SceneBullet3Physics::AddBody(NodeRef ref, btRigidBody *body) {
+	if (ref.idx >= node_body_idx.size())
+		node_body_idx.resize(ref.idx + 1, invalid_body_idx);
+
+	node_body_idx[ref.idx] = uint32_t(bodies.size());
+
+	Bullet3Node _node;
+	_node.body = body;
+
+	bodies.push_back(_node);
+	body_nodes.push_back(ref);
+	prv_world_mtx.push_back(Mat4::Identity);
+	prv_world_mtx_valid.push_back(0);
+
+	motion_lists_dirty = true;
+}
+
+void SceneBullet3Physics::RemoveBody(uint32_t idx) {
+	const auto last = uint32_t(bodies.size() - 1);
+
+	node_body_idx[body_nodes[idx].idx] = invalid_body_idx;
+
+	if (idx != last) {
+		bodies[idx] = bodies[last];
+		body_nodes[idx] = body_nodes[last];
+		prv_world_mtx[idx] = prv_world_mtx[last];
+		prv_world_mtx_valid[idx] = prv_world_mtx_valid[last];
+
+		node_body_idx[body_nodes[idx].idx] = idx;
+	}
+
+	bodies.pop_back();
+	body_nodes.pop_back();
+	prv_world_mtx.pop_back();
+	prv_world_mtx_valid.pop_back();
+
+	motion_lists_dirty = true;
+}
+
+void SceneBullet3Physics::UpdateMotionLists() {
+	if (!motion_lists_dirty)
+		return;
+
+	dynamic_bodies.clear();
+	kinematic_bodies.clear();
+	dynamic_nodes.clear();
+	kinematic_nodes.clear();
+
+	for (uint32_t idx = 0; idx < bodies.size(); ++idx) {
+		const auto flags = bodies[idx].body->getCollisionFlags();
+
+		if (flags == btRigidBody::CF_DYNAMIC_OBJECT) {
+			dynamic_bodies.push_back(idx);
+			dynamic_nodes.push_back(body_nodes[idx]);
+		} else if (flags == btRigidBody::CF_KINEMATIC_OBJECT) {
+			kinematic_bodies.push_back(idx);
+			kinematic_nodes.push_back(body_nodes[idx]);
+		}
+	}
+
+	motion_lists_dirty = false;
+}
+
 void SceneBullet3Physics::NodeCreatePhysics(const Node &node, const Reader &ir, const ReadProvider &ip) {
 	auto rb = node.GetRigidBody();
 	if (!rb)
 		return; // no rigid body component
 
-	auto &_node = nodes[node.ref];
+	const auto idx = GetBodyIdx(node.ref);
 
-	if (_node.body) {
-		world->removeRigidBody(_node.body);
-		__DeleteRigidBody(_node.body);
-		_node.body = nullptr;
+	if (idx != invalid_body_idx) {
+		world->removeRigidBody(bodies[idx].body);
+		__DeleteRigidBody(bodies[idx].body);
+		RemoveBody(idx);
 	}
 
 	if (!node.GetCollisionCount())
@@ -245,6 +401,9 @@ void SceneBullet3Physics::NodeCreatePhysics(const Node &node, const Reader &ir,
 	std::vector<btCollisionShape *> shapes;
 	shapes.reserve(4);
 
+	std::vector<Mat4> shape_mtxs;
+	shape_mtxs.reserve(4);
+
 	float total_mass = 0.f;
 
 	for (size_t idx = 0; idx < node.GetCollisionCount(); ++idx) {
@@ -264,14 +423,20 @@ void SceneBullet3Physics::NodeCreatePhysics(const Node &node, const Reader &ir,
 		} else if (type == CT_Cylinder) {
 			shapes.push_back(new btCylinderShape(btVector3(size.x, size.y * 0.5f, size.z)));
 		} else if (type == CT_Mesh) {
-			if (auto tree = LoadCollisionTree(ir, ip, col.GetCollisionResource().c_str()))
-				shapes.push_back(tree);
+			if (auto tree = LoadCollisionTree(ir, ip, col.GetCollisionResource().c_str())) {
+				shapes.push_back(tree); // collision trees are shared, do not write to them
+				shape_mtxs.push_back(col.GetLocalTransform());
+				total_mass += col.GetMass();
+			}
+			continue;
 		} else {
 			error(format("Collision Type not implemented: %1").arg(type));
+			continue;
 		}
 
 		shapes.back()->setUserIndex(node.ref.idx); // ref back to node
-		total_mass += col.GetMass();
+		shape_mtxs.push_back(col.GetLocalTransform());
+		total_mass += col.GetMass(); // only account for the shapes actually created
 	}
 
 	auto trs = node.GetTransform();
@@ -281,10 +446,8 @@ void SceneBullet3Physics::NodeCreatePhysics(const Node &node, const Reader &ir,
 
 	if (!shapes.empty()) {
 		auto root_shape = new btCompoundShape;
-		for (size_t idx = 0; idx < node.GetCollisionCount(); ++idx) {
-			const auto col = node.GetCollision(idx);
-			root_shape->addChildShape(to_btTransform(col.GetLocalTransform()), shapes[idx]);
-		}
+		for (size_t idx = 0; idx < shapes.size(); ++idx)
+			root_shape->addChildShape(to_btTransform(shape_mtxs[idx]), shapes[idx]);
 
 		root_shape->setUserIndex(node.ref.idx); // ref back to node
 
@@ -301,24 +464,25 @@ void SceneBullet3Physics::NodeCreatePhysics(const Node &node, const Reader &ir,
 		rb_info.m_linearDamping = rb.GetLinearDamping();
 		rb_info.m_angularDamping = rb.GetAngularDamping();
 
-		_node.body = new btRigidBody(rb_info);
+		auto body = new btRigidBody(rb_info);
 
-		_node.body->setCollisionShape(root_shape);
-		_node.body->setUserIndex(node.ref.idx); // ref back to node
+		body->setCollisionShape(root_shape);
+		body->setUserIndex(node.ref.idx); // ref back to node
 
 		// configure
 		const auto type = rb.GetType();
-		const auto flags = _node.body->getCollisionFlags();
+		const auto flags = body->getCollisionFlags();
 
 		if (type == RBT_Dynamic)
-			_node.body->setCollisionFlags(flags & ~(btRigidBody::CF_KINEMATIC_OBJECT | btCollisionObject::CF_STATIC_OBJECT));
+			body->setCollisionFlags(flags & ~(btRigidBody::CF_KINEMATIC_OBJECT | btCollisionObject::CF_STATIC_OBJECT));
 		else if (type == RBT_Kinematic)
-			_node.body->setCollisionFlags((flags | btRigidBody::CF_KINEMATIC_OBJECT) & ~btCollisionObject::CF_STATIC_OBJECT);
+			body->setCollisionFlags((flags | btRigidBody::CF_KINEMATIC_OBJECT) & ~btCollisionObject::CF_STATIC_OBJECT);
 		else
-			_node.body->setCollisionFlags((flags & ~btRigidBody::CF_KINEMATIC_OBJECT) | btCollisionObject::CF_STATIC_OBJECT);
+			body->setCollisionFlags((flags & ~btRigidBody::CF_KINEMATIC_OBJECT) | btCollisionObject::CF_STATIC_OBJECT);
 
 		// add to world
-		world->addRigidBody(_node.body);
+		world->addRigidBody(body);
+		AddBody(node.ref, body);
 	}
 }
 
@@ -327,31 +491,39 @@ void SceneBullet3Physics::NodeCreatePhysicsFromAssets(const Node &node) { NodeCr
 
 //
 void SceneBullet3Physics::NodeDestroyPhysics(const Node &node) {
-	auto i = nodes.find(node.ref);
+	const auto idx = GetBodyIdx(node.ref);
 
-	if (i != std::end(nodes)) {
-		world->removeRigidBody(i->second.body);
-		__DeleteRigidBody(i->second.body);
-		nodes.erase(i);
+	if (idx != invalid_body_idx) {
+		world->removeRigidBody(bodies[idx].body);
+		__DeleteRigidBody(bodies[idx].body);
+		RemoveBody(idx);
 	}
 }
 
 //
 void SceneBullet3Physics::ClearNodes() {
-	for (auto i : nodes) // EJ maximize code cache hit by first removing all then deleting all
-		world->removeRigidBody(i.second.body);
+	for (const auto &i : bodies) // EJ maximize code cache hit by first removing all then deleting all
+		world->removeRigidBody(i.body);
 
-	for (auto i : nodes)
-		__DeleteRigidBody(i.second.body);
+	for (const auto &i : bodies)
+		__DeleteRigidBody(i.body);
+
+	bodies.clear();
+	body_nodes.clear();
+	node_body_idx.clear();
+
+	prv_world_mtx.clear();
+	prv_world_mtx_valid.clear();
+	was_teleported.clear();
 
-	nodes.clear();
+	motion_lists_dirty = true;
 }
 
 void SceneBullet3Physics::Clear() {
 	ClearNodes();
 
 	for (auto i : collision_trees)
-		;
+		ReleaseCollisionTree(i.second);
 
 	collision_trees.clear();
 }
@@ -359,38 +531,57 @@ void SceneBullet3Physics::Clear() {
 //
 size_t SceneBullet3Physics::GarbageCollect(const Scene &scene) {
 	size_t erased = 0;
-	for (auto i = std::begin(nodes); i != std::end(nodes);)
-		if (!scene.IsValidNodeRef(i->first)) {
-			world->removeRigidBody(i->second.body);
-			__DeleteRigidBody(i->second.body);
-			i = nodes.erase(i);
+	for (auto idx = uint32_t(bodies.size()); idx-- > 0;) // walk backward so that entries swapped in by RemoveBody were already visited
+		if (!scene.IsValidNodeRef(body_nodes[idx])) {
+			world->removeRigidBody(bodies[idx].body);
+			__DeleteRigidBody(bodies[idx].body);
+			RemoveBody(idx);
 
 			++erased;
-		} else {
-			++i;
 		}
 	return erased;
 }
 
 size_t SceneBullet3Physics::GarbageCollectResources() {
-	// TODO run through existing bodies and destroy all orphaned collision trees
-	return 0;
+	std::set<const btCollisionShape *> in_use;
+
+	for (const auto &i : bodies)
+		if (auto root_shape = static_cast<const btCompoundShape *>(i.body->getCollisionShape()))
+			for (int j = 0; j < root_shape->getNumChildShapes(); ++j)
+				in_use.insert(root_shape->getChildShape(j));
+
+	size_t erased = 0;
+	for (auto i = std::begin(collision_trees); i != std::end(collision_trees);)
+		if (in_use.find(i->second) == std::end(in_use)) {
+			ReleaseCollisionTree(i->second);
+			i = collision_trees.erase(i);
+
+			++erased;
+		} else {
+			++i;
+		}
+	return erased;
 }
 
 //
 void SceneBullet3Physics::StepSimulation(time_ns dt, time_ns step, int max_step) {
+	UpdateMotionLists();
+
 	// store current matrices to use as previous matrices should a physics sub-step be taken
-	std::map<NodeRef, Mat4> prv_mtx;
+	step_world_mtx.resize(bodies.size());
+	step_world_mtx_valid.assign(bodies.size(), 0);
 
-	for (const auto &i : nodes) {
-		const auto body = i.second.body;
-		if (body->getCollisionFlags() == btRigidBody::CF_DYNAMIC_OBJECT)
-			prv_mtx[i.first] = from_btTransform(body->getWorldTransform());
+	for (const auto idx : dynamic_bodies) {
+		step_world_mtx[idx] = from_btTransform(bodies[idx].body->getWorldTransform());
+		step_world_mtx_valid[idx] = 1;
 	}
 
-	// remove previous matrix for teleported nodes ([EJ] two step to avoid n2 queries)
-	for (auto ref : was_teleported)
-		prv_mtx.erase(ref);
+	// no previous matrix for teleported nodes
+	for (auto ref : was_teleported) {
+		const auto idx = GetBodyIdx(ref);
+		if (idx != invalid_body_idx)
+			step_world_mtx_valid[idx] = 0;
+	}
 
 	was_teleported.clear();
 
@@ -398,8 +589,10 @@ void SceneBullet3Physics::StepSimulation(time_ns dt, time_ns step, int max_step)
 	const auto substep_count = world->stepSimulation(time_to_sec_f(dt), max_step, time_to_sec_f(step));
 
 	// if substep was taken commit to prv_world_mtx
-	if (substep_count > 0)
-		prv_world_mtx = std::move(prv_mtx); // [EJ] would be much better to know beforehand that substep count will be >0 and work on prv_world_mtx directly
+	if (substep_count > 0) {
+		std::swap(prv_world_mtx, step_world_mtx);
+		std::swap(prv_world_mtx_valid, step_world_mtx_valid);
+	}
 
 	//
 	physics_motion_clock += dt - substep_count * step;
@@ -408,46 +601,36 @@ void SceneBullet3Physics::StepSimulation(time_ns dt, time_ns step, int max_step)
 
 //
 void SceneBullet3Physics::SyncTransformsFromScene(const Scene &scene) {
-	for (const auto &i : nodes) {
-		const auto body = i.second.body;
-		const auto flags = body->getCollisionFlags();
-
-		if (flags == btRigidBody::CF_KINEMATIC_OBJECT) {
-			/*
-				[EJ] ComputeNodeWorldMatrix is wasteful and only required so that the first frame
-				synchronization is correct as the scene matrices have not been computed yet.
-
-				We count on the fact that kinematic objects are a minority in the scene graph for
-				this change to not impact performances too much.
-			*/
-			const auto world_no_scale = Normalize(scene.ComputeNodeWorldMatrix(i.first));
-			body->setWorldTransform(to_btTransform(world_no_scale));
-		}
+	UpdateMotionLists();
+
+	for (size_t i = 0; i < kinematic_bodies.size(); ++i) {
+		/*
+			[EJ] ComputeNodeWorldMatrix is wasteful and only required so that the first frame
+			synchronization is correct as the scene matrices have not been computed yet.
+
+			We count on the fact that kinematic objects are a minority in the scene graph for
+			this change to not impact performances too much.
+		*/
+		const auto world_no_scale = Normalize(scene.ComputeNodeWorldMatrix(kinematic_nodes[i]));
+		bodies[kinematic_bodies[i]].body->setWorldTransform(to_btTransform(world_no_scale));
 	}
 }
 
 void SceneBullet3Physics::SyncTransformsToScene(Scene &scene) {
-	Mat4 world;
+	UpdateMotionLists();
 
-	for (const auto &i : nodes) {
-		const auto body = i.second.body;
-		const auto flags = body->getCollisionFlags();
-
-		if (flags == btRigidBody::CF_DYNAMIC_OBJECT) {
-			const auto j = prv_world_mtx.find(i.first);
+	sync_world_mtx.resize(dynamic_bodies.size());
 
-			if (j != std::end(prv_world_mtx)) {
-				const auto prv_world = j->second;
-				const auto cur_world = from_btTransform(body->getWorldTransform());
+	parallel_for(dynamic_bodies.size(), 512, [&](size_t begin, size_t end) {
+		for (auto i = begin; i < end; ++i) {
+			const auto idx = dynamic_bodies[i];
+			const auto cur_world = from_btTransform(bodies[idx].body->getWorldTransform());
 
-				world = LerpAsOrthonormalBase(prv_world, cur_world, physics_motion_k);
-			} else {
-				world = from_btTransform(body->getWorldTransform());
-			}
-
-			scene.SetNodeWorldMatrix(i.first, world); // EJ20222101 do not use Transform.SetWorld which is much slower
+			sync_world_mtx[i] = prv_world_mtx_valid[idx] ? LerpAsOrthonormalBase(prv_world_mtx[idx], cur_world, physics_motion_k) : cur_world;
 		}
-	}
+	});
+
+	scene.SetNodesWorldMatrix(dynamic_nodes, sync_world_mtx); // EJ20222101 do not use Transform.SetWorld which is much slower
 }
 
 //
@@ -773,17 +956,6 @@ std::vector<RaycastOut> SceneBullet3Physics::RaycastAllHits(const Scene &scene,
 	return outs;
 }
 
-//
-struct DeserializeHandle {
-	Reader ir;
-	Handle h;
-};
-
-static void _ReadCollisionMesh(void *const deserializeHandle, void *const buffer, int size) {
-	auto hnd = reinterpret_cast<const DeserializeHandle *>(deserializeHandle);
-	hnd->ir.read(hnd->h, buffer, size);
-}
-
 btCollisionShape *SceneBullet3Physics::LoadCollisionTree(const Reader &ir, const ReadProvider &ip, const char *name, int id) {
 	auto i = collision_trees.find(name);
 	if (i != std::end(collision_trees))
@@ -792,22 +964,17 @@ btCollisionShape *SceneBullet3Physics::LoadCollisionTree(const Reader &ir, const
 	btCollisionShape *collision = nullptr;
 
 	ScopedReadHandle h(ip, name);
-	DeserializeHandle hnd = {ir, h};
 
-	if (ir.is_valid(hnd.h)) {
-		btBulletWorldImporter importer;
+	if (ir.is_valid(h)) {
 		const size_t size = ir.size(h);
 
-		std::vector<char> buffer(size, 0);
-		ir.read(h, buffer.data(), size);
-
-		if (importer.loadFileFromMemory(buffer.data(), size)) {
-			const int numShape = importer.getNumCollisionShapes();
+		std::vector<char> data(size);
+		if (ir.read(h, data.data(), size) == size) {
+			const auto key = GetCollisionTreeKey(data.data(), size);
 
-			if (numShape)
-				collision = importer.getCollisionShapeByIndex(0);
-			else
-				error(format("Failed to load Bullet3 collision tree '%1'").arg(name));
+			collision = AcquireCachedCollisionTree(key, data.data());
+			if (!collision)
+				collision = AcquireCollisionTree(name, key, data); // parsed from the data just read
 		}
 	}
 
@@ -819,6 +986,28 @@ btCollisionShape *SceneBullet3Physics::LoadCollisionTree(const Reader &ir, const
 	return collision;
 }
 
+btCollisionShape *SceneBullet3Physics::LoadCollisionTreeFromMemory(const char *name, const void *data, size_t size, int id) {
+	auto i = collision_trees.find(name);
+	if (i != std::end(collision_trees))
+		return i->second;
+
+	const auto key = GetCollisionTreeKey(data, size);
+
+	auto collision = AcquireCachedCollisionTree(key, data);
+
+	if (!collision) {
+		std::vector<char> copy(reinterpret_cast<const char *>(data), reinterpret_cast<const char *>(data) + size); // data is read-only
+		collision = AcquireCollisionTree(name, key, copy);
+	}
+
+	collision_trees[name] = collision;
+
+	if (!collision)
+		warn(format("Failed to load Bullet3 collision tree '%1'").arg(name));
+
+	return collision;
+}
+
 btCollisionShape *SceneBullet3Physics::LoadCollisionTreeFromFile(const char *path, int id) {
 	return LoadCollisionTree(g_file_reader, g_file_read_provider, path, id);
 }
@@ -7,6 +7,7 @@
 #include <array>
 #include <limits>
 #include <memory>
+#include <vector>
 
 class btRigidBody;
 class btDiscreteDynamicsWorld;
@@ -50,7 +51,7 @@ public:
 
 	void NodeDestroyPhysics(const Node &node);
 
-	bool NodeHasBody(NodeRef ref) const { return nodes.find(ref) != std::end(nodes); }
+	bool NodeHasBody(NodeRef ref) const { return GetBodyIdx(ref) != invalid_body_idx; }
 	bool NodeHasBody(const Node &node) const { return NodeHasBody(node.ref); }
 
 	/// Step physics world
@@ -125,11 +126,15 @@ public:
 	}
 	void Remove6DofConstraint(btGeneric6DofConstraint* constraint);
 
-	//
+	/// Load a serialized collision tree.
+	/// Collision trees are shared by all physics worlds in the process, a tree with the same content is only deserialized once.
 	btCollisionShape *LoadCollisionTree(const Reader &ir, const ReadProvider &ip, const char *name, int shape_id = 0);
 
 	btCollisionShape *LoadCollisionTreeFromFile(const char *path, int shape_id = 0);
 	btCollisionShape *LoadCollisionTreeFromAssets(const char *name, int shape_id = 0);
+	/// Load a serialized collision tree from memory, the data is only parsed if no collision tree with the same content is loaded yet.
+	/// @note The data is copied on a cache miss as it is parsed in place.
+	btCollisionShape *LoadCollisionTreeFromMemory(const char *name, const void *data, size_t size, int shape_id = 0);
 
 	//
 	NodePairContacts NodeCollideWorld(const Scene &scene, NodeRef ref, const Mat4 &world, int max_contact = 1) const;
@@ -148,8 +153,32 @@ public:
  private:
 	std::unique_ptr<btDiscreteDynamicsWorld> world;
 
-	std::map<NodeRef, Bullet3Node> nodes;
-	std::map<std::string, btCollisionShape *> collision_trees;
+	static const uint32_t invalid_body_idx = 0xffffffff;
+
+	std::vector<Bullet3Node> bodies; // dense body table, removal swaps the last entry in
+	std::vector<NodeRef> body_nodes; // node owning each body table entry
+	std::vector<uint32_t> node_body_idx; // body table index for each node index
+
+	uint32_t GetBodyIdx(NodeRef ref) const {
+		if (ref.idx < node_body_idx.size()) {
+			const auto idx = node_body_idx[ref.idx];
+			if (idx != invalid_body_idx && body_nodes[idx] == ref)
+				return idx;
+		}
+		return invalid_body_idx;
+	}
+
+	void AddBody(NodeRef ref, btRigidBody *body);
+	void RemoveBody(uint32_t idx);
+
+	// body table indices and owner nodes of dynamic and kinematic bodies, rebuilt when the body table changes
+	std::vector<uint32_t> dynamic_bodies, kinematic_bodies;
+	std::vector<NodeRef> dynamic_nodes, kinematic_nodes;
+	bool motion_lists_dirty = false;
+
+	void UpdateMotionLists();
+
+	std::map<std::string, btCollisionShape *> collision_trees; // each entry holds a reference to a shared collision tree
 
 	btRigidBody *GetNodeBody(NodeRef ref, const char *func) const;
 
@@ -158,10 +187,17 @@ public:
 	time_ns physics_motion_clock = 0;
 	float physics_motion_k = 0.f; // motion interpolation coefficient
 
-	std::map<NodeRef, Mat4> prv_world_mtx; // [EJ] this will probably quickly become a bottleneck and just be replaced by a faster structure
+	// previous world matrix of each body table entry, swapped with the matrices stored before a step if a substep was taken
+	std::vector<Mat4> prv_world_mtx, step_world_mtx;
+	std::vector<uint8_t> prv_world_mtx_valid, step_world_mtx_valid;
 	std::vector<NodeRef> was_teleported;
 
+	std::vector<Mat4> sync_world_mtx;
+
 	std::function<void(SceneBullet3Physics&, hg::time_ns t)> pre_tick_callback;
 };
 
+/// Return the number of collision trees shared by all physics worlds in the process.
+size_t GetBullet3CollisionTreeCacheSize();
+
 } // namespace hg
@@ -13,6 +13,8 @@
 
 #include <json/json.hpp>
 
+#include <algorithm>
+
 namespace bgfx {
 void getTextureSizeFromRatio(BackbufferRatio::Enum _ratio, uint16_t &_width, uint16_t &_height);
 } // namespace bgfx
@@ -378,6 +380,54 @@ void DestroyForwardPipelineAAA(ForwardPipelineAAA &aaa) {
 }
 
 //
+static void AddSceneForwardPipelineLight(const Scene &scene, const Node &light, std::vector<ForwardPipelineLight> &out_lights) {
+	if (!light.IsEnabled())
+		return;
+
+	const auto trs = light.GetTransform();
+	const auto lgt = light.GetLight();
+
+	ForwardPipelineLight lgt_;
+
+	lgt_.world = scene.GetTransformWorldMatrix(trs.ref.idx);
+	lgt_.diffuse = lgt.GetDiffuseColor() * lgt.GetDiffuseIntensity();
+	lgt_.specular = lgt.GetSpecularColor() * lgt.GetSpecularIntensity();
+
+	const auto light_type = lgt.GetType();
+
+	if (light_type == LT_Linear) {
+		lgt_.type = FPLT_Linear;
+		lgt_.pssm_split = lgt.GetPSSMSplit();
+		lgt_.radius = 0.f;
+		lgt_.inner_angle = 0.f;
+		lgt_.outer_angle = 0.f;
+	} else if (light_type == LT_Spot) {
+		lgt_.type = FPLT_Spot;
+		lgt_.pssm_split = Vec4::Zero;
+		lgt_.radius = lgt.GetRadius();
+		lgt_.inner_angle = lgt.GetInnerAngle();
+		lgt_.outer_angle = lgt.GetOuterAngle();
+	} else { // fall back to point
+		lgt_.type = FPLT_Point;
+		lgt_.pssm_split = Vec4::Zero;
+		lgt_.radius = lgt.GetRadius();
+		lgt_.inner_angle = 0.f;
+		lgt_.outer_angle = 0.f;
+	}
+
+	const auto shadow_type = lgt.GetShadowType();
+
+	if (shadow_type == LST_Map)
+		lgt_.shadow_type = FPST_Map;
+	else
+		lgt_.shadow_type = FPST_None;
+
+	lgt_.priority = lgt.GetPriority();
+	lgt_.shadow_bias = lgt.GetShadowBias();
+
+	out_lights.push_back(lgt_);
+}
+
 void GetSceneForwardPipelineLights(const Scene &scene, std::vector<ForwardPipelineLight> &out_lights) {
 	out_lights.clear();
 
@@ -385,53 +435,20 @@ void GetSceneForwardPipelineLights(const Scene &scene, std::vector<ForwardPipeli
 
 	out_lights.reserve(lights.size());
 
-	for (const auto &light : lights) {
-		if (!light.IsEnabled())
-			continue;
-
-		const auto trs = light.GetTransform();
-		const auto lgt = light.GetLight();
-
-		ForwardPipelineLight lgt_;
-
-		lgt_.world = scene.GetTransformWorldMatrix(trs.ref.idx);
-		lgt_.diffuse = lgt.GetDiffuseColor() * lgt.GetDiffuseIntensity();
-		lgt_.specular = lgt.GetSpecularColor() * lgt.GetSpecularIntensity();
-
-		const auto light_type = lgt.GetType();
-
-		if (light_type == LT_Linear) {
-			lgt_.type = FPLT_Linear;
-			lgt_.pssm_split = lgt.GetPSSMSplit();
-			lgt_.radius = 0.f;
-			lgt_.inner_angle = 0.f;
-			lgt_.outer_angle = 0.f;
-		} else if (light_type == LT_Spot) {
-			lgt_.type = FPLT_Spot;
-			lgt_.pssm_split = Vec4::Zero;
-			lgt_.radius = lgt.GetRadius();
-			lgt_.inner_angle = lgt.GetInnerAngle();
-			lgt_.outer_angle = lgt.GetOuterAngle();
-		} else { // fall back to point
-			lgt_.type = FPLT_Point;
-			lgt_.pssm_split = Vec4::Zero;
-			lgt_.radius = lgt.GetRadius();
-			lgt_.inner_angle = 0.f;
-			lgt_.outer_angle = 0.f;
-		}
+	for (const auto &light : lights)
+		AddSceneForwardPipelineLight(scene, light, out_lights);
+}
 
-		const auto shadow_type = lgt.GetShadowType();
+void GetSceneForwardPipelineLights(const Scene &scene, const Frustum &frustum, std::vector<ForwardPipelineLight> &out_lights) {
+	out_lights.clear();
 
-		if (shadow_type == LST_Map)
-			lgt_.shadow_type = FPST_Map;
-		else
-			lgt_.shadow_type = FPST_None;
+	std::vector<NodeRef> lights;
+	scene.QueryLightNodes(frustum, lights);
 
-		lgt_.priority = lgt.GetPriority();
-		lgt_.shadow_bias = lgt.GetShadowBias();
+	out_lights.reserve(lights.size());
 
-		out_lights.push_back(lgt_);
-	}
+	for (const auto &light : lights)
+		AddSceneForwardPipelineLight(scene, scene.GetNode(light), out_lights);
 }
 
 //
@@ -521,46 +538,184 @@ static int ComputeForwardPipelineConfigurationIdx(ForwardPipelineStage pipeline_
 	return -1;
 }
 
+/// Return the object nodes which can be drawn to a view or to the shadow maps it samples, the scene spatial index must be up to date.
+static void QuerySceneForwardPipelineViewObjectNodes(
+	const Scene &scene, const ViewState &view_state, const ForwardPipelineLights &lights, const ForwardPipeline &pipeline, std::vector<NodeRef> &out_nodes) {
+	ForwardPipelineShadowMapViews shadow_views;
+	ForwardPipelineShadowData shadow_data;
+	ComputeLinearShadowMapViewsForForwardPipeline(view_state, lights, pipeline, shadow_views, shadow_data);
+	ComputeSpotShadowMapViewForForwardPipeline(lights, pipeline, shadow_views, shadow_data);
+
+	scene.QueryObjectNodes(view_state.frustum, out_nodes);
+
+	std::vector<NodeRef> pass_nodes;
+	for (const auto &shadow_view : shadow_views)
+		if (shadow_view.active) { // shadow pass frustums extend toward the light and include casters outside of the view
+			scene.QueryObjectNodes(shadow_view.frustum, pass_nodes);
+			out_nodes.insert(std::end(out_nodes), std::begin(pass_nodes), std::end(pass_nodes));
+		}
+
+	std::sort(std::begin(out_nodes), std::end(out_nodes));
+	out_nodes.erase(std::unique(std::begin(out_nodes), std::end(out_nodes)), std::end(out_nodes));
+}
+
 //
-void PrepareSceneForwardPipelineCommonRenderData(bgfx::ViewId &view_id, const Scene &scene, SceneForwardPipelineRenderData &render_data,
-	const ForwardPipeline &pipeline, const PipelineResources &resources, SceneForwardPipelinePassViewId &views, const char *debug_name) {
-	scene.GetModelDisplayLists(
-		render_data.all_opaque, render_data.all_transparent, render_data.all_opaque_skinned, render_data.all_transparent_skinned, resources);
+static void PrepareSceneForwardPipelineCommonRenderData_(bgfx::ViewId &view_id, const ViewState *view_state, const Scene &scene,
+	SceneForwardPipelineRenderData &render_data, const ForwardPipeline &pipeline, const PipelineResources &resources, SceneForwardPipelinePassViewId &views,
+	const char *debug_name) {
+	const auto &mtxs = scene.GetTransformWorldMatrices();
+
+	const bool use_spatial_index = view_state && scene.IsSpatialIndexUpToDate(resources);
 
 	std::vector<ForwardPipelineLight> lights;
-	GetSceneForwardPipelineLights(scene, lights);
+	if (use_spatial_index)
+		GetSceneForwardPipelineLights(scene, view_state->frustum, lights);
+	else
+		GetSceneForwardPipelineLights(scene, lights);
 	render_data.pipe_lights = PrepareForwardPipelineLights(lights);
 
+	if (pipeline.cached_shadow_maps) { // the static shadow casters hash covers all static casters, not the ones close to the view
+		scene.GetModelDisplayLists(render_data.all_opaque, render_data.all_static_opaque, render_data.all_transparent, render_data.all_opaque_skinned,
+			render_data.all_transparent_skinned, resources);
+		UpdateForwardPipelineShadowMapCache(render_data.shadow_map_cache, render_data.all_static_opaque, mtxs);
+	} else if (use_spatial_index) {
+		std::vector<NodeRef> nodes;
+		QuerySceneForwardPipelineViewObjectNodes(scene, *view_state, render_data.pipe_lights, pipeline, nodes);
+
+		scene.GetModelDisplayLists(nodes, render_data.all_opaque, render_data.all_transparent, render_data.all_opaque_skinned,
+			render_data.all_transparent_skinned, resources);
+		render_data.all_static_opaque.clear();
+	} else {
+		scene.GetModelDisplayLists(
+			render_data.all_opaque, render_data.all_transparent, render_data.all_opaque_skinned, render_data.all_transparent_skinned, resources);
+		render_data.all_static_opaque.clear();
+	}
+
+	render_data.view_shadow_map_cache_idx = 0;
+
+	ComputeSpotShadowMapViewForForwardPipeline(
+		render_data.pipe_lights, pipeline, render_data.shadow_views, render_data.shadow_data, &render_data.shadow_map_cache);
+
+	if (render_data.shadow_views[FPSP_Slot1Spot].active) {
+		const std::vector<Frustum> frustums = {render_data.shadow_views[FPSP_Slot1Spot].frustum};
+
+		std::vector<uint32_t> visibility;
+		CullModelDisplayLists(frustums, render_data.all_opaque, mtxs, resources, visibility, {&render_data.shadow_opaque[FPSP_Slot1Spot]});
+		CullModelDisplayLists(frustums, render_data.all_static_opaque, mtxs, resources, visibility, {&render_data.shadow_static_opaque[FPSP_Slot1Spot]});
+		CullSkinnedModelDisplayLists(
+			frustums, render_data.all_opaque_skinned, mtxs, resources, visibility, {&render_data.shadow_opaque_skinned[FPSP_Slot1Spot]});
+
+		const auto &view = render_data.shadow_views[FPSP_Slot1Spot].view;
+		SortModelDisplayLists(render_data.shadow_opaque[FPSP_Slot1Spot], view, mtxs, resources);
+		SortModelDisplayLists(render_data.shadow_static_opaque[FPSP_Slot1Spot], view, mtxs, resources);
+	}
+
 	ForwardPipelineShadowPassViewId sp_views;
-	GenerateSpotShadowMapForForwardPipeline(view_id, render_data.all_opaque, render_data.all_opaque_skinned, scene.GetTransformWorldMatrices(),
-		render_data.pipe_lights, pipeline, resources, sp_views, render_data.shadow_data, debug_name);
+	GenerateSpotShadowMapForForwardPipeline(view_id, render_data.shadow_views, render_data.shadow_static_opaque, render_data.shadow_opaque,
+		render_data.shadow_opaque_skinned, mtxs, pipeline, resources, render_data.shadow_map_cache, sp_views, debug_name);
 
 	views[FPSP_Slot1Spot] = sp_views[FPSP_Slot1Spot];
 }
 
+void PrepareSceneForwardPipelineCommonRenderData(bgfx::ViewId &view_id, const Scene &scene, SceneForwardPipelineRenderData &render_data,
+	const ForwardPipeline &pipeline, const PipelineResources &resources, SceneForwardPipelinePassViewId &views, const char *debug_name) {
+	PrepareSceneForwardPipelineCommonRenderData_(view_id, nullptr, scene, render_data, pipeline, resources, views, debug_name);
+}
+
+void PrepareSceneForwardPipelineCommonRenderData(bgfx::ViewId &view_id, const ViewState &view_state, const Scene &scene,
+	SceneForwardPipelineRenderData &render_data, const ForwardPipeline &pipeline, const PipelineResources &resources, SceneForwardPipelinePassViewId &views,
+	const char *debug_name) {
+	PrepareSceneForwardPipelineCommonRenderData_(view_id, &view_state, scene, render_data, pipeline, resources, views, debug_name);
+}
+
 //
 void PrepareSceneForwardPipelineViewDependentRenderData(bgfx::ViewId &view_id, const ViewState &view_state, const Scene &scene,
 	SceneForwardPipelineRenderData &render_data, const ForwardPipeline &pipeline, const PipelineResources &resources, SceneForwardPipelinePassViewId &views,
 	const char *debug_name) {
 
+	const auto &mtxs = scene.GetTransformWorldMatrices();
+
+	// views are identified by their preparation order since the common render data
+	if (render_data.view_shadow_map_cache_idx >= render_data.view_shadow_map_caches.size())
+		render_data.view_shadow_map_caches.resize(render_data.view_shadow_map_cache_idx + 1);
+
+	auto &shadow_map_cache = render_data.view_shadow_map_caches[render_data.view_shadow_map_cache_idx++];
+	shadow_map_cache.static_hash = render_data.shadow_map_cache.static_hash; // static casters and settings are shared by all views
+	shadow_map_cache.split_margin = render_data.shadow_map_cache.split_margin;
+
+	ComputeLinearShadowMapViewsForForwardPipeline(
+		view_state, render_data.pipe_lights, pipeline, render_data.shadow_views, render_data.shadow_data, &shadow_map_cache);
+
+	// cull opaque display lists against the view and the active linear shadow map splits in a single pass
+	std::vector<Frustum> frustums = {view_state.frustum};
+	std::vector<std::vector<ModelDisplayList> *> culled_display_lists = {&render_data.view_opaque};
+	std::vector<std::vector<ModelDisplayList> *> culled_static_display_lists = {nullptr};
+	std::vector<std::vector<SkinnedModelDisplayList> *> culled_skinned_display_lists = {&render_data.view_opaque_skinned};
+
+	for (int i = FPSP_Slot0LinearSplit0; i <= FPSP_Slot0LinearSplit3; ++i)
+		if (render_data.shadow_views[i].active) {
+			frustums.push_back(render_data.shadow_views[i].frustum);
+			culled_display_lists.push_back(&render_data.shadow_opaque[i]);
+			culled_static_display_lists.push_back(&render_data.shadow_static_opaque[i]);
+			culled_skinned_display_lists.push_back(&render_data.shadow_opaque_skinned[i]);
+		}
+
+	CullModelDisplayLists(frustums, render_data.all_opaque, mtxs, resources, render_data.all_opaque_visibility, culled_display_lists);
+
+	if (!render_data.all_static_opaque.empty()) {
+		std::vector<ModelDisplayList> view_static_opaque;
+		culled_static_display_lists[0] = &view_static_opaque;
+
+		std::vector<uint32_t> static_visibility;
+		CullModelDisplayLists(frustums, render_data.all_static_opaque, mtxs, resources, static_visibility, culled_static_display_lists);
+
+		render_data.view_opaque.insert(std::end(render_data.view_opaque), std::begin(view_static_opaque), std::end(view_static_opaque));
+	} else {
+		for (int i = FPSP_Slot0LinearSplit0; i <= FPSP_Slot0LinearSplit3; ++i)
+			render_data.shadow_static_opaque[i].clear();
+	}
+
+	std::vector<uint32_t> skinned_visibility;
+	CullSkinnedModelDisplayLists(frustums, render_data.all_opaque_skinned, mtxs, resources, skinned_visibility, culled_skinned_display_lists);
+
+	render_data.view_transparent = render_data.all_transparent;
+	CullModelDisplayLists(view_state.frustum, render_data.view_transparent, mtxs, resources);
+
+	render_data.view_transparent_skinned = render_data.all_transparent_skinned;
+	CullSkinnedModelDisplayLists(view_state.frustum, render_data.view_transparent_skinned, mtxs, resources);
+
+	// cull view display lists hidden behind the scene occluders
+	if (IsValid(render_data.occlusion_buffer)) {
+		std::vector<ModelOccluder> occluders;
+		scene.GetModelOccluders(occluders, resources);
+
+		ClearOcclusionBuffer(render_data.occlusion_buffer, view_state.view, view_state.proj);
+		RasterizeOccluders(render_data.occlusion_buffer, occluders, mtxs, resources);
+
+		CullModelDisplayLists(render_data.occlusion_buffer, render_data.view_opaque, mtxs, resources);
+		CullSkinnedModelDisplayLists(render_data.occlusion_buffer, render_data.view_opaque_skinned, mtxs, resources);
+		CullModelDisplayLists(render_data.occlusion_buffer, render_data.view_transparent, mtxs, resources);
+		CullSkinnedModelDisplayLists(render_data.occlusion_buffer, render_data.view_transparent_skinned, mtxs, resources);
+	}
+
+	// sort opaque display lists by state then front-to-back to minimize state changes
+	SortModelDisplayLists(render_data.view_opaque, view_state.view, mtxs, resources);
+
+	for (int i = FPSP_Slot0LinearSplit0; i <= FPSP_Slot0LinearSplit3; ++i)
+		if (render_data.shadow_views[i].active) {
+			SortModelDisplayLists(render_data.shadow_opaque[i], render_data.shadow_views[i].view, mtxs, resources);
+			SortModelDisplayLists(render_data.shadow_static_opaque[i], render_data.shadow_views[i].view, mtxs, resources);
+		}
+
 	ForwardPipelineShadowPassViewId sp_views;
-	GenerateLinearShadowMapForForwardPipeline(view_id, view_state, render_data.all_opaque, render_data.all_opaque_skinned, scene.GetTransformWorldMatrices(),
-		render_data.pipe_lights, pipeline, resources, sp_views, render_data.shadow_data, debug_name);
+	GenerateLinearShadowMapForForwardPipeline(view_id, render_data.shadow_views, render_data.shadow_static_opaque, render_data.shadow_opaque,
+		render_data.shadow_opaque_skinned, mtxs, pipeline, resources, shadow_map_cache, sp_views, debug_name);
 
 	views[SFPP_Slot0LinearSplit0] = sp_views[FPSP_Slot0LinearSplit0];
 	views[SFPP_Slot0LinearSplit1] = sp_views[FPSP_Slot0LinearSplit1];
 	views[SFPP_Slot0LinearSplit2] = sp_views[FPSP_Slot0LinearSplit2];
 	views[SFPP_Slot0LinearSplit3] = sp_views[FPSP_Slot0LinearSplit3];
 
-	render_data.view_opaque = render_data.all_opaque;
-	CullModelDisplayLists(view_state.frustum, render_data.view_opaque, scene.GetTransformWorldMatrices(), resources);
-	render_data.view_transparent = render_data.all_transparent;
-	CullModelDisplayLists(view_state.frustum, render_data.view_transparent, scene.GetTransformWorldMatrices(), resources);
-
-	// FIXME cull skinned models !!!
-	render_data.view_opaque_skinned = render_data.all_opaque_skinned;
-	render_data.view_transparent_skinned = render_data.all_transparent_skinned;
-
 	render_data.fog = GetSceneForwardPipelineFog(scene);
 }
 
@@ -950,7 +1105,7 @@ void SubmitSceneToForwardPipeline(bgfx::ViewId &view_id, const Scene &scene, con
 void SubmitSceneToPipeline(bgfx::ViewId &view_id, const Scene &scene, const Rect<int> &rect, const ViewState &view_state, ForwardPipeline &pipeline,
 	const PipelineResources &resources, SceneForwardPipelinePassViewId &views, bgfx::FrameBufferHandle fb, const char *debug_name) {
 	SceneForwardPipelineRenderData render_data;
-	PrepareSceneForwardPipelineCommonRenderData(view_id, scene, render_data, pipeline, resources, views, debug_name);
+	PrepareSceneForwardPipelineCommonRenderData(view_id, view_state, scene, render_data, pipeline, resources, views, debug_name);
 	PrepareSceneForwardPipelineViewDependentRenderData(view_id, view_state, scene, render_data, pipeline, resources, views, debug_name);
 	SubmitSceneToForwardPipeline(view_id, scene, rect, view_state, pipeline, render_data, resources, views, fb, debug_name);
 }
@@ -969,7 +1124,7 @@ void SubmitSceneToPipeline(bgfx::ViewId &view_id, const Scene &scene, const Rect
 	const PipelineResources &resources, SceneForwardPipelinePassViewId &views, ForwardPipelineAAA &aaa, const ForwardPipelineAAAConfig &aaa_config, int frame,
 	bgfx::FrameBufferHandle fb, const char *debug_name) {
 	SceneForwardPipelineRenderData render_data;
-	PrepareSceneForwardPipelineCommonRenderData(view_id, scene, render_data, pipeline, resources, views, debug_name);
+	PrepareSceneForwardPipelineCommonRenderData(view_id, view_state, scene, render_data, pipeline, resources, views, debug_name);
 	PrepareSceneForwardPipelineViewDependentRenderData(view_id, view_state, scene, render_data, pipeline, resources, views, debug_name);
 	SubmitSceneToForwardPipeline(view_id, scene, rect, view_state, pipeline, render_data, resources, views, aaa, aaa_config, frame, fb, debug_name);
 	aaa.Flip(view_state);
@@ -9,6 +9,7 @@
 #include "engine/forward_pipeline.h"
 #include "engine/hiz.h"
 #include "engine/motion_blur.h"
+#include "engine/occlusion_culling.h"
 #include "engine/render_pipeline.h"
 #include "engine/ssgi.h"
 #include "engine/ssr.h"
@@ -181,6 +182,9 @@ inline bgfx::ViewId GetSceneForwardPipelinePassViewId(const SceneForwardPipeline
 
 /// Prepare scene lights for the forward pipeline.
 void GetSceneForwardPipelineLights(const Scene &scene, std::vector<ForwardPipelineLight> &out_lights);
+/// Prepare the scene lights affecting a frustum for the forward pipeline, the scene spatial index must be up to date.
+/// @see Scene::UpdateSpatialIndex.
+void GetSceneForwardPipelineLights(const Scene &scene, const Frustum &frustum, std::vector<ForwardPipelineLight> &out_lights);
 
 /// Return scene fog settings for the forward pipeline.
 ForwardPipelineFog GetSceneForwardPipelineFog(const Scene &scene);
@@ -188,11 +192,25 @@ ForwardPipelineFog GetSceneForwardPipelineFog(const Scene &scene);
 //
 struct SceneForwardPipelineRenderData {
 	std::vector<ModelDisplayList> all_opaque, view_opaque;
+	std::vector<ModelDisplayList> all_static_opaque; // opaque display lists of NF_Static nodes, only split from all_opaque if the pipeline caches shadow maps
 	std::vector<ModelDisplayList> all_transparent, view_transparent;
 
 	std::vector<SkinnedModelDisplayList> all_opaque_skinned, view_opaque_skinned;
 	std::vector<SkinnedModelDisplayList> all_transparent_skinned, view_transparent_skinned;
 
+	std::vector<uint32_t> all_opaque_visibility; // per display list view and shadow map splits visibility bitmask, see CullModelDisplayLists
+	ForwardPipelineShadowMapViews shadow_views;
+	ForwardPipelineShadowPassDisplayLists shadow_opaque; // opaque display lists culled against each shadow map pass view
+	ForwardPipelineShadowPassSkinnedDisplayLists shadow_opaque_skinned;
+	ForwardPipelineShadowPassDisplayLists shadow_static_opaque;
+
+	// shadow map caches are only effective if render data is kept from one frame to the next
+	ForwardPipelineShadowMapCache shadow_map_cache; // spot light, shared by all views
+	std::vector<ForwardPipelineShadowMapCache> view_shadow_map_caches; // linear light, one per view prepared after the common render data
+	size_t view_shadow_map_cache_idx{0};
+
+	OcclusionBuffer occlusion_buffer; // view display lists hidden behind NF_Occluder nodes are culled if the buffer is valid, see CreateOcclusionBuffer
+
 	ForwardPipelineLights pipe_lights;
 	ForwardPipelineShadowData shadow_data;
 	ForwardPipelineFog fog;
@@ -201,6 +219,14 @@ struct SceneForwardPipelineRenderData {
 /// Prepare common scene render data for a submission to the forward pipeline by calling SubmitSceneToForwardPipeline.
 void PrepareSceneForwardPipelineCommonRenderData(bgfx::ViewId &view_id, const Scene &scene, SceneForwardPipelineRenderData &render_data,
 	const ForwardPipeline &pipeline, const PipelineResources &resources, SceneForwardPipelinePassViewId &views, const char *debug_name = "scene");
+/*!
+	Same as above for render data only used by a single view. If the scene spatial index is up to date, only the lights affecting the view and the
+	objects drawn to the view or to its shadow maps are prepared. Objects are not queried when the pipeline caches static shadow maps.
+	@see Scene::UpdateSpatialIndex.
+*/
+void PrepareSceneForwardPipelineCommonRenderData(bgfx::ViewId &view_id, const ViewState &view_state, const Scene &scene,
+	SceneForwardPipelineRenderData &render_data, const ForwardPipeline &pipeline, const PipelineResources &resources, SceneForwardPipelinePassViewId &views,
+	const char *debug_name = "scene");
 
 void PrepareSceneForwardPipelineViewDependentRenderData(bgfx::ViewId &view_id, const ViewState &view_state, const Scene &scene,
 	SceneForwardPipelineRenderData &render_data, const ForwardPipeline &pipeline, const PipelineResources &resources, SceneForwardPipelinePassViewId &views,
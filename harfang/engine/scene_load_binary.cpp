@@ -302,26 +302,17 @@ bool Scene::Save_binary(
 					if (rigid_bodies.is_valid(node_->components[NCI_RigidBody]))
 						used_component_refs[NCI_RigidBody].insert(node_->components[NCI_RigidBody]);
 
-					{
-						const auto &i = node_collisions.find(ref);
-						if (i != std::end(node_collisions))
-							for (const auto &ref : i->second)
-								used_collision_refs.insert(ref);
-					}
+					for (const auto &ref : node_collisions.get(ref))
+						used_collision_refs.insert(ref);
 				}
 
 				if (save_flags & LSSF_Scripts) {
-					const auto &i = node_scripts.find(ref);
-					if (i != std::end(node_scripts))
-						for (const auto &ref : i->second)
-							used_script_refs.insert(ref);
+					for (const auto &ref : node_scripts.get(ref))
+						used_script_refs.insert(ref);
 				}
 
-				{
-					const auto &i = node_instance.find(ref);
-					if (i != std::end(node_instance))
-						used_instance_refs.insert(i->second);
-				}
+				if (const auto cref = node_instance.find(ref))
+					used_instance_refs.insert(*cref);
 			}
 
 	if (save_flags & LSSF_Scene)
@@ -419,35 +410,26 @@ bool Scene::Save_binary(
 						Write<uint32_t>(iw, h, 0xffffffff);
 					}
 
-					const auto &c = node_collisions.find(ref);
-					if (c != std::end(node_collisions)) {
-						Write(iw, h, numeric_cast<uint32_t>(c->second.size())); // collision count
-						for (const auto &col_ref : c->second) {
-							const auto &i = used_collision_refs.find(col_ref);
-							Write(iw, h, numeric_cast<uint32_t>(std::distance(std::begin(used_collision_refs), i))); // idx
-						}
-					} else {
-						Write<uint32_t>(iw, h, 0); // collision count
+					const auto c = node_collisions.get(ref);
+					Write(iw, h, numeric_cast<uint32_t>(c.size())); // collision count
+					for (const auto &col_ref : c) {
+						const auto &i = used_collision_refs.find(col_ref);
+						Write(iw, h, numeric_cast<uint32_t>(std::distance(std::begin(used_collision_refs), i))); // idx
 					}
 				}
 
 				if (save_flags & LSSF_Scripts) {
-					const auto &c = node_scripts.find(ref);
-					if (c != std::end(node_scripts)) {
-						Write(iw, h, numeric_cast<uint32_t>(c->second.size())); // script count
-						for (const auto &script_ref : c->second) {
-							const auto &i = used_script_refs.find(script_ref);
-							Write(iw, h, numeric_cast<uint32_t>(std::distance(std::begin(used_script_refs), i))); // idx
-						}
-					} else {
-						Write<uint32_t>(iw, h, 0); // script count
+					const auto c = node_scripts.get(ref);
+					Write(iw, h, numeric_cast<uint32_t>(c.size())); // script count
+					for (const auto &script_ref : c) {
+						const auto &i = used_script_refs.find(script_ref);
+						Write(iw, h, numeric_cast<uint32_t>(std::distance(std::begin(used_script_refs), i))); // idx
 					}
 				}
 
 				{
-					const auto c = node_instance.find(ref);
-					if (c != std::end(node_instance)) {
-						const auto &i = used_instance_refs.find(c->second);
+					if (const auto c = node_instance.find(ref)) {
+						const auto &i = used_instance_refs.find(*c);
 						Write(iw, h, numeric_cast<uint32_t>(std::distance(std::begin(used_instance_refs), i)));
 					} else {
 						Write(iw, h, InvalidComponentRef.idx);
@@ -665,6 +647,7 @@ bool Scene::Load_binary(const Reader &ir, const Handle &h, const char *name, con
 			node_.name = Read<std::string>(ir, h);
 
 			const auto node_flags = Read<uint32_t>(ir, h);
+			node_.flags |= node_flags & NF_SerializedMask & ~NF_Disabled;
 			if (node_flags & NF_Disabled)
 				nodes_to_disable.push_back(node_ref);
 
@@ -690,18 +673,29 @@ bool Scene::Load_binary(const Reader &ir, const Handle &h, const char *name, con
 					node_.components[NCI_RigidBody] = rigid_body_refs[rigid_body_idx];
 
 				const auto collision_count = Read<uint32_t>(ir, h);
+				if (collision_count)
+					node_collisions.resize(node_ref, collision_count);
+
+				const auto node_collisions_ = node_collisions.get(node_ref);
 				for (uint32_t j = 0; j < collision_count; ++j) {
 					const auto col_idx = Read<uint32_t>(ir, h);
-					node_collisions[node_ref].push_back(collision_refs[col_idx]);
+					node_collisions_[j] = collision_refs[col_idx];
 				}
 			}
 
 			if (file_flags & LSSF_Scripts) {
 				const auto node_script_count = Read<uint32_t>(ir, h);
+				if (node_script_count)
+					node_scripts.resize(node_ref, node_script_count);
+
+				const auto node_scripts_ = node_scripts.get(node_ref);
 				for (uint32_t j = 0; j < node_script_count; ++j) {
 					const auto script_idx = Read<uint32_t>(ir, h);
-					node_scripts[node_ref].push_back(script_refs[script_idx]);
+					node_scripts_[j] = script_refs[script_idx];
 				}
+
+				if (node_script_count)
+					BumpScriptsRevision();
 			}
 
 			const auto instance_idx = Read<uint32_t>(ir, h);
@@ -709,6 +703,8 @@ bool Scene::Load_binary(const Reader &ir, const Handle &h, const char *name, con
 				node_instance[node_ref] = instance_refs[instance_idx];
 				node_with_instance_to_setup.push_back(node_ref);
 			}
+
+			AcquireNodeComponents_(node_ref);
 		}
 
 		// setup instances
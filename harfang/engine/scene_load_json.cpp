@@ -323,25 +323,14 @@ bool Scene::Save_json(json &js, const PipelineResources &resources, uint32_t sav
 				if (rigid_bodies.is_valid(node_->components[NCI_RigidBody]))
 					used_component_refs[NCI_RigidBody].insert(node_->components[NCI_RigidBody]);
 
-				{
-					const auto &i = node_collisions.find(ref);
-					if (i != std::end(node_collisions))
-						for (const auto &col_ref : i->second)
-							used_collision_refs.insert(col_ref);
-				}
+				for (const auto &col_ref : node_collisions.get(ref))
+					used_collision_refs.insert(col_ref);
 
-				{
-					const auto &i = node_scripts.find(ref);
-					if (i != std::end(node_scripts))
-						for (const auto &script_ref : i->second)
-							used_script_refs.insert(script_ref);
-				}
+				for (const auto &script_ref : node_scripts.get(ref))
+					used_script_refs.insert(script_ref);
 
-				{
-					const auto &i = node_instance.find(ref);
-					if (i != std::end(node_instance))
-						used_instance_refs.insert(i->second);
-				}
+				if (const auto cref = node_instance.find(ref))
+					used_instance_refs.insert(*cref);
 			}
 
 	if (save_flags & LSSF_Scene)
@@ -448,6 +437,8 @@ bool Scene::Save_json(json &js, const PipelineResources &resources, uint32_t sav
 				js_node["idx"] = ref;
 				js_node["name"] = node_->name;
 				js_node["disabled"] = node_->flags & NF_Disabled ? true : false;
+				js_node["static"] = node_->flags & NF_Static ? true : false;
+				js_node["occluder"] = node_->flags & NF_Occluder ? true : false;
 
 				std::array<uint32_t, 5> idxs = {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff};
 
@@ -479,12 +470,10 @@ bool Scene::Save_json(json &js, const PipelineResources &resources, uint32_t sav
 				js_node["components"] = idxs;
 
 				{
-					const auto &c = node_collisions.find(ref);
-
-					if (c != std::end(node_collisions)) {
+					if (node_collisions.contains(ref)) {
 						auto &js_node_cols = js_node["collisions"];
 
-						for (const auto col_ref : c->second) {
+						for (const auto col_ref : node_collisions.get(ref)) {
 							const auto &i = used_collision_refs.find(col_ref);
 
 							json col;
@@ -496,12 +485,10 @@ bool Scene::Save_json(json &js, const PipelineResources &resources, uint32_t sav
 				}
 
 				{
-					const auto &c = node_scripts.find(ref);
-
-					if (c != std::end(node_scripts)) {
+					if (node_scripts.contains(ref)) {
 						auto &js_node_scripts = js_node["scripts"];
 
-						for (const auto &script_ref : c->second) {
+						for (const auto &script_ref : node_scripts.get(ref)) {
 							const auto &i = used_script_refs.find(script_ref);
 
 							json script;
@@ -513,9 +500,8 @@ bool Scene::Save_json(json &js, const PipelineResources &resources, uint32_t sav
 				}
 
 				{
-					const auto &c = node_instance.find(ref);
-					if (c != std::end(node_instance)) {
-						const auto &i = used_instance_refs.find(c->second);
+					if (const auto c = node_instance.find(ref)) {
+						const auto &i = used_instance_refs.find(*c);
 						js_node["instance"] = std::distance(std::begin(used_instance_refs), i);
 					}
 				}
@@ -767,6 +753,12 @@ bool Scene::Load_json(const json &js, const char *name, const Reader &deps_ir, c
 					nodes_to_disable.push_back(node.ref);
 			}
 
+			for (const auto &flag : {std::make_pair("static", NF_Static), std::make_pair("occluder", NF_Occluder)}) {
+				const auto &i = js_node.find(flag.first);
+				if ((i != std::end(js_node)) && (i->get<bool>() == true))
+					nodes[node.ref.idx].flags |= flag.second;
+			}
+
 			{
 				const auto &js_node_components = js_node["components"];
 
@@ -795,17 +787,12 @@ bool Scene::Load_json(const json &js, const char *name, const Reader &deps_ir, c
 				const auto &js_cols = js_node.find("collisions");
 
 				if (js_cols != std::end(js_node)) {
-					const auto node_col_count = js_cols->size();
-					node_collisions[node.ref].reserve(node_col_count);
-					for (const auto &js_col : *js_cols) {
-						const auto col_idx = js_col["idx"].get<ComponentRef>().idx;
-
-						if (col_idx != 0xffffffff) {
-							const auto col_ref = col_refs[col_idx];
-							node_collisions[node.ref].push_back(col_ref);
-						} else {
-							node_collisions[node.ref].push_back(InvalidComponentRef);
-						}
+					node_collisions.resize(node.ref, js_cols->size());
+
+					const auto node_collisions_ = node_collisions.get(node.ref);
+					for (size_t j = 0; j < node_collisions_.size(); ++j) {
+						const auto col_idx = (*js_cols)[j]["idx"].get<ComponentRef>().idx;
+						node_collisions_[j] = col_idx != 0xffffffff ? col_refs[col_idx] : InvalidComponentRef;
 					}
 				}
 			}
@@ -814,18 +801,15 @@ bool Scene::Load_json(const json &js, const char *name, const Reader &deps_ir, c
 				const auto &js_scripts = js_node.find("scripts");
 
 				if (js_scripts != std::end(js_node)) {
-					const auto node_script_count = js_scripts->size();
-					node_scripts[node.ref].reserve(node_script_count);
-					for (const auto &js_script : *js_scripts) {
-						const auto script_idx = js_script["idx"].get<ComponentRef>().idx;
-
-						if (script_idx != 0xffffffff) {
-							const auto script_ref = script_refs[script_idx];
-							node_scripts[node.ref].push_back(script_ref);
-						} else {
-							node_scripts[node.ref].push_back(InvalidComponentRef);
-						}
+					node_scripts.resize(node.ref, js_scripts->size());
+
+					const auto node_scripts_ = node_scripts.get(node.ref);
+					for (size_t j = 0; j < node_scripts_.size(); ++j) {
+						const auto script_idx = (*js_scripts)[j]["idx"].get<ComponentRef>().idx;
+						node_scripts_[j] = script_idx != 0xffffffff ? script_refs[script_idx] : InvalidComponentRef;
 					}
+
+					BumpScriptsRevision();
 				}
 			}
 
@@ -839,6 +823,8 @@ bool Scene::Load_json(const json &js, const char *name, const Reader &deps_ir, c
 					}
 				}
 			}
+
+			AcquireNodeComponents_(node.ref);
 		}
 
 		// setup instances
@@ -5,6 +5,9 @@
 #include "foundation/file_rw_interface.h"
 #include "foundation/format.h"
 #include "foundation/log.h"
+#include "foundation/path_tools.h"
+#include "foundation/profiler.h"
+#include "foundation/string.h"
 
 #include "engine/assets_rw_interface.h"
 #include "engine/physics.h"
@@ -74,6 +77,8 @@ bool SceneLuaVM::CreateScriptFromSource(Scene &scene, ComponentRef ref, const st
 	const auto path = scene.GetScriptPath(ref);
 
 	if (!src.empty()) {
+		on_update_cache_valid = false;
+
 		auto &env = lua_scripts[ref]; // create new env
 		env = CreateEnv(L, true);
 
@@ -101,8 +106,7 @@ bool SceneLuaVM::CreateScript(Scene &scene, ComponentRef ref, const Reader &ir,
 		ScopedReadHandle h(ip, path.c_str());
 		src = LoadString(ir, h);
 	} else {
-		src = j->second;
-		src_overrides.erase(j);
+		src = j->second; // kept so that reloading this script does not revert it to its path
 	}
 
 	return CreateScriptFromSource(scene, ref, src);
@@ -166,6 +170,106 @@ std::vector<ComponentRef> SceneLuaVM::SceneCreateScripts(Scene &scene, const Rea
 std::vector<ComponentRef> SceneLuaVM::SceneCreateScriptsFromFile(Scene &scene) { return SceneCreateScripts(scene, g_file_reader, g_file_read_provider); }
 std::vector<ComponentRef> SceneLuaVM::SceneCreateScriptsFromAssets(Scene &scene) { return SceneCreateScripts(scene, g_assets_reader, g_assets_read_provider); }
 
+//
+bool SceneLuaVM::ReloadScriptFromSource(Scene &scene, ComponentRef ref, const std::string &src) {
+	const auto i = lua_scripts.find(ref);
+
+	if (i == std::end(lua_scripts))
+		return false; // not running on this VM
+
+	const auto path = scene.GetScriptPath(ref);
+
+	if (src.empty()) {
+		warn(format("Failed to reload Lua file '%1'").arg(path));
+		return false;
+	}
+
+	auto env = CreateEnv(L, true);
+
+	Set(env, "G", G);
+	Set(env, "hg", hg);
+
+	if (!Execute(L, src, path, &env))
+		return false;
+
+	// migrate state, functions come from the new chunk
+	{
+		LuaStackGuard guard(L);
+
+		i->second.Push();
+		env.Push();
+
+		const auto old_env_idx = lua_gettop(L) - 1, new_env_idx = lua_gettop(L);
+
+		for (lua_pushnil(L); lua_next(L, old_env_idx) != 0;)
+			if (lua_type(L, -1) != LUA_TFUNCTION) {
+				lua_pushvalue(L, -2); // key, value, key
+				lua_insert(L, -2); // key, key, value
+				lua_rawset(L, new_env_idx);
+			} else {
+				lua_pop(L, 1);
+			}
+	}
+
+	i->second = std::move(env);
+	on_update_cache_valid = false;
+	return true;
+}
+
+static std::string GetScriptPathKey(const std::string &path) {
+#if _WIN32
+	return tolower(CleanPath(path)); // case insensitive file system
+#else
+	return CleanPath(path);
+#endif
+}
+
+std::vector<ComponentRef> SceneLuaVM::ReloadScripts(Scene &scene, const std::vector<std::string> &paths, const Reader &ir, const ReadProvider &ip) {
+	std::vector<ComponentRef> reloaded_scripts;
+
+	if (paths.empty())
+		return reloaded_scripts;
+
+	std::set<std::string> modified_paths;
+	for (const auto &path : paths)
+		modified_paths.insert(GetScriptPathKey(path));
+
+	std::map<std::string, std::string> sources; // each modified file is loaded once
+
+	for (const auto &i : lua_scripts) {
+		if (!scene.IsValidScriptRef(i.first))
+			continue;
+
+		if (src_overrides.find(i.first) != std::end(src_overrides))
+			continue; // source is not loaded from the script path
+
+		const auto path = scene.GetScriptPath(i.first);
+
+		if (modified_paths.find(GetScriptPathKey(path)) == std::end(modified_paths))
+			continue;
+
+		auto j = sources.find(path);
+
+		if (j == std::end(sources)) {
+			ScopedReadHandle h(ip, path.c_str());
+			j = sources.emplace(path, LoadString(ir, h)).first;
+		}
+
+		if (ReloadScriptFromSource(scene, i.first, j->second))
+			reloaded_scripts.push_back(i.first);
+	}
+
+	return reloaded_scripts;
+}
+
+std::vector<ComponentRef> SceneLuaVM::ReloadScriptsFromFile(Scene &scene, const std::vector<std::string> &paths) {
+	return ReloadScripts(scene, paths, g_file_reader, g_file_read_provider);
+}
+
+std::vector<ComponentRef> SceneLuaVM::ReloadScriptsFromAssets(Scene &scene, const std::vector<std::string> &paths) {
+	return ReloadScripts(scene, paths, g_assets_reader, g_assets_read_provider);
+}
+
 //
 LuaObject SceneLuaVM::GetScriptEnv(ComponentRef ref) const {
 	auto i = lua_scripts.find(ref);
@@ -281,27 +385,35 @@ void SceneLuaVM::ForeachSceneScripts(Scene &scene, const std::function<void(Scen
 
 void SceneLuaVM::ForeachNodeScripts(const Scene &scene, NodeRef node_ref, const std::function<void(const Scene &, Node &, const LuaObject &)> &cb) const {
 	auto node = scene.GetNode(node_ref);
-	auto &node_scripts = scene.GetNodeScripts();
 
-	auto i = node_scripts.find(node_ref);
-	if (i != std::end(node_scripts))
-		for (auto cref : i->second) {
-			auto j = lua_scripts.find(cref);
-			if (j != std::end(lua_scripts))
-				cb(scene, node, j->second);
-		}
+	const auto node_scripts = scene.GetNodeScripts().get(node_ref);
+	const std::vector<ComponentRef> crefs(node_scripts.begin(), node_scripts.end()); // callbacks might modify the node scripts
+
+	for (auto cref : crefs) {
+		auto j = lua_scripts.find(cref);
+		if (j != std::end(lua_scripts))
+			cb(scene, node, j->second);
+	}
 }
 
 void SceneLuaVM::ForeachAllNodesScripts(const Scene &scene, const std::function<void(const Scene &, Node &, const LuaObject &)> &cb) const {
-	for (auto i : scene.GetNodeScripts()) {
+	// callbacks might modify the node scripts, iterate a copy (the reused buffer is taken in case a callback reenters this function)
+	auto node_scripts = std::move(node_scripts_scratch);
+	node_scripts.clear();
+
+	for (auto i : scene.GetNodeScripts()) // node index order
+		for (auto cref : i.second)
+			node_scripts.push_back({i.first, cref});
+
+	for (const auto &i : node_scripts) {
 		auto node = scene.GetNode(i.first);
 
-		for (auto cref : i.second) {
-			auto j = lua_scripts.find(cref);
-			if (j != std::end(lua_scripts))
-				cb(scene, node, j->second);
-		}
+		auto j = lua_scripts.find(i.second);
+		if (j != std::end(lua_scripts))
+			cb(scene, node, j->second);
 	}
+
+	node_scripts_scratch = std::move(node_scripts);
 }
 
 //
@@ -319,8 +431,79 @@ void SceneLuaVM::DestroyScripts(const std::vector<ComponentRef> &scripts) {
 		if (i != std::end(lua_scripts)) {
 			Call(ref, "OnDestroy", {});
 			lua_scripts.erase(i);
+			src_overrides.erase(ref);
+			on_update_cache_valid = false;
+		}
+	}
+}
+
+//
+static LuaObject _WrapObject(lua_State *L, const char *c_type, void *obj, OwnershipPolicy policy) {
+	const auto info = hg_lua_get_c_type_info(c_type);
+	__ASSERT__(info != nullptr);
+	info->from_c(L, obj, policy);
+	return Pop(L);
+}
+
+void SceneLuaVM::BuildOnUpdateCache(Scene &scene) {
+	on_update_cache.clear();
+
+	if (!scene.GetSceneScripts().empty()) {
+		const auto scene_obj = _WrapObject(L, "hg::Scene", &scene, NonOwning);
+
+		for (auto cref : scene.GetSceneScripts()) {
+			const auto i = lua_scripts.find(cref);
+			if (i != std::end(lua_scripts))
+				on_update_cache.push_back({i->second, scene_obj});
 		}
 	}
+
+	for (const auto &i : scene.GetNodeScripts()) {
+		LuaObject node_obj; // a single wrapper is shared by all scripts of a node
+
+		for (auto cref : i.second) {
+			const auto j = lua_scripts.find(cref);
+			if (j != std::end(lua_scripts)) {
+				if (!node_obj) {
+					auto node = scene.GetNode(i.first);
+					node_obj = _WrapObject(L, "hg::Node", &node, Copy);
+				}
+				on_update_cache.push_back({j->second, node_obj});
+			}
+		}
+	}
+
+	on_update_cache_scene = &scene;
+	on_update_cache_scripts_revision = scene.GetScriptsRevision();
+	on_update_cache_valid = true;
+}
+
+void SceneLuaVM::CallOnUpdate(Scene &scene, time_ns dt) {
+	if (!on_update_cache_valid || on_update_cache_scene != &scene || on_update_cache_scripts_revision != scene.GetScriptsRevision())
+		BuildOnUpdateCache(scene);
+
+	ProfilerPerfSection slice("SceneLuaVM.CallOnUpdate");
+
+	LuaStackGuard stack_guard(L);
+	PushCustomErrorHandler(L);
+
+	const auto err_handler = lua_gettop(L);
+
+	for (size_t i = 0; i < on_update_cache.size(); ++i) { // callbacks may modify the cache
+		on_update_cache[i].env.Push();
+		lua_getfield(L, -1, "OnUpdate"); // looked up on each call so that a script can reassign its callback
+
+		if (lua_isfunction(L, -1)) {
+			on_update_cache[i].ctx.Push();
+			lua_pushinteger(L, dt);
+
+			ResetExecutionWatchdog(L);
+			if (lua_pcall(L, 2, 0, err_handler) != LUA_OK)
+				lua_settop(L, err_handler); // error already reported by the handler
+		}
+
+		lua_settop(L, err_handler);
+	}
 }
 
 //
@@ -359,6 +542,9 @@ std::vector<std::string> SceneLuaVM::GetScriptInterface(ComponentRef ref) const
 void SceneLuaVM::Clear() {
 	lua_scripts.clear();
 	src_overrides.clear();
+
+	on_update_cache.clear();
+	on_update_cache_valid = false;
 }
 
 //
@@ -375,6 +561,7 @@ SceneLuaVM::SceneLuaVM() {
 
 SceneLuaVM::~SceneLuaVM() {
 	lua_scripts.clear();
+	on_update_cache.clear();
 
 	G.Clear();
 	hg.Clear();
@@ -48,6 +48,16 @@ public:
 	std::vector<ComponentRef> SceneCreateScriptsFromFile(Scene &scene);
 	std::vector<ComponentRef> SceneCreateScriptsFromAssets(Scene &scene);
 
+	/// Reload a single script component from source, non-function values of its current environment are migrated to the new environment.
+	/// @note If the new source fails to execute the script keeps running its current version.
+	bool ReloadScriptFromSource(Scene &scene, ComponentRef ref, const std::string &src);
+
+	/// Reload all script components whose path is found in the provided list, other scripts are left untouched.
+	/// Paths are compared once cleaned, scripts whose source is overridden are not reloaded.
+	std::vector<ComponentRef> ReloadScripts(Scene &scene, const std::vector<std::string> &paths, const Reader &ir, const ReadProvider &ip);
+	std::vector<ComponentRef> ReloadScriptsFromFile(Scene &scene, const std::vector<std::string> &paths);
+	std::vector<ComponentRef> ReloadScriptsFromAssets(Scene &scene, const std::vector<std::string> &paths);
+
 	/// Return all scripts that are not found in scene anymore.
 	std::vector<ComponentRef> GarbageCollect(const Scene &scene) const;
 	/// Destroy the provided scripts.
@@ -106,7 +116,13 @@ public:
 	std::vector<std::string> GetScriptInterface(ComponentRef ref) const;
 	std::vector<std::string> GetScriptInterface(const Script &script) const { return GetScriptInterface(script.ref); }
 
+	/// Call the OnUpdate function of all scripts attached to a scene and its nodes.
+	/// @note The list of scripts to call and their scene or node wrapper are cached until the scene script attachments change, the OnUpdate function
+	/// itself is looked up in the script environment on each call.
+	void CallOnUpdate(Scene &scene, time_ns dt);
+
 	/// Override the source code for a specific script component. when created the provided source will be used regardless of the script path parameter.
+	/// @note The override is kept until the script is destroyed, reloading modified scripts does not revert it to the file found at its path.
 	void OverrideScriptSource(ComponentRef ref, std::string src) { src_overrides[ref] = std::move(src); }
 
 	/// Clear all scripts.
@@ -118,6 +134,20 @@ private:
 
 	std::map<ComponentRef, LuaObject> lua_scripts;
 	std::map<ComponentRef, std::string> src_overrides;
+
+	mutable std::vector<std::pair<NodeRef, ComponentRef>> node_scripts_scratch; // see ForeachAllNodesScripts
+
+	struct ScriptCallback {
+		LuaObject env; // script environment
+		LuaObject ctx; // wrapped scene or node the script is attached to
+	};
+
+	std::vector<ScriptCallback> on_update_cache;
+	const Scene *on_update_cache_scene{};
+	uint32_t on_update_cache_scripts_revision{};
+	bool on_update_cache_valid{};
+
+	void BuildOnUpdateCache(Scene &scene);
 };
 
 /// Create a script parameter from Lua object.
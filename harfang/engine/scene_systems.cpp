@@ -4,7 +4,11 @@
 
 #include "foundation/file_rw_interface.h"
 #include "foundation/format.h"
+#include "foundation/job_graph.h"
 #include "foundation/log.h"
+#include "foundation/path_tools.h"
+
+#include "platform/filesystem_watcher.h"
 
 #include "engine/assets_rw_interface.h"
 #include "engine/scene_lua_vm.h"
@@ -42,21 +46,7 @@ static void SceneSyncToScriptsCall(SceneLuaVM &vm, Scene &scene, const Reader &i
 }
 
 //
-static void SceneScriptsOnUpdateCall(SceneLuaVM &vm, Scene &scene, time_ns dt) {
-	vm.ForeachSceneScripts(scene, [&](Scene &scene, const LuaObject &env) {
-		if (auto on_create = Get(env, "OnUpdate")) {
-			on_create.Push();
-			hg_lua_OnUpdate_SceneCtx(env.L(), -1, scene, dt);
-		}
-	});
-
-	vm.ForeachAllNodesScripts(scene, [&](const Scene &scene, Node &node, const LuaObject &env) {
-		if (auto on_create = Get(env, "OnUpdate")) {
-			on_create.Push();
-			hg_lua_OnUpdate_NodeCtx(env.L(), -1, node, dt);
-		}
-	});
-}
+static void SceneScriptsOnUpdateCall(SceneLuaVM &vm, Scene &scene, time_ns dt) { vm.CallOnUpdate(scene, dt); }
 
 static void SceneScriptsOnCollisionCall(SceneLuaVM &vm, Scene &scene, const NodePairContacts &node_node_contacts) {
 	for (auto i : node_node_contacts)
@@ -149,58 +139,158 @@ void SceneSyncToSystemsFromAssets(Scene &scene, SceneBullet3Physics &physics, Sc
 #endif
 
 //
-static void SceneUpdateSystemsImpl(Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics *bullet3_physics, NodePairContacts *node_node_contacts,
-	time_ns physics_step, int max_physics_step, SceneLuaVM *vm) {
-	scene.StorePreviousWorldMatrices();
-	scene.ReadyWorldMatrices();
+static std::vector<std::string> GetModifiedFiles(const std::string &watched_dir, bool prefix_with_watched_dir) {
+	std::vector<std::string> paths;
 
-	scene.UpdatePlayingAnims(dt);
+	for (const auto &e : GetDirectoryWatchEvents(watched_dir))
+		if (e.type == WatchEvent::FileModified || e.type == WatchEvent::FileAdded)
+			paths.push_back(prefix_with_watched_dir ? PathJoin(watched_dir, e.path) : e.path);
 
-#if HG_ENABLE_BULLET3_SCENE_PHYSICS
-	if (bullet3_physics) {
-		bullet3_physics->SyncTransformsFromScene(scene);
-		bullet3_physics->StepSimulation(dt, physics_step, max_physics_step);
-		bullet3_physics->SyncTransformsToScene(scene);
+	return paths;
+}
 
-		if (node_node_contacts) {
-			bullet3_physics->CollectCollisionEvents(scene, *node_node_contacts);
+std::vector<ComponentRef> SceneReloadModifiedScriptsFromFile(Scene &scene, SceneLuaVM &vm, const std::string &watched_dir) {
+	return vm.ReloadScriptsFromFile(scene, GetModifiedFiles(watched_dir, true));
+}
 
-			if (vm)
-				SceneScriptsOnCollisionCall(*vm, scene, *node_node_contacts);
+std::vector<ComponentRef> SceneReloadModifiedScriptsFromAssets(Scene &scene, SceneLuaVM &vm, const std::string &watched_dir) {
+	return vm.ReloadScriptsFromAssets(scene, GetModifiedFiles(watched_dir, false));
+}
+
+//
+enum SceneSystemsResource : job_resource {
+	SSR_WorldMatrices, // current world matrices and their update flags
+	SSR_PreviousWorldMatrices,
+	SSR_Transforms,
+	SSR_Anims, // playing animations and the component values they drive
+	SSR_PhysicsWorld,
+	SSR_Contacts,
+};
+
+// scripts can touch anything but the previous world matrices
+static const std::vector<job_resource> scripts_resources = {SSR_WorldMatrices, SSR_Transforms, SSR_Anims, SSR_PhysicsWorld, SSR_Contacts};
+
+struct SceneUpdateSystemsArgs {
+	Scene *scene;
+	SceneClocks *clocks;
+	time_ns dt;
+	SceneBullet3Physics *physics;
+	NodePairContacts *contacts;
+	time_ns physics_step;
+	int max_physics_step;
+	SceneLuaVM *vm;
+};
+
+// jobs read the arguments of the current call through args
+static void BuildSceneUpdateSystemsGraph(job_graph &graph, const SceneUpdateSystemsArgs &args) {
+	// the transform storage is not resized by the other jobs
+	add_job(
+		graph, "StorePreviousWorldMatrices",
+		[&args]() {
+			args.scene->StorePreviousWorldMatrices();
+			args.scene->ReadyWorldMatrices();
+		},
+		{}, {SSR_WorldMatrices, SSR_PreviousWorldMatrices});
+
+	add_job(
+		graph, "UpdatePlayingAnims", [&args]() { args.scene->UpdatePlayingAnims(args.dt); }, {}, {SSR_Anims, SSR_Transforms});
+
+#if HG_ENABLE_BULLET3_SCENE_PHYSICS
+	if (args.physics) {
+		add_job(
+			graph, "SyncTransformsFromScene", [&args]() { args.physics->SyncTransformsFromScene(*args.scene); }, {SSR_Transforms}, {SSR_PhysicsWorld});
+		add_job(
+			graph, "StepSimulation", [&args]() { args.physics->StepSimulation(args.dt, args.physics_step, args.max_physics_step); }, {},
+			{SSR_PhysicsWorld});
+		// only sets the world matrix of dynamic bodies, motion lists are up to date since SyncTransformsFromScene
+		add_job(
+			graph, "SyncTransformsToScene", [&args]() { args.physics->SyncTransformsToScene(*args.scene); }, {SSR_PhysicsWorld}, {SSR_WorldMatrices});
+
+		if (args.contacts) {
+			add_job(
+				graph, "CollectCollisionEvents", [&args]() { args.physics->CollectCollisionEvents(*args.scene, *args.contacts); }, {SSR_PhysicsWorld},
+				{SSR_Contacts});
+
+			if (args.vm)
+				add_job(
+					graph, "ScriptsOnCollision", [&args]() { SceneScriptsOnCollisionCall(*args.vm, *args.scene, *args.contacts); }, {}, scripts_resources,
+					true);
 		}
 	}
 #endif
 
-	if (vm)
-		SceneScriptsOnUpdateCall(*vm, scene, dt); // calls OnUpdate in context
+	if (args.vm) // calls OnUpdate in context
+		add_job(
+			graph, "ScriptsOnUpdate", [&args]() { SceneScriptsOnUpdateCall(*args.vm, *args.scene, args.dt); }, {}, scripts_resources, true);
+
+	add_job(
+		graph, "ComputeWorldMatrices",
+		[&args]() {
+			args.scene->ComputeWorldMatrices();
+			args.scene->FixupPreviousWorldMatrices();
+		},
+		{SSR_Transforms}, {SSR_WorldMatrices, SSR_PreviousWorldMatrices});
+}
+
+// one graph per combination of systems, built on first use
+struct SceneUpdateSystemsGraph {
+	job_graph graph;
+	SceneUpdateSystemsArgs args;
+	bool built{false}, running{false};
+};
 
-	scene.ComputeWorldMatrices();
-	scene.FixupPreviousWorldMatrices();
+static void SceneUpdateSystemsImpl(Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics *bullet3_physics, NodePairContacts *node_node_contacts,
+	time_ns physics_step, int max_physics_step, SceneLuaVM *vm, job_graph_trace *trace) {
+	static thread_local SceneUpdateSystemsGraph graphs[8];
+
+	const SceneUpdateSystemsArgs args = {&scene, &clocks, dt, bullet3_physics, node_node_contacts, physics_step, max_physics_step, vm};
+	auto &cached = graphs[(bullet3_physics ? 1 : 0) | (node_node_contacts ? 2 : 0) | (vm ? 4 : 0)];
+
+	if (cached.running) { // called from a script during an update, use a temporary graph
+		SceneUpdateSystemsGraph nested;
+		nested.args = args;
+		BuildSceneUpdateSystemsGraph(nested.graph, nested.args);
+		run_job_graph(nested.graph, trace);
+		return;
+	}
+
+	cached.args = args;
+	if (!cached.built) {
+		BuildSceneUpdateSystemsGraph(cached.graph, cached.args);
+		cached.built = true;
+	}
+
+	cached.running = true;
+	run_job_graph(cached.graph, trace);
+	cached.running = false;
 }
 
-void SceneUpdateSystems(Scene &scene, SceneClocks &clock, time_ns dt) { SceneUpdateSystemsImpl(scene, clock, dt, nullptr, nullptr, 0, 0, nullptr); }
-void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneLuaVM &vm) {
-	SceneUpdateSystemsImpl(scene, clocks, dt, nullptr, nullptr, 0, 0, &vm);
+void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, job_graph_trace *trace) {
+	SceneUpdateSystemsImpl(scene, clocks, dt, nullptr, nullptr, 0, 0, nullptr, trace);
+}
+void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneLuaVM &vm, job_graph_trace *trace) {
+	SceneUpdateSystemsImpl(scene, clocks, dt, nullptr, nullptr, 0, 0, &vm, trace);
 }
 
 #if HG_ENABLE_BULLET3_SCENE_PHYSICS
-void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, time_ns physics_step, int physics_max_step) {
-	SceneUpdateSystemsImpl(scene, clocks, dt, &physics, nullptr, physics_step, physics_max_step, nullptr);
+void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, time_ns physics_step, int physics_max_step,
+	job_graph_trace *trace) {
+	SceneUpdateSystemsImpl(scene, clocks, dt, &physics, nullptr, physics_step, physics_max_step, nullptr, trace);
 }
 
-void SceneUpdateSystems(
-	Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, time_ns physics_step, int physics_max_step, SceneLuaVM &vm) {
-	SceneUpdateSystemsImpl(scene, clocks, dt, &physics, nullptr, physics_step, physics_max_step, &vm);
+void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, time_ns physics_step, int physics_max_step,
+	SceneLuaVM &vm, job_graph_trace *trace) {
+	SceneUpdateSystemsImpl(scene, clocks, dt, &physics, nullptr, physics_step, physics_max_step, &vm, trace);
 }
 
-void SceneUpdateSystems(
-	Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, NodePairContacts &contacts, time_ns physics_step, int physics_max_step) {
-	SceneUpdateSystemsImpl(scene, clocks, dt, &physics, &contacts, physics_step, physics_max_step, nullptr);
+void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, NodePairContacts &contacts, time_ns physics_step,
+	int physics_max_step, job_graph_trace *trace) {
+	SceneUpdateSystemsImpl(scene, clocks, dt, &physics, &contacts, physics_step, physics_max_step, nullptr, trace);
 }
 
 void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, NodePairContacts &contacts, time_ns physics_step,
-	int physics_max_step, SceneLuaVM &vm) {
-	SceneUpdateSystemsImpl(scene, clocks, dt, &physics, &contacts, physics_step, physics_max_step, &vm);
+	int physics_max_step, SceneLuaVM &vm, job_graph_trace *trace) {
+	SceneUpdateSystemsImpl(scene, clocks, dt, &physics, &contacts, physics_step, physics_max_step, &vm, trace);
 }
 #endif
 
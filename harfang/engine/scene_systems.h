@@ -3,10 +3,12 @@
 #pragma once
 
 #include "foundation/generational_vector_list.h"
+#include "foundation/job_graph.h"
 #include "foundation/time.h"
 
 #include "engine/physics.h"
 
+#include <string>
 #include <vector>
 
 namespace hg {
@@ -36,19 +38,29 @@ void SceneSyncToSystemsFromFile(Scene &scene, SceneBullet3Physics &physics, Scen
 void SceneSyncToSystemsFromAssets(Scene &scene, SceneBullet3Physics &physics, SceneLuaVM &vm);
 #endif
 
-/// Update scene, physics and scripts. Script events are called where required.
-void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt);
-void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneLuaVM &vm);
+/// Reload scripts modified in a directory watched using WatchDirectory, script state is preserved and other scripts are left untouched.
+/// @note When reloading from assets the watched directory is expected to be an assets folder.
+std::vector<ComponentRef> SceneReloadModifiedScriptsFromFile(Scene &scene, SceneLuaVM &vm, const std::string &watched_dir);
+std::vector<ComponentRef> SceneReloadModifiedScriptsFromAssets(Scene &scene, SceneLuaVM &vm, const std::string &watched_dir);
+
+/**
+	@short Update scene, physics and scripts. Script events are called where required.
+	When a trace is passed the job graph executed by the call is recorded to it, see job_graph_trace_to_dot.
+	Stages not depending on each other overlap when the worker pool is started.
+*/
+void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, job_graph_trace *trace = nullptr);
+void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneLuaVM &vm, job_graph_trace *trace = nullptr);
 
 #if HG_ENABLE_BULLET3_SCENE_PHYSICS
-void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, time_ns physics_step, int max_physics_step);
-void SceneUpdateSystems(
-	Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, time_ns physics_step, int max_physics_step, SceneLuaVM &vm);
+void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, time_ns physics_step, int max_physics_step,
+	job_graph_trace *trace = nullptr);
+void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, time_ns physics_step, int max_physics_step,
+	SceneLuaVM &vm, job_graph_trace *trace = nullptr);
 
-void SceneUpdateSystems(
-	Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, NodePairContacts &contacts, time_ns physics_step, int max_physics_step);
 void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, NodePairContacts &contacts, time_ns physics_step,
-	int max_physics_step, SceneLuaVM &vm);
+	int max_physics_step, job_graph_trace *trace = nullptr);
+void SceneUpdateSystems(Scene &scene, SceneClocks &clocks, time_ns dt, SceneBullet3Physics &physics, NodePairContacts &contacts, time_ns physics_step,
+	int max_physics_step, SceneLuaVM &vm, job_graph_trace *trace = nullptr);
 #endif
 
 /// Collect scene, physics and scripts garbage and destroy them.
@@ -182,7 +182,8 @@ static int WavAudioStreamSeek(AudioStreamRef ref, AudioTimestamp t) {
 
 	const auto &stream = streams[ref];
 
-	const size_t seek_offset = TimestampToByte(stream.fmt, t);
+	const size_t block_align = AFF_ChannelCount[stream.fmt] * AFF_Resolution[stream.fmt] / 8;
+	const size_t seek_offset = TimestampToByte(stream.fmt, t) / block_align * block_align; // never seek in the middle of a sample
 	if (seek_offset > stream.data_size)
 		return 0; // jumping out of stream
 
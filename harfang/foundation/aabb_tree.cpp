@@ -0,0 +1,375 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#include "foundation/aabb_tree.h"
+#include "foundation/assert.h"
+#include "foundation/math.h"
+
+namespace hg {
+
+static inline float GetSurfaceArea(const MinMax &mm) {
+	const auto s = GetSize(mm);
+	return 2.f * (s.x * s.y + s.y * s.z + s.z * s.x);
+}
+
+static inline bool Contains(const MinMax &a, const MinMax &b) {
+	return a.mn.x <= b.mn.x && a.mn.y <= b.mn.y && a.mn.z <= b.mn.z && a.mx.x >= b.mx.x && a.mx.y >= b.mx.y && a.mx.z >= b.mx.z;
+}
+
+static inline MinMax Enlarge(const MinMax &mm, float margin) { return {mm.mn - Vec3(margin, margin, margin), mm.mx + Vec3(margin, margin, margin)}; }
+
+//
+int32_t AABBTree::AllocateNode() {
+	int32_t node;
+
+	if (free_list != invalid_proxy) {
+		node = free_list;
+		free_list = nodes[node].parent;
+	} else {
+		node = int32_t(nodes.size());
+		nodes.emplace_back();
+	}
+
+	auto &n = nodes[node];
+	n.parent = n.left = n.right = invalid_proxy;
+	n.height = 0;
+	n.value = 0;
+	return node;
+}
+
+void AABBTree::FreeNode(int32_t node) {
+	nodes[node].parent = free_list;
+	nodes[node].height = -1;
+	free_list = node;
+}
+
+//
+int32_t AABBTree::Insert(const MinMax &bounds, uint32_t value) {
+	const auto proxy = AllocateNode();
+	nodes[proxy].bounds = Enlarge(bounds, margin);
+	nodes[proxy].value = value;
+
+	InsertLeaf(proxy);
+	++proxy_count;
+	return proxy;
+}
+
+void AABBTree::Remove(int32_t proxy) {
+	__ASSERT__(proxy >= 0 && proxy < int32_t(nodes.size()) && nodes[proxy].IsLeaf() && nodes[proxy].height == 0);
+
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	--proxy_count;
+}
+
+bool AABBTree::Move(int32_t proxy, const MinMax &bounds) {
+	__ASSERT__(proxy >= 0 && proxy < int32_t(nodes.size()) && nodes[proxy].IsLeaf() && nodes[proxy].height == 0);
+
+	const auto &fat_bounds = nodes[proxy].bounds;
+
+	if (Contains(fat_bounds, bounds) && Contains(Enlarge(bounds, margin * 4.f), fat_bounds))
+		return false; // still within its enlarged bounds which are not too large
+
+	RemoveLeaf(proxy);
+	nodes[proxy].bounds = Enlarge(bounds, margin);
+	InsertLeaf(proxy);
+	return true;
+}
+
+void AABBTree::Clear() {
+	nodes.clear();
+	root = free_list = invalid_proxy;
+	proxy_count = 0;
+}
+
+//
+void AABBTree::InsertLeaf(int32_t leaf) {
+	if (root == invalid_proxy) {
+		root = leaf;
+		nodes[root].parent = invalid_proxy;
+		return;
+	}
+
+	// find the best sibling, minimizing the surface area added to the tree
+	const auto leaf_bounds = nodes[leaf].bounds;
+
+	int32_t index = root;
+	while (!nodes[index].IsLeaf()) {
+		const auto &node = nodes[index];
+
+		const float area = GetSurfaceArea(node.bounds);
+		const float combined_area = GetSurfaceArea(Union(node.bounds, leaf_bounds));
+
+		const float cost = 2.f * combined_area; // cost of creating a new parent for this node and the new leaf
+		const float inheritance_cost = 2.f * (combined_area - area); // minimum cost of pushing the leaf further down the tree
+
+		const auto GetDescentCost = [&](int32_t child) {
+			const auto &c = nodes[child];
+			const float child_area = GetSurfaceArea(Union(c.bounds, leaf_bounds));
+			return (c.IsLeaf() ? child_area : child_area - GetSurfaceArea(c.bounds)) + inheritance_cost;
+		};
+
+		const float cost_left = GetDescentCost(node.left), cost_right = GetDescentCost(node.right);
+
+		if (cost < cost_left && cost < cost_right)
+			break;
+
+		index = cost_left < cost_right ? node.left : node.right;
+	}
+
+	const int32_t sibling = index;
+
+	// create a new parent for the sibling and the leaf
+	const int32_t old_parent = nodes[sibling].parent;
+	const int32_t new_parent = AllocateNode();
+
+	nodes[new_parent].parent = old_parent;
+	nodes[new_parent].bounds = Union(leaf_bounds, nodes[sibling].bounds);
+	nodes[new_parent].height = nodes[sibling].height + 1;
+	nodes[new_parent].left = sibling;
+	nodes[new_parent].right = leaf;
+
+	nodes[sibling].parent = new_parent;
+	nodes[leaf].parent = new_parent;
+
+	if (old_parent != invalid_proxy) {
+		if (nodes[old_parent].left == sibling)
+			nodes[old_parent].left = new_parent;
+		else
+			nodes[old_parent].right = new_parent;
+	} else {
+		root = new_parent;
+	}
+
+	Refit(new_parent);
+}
+
+void AABBTree::RemoveLeaf(int32_t leaf) {
+	if (leaf == root) {
+		root = invalid_proxy;
+		return;
+	}
+
+	const int32_t parent = nodes[leaf].parent;
+	const int32_t grand_parent = nodes[parent].parent;
+	const int32_t sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+	// replace the parent with the sibling
+	if (grand_parent != invalid_proxy) {
+		if (nodes[grand_parent].left == parent)
+			nodes[grand_parent].left = sibling;
+		else
+			nodes[grand_parent].right = sibling;
+
+		nodes[sibling].parent = grand_parent;
+		FreeNode(parent);
+
+		Refit(grand_parent);
+	} else {
+		root = sibling;
+		nodes[sibling].parent = invalid_proxy;
+		FreeNode(parent);
+	}
+}
+
+/// Walk up the tree from a node, rebalancing and updating the bounds of all its ancestors.
+void AABBTree::Refit(int32_t index) {
+	while (index != invalid_proxy) {
+		index = Balance(index);
+
+		auto &node = nodes[index];
+		const auto &left = nodes[node.left], &right = nodes[node.right];
+
+		node.height = 1 + Max(left.height, right.height);
+		node.bounds = Union(left.bounds, right.bounds);
+
+		index = node.parent;
+	}
+}
+
+/// Perform a left or right rotation if a node is imbalanced, return the index of the node now at its position.
+int32_t AABBTree::Balance(int32_t ia) {
+	auto &a = nodes[ia];
+	if (a.IsLeaf() || a.height < 2)
+		return ia;
+
+	const int32_t ib = a.left, ic = a.right;
+	auto &b = nodes[ib], &c = nodes[ic];
+
+	const int32_t balance = c.height - b.height;
+
+	if (balance > 1) { // rotate c up
+		const int32_t i_f = c.left, ig = c.right;
+		auto &f = nodes[i_f], &g = nodes[ig];
+
+		c.left = ia;
+		c.parent = a.parent;
+		a.parent = ic;
+
+		if (c.parent != invalid_proxy) {
+			if (nodes[c.parent].left == ia)
+				nodes[c.parent].left = ic;
+			else
+				nodes[c.parent].right = ic;
+		} else {
+			root = ic;
+		}
+
+		if (f.height > g.height) {
+			c.right = i_f;
+			a.right = ig;
+			g.parent = ia;
+			a.bounds = Union(b.bounds, g.bounds);
+			c.bounds = Union(a.bounds, f.bounds);
+			a.height = 1 + Max(b.height, g.height);
+			c.height = 1 + Max(a.height, f.height);
+		} else {
+			c.right = ig;
+			a.right = i_f;
+			f.parent = ia;
+			a.bounds = Union(b.bounds, f.bounds);
+			c.bounds = Union(a.bounds, g.bounds);
+			a.height = 1 + Max(b.height, f.height);
+			c.height = 1 + Max(a.height, g.height);
+		}
+		return ic;
+	}
+
+	if (balance < -1) { // rotate b up
+		const int32_t id = b.left, ie = b.right;
+		auto &d = nodes[id], &e = nodes[ie];
+
+		b.left = ia;
+		b.parent = a.parent;
+		a.parent = ib;
+
+		if (b.parent != invalid_proxy) {
+			if (nodes[b.parent].left == ia)
+				nodes[b.parent].left = ib;
+			else
+				nodes[b.parent].right = ib;
+		} else {
+			root = ib;
+		}
+
+		if (d.height > e.height) {
+			b.right = id;
+			a.left = ie;
+			e.parent = ia;
+			a.bounds = Union(c.bounds, e.bounds);
+			b.bounds = Union(a.bounds, d.bounds);
+			a.height = 1 + Max(c.height, e.height);
+			b.height = 1 + Max(a.height, d.height);
+		} else {
+			b.right = ie;
+			a.left = id;
+			d.parent = ia;
+			a.bounds = Union(c.bounds, d.bounds);
+			b.bounds = Union(a.bounds, e.bounds);
+			a.height = 1 + Max(c.height, d.height);
+			b.height = 1 + Max(a.height, e.height);
+		}
+		return ib;
+	}
+
+	return ia;
+}
+
+//
+void AABBTree::CollectLeaves(int32_t node, std::vector<uint32_t> &out, std::vector<int32_t> &stack) const {
+	const auto base = stack.size();
+	stack.push_back(node);
+
+	while (stack.size() > base) {
+		const auto &n = nodes[stack.back()];
+		stack.pop_back();
+
+		if (n.IsLeaf()) {
+			out.push_back(n.value);
+		} else {
+			stack.push_back(n.left);
+			stack.push_back(n.right);
+		}
+	}
+}
+
+void AABBTree::Query(const MinMax &bounds, std::vector<uint32_t> &out) const {
+	if (root == invalid_proxy)
+		return;
+
+	std::vector<int32_t> stack;
+	stack.reserve(64);
+	stack.push_back(root);
+
+	while (!stack.empty()) {
+		const auto &n = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!Overlap(n.bounds, bounds))
+			continue;
+
+		if (n.IsLeaf()) {
+			out.push_back(n.value);
+		} else {
+			stack.push_back(n.left);
+			stack.push_back(n.right);
+		}
+	}
+}
+
+void AABBTree::Query(const Frustum &frustum, std::vector<uint32_t> &out) const {
+	if (root == invalid_proxy)
+		return;
+
+	std::vector<int32_t> stack;
+	stack.reserve(64);
+	stack.push_back(root);
+
+	while (!stack.empty()) {
+		const auto index = stack.back();
+		stack.pop_back();
+
+		const auto &n = nodes[index];
+		const auto visibility = TestVisibility(frustum, n.bounds);
+
+		if (visibility == V_Outside)
+			continue;
+
+		if (n.IsLeaf()) {
+			out.push_back(n.value);
+		} else if (visibility == V_Inside) {
+			CollectLeaves(index, out, stack); // no need to test the subtree any further
+		} else {
+			stack.push_back(n.left);
+			stack.push_back(n.right);
+		}
+	}
+}
+
+void AABBTree::Query(const Vec3 &center, float radius, std::vector<uint32_t> &out) const {
+	if (root == invalid_proxy)
+		return;
+
+	std::vector<int32_t> stack;
+	stack.reserve(64);
+	stack.push_back(root);
+
+	const float sq_radius = radius * radius;
+
+	while (!stack.empty()) {
+		const auto &n = nodes[stack.back()];
+		stack.pop_back();
+
+		const auto closest = Clamp(center, n.bounds.mn, n.bounds.mx);
+		if (Dist2(center, closest) > sq_radius)
+			continue;
+
+		if (n.IsLeaf()) {
+			out.push_back(n.value);
+		} else {
+			stack.push_back(n.left);
+			stack.push_back(n.right);
+		}
+	}
+}
+
+} // namespace hg
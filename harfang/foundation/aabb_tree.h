@@ -0,0 +1,73 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#pragma once
+
+#include "foundation/frustum.h"
+#include "foundation/minmax.h"
+#include "foundation/vector3.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace hg {
+
+/*!
+	Dynamic bounding volume hierarchy over a set of proxies, each proxy storing a user value and its bounds enlarged by a margin. Moving a proxy within
+	its enlarged bounds does not modify the tree, otherwise the proxy is reinserted and the tree rebalanced so that queries remain logarithmic.
+*/
+class AABBTree {
+public:
+	static const int32_t invalid_proxy = -1;
+
+	explicit AABBTree(float margin = 0.1f) : margin(margin) {}
+
+	/// Insert a proxy and return its identifier.
+	int32_t Insert(const MinMax &bounds, uint32_t value);
+	void Remove(int32_t proxy);
+	/// Update the bounds of a proxy, return true if the proxy had to be reinserted.
+	bool Move(int32_t proxy, const MinMax &bounds);
+
+	void Clear();
+
+	uint32_t GetValue(int32_t proxy) const { return nodes[proxy].value; }
+	/// Return the enlarged bounds of a proxy.
+	const MinMax &GetBounds(int32_t proxy) const { return nodes[proxy].bounds; }
+
+	size_t GetProxyCount() const { return proxy_count; }
+	/// Return the height of the tree, 0 if it is empty.
+	int GetHeight() const { return root != invalid_proxy ? nodes[root].height + 1 : 0; }
+
+	/// Output the value of all proxies whose bounds intersect a volume, proxies are tested against their enlarged bounds.
+	void Query(const MinMax &bounds, std::vector<uint32_t> &out) const;
+	void Query(const Frustum &frustum, std::vector<uint32_t> &out) const;
+	void Query(const Vec3 &center, float radius, std::vector<uint32_t> &out) const;
+
+private:
+	struct Node {
+		MinMax bounds;
+		uint32_t value;
+		int32_t parent; // next free node if the node is unused
+		int32_t left, right; // invalid_proxy for leaves
+		int32_t height; // 0 for leaves, -1 for unused nodes
+
+		bool IsLeaf() const { return left == invalid_proxy; }
+	};
+
+	std::vector<Node> nodes;
+	int32_t root{invalid_proxy}, free_list{invalid_proxy};
+	size_t proxy_count{0};
+
+	float margin;
+
+	int32_t AllocateNode();
+	void FreeNode(int32_t node);
+
+	void InsertLeaf(int32_t leaf);
+	void RemoveLeaf(int32_t leaf);
+	int32_t Balance(int32_t node);
+	void Refit(int32_t node);
+
+	void CollectLeaves(int32_t node, std::vector<uint32_t> &out, std::vector<int32_t> &stack) const;
+};
+
+} // namespace hg
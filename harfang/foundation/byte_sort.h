@@ -32,6 +32,9 @@ template <typename T, typename O> bytesort_entry<T, O> *bytesort(size_t count, b
 	for (size_t r = 0; r < sizeof(T); ++r) {
 		uint32_t *__restrict p_radix = radix.data() + r * 256;
 
+		if (count && p_radix[reinterpret_cast<const uint8_t *>(a)[r]] == count)
+			continue; // all entries share the same byte, this pass would not change their order
+
 		// convert count to index
 		uint32_t t = 0;
 		for (int i = 0; i < 256; ++i) {
@@ -0,0 +1,315 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#pragma once
+
+#include "foundation/assert.h"
+#include "foundation/generational_vector_list.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace hg {
+
+/*
+	gen_ref_table
+
+	- Associate a value to gen_ref keys, usually side data for a subset of the entries of a generational_vector_list.
+	- Constant time lookup/insertion/removal by key index, an entry is only found if its key generation matches.
+	- Values are stored contiguously for fast iteration, removing an entry moves the last entry in its place.
+
+	Memory usage: (highest key index + 1) * sizeof(uint32_t) + size() * (sizeof(gen_ref) + sizeof(T))
+*/
+template <typename T> class gen_ref_table {
+public:
+	struct entry {
+		gen_ref first; // key
+		T second;
+	};
+
+	using iterator = typename std::vector<entry>::iterator;
+	using const_iterator = typename std::vector<entry>::const_iterator;
+
+	T *find(gen_ref key) {
+		const auto i = find_dense_(key);
+		return i != invalid_idx ? &dense[i].second : nullptr;
+	}
+
+	const T *find(gen_ref key) const {
+		const auto i = find_dense_(key);
+		return i != invalid_idx ? &dense[i].second : nullptr;
+	}
+
+	bool contains(gen_ref key) const { return find_dense_(key) != invalid_idx; }
+
+	/// Return the value associated to a key, inserting a default value if the key is not in the table.
+	T &operator[](gen_ref key) {
+		__ASSERT__(key.idx != invalid_gen_ref.idx);
+
+		if (key.idx >= sparse.size())
+			sparse.resize(size_t(key.idx) + 1, uint32_t(invalid_idx));
+
+		auto &i = sparse[key.idx];
+
+		if (i == invalid_idx) {
+			i = uint32_t(dense.size());
+			dense.push_back({key, T()});
+		} else if (dense[i].first != key) {
+			dense[i] = {key, T()}; // stale entry from a previous generation
+		}
+
+		return dense[i].second;
+	}
+
+	bool erase(gen_ref key) {
+		const auto i = find_dense_(key);
+		if (i == invalid_idx)
+			return false;
+
+		if (i != dense.size() - 1) {
+			dense[i] = std::move(dense.back());
+			sparse[dense[i].first.idx] = i;
+		}
+
+		dense.pop_back();
+		sparse[key.idx] = invalid_idx;
+		return true;
+	}
+
+	void clear() {
+		sparse.clear();
+		dense.clear();
+	}
+
+	size_t size() const { return dense.size(); }
+	bool empty() const { return dense.empty(); }
+
+	iterator begin() { return std::begin(dense); }
+	iterator end() { return std::end(dense); }
+	const_iterator begin() const { return std::begin(dense); }
+	const_iterator end() const { return std::end(dense); }
+
+	/// Memory allocated by the table, excluding memory allocated by the values themselves.
+	size_t memory_footprint() const { return sparse.capacity() * sizeof(uint32_t) + dense.capacity() * sizeof(entry); }
+
+private:
+	static const uint32_t invalid_idx = 0xffffffff;
+
+	std::vector<uint32_t> sparse; // key index to dense index
+	std::vector<entry> dense;
+
+	uint32_t find_dense_(gen_ref key) const {
+		if (key.idx >= sparse.size())
+			return invalid_idx;
+		const auto i = sparse[key.idx];
+		return i != invalid_idx && dense[i].first == key ? i : invalid_idx;
+	}
+};
+
+/*
+	gen_ref_list_table
+
+	- Associate a list of values to gen_ref keys.
+	- All lists are stored back to back in a single pool, each key addresses an offset/count/capacity range of the pool.
+	- A list growing past its capacity is moved to the end of the pool, the pool is compacted when more than half of it is unused.
+	- Iteration is in key index order.
+
+	Modifying a list or removing a key invalidates all spans returned by the table.
+*/
+template <typename T> class gen_ref_list_table {
+public:
+	template <typename V> struct span {
+		V *data{nullptr};
+		size_t count{0};
+
+		V *begin() const { return data; }
+		V *end() const { return data + count; }
+
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+
+		V &operator[](size_t i) const {
+			__ASSERT__(i < count);
+			return data[i];
+		}
+	};
+
+	struct entry {
+		gen_ref first; // key
+		span<const T> second;
+	};
+
+	class const_iterator {
+	public:
+		const_iterator(const gen_ref_list_table *table, size_t i) : table(table), i(i) { skip_(); }
+
+		entry operator*() const {
+			const auto &r = table->ranges[table->sparse[i]];
+			return {r.key, {table->pool.data() + r.offset, r.count}};
+		}
+
+		const_iterator &operator++() {
+			++i;
+			skip_();
+			return *this;
+		}
+
+		bool operator==(const const_iterator &o) const { return i == o.i; }
+		bool operator!=(const const_iterator &o) const { return i != o.i; }
+
+	private:
+		const gen_ref_list_table *table;
+		size_t i; // key index
+
+		void skip_() {
+			while (i < table->sparse.size() && table->sparse[i] == invalid_idx)
+				++i;
+		}
+	};
+
+	span<T> get(gen_ref key) {
+		const auto i = find_range_(key);
+		return i != invalid_idx ? span<T>{pool.data() + ranges[i].offset, ranges[i].count} : span<T>{};
+	}
+
+	span<const T> get(gen_ref key) const {
+		const auto i = find_range_(key);
+		return i != invalid_idx ? span<const T>{pool.data() + ranges[i].offset, ranges[i].count} : span<const T>{};
+	}
+
+	bool contains(gen_ref key) const { return find_range_(key) != invalid_idx; }
+
+	/// Resize the list of a key, inserting the key if it is not in the table.
+	void resize(gen_ref key, size_t count, const T &value = T()) {
+		const T v = value; // value might reference an entry of the pool, growing the pool invalidates it
+
+		auto &r = ranges[get_or_add_range_(key)];
+
+		if (count > r.capacity) {
+			const auto capacity = std::max<size_t>(count, r.capacity * 2);
+
+			if (r.offset + r.capacity == pool.size()) {
+				pool.resize(r.offset + capacity); // last range in the pool, grow in place
+			} else {
+				const auto offset = uint32_t(pool.size());
+				pool.resize(pool.size() + capacity);
+				std::copy(pool.begin() + r.offset, pool.begin() + r.offset + r.count, pool.begin() + offset);
+
+				unused += r.capacity;
+				r.offset = offset;
+			}
+
+			r.capacity = uint32_t(capacity);
+		}
+
+		for (auto i = r.count; i < count; ++i)
+			pool[r.offset + i] = v;
+		r.count = uint32_t(count);
+
+		compact_if_fragmented_();
+	}
+
+	void push_back(gen_ref key, const T &v) { resize(key, get(key).size() + 1, v); }
+
+	bool erase(gen_ref key) {
+		const auto i = find_range_(key);
+		if (i == invalid_idx)
+			return false;
+
+		if (ranges[i].offset + ranges[i].capacity == pool.size())
+			pool.resize(ranges[i].offset); // last range in the pool, reclaim its storage
+		else
+			unused += ranges[i].capacity;
+
+		if (i != ranges.size() - 1) {
+			ranges[i] = ranges.back();
+			sparse[ranges[i].key.idx] = i;
+		}
+
+		ranges.pop_back();
+		sparse[key.idx] = invalid_idx;
+
+		compact_if_fragmented_();
+		return true;
+	}
+
+	void clear() {
+		sparse.clear();
+		ranges.clear();
+		pool.clear();
+		unused = 0;
+	}
+
+	/// Number of keys in the table.
+	size_t size() const { return ranges.size(); }
+	bool empty() const { return ranges.empty(); }
+
+	const_iterator begin() const { return {this, 0}; }
+	const_iterator end() const { return {this, sparse.size()}; }
+
+	/// Move all lists back to back in the pool, trimming their capacity to their size.
+	void compact() {
+		std::vector<T> compacted;
+		compacted.reserve(pool.size() - unused);
+
+		for (auto &r : ranges) {
+			const auto offset = uint32_t(compacted.size());
+			compacted.insert(compacted.end(), pool.begin() + r.offset, pool.begin() + r.offset + r.count);
+			r.offset = offset;
+			r.capacity = r.count;
+		}
+
+		pool = std::move(compacted);
+		unused = 0;
+	}
+
+	/// Memory allocated by the table.
+	size_t memory_footprint() const { return sparse.capacity() * sizeof(uint32_t) + ranges.capacity() * sizeof(range) + pool.capacity() * sizeof(T); }
+
+private:
+	static const uint32_t invalid_idx = 0xffffffff;
+
+	struct range {
+		gen_ref key;
+		uint32_t offset, count, capacity;
+	};
+
+	std::vector<uint32_t> sparse; // key index to range index
+	std::vector<range> ranges;
+	std::vector<T> pool;
+
+	size_t unused{0}; // pool entries not addressed by any range
+
+	uint32_t find_range_(gen_ref key) const {
+		if (key.idx >= sparse.size())
+			return invalid_idx;
+		const auto i = sparse[key.idx];
+		return i != invalid_idx && ranges[i].key == key ? i : invalid_idx;
+	}
+
+	uint32_t get_or_add_range_(gen_ref key) {
+		__ASSERT__(key.idx != invalid_gen_ref.idx);
+
+		if (key.idx >= sparse.size())
+			sparse.resize(size_t(key.idx) + 1, uint32_t(invalid_idx));
+
+		auto &i = sparse[key.idx];
+
+		if (i == invalid_idx) {
+			i = uint32_t(ranges.size());
+			ranges.push_back({key, uint32_t(pool.size()), 0, 0});
+		} else if (ranges[i].key != key) {
+			ranges[i].key = key; // stale range from a previous generation
+			ranges[i].count = 0;
+		}
+
+		return i;
+	}
+
+	void compact_if_fragmented_() {
+		if (unused > 64 && unused * 2 > pool.size())
+			compact();
+	}
+};
+
+} // namespace hg
@@ -0,0 +1,196 @@
+// HARFANG(R) Copyright (C) 2021 Emmanuel Julien, NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#include "foundation/job_graph.h"
+#include "foundation/format.h"
+#include "foundation/worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace hg {
+
+static void add_dependency(job_graph &graph, size_t i, size_t dep) {
+	auto &deps = graph.nodes[i].dependencies;
+	if (dep != i && std::find(std::begin(deps), std::end(deps), dep) == std::end(deps)) {
+		deps.push_back(dep);
+		graph.nodes[dep].dependents.push_back(i);
+	}
+}
+
+size_t add_job(job_graph &graph, std::string name, std::function<void()> fn, std::vector<job_resource> reads, std::vector<job_resource> writes,
+	bool on_calling_thread) {
+	const auto i = graph.nodes.size();
+	graph.nodes.push_back({std::move(name), std::move(fn), std::move(reads), std::move(writes), on_calling_thread, {}, {}});
+
+	const auto &n = graph.nodes.back();
+
+	for (auto r : n.reads) {
+		const auto &state = graph.resources[r];
+		if (state.last_writer != SIZE_MAX)
+			add_dependency(graph, i, state.last_writer); // read after write
+	}
+
+	for (auto r : n.writes) {
+		const auto &state = graph.resources[r];
+		if (state.last_writer != SIZE_MAX)
+			add_dependency(graph, i, state.last_writer); // write after write
+		for (auto reader : state.readers)
+			add_dependency(graph, i, reader); // write after read
+	}
+
+	for (auto r : n.reads)
+		graph.resources[r].readers.push_back(i);
+
+	for (auto r : n.writes) {
+		auto &state = graph.resources[r];
+		state.last_writer = i;
+		state.readers.clear();
+	}
+
+	return i;
+}
+
+std::vector<std::vector<size_t>> compute_job_graph_dependencies(const job_graph &graph) {
+	std::vector<std::vector<size_t>> deps;
+	deps.reserve(graph.nodes.size());
+	for (const auto &n : graph.nodes)
+		deps.push_back(n.dependencies);
+	return deps;
+}
+
+//
+void run_job_graph(const job_graph &graph, job_graph_trace *trace) {
+	const auto count = graph.nodes.size();
+
+	if (trace) {
+		trace->nodes.resize(count);
+		for (size_t i = 0; i < count; ++i)
+			trace->nodes[i] = {graph.nodes[i].name, graph.nodes[i].dependencies, -1, 0, 0};
+	}
+
+	const auto execute = [&](size_t i) {
+		if (trace) {
+			trace->nodes[i].worker = get_worker_index();
+			trace->nodes[i].start = time_now();
+		}
+
+		graph.nodes[i].fn();
+
+		if (trace)
+			trace->nodes[i].end = time_now();
+	};
+
+	if (get_worker_count() == 0) {
+		for (size_t i = 0; i < count; ++i)
+			execute(i); // declaration order is a valid execution order
+		return;
+	}
+
+	//
+	std::unique_ptr<std::atomic<int>[]> unresolved(new std::atomic<int>[count]);
+	for (size_t i = 0; i < count; ++i)
+		unresolved[i] = int(graph.nodes[i].dependencies.size());
+
+	std::atomic<size_t> remaining{count};
+	job_counter counter;
+
+	std::mutex calling_thread_mutex;
+	std::condition_variable calling_thread_condition;
+	std::vector<size_t> calling_thread_jobs; // ready jobs that must run on the calling thread
+	size_t pushed_job_count = 0; // jobs pushed to the pool, lets the calling thread wake up to help with them
+
+	std::function<void(size_t)> schedule;
+
+	const auto complete = [&](size_t i) {
+		for (auto d : graph.nodes[i].dependents)
+			if (--unresolved[d] == 0)
+				schedule(d);
+
+		if (--remaining == 0) {
+			std::lock_guard<std::mutex> lock(calling_thread_mutex);
+			calling_thread_condition.notify_one();
+		}
+	};
+
+	schedule = [&](size_t i) {
+		if (graph.nodes[i].on_calling_thread) {
+			std::lock_guard<std::mutex> lock(calling_thread_mutex);
+			calling_thread_jobs.push_back(i);
+			calling_thread_condition.notify_one();
+		} else {
+			run_job(
+				[&, i]() {
+					execute(i);
+					complete(i);
+				},
+				counter);
+
+			std::lock_guard<std::mutex> lock(calling_thread_mutex);
+			++pushed_job_count;
+			calling_thread_condition.notify_one();
+		}
+	};
+
+	for (size_t i = 0; i < count; ++i)
+		if (graph.nodes[i].dependencies.empty())
+			schedule(i);
+
+	while (remaining > 0) {
+		size_t i = SIZE_MAX, seen_pushed_job_count;
+
+		{
+			std::lock_guard<std::mutex> lock(calling_thread_mutex);
+			seen_pushed_job_count = pushed_job_count;
+
+			if (!calling_thread_jobs.empty()) {
+				i = calling_thread_jobs.back();
+				calling_thread_jobs.pop_back();
+			}
+		}
+
+		if (i != SIZE_MAX) {
+			execute(i);
+			complete(i);
+		} else if (!run_pending_job(counter)) {
+			// all ready jobs are running, sleep until a job becomes ready or the graph completes
+			std::unique_lock<std::mutex> lock(calling_thread_mutex);
+			calling_thread_condition.wait(
+				lock, [&] { return !calling_thread_jobs.empty() || pushed_job_count != seen_pushed_job_count || remaining == 0; });
+		}
+	}
+
+	wait_jobs(counter); // returns once the last job released the graph state
+}
+
+//
+std::string job_graph_trace_to_dot(const job_graph_trace &trace) {
+	std::string dot = "digraph job_graph {\n\tnode [shape=box];\n";
+
+	time_ns t_origin = trace.nodes.empty() ? 0 : trace.nodes.front().start;
+	for (const auto &n : trace.nodes)
+		t_origin = std::min(t_origin, n.start);
+
+	for (size_t i = 0; i < trace.nodes.size(); ++i) {
+		const auto &n = trace.nodes[i];
+		const auto worker = n.worker >= 0 ? format("worker %1").arg(n.worker).str() : std::string("calling thread");
+
+		dot += format("\tjob%1 [label=\"%2\\n%3\\nstart %4 ms, %5 ms\"];\n")
+				   .arg(i)
+				   .arg(n.name)
+				   .arg(worker)
+				   .arg(time_to_ms_f(n.start - t_origin), 3)
+				   .arg(time_to_ms_f(n.end - n.start), 3)
+				   .str();
+
+		for (auto d : n.dependencies)
+			dot += format("\tjob%1 -> job%2;\n").arg(d).arg(i).str();
+	}
+
+	dot += "}\n";
+	return dot;
+}
+
+} // namespace hg
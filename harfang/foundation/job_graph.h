@@ -0,0 +1,66 @@
+// HARFANG(R) Copyright (C) 2021 Emmanuel Julien, NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#pragma once
+
+#include "foundation/time.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace hg {
+
+/// Identify a piece of data read or written by the jobs of a graph.
+using job_resource = uint32_t;
+
+/// Set of jobs declaring the data they read and write, a graph can be run any number of times.
+struct job_graph {
+	struct node {
+		std::string name;
+		std::function<void()> fn;
+		std::vector<job_resource> reads, writes;
+		bool on_calling_thread; // job must run on the thread calling run_job_graph
+
+		std::vector<size_t> dependencies, dependents; // resolved by add_job
+	};
+
+	struct resource_state {
+		size_t last_writer{SIZE_MAX};
+		std::vector<size_t> readers; // since last write
+	};
+
+	std::vector<node> nodes;
+	std::map<job_resource, resource_state> resources; // access state after the last added job
+};
+
+/**
+	@short Add a job to a graph.
+	The job runs after all previously added jobs writing a resource it reads or writes and after all previously added jobs reading a resource it writes.
+*/
+size_t add_job(job_graph &graph, std::string name, std::function<void()> fn, std::vector<job_resource> reads, std::vector<job_resource> writes,
+	bool on_calling_thread = false);
+
+/// Return the list of jobs each job of a graph depends on.
+std::vector<std::vector<size_t>> compute_job_graph_dependencies(const job_graph &graph);
+
+/// Execution record of a job graph.
+struct job_graph_trace {
+	struct node {
+		std::string name;
+		std::vector<size_t> dependencies;
+		int worker; // -1 when executed by a thread outside the worker pool
+		time_ns start, end;
+	};
+
+	std::vector<node> nodes;
+};
+
+/// Run a job graph on the worker pool, returns once all jobs completed.
+void run_job_graph(const job_graph &graph, job_graph_trace *trace = nullptr);
+
+/// Return a job graph trace in the Graphviz DOT format.
+std::string job_graph_trace_to_dot(const job_graph_trace &trace);
+
+} // namespace hg
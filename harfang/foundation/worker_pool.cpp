@@ -0,0 +1,224 @@
+// HARFANG(R) Copyright (C) 2021 Emmanuel Julien, NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#include "foundation/worker_pool.h"
+#include "foundation/format.h"
+#include "foundation/thread.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hg {
+
+struct job {
+	std::function<void()> fn;
+	job_counter *counter;
+};
+
+struct job_queue {
+	std::mutex mutex;
+	std::deque<job> jobs;
+};
+
+static std::vector<std::unique_ptr<job_queue>> job_queues; // one per worker plus one for threads outside the pool
+static std::vector<std::thread> workers;
+
+static std::atomic<bool> workers_running{false};
+static std::atomic<int> queued_job_count{0};
+
+static std::mutex wake_mutex; // guards idle workers going to sleep
+static std::condition_variable wake_condition;
+
+static std::mutex done_mutex; // guards threads waiting for a job counter to reach zero
+static std::condition_variable done_condition;
+
+static thread_local int worker_index = -1;
+
+int get_worker_count() { return int(workers.size()); }
+int get_worker_index() { return worker_index; }
+
+//
+static bool pop_from_queue(job_queue &q, const job_counter *group, bool lifo, job &out) {
+	std::lock_guard<std::mutex> lock(q.mutex);
+
+	if (q.jobs.empty())
+		return false;
+
+	if (!group) {
+		if (lifo) {
+			out = std::move(q.jobs.back());
+			q.jobs.pop_back();
+		} else {
+			out = std::move(q.jobs.front());
+			q.jobs.pop_front();
+		}
+	} else {
+		auto i = std::find_if(std::begin(q.jobs), std::end(q.jobs), [group](const job &j) { return j.counter == group; });
+		if (i == std::end(q.jobs))
+			return false;
+
+		out = std::move(*i);
+		q.jobs.erase(i);
+	}
+
+	--queued_job_count;
+	return true;
+}
+
+/// Pop a pending job, only jobs tracked by group are considered if not null.
+static bool pop_job(job &out, const job_counter *group) {
+	if (queued_job_count.load(std::memory_order_acquire) <= 0)
+		return false;
+
+	const auto queue_count = int(job_queues.size());
+	const auto own_idx = worker_index >= 0 ? worker_index : queue_count - 1;
+
+	if (pop_from_queue(*job_queues[own_idx], group, true, out)) // LIFO on the own queue for cache locality
+		return true;
+
+	for (int i = 1; i < queue_count; ++i)
+		if (pop_from_queue(*job_queues[(own_idx + i) % queue_count], group, false, out)) // FIFO when stealing from other queues
+			return true;
+
+	return false;
+}
+
+static void execute_job(job &j) {
+	j.fn();
+
+	if (j.counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		std::lock_guard<std::mutex> lock(done_mutex); // a waiting thread either sees the counter at zero or is already waiting
+		done_condition.notify_all();
+	}
+}
+
+static void worker_thread__(int idx) {
+	set_thread_name(format("Harfang - worker %1").arg(idx).str());
+	worker_index = idx;
+
+	for (;;) {
+		job j;
+
+		if (pop_job(j, nullptr)) {
+			execute_job(j);
+		} else {
+			std::unique_lock<std::mutex> lock(wake_mutex);
+			wake_condition.wait(lock, [] { return queued_job_count > 0 || !workers_running; });
+
+			if (!workers_running)
+				break;
+		}
+	}
+}
+
+//
+void run_job(std::function<void()> fn, job_counter &counter) {
+	if (workers.empty()) {
+		fn(); // no pool, run on the calling thread
+		return;
+	}
+
+	counter.pending.fetch_add(1, std::memory_order_acq_rel);
+
+	{
+		auto &q = *job_queues[worker_index >= 0 ? worker_index : job_queues.size() - 1];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		q.jobs.push_back({std::move(fn), &counter});
+		++queued_job_count;
+	}
+
+	std::lock_guard<std::mutex> lock(wake_mutex); // an idle worker either sees the queued job or is already waiting
+	wake_condition.notify_one();
+}
+
+void wait_jobs(job_counter &counter) {
+	while (counter.pending.load(std::memory_order_acquire) > 0) {
+		if (run_pending_job(counter))
+			continue;
+
+		// remaining jobs are running on other threads
+		std::unique_lock<std::mutex> lock(done_mutex);
+		done_condition.wait(lock, [&] { return counter.pending.load(std::memory_order_acquire) == 0; });
+	}
+}
+
+bool run_pending_job(job_counter &counter) {
+	job j;
+
+	if (!pop_job(j, &counter))
+		return false;
+
+	execute_job(j);
+	return true;
+}
+
+//
+void parallel_for(size_t count, size_t chunk_size, const std::function<void(size_t begin, size_t end)> &fn) {
+	if (chunk_size == 0)
+		chunk_size = 1;
+
+	if (workers.empty() || count <= chunk_size) {
+		if (count)
+			fn(0, count);
+		return;
+	}
+
+	job_counter counter;
+
+	size_t begin = chunk_size; // first chunk is processed by the calling thread
+	for (; begin < count; begin += chunk_size) {
+		const auto end = begin + chunk_size < count ? begin + chunk_size : count;
+		run_job([&fn, begin, end]() { fn(begin, end); }, counter);
+	}
+
+	fn(0, chunk_size);
+	wait_jobs(counter);
+}
+
+//
+void start_workers(int count) {
+	if (!workers.empty())
+		return;
+
+	if (count <= 0)
+		count = get_system_thread_count() - 1;
+	if (count <= 0)
+		return; // single core, jobs run on the calling thread
+
+	job_queues.clear();
+	for (int i = 0; i < count + 1; ++i)
+		job_queues.push_back(std::make_unique<job_queue>());
+
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		workers_running = true;
+	}
+
+	workers.reserve(count);
+	for (int i = 0; i < count; ++i)
+		workers.emplace_back(worker_thread__, i);
+}
+
+void stop_workers() {
+	if (workers.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		workers_running = false;
+		wake_condition.notify_all();
+	}
+
+	for (auto &w : workers)
+		w.join();
+
+	workers.clear();
+	job_queues.clear();
+	queued_job_count = 0;
+}
+
+} // namespace hg
@@ -0,0 +1,37 @@
+// HARFANG(R) Copyright (C) 2021 Emmanuel Julien, NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+namespace hg {
+
+/// Start the worker pool, a count of 0 starts one worker per logical thread minus the calling thread.
+/// @note Until the pool is started all jobs run on the thread pushing them.
+void start_workers(int count = 0);
+/// Stop the worker pool, all jobs must have been waited on.
+void stop_workers();
+
+/// Return the number of running workers.
+int get_worker_count();
+/// Return the index of the calling worker or -1 if the calling thread is not a worker.
+int get_worker_index();
+
+/// Track completion of a batch of jobs.
+struct job_counter {
+	std::atomic<int> pending{0};
+};
+
+/// Push a job to the pool. Jobs pushed from a worker go to its own queue, idle workers steal jobs from the other queues.
+void run_job(std::function<void()> job, job_counter &counter);
+/// Wait for all jobs tracked by a counter to complete, the calling thread executes pending jobs tracked by the same counter while waiting.
+void wait_jobs(job_counter &counter);
+/// Execute a single pending job tracked by a counter on the calling thread, return false if no such job was pending.
+bool run_pending_job(job_counter &counter);
+
+/// Split the [0;count[ range in chunks of at most chunk_size elements and process them in parallel.
+void parallel_for(size_t count, size_t chunk_size, const std::function<void(size_t begin, size_t end)> &fn);
+
+} // namespace hg
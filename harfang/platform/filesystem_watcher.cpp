@@ -43,8 +43,8 @@ private:
 	std::mutex mutex;
 	std::vector<WatchEvent> events;
 
+	std::atomic<bool> running{false}; // must be initialized before the thread starts
 	std::thread thread;
-	std::atomic<bool> running{false};
 
 	void Thread(const std::string &path, bool recursive);
 	void Update(const std::string &root, const std::string &path, bool recursive);
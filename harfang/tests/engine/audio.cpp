@@ -3,6 +3,7 @@
 #define TEST_NO_MAIN
 #include "acutest.h"
 
+#include "foundation/time.h"
 #include "foundation/timer.h"
 
 #include "engine/audio.h"
@@ -21,6 +22,12 @@ struct Audio {
 		TEST_CHECK(initialized == true);
 	}
 
+	Audio(const AudioConfig &config) {
+		start_timer();
+		initialized = AudioInit(config);
+		TEST_CHECK(initialized == true);
+	}
+
 	~Audio() {
 		initialized = false;
 		AudioShutdown();
@@ -168,6 +175,105 @@ static void test_PlayOGG() {
 	UnloadSound(snd);
 }
 
+static void test_VoiceStealing() {
+	AudioConfig config;
+	config.max_source = 4;
+	config.max_streamed_source = 2;
+	config.device = "No Output"; // OpenAL Soft null backend
+
+	Audio audio(config);
+
+	const auto snd = LoadWAVSoundFile("./data/audio/sine_48S16Stereo.wav");
+	TEST_CHECK(snd != InvalidSoundRef);
+
+	SourceRef srcs[4];
+	for (int i = 0; i < 4; ++i) {
+		srcs[i] = PlayStereo(snd, {0.f, SR_Loop, 0.f, 0});
+		TEST_CHECK(srcs[i] != InvalidSourceRef);
+	}
+
+	// all sources are in use, a lower priority sound is not played
+	TEST_CHECK(PlayStereo(snd, {0.f, SR_Loop, 0.f, -1}) == InvalidSourceRef);
+
+	// an equal priority sound steals the oldest source
+	TEST_CHECK(PlayStereo(snd, {0.f, SR_Loop, 0.f, 0}) == srcs[0]);
+
+	// higher priority sounds steal the oldest source with the lowest priority
+	const auto high = PlayStereo(snd, {0.f, SR_Loop, 0.f, 10});
+	TEST_CHECK(high == srcs[1]);
+	TEST_CHECK(PlayStereo(snd, {0.f, SR_Loop, 0.f, 5}) == srcs[2]);
+	TEST_CHECK(PlayStereo(snd, {0.f, SR_Loop, 0.f, 5}) == srcs[3]);
+	TEST_CHECK(PlayStereo(snd, {0.f, SR_Loop, 0.f, 5}) == srcs[0]);
+
+	TEST_CHECK(GetSourceState(high) == SS_Playing);
+	TEST_CHECK(GetAudioStats().stolen_source_count == 5);
+
+	StopAllSources();
+
+	// streamed sources past the limit steal the oldest streamed source
+	const auto stream_0 = StreamWAVFileStereo("./data/audio/sine_48S16Stereo.wav", {0.f, SR_Loop, 0.f, 0});
+	const auto stream_1 = StreamWAVFileStereo("./data/audio/sine_48S16Stereo.wav", {0.f, SR_Loop, 0.f, 0});
+	TEST_CHECK(stream_0 != InvalidSourceRef && stream_1 != InvalidSourceRef);
+
+	const auto stream_2 = StreamOGGFileStereo("./data/audio/Dance_of_the_Sugar_Plum_Fairies_(ISRC_USUAN1100270).ogg", {0.f, SR_Loop, 0.f, 0});
+	TEST_CHECK(stream_2 == stream_0);
+
+	const auto stats = GetAudioStats();
+	TEST_CHECK(stats.streamed_source_count == 2);
+	TEST_CHECK(stats.source_count == 4);
+
+	// a missing file does not hold on to a source
+	TEST_CHECK(StreamWAVFileStereo("./data/audio/missing.wav", {}) == InvalidSourceRef);
+	TEST_CHECK(GetAudioStats().streamed_source_count == 2);
+
+	StopAllSources();
+	TEST_CHECK(GetAudioStats().streamed_source_count == 0);
+
+	UnloadSound(snd);
+}
+
+static void test_ConcurrentStreams() {
+	AudioConfig config;
+	config.device = "No Output";
+
+	Audio audio(config);
+
+	const int stream_count = 32;
+
+	SourceRef srcs[stream_count];
+	for (int i = 0; i < stream_count; ++i) {
+		srcs[i] = i % 2 ? StreamWAVFileStereo("./data/audio/sine_48S16Stereo.wav", {0.f, SR_Loop})
+						: StreamOGGFileStereo("./data/audio/Dance_of_the_Sugar_Plum_Fairies_(ISRC_USUAN1100270).ogg", {0.f, SR_Loop});
+		TEST_CHECK(srcs[i] != InvalidSourceRef);
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	time_ns timecodes[stream_count];
+	for (int i = 0; i < stream_count; ++i)
+		timecodes[i] = GetSourceTimecode(srcs[i]);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+	// every stream keeps advancing, the 2 seconds WAV file has not looped yet
+	for (int i = 0; i < stream_count; ++i)
+		TEST_CHECK_(GetSourceTimecode(srcs[i]) > timecodes[i], "Stream %d", i);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+	// looping streams keep playing past their end, none of them ran out of decoded buffers
+	for (int i = 0; i < stream_count; ++i)
+		TEST_CHECK(GetSourceState(srcs[i]) == SS_Playing);
+
+	const auto stats = GetAudioStats();
+	TEST_CHECK(stats.underrun_count == 0);
+	TEST_CHECK(stats.streamed_source_count == stream_count);
+	TEST_CHECK(stats.free_pcm_block_count > 0);
+
+	StopAllSources();
+	TEST_CHECK(GetAudioStats().streamed_source_count == 0);
+}
+
 void test_audio() { 
 	test_InitShutdown();
 	test_PlayWAV();
@@ -175,4 +281,6 @@ void test_audio() {
 	test_Timestamps();
 	test_StreamOGG();
 	test_PlayOGG();
+	test_VoiceStealing();
+	test_ConcurrentStreams();
 }
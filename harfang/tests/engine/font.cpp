@@ -0,0 +1,274 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include "engine/font.h"
+#include "engine/render_pipeline.h"
+
+#include "foundation/format.h"
+#include "foundation/log.h"
+#include "foundation/math.h"
+#include "foundation/matrix4.h"
+#include "foundation/time.h"
+
+#include "platform/window_system.h"
+
+#include <bgfx/bgfx.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace hg;
+
+static void DrawTestText(const Font &font, const char *text) {
+	DrawText(0, font, text, BGFX_INVALID_HANDLE, "u_tex", 0, Mat4::Identity);
+}
+
+static void test_LazyGlyphAtlas() {
+	// single small page to exercise eviction
+	const auto font = LoadFontFromFile("./data/ttf/Cabin-Regular.ttf", 24.f, 128, 1, nullptr, 1);
+	TEST_CHECK(font.cache != nullptr);
+
+	auto stats = GetFontAtlasStats(font);
+	TEST_CHECK(stats.page_count == 0);
+	TEST_CHECK(stats.glyph_count == 0);
+
+	// measuring text does not rasterize glyphs
+	const auto rect = ComputeTextRect(font, "Hello");
+	TEST_CHECK(GetWidth(rect) > 0.f);
+	TEST_CHECK(GetFontAtlasStats(font).glyph_count == 0);
+
+	DrawTestText(font, "Hello");
+	stats = GetFontAtlasStats(font);
+	TEST_CHECK(stats.page_count == 1);
+	TEST_CHECK(stats.glyph_count == 4);
+	TEST_CHECK(stats.rasterized_count == 4);
+	TEST_CHECK(stats.occupancy > 0.f && stats.occupancy < 1.f);
+
+	// drawing the same glyphs again hits the cache
+	DrawTestText(font, "Hello Hello");
+	TEST_CHECK(GetFontAtlasStats(font).rasterized_count == 4);
+
+	// fill the atlas during a single frame, glyphs in use can not be evicted
+	const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+	DrawTestText(font, alphabet);
+	stats = GetFontAtlasStats(font);
+	TEST_CHECK(stats.glyph_count == stats.cell_count);
+	TEST_CHECK(stats.evicted_count == 0);
+	TEST_CHECK(stats.dropped_count > 0); // more glyphs than cells
+	TEST_CHECK(stats.occupancy == 1.f);
+
+	const auto dropped_count = stats.dropped_count;
+
+	// glyphs from the previous frames are evicted least recently used first
+	UpdateFontAtlas(font);
+	DrawTestText(font, "!?&");
+	stats = GetFontAtlasStats(font);
+	TEST_CHECK(stats.evicted_count == 3);
+	TEST_CHECK(stats.dropped_count == dropped_count);
+	TEST_CHECK(stats.glyph_count == stats.cell_count);
+	TEST_CHECK(stats.page_count == 1);
+
+	// the first glyphs drawn were evicted, the last one of the first text is still in the atlas
+	const auto rasterized_count = stats.rasterized_count;
+	DrawTestText(font, "o");
+	TEST_CHECK(GetFontAtlasStats(font).rasterized_count == rasterized_count);
+	DrawTestText(font, "H");
+	TEST_CHECK(GetFontAtlasStats(font).rasterized_count == rasterized_count + 1);
+	TEST_CHECK(GetFontAtlasStats(font).evicted_count == 4);
+
+	// invalid font
+	const auto missing = LoadFontFromFile("./data/ttf/missing.ttf");
+	TEST_CHECK(missing.cache == nullptr);
+	TEST_CHECK(GetFontAtlasStats(missing).glyph_count == 0);
+	TEST_CHECK(GetWidth(ComputeTextRect(missing, "Hello")) == 0.f);
+	DrawTestText(missing, "Hello");
+}
+
+static void test_GlyphPreloadAndKerning() {
+	const auto font = LoadFontFromFile("./data/ttf/Cabin-Regular.ttf", 24.f, 256, 1, "abcabc");
+	TEST_CHECK(GetFontAtlasStats(font).glyph_count == 3);
+
+	Font::Glyph glyph;
+	TEST_CHECK(GetFontGlyph(font, 'a', glyph));
+	TEST_CHECK(GetFontPages(font).size() == 1);
+	TEST_CHECK(glyph.page == 0 && glyph.pc.advance > 0.f);
+	TEST_CHECK(GetFontAtlasStats(font).glyph_count == 3);
+
+	// kerning is looked up on demand and cached
+	const auto kerning = GetKerning(font, 'A', 'V');
+	TEST_CHECK(kerning < 0.f);
+	TEST_CHECK(GetKerning(font, 'A', 'V') == kerning);
+	TEST_CHECK(GetKerning(font, 'V', 'A') < 0.f);
+	TEST_CHECK(GetKerning(font, 'o', 'o') == 0.f);
+}
+
+static void test_TextBatch() {
+	const auto font = LoadFontFromFile("./data/ttf/Cabin-Regular.ttf", 24.f, 256);
+
+	TextBatch batch;
+
+	size_t glyph_count = 0;
+	for (int i = 0; i < 200; ++i) {
+		const auto label = format("Unit %1").arg(i).str();
+		AddTextToBatch(batch, font, label.c_str(), TranslationMat4({float(i), 0.f, 0.f}), {}, Color::Red);
+		glyph_count += label.size() - 1; // space has no quad
+	}
+
+	// all labels end up in the vertices of a single atlas page
+	TEST_CHECK(batch.pages.size() == 1);
+	TEST_CHECK(batch.pages[0].size() == glyph_count * 4);
+	TEST_CHECK(batch.pages[0][0].color == ColorToABGR32(Color::Red));
+
+	// each label transformation is applied to its vertices
+	TEST_CHECK(AlmostEqual(batch.pages[0][20].pos[0] - batch.pages[0][0].pos[0], 1.f, 0.0001f));
+
+	DrawTextBatch(0, batch, BGFX_INVALID_HANDLE, "u_tex", 0);
+
+	// a batch only holds text using a single font
+	const auto other_font = LoadFontFromFile("./data/ttf/Cabin-Regular.ttf", 12.f, 256);
+	AddTextToBatch(batch, other_font, "Other", Mat4::Identity);
+	TEST_CHECK(batch.pages[0].size() == glyph_count * 4);
+
+	ClearTextBatch(batch);
+	TEST_CHECK(batch.pages[0].empty());
+
+	AddTextToBatch(batch, other_font, "Other", Mat4::Identity);
+	TEST_CHECK(batch.pages[0].size() == 5 * 4);
+}
+
+static void test_RetainedText() {
+	const auto font = LoadFontFromFile("./data/ttf/Cabin-Regular.ttf", 24.f, 256);
+
+	RetainedText text;
+	SetRetainedText(text, font, "Score: 100");
+	DrawRetainedText(0, text, BGFX_INVALID_HANDLE, "u_tex", 0, Mat4::Identity);
+	TEST_CHECK(text.revision == 1);
+	TEST_CHECK(text.pages.size() == 1);
+	TEST_CHECK(text.pages[0].idx_count == 9 * 6);
+
+	// unchanged content reuses the vertex buffers
+	SetRetainedText(text, font, "Score: 100");
+	TEST_CHECK(text.dirty == false);
+	DrawRetainedText(0, text, BGFX_INVALID_HANDLE, "u_tex", 0, TranslationMat4({10.f, 0.f, 0.f}));
+	TEST_CHECK(text.revision == 1);
+
+	SetRetainedText(text, font, "Score: 200");
+	DrawRetainedText(0, text, BGFX_INVALID_HANDLE, "u_tex", 0, Mat4::Identity);
+	TEST_CHECK(text.revision == 2);
+
+	SetRetainedText(text, font, "Score: 200", {}, Color::Green);
+	DrawRetainedText(0, text, BGFX_INVALID_HANDLE, "u_tex", 0, Mat4::Identity);
+	TEST_CHECK(text.revision == 3);
+
+	DestroyRetainedText(text);
+	TEST_CHECK(text.pages.empty());
+
+	// a retained text owns its buffers, they follow it when moved and are destroyed with it
+	{
+		RetainedText label;
+		SetRetainedText(label, font, "Moved");
+		DrawRetainedText(0, label, BGFX_INVALID_HANDLE, "u_tex", 0, Mat4::Identity);
+
+		RetainedText moved(std::move(label));
+		TEST_CHECK(label.pages.empty());
+		TEST_CHECK(moved.pages.size() == 1);
+
+		DrawRetainedText(0, moved, BGFX_INVALID_HANDLE, "u_tex", 0, Mat4::Identity);
+		TEST_CHECK(moved.revision == 1);
+	}
+
+	// evicting one of its glyphs from the atlas rebuilds the text
+	const auto small_font = LoadFontFromFile("./data/ttf/Cabin-Regular.ttf", 24.f, 128, 1, nullptr, 1);
+
+	RetainedText symbols;
+	SetRetainedText(symbols, small_font, "#%@");
+	DrawRetainedText(0, symbols, BGFX_INVALID_HANDLE, "u_tex", 0, Mat4::Identity);
+	TEST_CHECK(symbols.revision == 1);
+
+	UpdateFontAtlas(small_font);
+	DrawRetainedText(0, symbols, BGFX_INVALID_HANDLE, "u_tex", 0, Mat4::Identity);
+	TEST_CHECK(symbols.revision == 1);
+
+	UpdateFontAtlas(small_font);
+	DrawTestText(small_font, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789");
+	TEST_CHECK(GetFontAtlasStats(small_font).evicted_count > 0);
+
+	UpdateFontAtlas(small_font);
+	DrawRetainedText(0, symbols, BGFX_INVALID_HANDLE, "u_tex", 0, Mat4::Identity);
+	TEST_CHECK(symbols.revision == 2);
+
+	// glyphs that could not be drawn because the atlas was full are drawn once it has room for them
+	UpdateFontAtlas(small_font);
+	DrawTestText(small_font, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789");
+
+	RetainedText dropped;
+	SetRetainedText(dropped, small_font, "+-=");
+	DrawRetainedText(0, dropped, BGFX_INVALID_HANDLE, "u_tex", 0, Mat4::Identity);
+	TEST_CHECK(dropped.revision == 1);
+	TEST_CHECK(dropped.glyphs.size() == 3);
+	TEST_CHECK(dropped.pages.empty() || dropped.pages[0].idx_count < 3 * 6);
+
+	UpdateFontAtlas(small_font);
+	DrawRetainedText(0, dropped, BGFX_INVALID_HANDLE, "u_tex", 0, Mat4::Identity);
+	TEST_CHECK(dropped.revision == 2);
+	TEST_CHECK(dropped.pages.size() == 1);
+	TEST_CHECK(dropped.pages[0].idx_count == 3 * 6);
+
+	UpdateFontAtlas(small_font);
+	DrawRetainedText(0, dropped, BGFX_INVALID_HANDLE, "u_tex", 0, Mat4::Identity);
+	TEST_CHECK(dropped.revision == 2);
+
+	DestroyRetainedText(dropped);
+	DestroyRetainedText(symbols);
+}
+
+#if HG_BUILD_TESTS_BENCHMARKS
+static void test_FontLoadPerformance() {
+	auto t_0 = time_now();
+	const auto font = LoadFontFromFile("./data/ttf/Cabin-Regular.ttf", 32.f);
+	const auto t_load = time_now() - t_0;
+
+	std::string text;
+	for (int i = 0; i < 64; ++i)
+		text += "The quick brown fox jumps over the lazy dog. THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG!\n";
+
+	t_0 = time_now();
+	DrawTestText(font, text.c_str());
+	const auto t_first_draw = time_now() - t_0;
+
+	t_0 = time_now();
+	DrawTestText(font, text.c_str());
+	const auto t_draw = time_now() - t_0;
+
+	const auto stats = GetFontAtlasStats(font);
+
+	log(format("Font load %1 ms, first draw %2 ms (%3 glyphs rasterized), cached draw %4 ms, atlas occupancy %5%")
+			.arg(time_to_ms_f(t_load), 3)
+			.arg(time_to_ms_f(t_first_draw), 3)
+			.arg(stats.rasterized_count)
+			.arg(time_to_ms_f(t_draw), 3)
+			.arg(stats.occupancy * 100.f, 1)
+			.c_str());
+}
+#endif // HG_BUILD_TESTS_BENCHMARKS
+
+void test_font() {
+	auto win = RenderInit(64, 64, bgfx::RendererType::Noop);
+	TEST_CHECK(win != nullptr);
+
+	test_LazyGlyphAtlas();
+	test_GlyphPreloadAndKerning();
+	test_TextBatch();
+	test_RetainedText();
+#if HG_BUILD_TESTS_BENCHMARKS
+	test_FontLoadPerformance();
+#endif
+
+	bgfx::frame();
+
+	RenderShutdown();
+	DestroyWindow(win);
+}
@@ -0,0 +1,178 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include "engine/geometry.h"
+
+#include "foundation/format.h"
+#include "foundation/log.h"
+#include "foundation/math.h"
+#include "foundation/time.h"
+#include "foundation/worker_pool.h"
+
+using namespace hg;
+
+// flat grid of size x size quads in the XZ plane, UV follow the X and Z axes
+static Geometry MakeGridGeometry(int size) {
+	Geometry geo;
+
+	for (int j = 0; j <= size; ++j)
+		for (int i = 0; i <= size; ++i)
+			geo.vtx.push_back({float(i), 0.f, float(j)});
+
+	for (int j = 0; j < size; ++j)
+		for (int i = 0; i < size; ++i) {
+			const uint32_t v = j * (size + 1) + i;
+			const uint32_t quad[4] = {v, v + size + 1, v + size + 2, v + 1};
+
+			geo.pol.push_back({4, uint8_t(i < size / 2 ? 0 : 1)});
+
+			for (auto q : quad) {
+				geo.binding.push_back(q);
+				geo.uv[0].push_back({geo.vtx[q].x, geo.vtx[q].z});
+				geo.color.push_back(Color::White);
+			}
+		}
+
+	return geo;
+}
+
+static void test_VertexAdjacency() {
+	const auto geo = MakeGridGeometry(8);
+
+	const auto vtx_to_pol = ComputeVertexPolygonAdjacency(geo);
+	const auto legacy_vtx_to_pol = ComputeVertexToPolygon(geo);
+
+	TEST_CHECK(vtx_to_pol.offset.size() == geo.vtx.size() + 1);
+	TEST_CHECK(vtx_to_pol.offset.back() == geo.binding.size());
+
+	for (size_t v = 0; v < geo.vtx.size(); ++v) {
+		const auto &legacy = legacy_vtx_to_pol[v];
+		TEST_CHECK(vtx_to_pol.offset[v + 1] - vtx_to_pol.offset[v] == legacy.pol_count);
+
+		for (uint16_t k = 0; k < legacy.pol_count; ++k) {
+			const uint32_t pol_index = vtx_to_pol.pol_index[vtx_to_pol.offset[v] + k], vtx_index = vtx_to_pol.vtx_index[vtx_to_pol.offset[v] + k];
+			TEST_CHECK(pol_index == legacy.pol_index[k] && vtx_index == legacy.vtx_index[k]);
+			TEST_CHECK(geo.binding[pol_index * 4 + vtx_index] == v);
+		}
+	}
+
+	TEST_CHECK(vtx_to_pol.offset[1] - vtx_to_pol.offset[0] == 1); // corner
+	TEST_CHECK(vtx_to_pol.offset[11] - vtx_to_pol.offset[10] == 4); // interior
+
+	// each polygon a vertex belongs to contributes its previous and next vertex
+	const auto vtx_to_vtx = ComputeVertexVertexAdjacency(geo, vtx_to_pol);
+	TEST_CHECK(vtx_to_vtx.offset[11] - vtx_to_vtx.offset[10] == 8);
+
+	const auto legacy_vtx_to_vtx = ComputeVertexToVertex(geo, legacy_vtx_to_pol);
+	TEST_CHECK(legacy_vtx_to_vtx[10].vtx_count == 8);
+
+	for (auto k = vtx_to_vtx.offset[10]; k < vtx_to_vtx.offset[11]; ++k) {
+		const auto &vv = vtx_to_vtx.vtx[k];
+		const auto &neighbour = geo.vtx[geo.binding[vv.pol_index * 4 + vv.vtx_index]];
+		TEST_CHECK(Dist(neighbour, geo.vtx[10]) == 1.f);
+	}
+}
+
+static void test_VertexNormalTangent() {
+	auto geo = MakeGridGeometry(16);
+
+	const auto vtx_to_pol = ComputeVertexPolygonAdjacency(geo);
+	const auto normal = ComputeVertexNormal(geo, vtx_to_pol);
+	TEST_CHECK(normal == ComputeVertexNormal(geo, ComputeVertexToPolygon(geo)));
+
+	for (const auto &n : normal)
+		TEST_CHECK(AlmostEqual(Abs(n.y), 1.f, 0.0001f));
+
+	const auto tangent = ComputeVertexTangent(geo, normal, vtx_to_pol);
+	TEST_CHECK(tangent.size() == geo.binding.size());
+
+	for (const auto &t : tangent) {
+		TEST_CHECK(AlmostEqual(t.T.x, 1.f, 0.0001f));
+		TEST_CHECK(AlmostEqual(Abs(t.B.z), 1.f, 0.0001f));
+	}
+
+	// missing UV set
+	TEST_CHECK(ComputeVertexTangent(geo, normal, vtx_to_pol, 1)[0].T == Vec3::Zero);
+
+	// smoothing a constant color leaves it unchanged
+	SmoothVertexColor(geo, ComputePolygonIndex(geo), ComputeVertexVertexAdjacency(geo, vtx_to_pol));
+	for (const auto &c : geo.color)
+		TEST_CHECK(AlmostEqual(c.r, 1.f, 0.0001f) && AlmostEqual(c.a, 1.f, 0.0001f));
+}
+
+static void test_ParallelVertexNormalTangent() {
+	const auto geo = MakeGridGeometry(128); // split across several jobs
+
+	const auto serial_vtx_to_pol = ComputeVertexPolygonAdjacency(geo);
+	const auto serial_normal = ComputeVertexNormal(geo, serial_vtx_to_pol);
+	const auto serial_tangent = ComputeVertexTangent(geo, serial_normal, serial_vtx_to_pol);
+
+	start_workers();
+
+	const auto vtx_to_pol = ComputeVertexPolygonAdjacency(geo);
+	const auto normal = ComputeVertexNormal(geo, vtx_to_pol);
+	const auto tangent = ComputeVertexTangent(geo, normal, vtx_to_pol);
+
+	stop_workers();
+
+	TEST_CHECK(vtx_to_pol.offset == serial_vtx_to_pol.offset && vtx_to_pol.pol_index == serial_vtx_to_pol.pol_index);
+	TEST_CHECK(normal == serial_normal);
+	TEST_CHECK(normal == ComputeVertexNormal(geo, ComputeVertexToPolygon(geo)));
+	TEST_CHECK(tangent.size() == serial_tangent.size());
+
+	bool same_tangent = true;
+	for (size_t i = 0; i < tangent.size(); ++i)
+		same_tangent &= tangent[i].T == serial_tangent[i].T && tangent[i].B == serial_tangent[i].B;
+	TEST_CHECK(same_tangent);
+}
+
+#if HG_BUILD_TESTS_BENCHMARKS
+static void test_AdjacencyPerformance() {
+	const auto geo = MakeGridGeometry(1024);
+
+	auto t_0 = time_now();
+	const auto legacy_vtx_to_pol = ComputeVertexToPolygon(geo);
+	const auto legacy_normal = ComputeVertexNormal(geo, legacy_vtx_to_pol);
+	const auto t_legacy = time_now() - t_0;
+
+	start_workers();
+
+	t_0 = time_now();
+	const auto vtx_to_pol = ComputeVertexPolygonAdjacency(geo);
+	const auto t_adjacency = time_now() - t_0;
+
+	t_0 = time_now();
+	const auto normal = ComputeVertexNormal(geo, vtx_to_pol);
+	const auto t_normal = time_now() - t_0;
+
+	t_0 = time_now();
+	const auto tangent = ComputeVertexTangent(geo, normal, vtx_to_pol);
+	const auto t_tangent = time_now() - t_0;
+
+	const auto worker_count = get_worker_count();
+	stop_workers();
+
+	TEST_CHECK(normal == legacy_normal);
+	TEST_CHECK(tangent.size() == geo.binding.size());
+
+	log(format("Geometry %1 vertices, %2 workers: per vertex lists + normals %3 ms, CSR adjacency %4 ms, normals %5 ms, tangents %6 ms")
+			.arg(geo.vtx.size())
+			.arg(worker_count)
+			.arg(time_to_ms_f(t_legacy), 3)
+			.arg(time_to_ms_f(t_adjacency), 3)
+			.arg(time_to_ms_f(t_normal), 3)
+			.arg(time_to_ms_f(t_tangent), 3)
+			.c_str());
+}
+#endif // HG_BUILD_TESTS_BENCHMARKS
+
+void test_geometry() {
+	test_VertexAdjacency();
+	test_VertexNormalTangent();
+	test_ParallelVertexNormalTangent();
+#if HG_BUILD_TESTS_BENCHMARKS
+	test_AdjacencyPerformance();
+#endif
+}
@@ -1,75 +1,176 @@
-// HARFANG(R) Copyright (C) 2021 Emmanuel Julien, NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#define TEST_NO_MAIN
+#include "acutest.h"
 
-#include "engine/assets.h"
 #include "engine/iso_surface.h"
 #include "engine/model_builder.h"
-#include "engine/render_pipeline.h"
-#include "foundation/clock.h"
+
+#include "foundation/format.h"
+#include "foundation/log.h"
 #include "foundation/math.h"
-#include "foundation/projection.h"
+#include "foundation/time.h"
 #include "foundation/unit.h"
-#include "platform/window_system.h"
-#include "shared.h"
-#include "gtest/gtest.h"
+#include "foundation/worker_pool.h"
+
+#include <set>
 
 using namespace hg;
 
-TEST(IsoSurface, RenderModelNoPipeline) {
-	auto window = NewWindow(1280, 720);
-	EXPECT_TRUE(RenderInit(window));
+static void AddSpheres(IsoSurface &surface, int cell_count, int sphere_count, float t) {
+	for (int i = 0; i < sphere_count; ++i) {
+		const float k = float(i) * Deg(12.f) + t;
+
+		const float x = (Sin(k * 0.4f) * Cos(k * -1.5f) * 0.75f + 1.f) * cell_count / 2.f;
+		const float y = (Cos(k * -1.2f) * Cos(k * 2.f) * 0.75f + 1.f) * cell_count / 2.f;
+		const float z = (Sin(k * 1.7f) * Cos(k * -0.8f) * 0.75f + 1.f) * cell_count / 2.f;
+
+		IsoSurfaceSphere(surface, cell_count, cell_count, cell_count, x, y, z, (Sin(k * 3.f + float(i) * Deg(8.f)) * 0.5f + 1.f) * cell_count / 8.f);
+	}
+}
 
-	//
-	const auto prg = LoadProgramFromFile(GetResPath("gpu/shader/default_mdl.vsb").c_str(), GetResPath("gpu/shader/default_mdl.fsb").c_str());
+static size_t GetIndexCount(const IsoSurfaceChunks &chunks) {
+	size_t count = 0;
+	for (const auto &chunk : chunks.chunks)
+		count += chunk.idx.size();
+	return count;
+}
 
-	//
-	bgfx::VertexLayout vtx_layout;
+static bool IsSameGeometry(const IsoSurfaceChunk &a, const IsoSurfaceChunk &b) { return a.vtx == b.vtx && a.nrm == b.nrm && a.idx == b.idx; }
 
-	vtx_layout.begin();
-	vtx_layout.add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float);
-	vtx_layout.add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Float);
-	vtx_layout.end();
+static void test_ChunkedPolygonization() {
+	const int cell_count = 48;
 
-	//
-	static const int cell_count = 64;
 	auto surface = NewIsoSurface(cell_count, cell_count, cell_count);
+	AddSpheres(surface, cell_count, 8, 0.f);
+
+	auto single = NewIsoSurfaceChunks(cell_count, cell_count, cell_count, cell_count);
+	auto chunked = NewIsoSurfaceChunks(cell_count, cell_count, cell_count, 10); // partial chunks on the borders
+
+	TEST_CHECK(single.chunks.size() == 1);
+	TEST_CHECK(chunked.chunks.size() == 5 * 5 * 5);
+
+	TEST_CHECK(UpdateIsoSurfaceChunks(single, surface) == 1);
+	TEST_CHECK(UpdateIsoSurfaceChunks(chunked, surface) == chunked.chunks.size());
+	TEST_CHECK(GetDirtyIsoSurfaceChunkCount(chunked) == 0);
+
+	// splitting the volume does not change the triangles produced
+	const auto &mesh = single.chunks[0];
+	TEST_CHECK(!mesh.idx.empty());
+	TEST_CHECK(GetIndexCount(chunked) == mesh.idx.size());
+
+	// vertices are shared between cells
+	TEST_CHECK(mesh.vtx.size() == mesh.nrm.size());
+	TEST_CHECK(mesh.vtx.size() * 4 < mesh.idx.size());
+
+	for (const auto &chunk : chunked.chunks)
+		for (auto i : chunk.idx)
+			TEST_CHECK_(i < chunk.vtx.size(), "Chunk index %d out of range", int(i));
+
+	// vertices on the faces between chunks are identified so that they are added to a model once
+	size_t vtx_count = 0;
+	std::set<uint64_t> border_edges;
+	for (const auto &chunk : chunked.chunks) {
+		vtx_count += chunk.vtx.size();
+		for (const auto &v : chunk.border)
+			if (!border_edges.insert(v.edge).second)
+				--vtx_count;
+	}
+	TEST_CHECK(!border_edges.empty());
+	TEST_CHECK(vtx_count == mesh.vtx.size());
 
-	//
-	reset_clock();
+	// nothing left to update
+	TEST_CHECK(UpdateIsoSurfaceChunks(chunked, surface) == 0);
 
-	for (float a = 0.f; a < 4.f; a += time_to_sec_f(tick_clock())) {
-		//
-		const auto cam = TransformationMat4({cell_count / 2.f, cell_count / 2.f, -cell_count / 2.f}, {0.f, 0.f, 0.f});
-		hg::SetViewPerspective(0, 0, 0, 1280, 720, cam, 0.01f, 5000.f, 1.8f, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, hg::ColorFromABGR32(0x303030ff));
+	ModelBuilder builder;
+	TEST_CHECK(IsoSurfaceChunksToModel(builder, chunked));
+	TEST_CHECK(IsoSurfaceToModel(builder, surface, cell_count, cell_count, cell_count));
+	TEST_CHECK(IsoSurfaceToModel(builder, {}, cell_count, cell_count, cell_count) == false);
+}
 
-		//
-		std::fill(std::begin(surface), std::end(surface), 0.f);
+static void test_DirtyChunkRemesh() {
+	const int cell_count = 64;
 
-		for (int i = 0; i < 16; ++i) {
-			float k = float(i) * Deg(12.f) + a;
+	auto surface = NewIsoSurface(cell_count, cell_count, cell_count);
+	AddSpheres(surface, cell_count, 4, 0.f);
+
+	auto chunks = NewIsoSurfaceChunks(cell_count, cell_count, cell_count, 16);
+	UpdateIsoSurfaceChunks(chunks, surface);
+
+	// small edit in a corner of the volume
+	IsoSurfaceSphere(surface, cell_count, cell_count, cell_count, 12.f, 20.f, 50.f, 6.f);
+	MarkIsoSurfaceSphereDirty(chunks, 12.f, 20.f, 50.f, 6.f);
+
+	const auto dirty_count = GetDirtyIsoSurfaceChunkCount(chunks);
+	TEST_CHECK(dirty_count > 0);
+	TEST_CHECK(dirty_count <= 8);
+	TEST_CHECK(UpdateIsoSurfaceChunks(chunks, surface) == dirty_count);
+
+	// remeshing the dirty chunks only must match remeshing all chunks
+	auto reference = NewIsoSurfaceChunks(cell_count, cell_count, cell_count, 16);
+	UpdateIsoSurfaceChunks(reference, surface);
+
+	for (size_t i = 0; i < chunks.chunks.size(); ++i)
+		TEST_CHECK_(IsSameGeometry(chunks.chunks[i], reference.chunks[i]), "Chunk %d geometry", int(i));
+
+	// explicit range
+	MarkIsoSurfaceChunksDirty(chunks, 40, 40, 40, 41, 41, 41);
+	TEST_CHECK(GetDirtyIsoSurfaceChunkCount(chunks) == 1);
+	MarkIsoSurfaceChunksDirty(chunks, 100, 100, 100, 120, 120, 120);
+	TEST_CHECK(GetDirtyIsoSurfaceChunkCount(chunks) == 1);
+	MarkIsoSurfaceChunksDirty(chunks);
+	TEST_CHECK(GetDirtyIsoSurfaceChunkCount(chunks) == chunks.chunks.size());
+}
 
-			float x = (Sin(k * 0.4f) * Cos(k * -1.5f) * 0.75f + 1.f) * cell_count / 2.f;
-			float y = (Cos(k * -1.2f) * Cos(k * 2.f) * 0.75f + 1.f) * cell_count / 2.f;
-			float z = (Sin(k * 1.7f) * Cos(k * -0.8f) * 0.75f + 1.f) * cell_count / 2.f;
+#if HG_BUILD_TESTS_BENCHMARKS
+static void test_ChunkedPolygonizationPerformance() {
+	const int cell_count = 256;
 
-			IsoSurfaceSphere(surface, cell_count, cell_count, cell_count, x, y, z, (Sin(k * 3.f + float(i) * Deg(8.f)) * 0.5f + 1.f) * 8.f);
-		}
+	auto surface = NewIsoSurface(cell_count, cell_count, cell_count);
+	AddSpheres(surface, cell_count, 16, 0.f);
 
-		surface = GaussianBlurIsoSurface(surface, cell_count, cell_count, cell_count);
+	start_workers();
 
-		//
-		ModelBuilder builder;
+	auto chunks = NewIsoSurfaceChunks(cell_count, cell_count, cell_count);
 
-		if (IsoSurfaceToModel(builder, surface, cell_count, cell_count, cell_count)) {
-			auto mdl = builder.MakeModel(vtx_layout);
-			DrawModel(0, mdl, prg, {}, {}, &Mat4::Identity);
-			Destroy(mdl);
-		}
+	auto t_0 = time_now();
+	TEST_CHECK(UpdateIsoSurfaceChunks(chunks, surface) == chunks.chunks.size());
+	const auto t_full = time_now() - t_0;
 
-		//
-		bgfx::frame();
-		UpdateWindow(window);
-	}
+	IsoSurfaceSphere(surface, cell_count, cell_count, cell_count, 128.f, 128.f, 128.f, 12.f);
+	MarkIsoSurfaceSphereDirty(chunks, 128.f, 128.f, 128.f, 12.f);
+
+	t_0 = time_now();
+	const auto remeshed = UpdateIsoSurfaceChunks(chunks, surface);
+	const auto t_remesh = time_now() - t_0;
 
-	RenderShutdown();
-	DestroyWindow(window);
+	t_0 = time_now();
+	ModelBuilder builder;
+	TEST_CHECK(IsoSurfaceChunksToModel(builder, chunks));
+	const auto t_build = time_now() - t_0;
+
+	const auto worker_count = get_worker_count();
+	stop_workers();
+
+	TEST_CHECK(remeshed > 0 && remeshed < chunks.chunks.size());
+
+	log(format("IsoSurface %1^3 cells, %2 workers: %3 triangles in %4 ms, %5/%6 dirty chunks remeshed in %7 ms, model builder %8 ms")
+			.arg(cell_count)
+			.arg(worker_count)
+			.arg(GetIndexCount(chunks) / 3)
+			.arg(time_to_ms_f(t_full), 3)
+			.arg(remeshed)
+			.arg(chunks.chunks.size())
+			.arg(time_to_ms_f(t_remesh), 3)
+			.arg(time_to_ms_f(t_build), 3)
+			.c_str());
+}
+#endif // HG_BUILD_TESTS_BENCHMARKS
+
+void test_iso_surface() {
+	test_ChunkedPolygonization();
+	test_DirtyChunkRemesh();
+#if HG_BUILD_TESTS_BENCHMARKS
+	test_ChunkedPolygonizationPerformance();
+#endif
 }
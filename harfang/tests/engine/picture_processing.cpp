@@ -0,0 +1,241 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include "engine/picture_processing.h"
+
+#include "foundation/data.h"
+#include "foundation/file.h"
+#include "foundation/format.h"
+#include "foundation/log.h"
+#include "foundation/math.h"
+#include "foundation/path_tools.h"
+#include "foundation/time.h"
+#include "foundation/worker_pool.h"
+
+#include "../utils.h"
+
+#include <bimg/bimg.h>
+#include <bimg/decode.h>
+#include <bx/allocator.h>
+
+#include <cstring>
+#include <vector>
+
+using namespace hg;
+
+static Picture MakeGradientPicture(uint16_t width, uint16_t height, PictureFormat format) {
+	Picture pic(width, height, format);
+	for (uint16_t y = 0; y < height; ++y)
+		for (uint16_t x = 0; x < width; ++x)
+			SetPixelRGBA(pic, x, y, {float(x) / float(width), float(y) / float(height), float((x + y) % 256) / 255.f, 1.f});
+	return pic;
+}
+
+static bool IsSamePicture(const Picture &a, const Picture &b) {
+	return a.GetWidth() == b.GetWidth() && a.GetHeight() == b.GetHeight() && a.GetFormat() == b.GetFormat() &&
+		   memcmp(a.GetData(), b.GetData(), size_t(a.GetWidth()) * a.GetHeight() * size_of(a.GetFormat())) == 0;
+}
+
+static void test_ConvertPicture() {
+	const auto rgb = MakeGradientPicture(67, 33, PF_RGB24);
+
+	const auto rgba = ConvertPicture(rgb, PF_RGBA32);
+	TEST_CHECK(rgba.GetFormat() == PF_RGBA32);
+	TEST_CHECK(GetPixelRGBA(rgba, 12, 7).a == 1.f);
+
+	const auto rgbaf = ConvertPicture(rgba, PF_RGBA32F);
+	TEST_CHECK(GetPixelRGBA(rgbaf, 12, 7) == GetPixelRGBA(rgba, 12, 7));
+
+	// 8 bit to float to 8 bit is lossless
+	TEST_CHECK(IsSamePicture(ConvertPicture(rgbaf, PF_RGB24), rgb));
+	TEST_CHECK(IsSamePicture(ConvertPicture(rgbaf, PF_RGBA32), rgba));
+	TEST_CHECK(IsSamePicture(ConvertPicture(rgba, PF_RGB24), rgb));
+	TEST_CHECK(IsSamePicture(ConvertPicture(ConvertPicture(rgb, PF_RGBA32F), PF_RGB24), rgb));
+
+	TEST_CHECK(ConvertPicture(Picture(), PF_RGBA32).GetData() == nullptr);
+}
+
+static void test_ResizePicture() {
+	// a constant picture stays constant whatever the filter, including out of [0;1] values in float pictures
+	const PictureFilter filters[] = {PFT_Box, PFT_Triangle, PFT_CubicBSpline, PFT_CatmullRom, PFT_Mitchell};
+
+	for (auto filter : filters)
+		for (auto format : {PF_RGB24, PF_RGBA32, PF_RGBA32F}) {
+			const Color color = format == PF_RGBA32F ? Color(4.f, 0.5f, 0.25f, 1.f) : Color(0.2f, 0.6f, 1.f, 0.4f);
+
+			Picture pic(37, 21, format);
+			for (uint16_t y = 0; y < pic.GetHeight(); ++y)
+				for (uint16_t x = 0; x < pic.GetWidth(); ++x)
+					SetPixelRGBA(pic, x, y, color);
+
+			const auto expected = GetPixelRGBA(pic, 0, 0);
+
+			for (auto size : {uint16_t(8), uint16_t(37), uint16_t(80)}) {
+				const auto out = ResizePicture(pic, size, size / 2, filter);
+				TEST_CHECK(out.GetWidth() == size && out.GetHeight() == size / 2 && out.GetFormat() == format);
+
+				const auto c = GetPixelRGBA(out, size / 3, size / 5);
+				TEST_CHECK_(AlmostEqual(c.r, expected.r, 0.005f) && AlmostEqual(c.g, expected.g, 0.005f) && AlmostEqual(c.b, expected.b, 0.005f) &&
+								AlmostEqual(c.a, expected.a, 0.005f),
+					"Filter %d format %d size %d", int(filter), int(format), int(size));
+			}
+		}
+
+	// black and white checker, halving it averages pixel pairs
+	Picture checker(64, 64, PF_RGBA32);
+	for (uint16_t y = 0; y < 64; ++y)
+		for (uint16_t x = 0; x < 64; ++x)
+			SetPixelRGBA(checker, x, y, (x + y) % 2 ? Color::White : Color::Black);
+
+	const auto half = ResizePicture(checker, 32, 32, PFT_Box);
+	TEST_CHECK(GetPixelRGBA(half, 10, 10).r == 128.f / 255.f);
+
+	// averaging in linear space is brighter once converted back to sRGB
+	const auto half_srgb = ResizePicture(checker, 32, 32, PFT_Box, true);
+	TEST_CHECK(GetPixelRGBA(half_srgb, 10, 10).r == 188.f / 255.f);
+	TEST_CHECK(GetPixelRGBA(half_srgb, 10, 10).a == 1.f);
+
+	// identical output when processed on the worker pool
+	const auto gradient = MakeGradientPicture(301, 207, PF_RGBA32);
+	const auto single_threaded = ResizePicture(gradient, 123, 456);
+
+	start_workers();
+	const auto multi_threaded = ResizePicture(gradient, 123, 456);
+	stop_workers();
+
+	TEST_CHECK(IsSamePicture(single_threaded, multi_threaded));
+
+	TEST_CHECK(ResizePicture(gradient, 0, 10).GetData() == nullptr);
+	TEST_CHECK(Resize(gradient, 10, 10).GetWidth() == 10);
+}
+
+static void test_GenerateMipChain() {
+	TEST_CHECK(GetMipCount(1, 1) == 1);
+	TEST_CHECK(GetMipCount(256, 128) == 9);
+	TEST_CHECK(GetMipCount(300, 7) == 9);
+
+	const auto pic = MakeGradientPicture(256, 128, PF_RGBA32);
+	const auto mips = GenerateMipChain(pic, PFT_Box, true);
+
+	TEST_CHECK(mips.size() == 9);
+	TEST_CHECK(IsSamePicture(mips[0], pic));
+	TEST_CHECK(mips[1].GetWidth() == 128 && mips[1].GetHeight() == 64);
+	TEST_CHECK(mips[7].GetWidth() == 2 && mips[7].GetHeight() == 1);
+	TEST_CHECK(mips[8].GetWidth() == 1 && mips[8].GetHeight() == 1);
+
+	// alpha is filtered as is
+	TEST_CHECK(GetPixelRGBA(mips[8], 0, 0).a == 1.f);
+}
+
+static void test_SaveBlockCompressed() {
+	const std::string tmp = test::GetTempDirectoryName();
+
+	// several strips of 16 block rows, the last one partial and not a multiple of the block size
+	const auto pic = MakeGradientPicture(130, 150, PF_RGBA32);
+	const auto path = PathJoin(tmp, "bc7.dds");
+
+	start_workers();
+	TEST_CHECK(SaveBC7(pic, path.c_str(), true));
+	stop_workers();
+
+	Data data;
+	TEST_CHECK(FileToData(path.c_str(), data));
+
+	bx::DefaultAllocator allocator;
+	auto image = bimg::imageParse(&allocator, data.GetData(), uint32_t(data.GetSize()), bimg::TextureFormat::Count);
+	TEST_CHECK(image != nullptr);
+
+	if (image) {
+		TEST_CHECK(image->m_format == bimg::TextureFormat::BC7);
+		TEST_CHECK(image->m_width == 130 && image->m_height == 150);
+		TEST_CHECK(image->m_numMips == 1);
+
+		// a single mip holding every block row
+		bimg::ImageMip mip;
+		TEST_CHECK(bimg::imageGetRawData(*image, 0, 0, image->m_data, image->m_size, mip));
+		TEST_CHECK(mip.m_width == 130 && mip.m_height == 150);
+		TEST_CHECK(mip.m_size == ((130 + 3) / 4) * ((150 + 3) / 4) * 16);
+
+		// each strip was copied at its block row offset
+		std::vector<uint8_t> rgba(size_t(130) * 150 * 4);
+		bimg::imageDecodeToRgba8(&allocator, rgba.data(), mip.m_data, 130, 150, 130 * 4, bimg::TextureFormat::BC7);
+
+		for (uint16_t y : {uint16_t(2), uint16_t(70), uint16_t(133), uint16_t(149)})
+			for (uint16_t x : {uint16_t(1), uint16_t(64), uint16_t(129)}) {
+				const auto expected = GetPixelRGBA(pic, x, y);
+				const auto *p = &rgba[(size_t(y) * 130 + x) * 4];
+				TEST_CHECK_(AlmostEqual(p[0] / 255.f, expected.r, 0.05f) && AlmostEqual(p[1] / 255.f, expected.g, 0.05f) &&
+								AlmostEqual(p[2] / 255.f, expected.b, 0.05f),
+					"Pixel %d %d", int(x), int(y));
+			}
+
+		bimg::imageFree(image);
+	}
+
+	Unlink(path.c_str());
+}
+
+#if HG_BUILD_TESTS_BENCHMARKS
+static void test_PictureProcessingPerformance() {
+	const auto pic = MakeGradientPicture(4096, 4096, PF_RGBA32);
+	const float mpix = 4096.f * 4096.f / 1000000.f;
+
+	auto t_0 = time_now();
+	auto half = ResizePicture(pic, 2048, 2048);
+	const auto t_resize_single = time_now() - t_0;
+
+	start_workers();
+
+	t_0 = time_now();
+	half = ResizePicture(pic, 2048, 2048);
+	const auto t_resize = time_now() - t_0;
+
+	t_0 = time_now();
+	const auto half_f = ConvertPicture(half, PF_RGBA32F);
+	const auto t_convert = time_now() - t_0;
+
+	t_0 = time_now();
+	const auto quarter_f = ResizePicture(half_f, 1024, 1024);
+	const auto t_resize_float = time_now() - t_0;
+
+	t_0 = time_now();
+	const auto rgb = ConvertPicture(pic, PF_RGB24);
+	const auto t_convert_rgb = time_now() - t_0;
+
+	t_0 = time_now();
+	const auto mips = GenerateMipChain(pic, PFT_Box, true);
+	const auto t_mips = time_now() - t_0;
+
+	const auto worker_count = get_worker_count();
+	stop_workers();
+
+	TEST_CHECK(mips.size() == 13);
+	TEST_CHECK(quarter_f.GetFormat() == PF_RGBA32F);
+	TEST_CHECK(rgb.GetFormat() == PF_RGB24);
+
+	const auto MPixPerSec = [](float mpix, time_ns t) { return mpix / Max(time_to_sec_f(t), 0.000001f); };
+
+	log(format("Picture processing, %1 workers: RGBA32 4096^2 to 2048^2 resize %2 MPix/s (%3 MPix/s single threaded), RGBA32 to RGBA32F %4 MPix/s, "
+			   "RGBA32F 2048^2 to 1024^2 resize %5 MPix/s, RGBA32 to RGB24 %6 MPix/s, sRGB mip chain %7 ms")
+			.arg(worker_count)
+			.arg(MPixPerSec(mpix, t_resize), 4)
+			.arg(MPixPerSec(mpix, t_resize_single), 4)
+			.arg(MPixPerSec(mpix / 4.f, t_convert), 4)
+			.arg(MPixPerSec(mpix / 4.f, t_resize_float), 4)
+			.arg(MPixPerSec(mpix, t_convert_rgb), 4)
+			.arg(time_to_ms_f(t_mips), 4)
+			.c_str());
+}
+#endif // HG_BUILD_TESTS_BENCHMARKS
+
+void test_picture_processing() {
+	test_ConvertPicture();
+	test_ResizePicture();
+	test_GenerateMipChain();
+	test_SaveBlockCompressed();
+#if HG_BUILD_TESTS_BENCHMARKS
+	test_PictureProcessingPerformance();
+#endif
+}
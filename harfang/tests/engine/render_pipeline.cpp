@@ -0,0 +1,990 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include "engine/create_geometry.h"
+#include "engine/forward_pipeline.h"
+#include "engine/occlusion_culling.h"
+#include "engine/render_pipeline.h"
+
+#include "foundation/file.h"
+#include "foundation/format.h"
+#include "foundation/log.h"
+#include "foundation/matrix4.h"
+#include "foundation/path_tools.h"
+#include "foundation/projection.h"
+#include "foundation/rand.h"
+#include "foundation/time.h"
+#include "foundation/worker_pool.h"
+#include "../utils.h"
+
+#include "platform/window_system.h"
+
+#include <bgfx/bgfx.h>
+#include <bimg/bimg.h>
+#include <bx/bx.h>
+#include <bx/file.h>
+
+#include <algorithm>
+
+using namespace hg;
+
+// shader binary header with no uniform, enough for the Noop renderer to create a valid program
+static bgfx::ShaderHandle CreateNoopShader(bool vertex) {
+	const uint32_t header[] = {vertex ? BX_MAKEFOURCC('V', 'S', 'H', 11) : BX_MAKEFOURCC('F', 'S', 'H', 11), 0, 0, 0, 0};
+	return bgfx::createShader(bgfx::copy(header, sizeof(header)));
+}
+
+static PipelineProgramRef AddNoopPipelineProgram(PipelineResources &res) {
+	PipelineProgram prg;
+	prg.name = "noop";
+	prg.pipeline = {"noop", {{}}}; // single configuration
+	prg.programs = {{bgfx::createProgram(CreateNoopShader(true), CreateNoopShader(false), true), true}};
+	prg.revision = 1;
+	return res.programs.Add("noop", std::move(prg));
+}
+
+// program declaring the OptionalInstancing feature, variant 0 draws one display list, variant 1 is the instanced variant
+static PipelineProgramRef AddNoopInstancedPipelineProgram(PipelineResources &res) {
+	PipelineProgram prg;
+	prg.name = "noop_instanced";
+	prg.features = {OptionalInstancing};
+	prg.pipeline = {"noop", {{}}};
+	prg.programs = {{bgfx::createProgram(CreateNoopShader(true), CreateNoopShader(false), true), true},
+		{bgfx::createProgram(CreateNoopShader(true), CreateNoopShader(false), true), true}};
+	prg.instancing_variant_offset = 1;
+	prg.revision = 1;
+	return res.programs.Add("noop_instanced", std::move(prg));
+}
+
+// program drawing the forward pipeline depth only configuration
+static PipelineProgramRef AddNoopDepthOnlyPipelineProgram(PipelineResources &res) {
+	PipelineProgram prg;
+	prg.name = "noop_depth_only";
+	prg.pipeline = GetForwardPipelineInfo();
+	prg.programs.resize(prg.pipeline.configs.size());
+	prg.programs[9] = {bgfx::createProgram(CreateNoopShader(true), CreateNoopShader(false), true), true}; // FPS_DepthOnly
+	prg.revision = 1;
+	return res.programs.Add("noop_depth_only", std::move(prg));
+}
+
+static DisplayListSubmitStats SubmitModelDisplayLists(
+	const std::vector<ModelDisplayList> &display_lists, const std::vector<uint32_t> &depths, const std::vector<Mat4> &mtxs, const PipelineResources &res) {
+	ResetDisplayListSubmitStats();
+	DrawModelDisplayLists(0, display_lists, 0, {}, {}, mtxs, res);
+	DrawModelDisplayLists(0, display_lists, depths, 0, {}, {}, mtxs, res);
+	DrawModelDisplayLists(0, display_lists, 0, {}, {}, mtxs, mtxs, res);
+	bgfx::frame();
+	return GetDisplayListSubmitStats();
+}
+
+static void test_MultiThreadedSubmit() {
+	auto win = RenderInit(64, 64, bgfx::RendererType::Noop);
+	TEST_CHECK(win != nullptr);
+
+	{
+		PipelineResources res;
+
+		const auto prg_ref = AddNoopPipelineProgram(res);
+		const auto mdl_ref = res.models.Add("cube", CreateCubeModel(VertexLayoutPosFloatNormUInt8(), 1.f, 1.f, 1.f));
+
+		Material mat;
+		mat.program = prg_ref;
+
+		const size_t count = 4096;
+
+		std::vector<Mat4> mtxs(count);
+		std::vector<ModelDisplayList> display_lists(count);
+		std::vector<uint32_t> depths(count);
+
+		for (size_t i = 0; i < count; ++i) {
+			mtxs[i] = TranslationMat4({float(i % 64), 0.f, float(i / 64)});
+			display_lists[i] = {&mat, uint32_t(i), uint16_t(mdl_ref.ref.idx), 0};
+			depths[i] = uint32_t(count - i);
+		}
+
+		// serial submission is the reference
+		std::vector<DisplayListSubmitRecord> serial_record, parallel_record;
+
+		SetDisplayListSubmitJobCount(1);
+		SetDisplayListSubmitRecord(&serial_record);
+		const auto serial = SubmitModelDisplayLists(display_lists, depths, mtxs, res);
+
+		TEST_CHECK(serial.draw_count == count * 3);
+		TEST_CHECK(serial.job_count == 0);
+		TEST_CHECK(serial_record.size() == count * 3);
+
+		// submission split across 4 jobs, each with its own encoder
+		TEST_ASSERT(bgfx::getCaps()->limits.maxEncoders > 4);
+
+		start_workers(3);
+
+		SetDisplayListSubmitJobCount(4);
+		SetDisplayListSubmitRecord(&parallel_record);
+		const auto parallel = SubmitModelDisplayLists(display_lists, depths, mtxs, res);
+		SetDisplayListSubmitRecord(nullptr);
+
+		TEST_CHECK(parallel.job_count == 4 * 3);
+		TEST_CHECK(parallel.fallback_job_count == 0);
+		TEST_CHECK(parallel.draw_count == serial.draw_count);
+
+		// same draws in the same order, only the last draw of a job ends its run early
+		TEST_ASSERT(parallel_record.size() == serial_record.size());
+
+		size_t split_run_count = 0;
+		for (size_t i = 0; i < serial_record.size(); ++i) {
+			const auto &s = serial_record[i], &p = parallel_record[i];
+			TEST_CHECK(p.mat == s.mat && p.mtx_idx == s.mtx_idx && p.depth == s.depth && p.mdl_idx == s.mdl_idx && p.lst_idx == s.lst_idx);
+			if (p.keep_state != s.keep_state) {
+				TEST_CHECK(s.keep_state && !p.keep_state);
+				++split_run_count;
+			}
+		}
+		TEST_CHECK(split_run_count == 2 * 3); // 3 job boundaries in each of the 2 submissions using runs
+
+#if HG_BUILD_TESTS_BENCHMARKS
+		// submission time versus job count
+		for (int job_count : {1, 2, 4, 8}) {
+			SetDisplayListSubmitJobCount(job_count);
+
+			const int frame_count = 8;
+			time_ns t_submit = 0;
+
+			for (int frame = 0; frame < frame_count; ++frame) {
+				const auto t_0 = time_now();
+				DrawModelDisplayLists(0, display_lists, depths, 0, {}, {}, mtxs, res);
+				t_submit += time_now() - t_0;
+				bgfx::frame();
+			}
+
+			log(format("DrawModelDisplayLists %1 display lists, %2 job(s): %3 ms per frame")
+					.arg(count)
+					.arg(job_count)
+					.arg(time_to_ms_f(t_submit / frame_count), 3)
+					.c_str());
+		}
+#endif // HG_BUILD_TESTS_BENCHMARKS
+
+		SetDisplayListSubmitJobCount(1);
+		stop_workers();
+	}
+
+	RenderShutdown();
+	DestroyWindow(win);
+}
+
+static void test_InstancedSubmit() {
+	auto win = RenderInit(64, 64, bgfx::RendererType::Noop);
+	TEST_CHECK(win != nullptr);
+	TEST_ASSERT(bgfx::getCaps()->supported & BGFX_CAPS_INSTANCING);
+
+	{
+		PipelineResources res;
+
+		const auto prg_ref = AddNoopPipelineProgram(res);
+		const auto instanced_prg_ref = AddNoopInstancedPipelineProgram(res);
+		const auto cube_ref = res.models.Add("cube", CreateCubeModel(VertexLayoutPosFloatNormUInt8(), 1.f, 1.f, 1.f));
+		const auto sphere_ref = res.models.Add("sphere", CreateSphereModel(VertexLayoutPosFloatNormUInt8(), 1.f, 8, 8));
+
+		Material mat, red_mat, green_mat;
+		mat.program = prg_ref;
+		red_mat.program = green_mat.program = instanced_prg_ref;
+		SetMaterialValue(red_mat, "uColor", Vec4(1.f, 0.f, 0.f, 1.f));
+		SetMaterialValue(green_mat, "uColor", Vec4(0.f, 1.f, 0.f, 1.f));
+
+		const size_t count = 64;
+
+		std::vector<Mat4> mtxs(count);
+		for (size_t i = 0; i < count; ++i)
+			mtxs[i] = TranslationMat4({float(i), 0.f, 0.f});
+
+		// 3 instanced groups: red cubes, green cubes and red spheres, a single green sphere and 16 display lists without an instanced variant
+		std::vector<ModelDisplayList> display_lists;
+		for (uint32_t i = 0; i < 16; ++i) {
+			display_lists.push_back({&red_mat, i, uint16_t(cube_ref.ref.idx), 0});
+			display_lists.push_back({&green_mat, 16 + i, uint16_t(cube_ref.ref.idx), 0});
+			display_lists.push_back({&mat, 32 + i, uint16_t(cube_ref.ref.idx), 0});
+		}
+		for (uint32_t i = 0; i < 15; ++i)
+			display_lists.push_back({&red_mat, 48 + i, uint16_t(sphere_ref.ref.idx), 0});
+		display_lists.push_back({&green_mat, 63, uint16_t(sphere_ref.ref.idx), 0});
+
+		ResetDisplayListSubmitStats();
+		ResetDisplayListInstancingStats();
+		DrawModelDisplayLists(0, display_lists, 0, {}, {}, mtxs, res);
+		bgfx::frame();
+
+		const auto instancing = GetDisplayListInstancingStats();
+		TEST_CHECK(instancing.instanced_draw_count == 3);
+		TEST_CHECK(instancing.instance_count == 16 + 16 + 15);
+		TEST_CHECK(instancing.saved_draw_count == 15 + 15 + 14);
+		TEST_CHECK(GetDisplayListSubmitStats().draw_count == 3 + 1 + 16);
+
+		// an explicit draw order or previous matrices disable instancing
+		std::vector<uint32_t> depths(display_lists.size());
+		for (size_t i = 0; i < depths.size(); ++i)
+			depths[i] = uint32_t(i);
+
+		ResetDisplayListSubmitStats();
+		ResetDisplayListInstancingStats();
+		DrawModelDisplayLists(0, display_lists, depths, 0, {}, {}, mtxs, res);
+		DrawModelDisplayLists(0, display_lists, 0, {}, {}, mtxs, mtxs, res);
+		bgfx::frame();
+
+		TEST_CHECK(GetDisplayListInstancingStats().instanced_draw_count == 0);
+		TEST_CHECK(GetDisplayListSubmitStats().draw_count == display_lists.size() * 2);
+
+		Destroy(red_mat);
+		Destroy(green_mat);
+	}
+
+	RenderShutdown();
+	DestroyWindow(win);
+}
+
+static void test_MultiFrustumCull() {
+	PipelineResources res;
+
+	Model mdl;
+	mdl.bounds = {{{-0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, 0.5f}}};
+	const auto mdl_ref = res.models.Add("box", std::move(mdl));
+
+	Material mat;
+
+	std::vector<Mat4> mtxs;
+	std::vector<ModelDisplayList> display_lists;
+
+	for (int z = -32; z < 32; ++z)
+		for (int x = -32; x < 32; ++x) {
+			display_lists.push_back({&mat, uint32_t(mtxs.size()), uint16_t(mdl_ref.ref.idx), 0});
+			mtxs.push_back(TranslationMat4({float(x) * 4.f, 0.f, float(z) * 4.f}));
+		}
+
+	const std::vector<Frustum> frustums = {
+		MakeFrustum(ComputePerspectiveProjectionMatrix(0.1f, 100.f, 1.8f, {1.f, 1.f}), TranslationMat4({0.f, 0.f, -50.f})),
+		MakeFrustum(ComputePerspectiveProjectionMatrix(0.1f, 40.f, 3.f, {1.f, 1.f}), TranslationMat4({20.f, 0.f, 0.f})),
+		MakeFrustum(ComputeOrthographicProjectionMatrix(0.f, 200.f, 30.f, {1.f, 1.f}), TranslationMat4({-30.f, 0.f, -100.f})),
+	};
+
+	std::vector<ModelDisplayList> culled[3];
+	std::vector<uint32_t> visibility;
+	CullModelDisplayLists(frustums, display_lists, mtxs, res, visibility, {&culled[0], nullptr, &culled[2]});
+
+	TEST_CHECK(visibility.size() == display_lists.size());
+	TEST_CHECK(culled[1].empty());
+
+	// single pass culling must match culling against each frustum separately
+	for (size_t j = 0; j < frustums.size(); ++j) {
+		auto expected = display_lists;
+		CullModelDisplayLists(frustums[j], expected, mtxs, res);
+
+		TEST_CHECK(!expected.empty());
+		TEST_CHECK(expected.size() < display_lists.size());
+
+		size_t visible_count = 0;
+		for (auto mask : visibility)
+			if (mask & (1 << j))
+				++visible_count;
+		TEST_CHECK(visible_count == expected.size());
+
+		if (j != 1) {
+			TEST_CHECK(culled[j].size() == expected.size());
+			for (size_t i = 0; i < expected.size() && i < culled[j].size(); ++i)
+				TEST_CHECK(culled[j][i].mtx_idx == expected[i].mtx_idx);
+		}
+	}
+}
+
+static void test_SkinnedModelBounds() {
+	const int bone_count = 4, vtx_count = 256;
+
+	// skinned vertex layout as output by the geometry exporter
+	bgfx::VertexLayout decl;
+	decl.begin();
+	decl.add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float);
+	decl.add(bgfx::Attrib::Indices, 4, bgfx::AttribType::Uint8, true, false);
+	decl.add(bgfx::Attrib::Weight, 4, bgfx::AttribType::Uint8, true, false);
+	decl.end();
+
+	std::vector<Vec3> pos(vtx_count);
+	std::vector<std::array<uint8_t, 4>> idx(vtx_count);
+	std::vector<std::array<float, 4>> weight(vtx_count);
+
+	std::vector<uint8_t> vtx_data(decl.getSize(vtx_count));
+
+	for (int v = 0; v < vtx_count; ++v) {
+		pos[v] = {FRRand(-1.f, 1.f), FRRand(0.f, 4.f), FRRand(-1.f, 1.f)};
+
+		// up to two influences along the bone chain, bone 3 influences no vertex
+		const auto b = uint8_t(Min(int(pos[v].y), 2));
+		const float w = FRand(1.f);
+		idx[v] = {b, uint8_t(Min(b + 1, 2)), 0, 0};
+		weight[v] = {w, 1.f - w, 0.f, 0.f};
+
+		const float p[4] = {pos[v].x, pos[v].y, pos[v].z, 0.f};
+		const float i[4] = {float(idx[v][0]), float(idx[v][1]), 0.f, 0.f};
+		bgfx::vertexPack(p, false, bgfx::Attrib::Position, decl, vtx_data.data(), v);
+		bgfx::vertexPack(i, false, bgfx::Attrib::Indices, decl, vtx_data.data(), v);
+		bgfx::vertexPack(weight[v].data(), true, bgfx::Attrib::Weight, decl, vtx_data.data(), v);
+
+		float w_[4];
+		bgfx::vertexUnpack(w_, bgfx::Attrib::Weight, decl, vtx_data.data(), v); // use quantized weights
+		weight[v] = {w_[0], w_[1], w_[2], w_[3]};
+	}
+
+	const auto bones_bounds = ComputeDisplayListBonesBounds(decl, vtx_data.data(), uint32_t(vtx_data.size()), bone_count);
+
+	TEST_CHECK(bones_bounds.size() == bone_count);
+	TEST_CHECK(bones_bounds[0].mn.x <= bones_bounds[0].mx.x);
+	TEST_CHECK(bones_bounds[3].mn.x > bones_bounds[3].mx.x); // no influence
+
+	// model with a single skinned list
+	PipelineResources res;
+
+	Model mdl;
+	mdl.bounds = {{{-1.f, 0.f, -1.f}, {1.f, 4.f, 1.f}}};
+	mdl.lists.resize(1);
+	mdl.lists[0].index_buffer = BGFX_INVALID_HANDLE;
+	mdl.lists[0].vertex_buffer = BGFX_INVALID_HANDLE;
+	mdl.lists[0].bones_table = {0, 1, 2, 3};
+	mdl.lists[0].bones_bounds = bones_bounds;
+	for (int j = 0; j < bone_count; ++j)
+		mdl.bind_pose.push_back(InverseFast(TranslationMat4({0.f, float(j), 0.f})));
+
+	const auto mdl_ref = res.models.Add("skinned", std::move(mdl));
+	const auto &model = res.models.Get(mdl_ref);
+
+	Material mat;
+
+	SkinnedModelDisplayList dl;
+	dl.mat = &mat;
+	dl.bone_count = bone_count;
+	dl.mdl_idx = uint16_t(mdl_ref.ref.idx);
+	dl.lst_idx = 0;
+	for (int j = 0; j < bone_count; ++j) {
+		dl.mtx_idxs[j] = j;
+		dl.bones_idxs[j] = j;
+	}
+
+	// random poses, every skinned vertex must lie within the computed bounds
+	for (int pose = 0; pose < 64; ++pose) {
+		std::vector<Mat4> mtxs;
+		for (int j = 0; j < bone_count; ++j)
+			mtxs.push_back(TransformationMat4({FRRand(-10.f, 10.f), FRRand(-10.f, 10.f), FRRand(-10.f, 10.f)},
+				{FRRand(-3.f, 3.f), FRRand(-3.f, 3.f), FRRand(-3.f, 3.f)}, Vec3::One * FRRand(0.5f, 2.f)));
+
+		MinMax bounds;
+		TEST_CHECK(ComputeSkinnedModelDisplayListBounds(dl, mtxs, res, bounds));
+
+		const float e = 0.001f;
+		bool conservative = true;
+
+		for (int v = 0; v < vtx_count; ++v) {
+			Vec3 P = Vec3::Zero;
+			for (int k = 0; k < 4; ++k)
+				if (weight[v][k] > 0.f)
+					P += (mtxs[idx[v][k]] * model.bind_pose[idx[v][k]] * pos[v]) * weight[v][k];
+
+			const float sum = weight[v][0] + weight[v][1] + weight[v][2] + weight[v][3];
+			P = P / sum; // weights are quantized
+
+			if (P.x < bounds.mn.x - e || P.y < bounds.mn.y - e || P.z < bounds.mn.z - e || P.x > bounds.mx.x + e || P.y > bounds.mx.y + e ||
+				P.z > bounds.mx.z + e)
+				conservative = false;
+		}
+
+		TEST_CHECK(conservative);
+	}
+
+	// a display list behind the view is culled, one in front of it is not
+	std::vector<Mat4> mtxs(bone_count, TranslationMat4({0.f, 0.f, 10.f}));
+	std::vector<SkinnedModelDisplayList> display_lists = {dl};
+
+	const auto frustum = MakeFrustum(ComputePerspectiveProjectionMatrix(0.1f, 100.f, 1.8f, {1.f, 1.f}), Mat4::Identity);
+	CullSkinnedModelDisplayLists(frustum, display_lists, mtxs, res);
+	TEST_CHECK(display_lists.size() == 1);
+
+	std::fill(std::begin(mtxs), std::end(mtxs), TranslationMat4({0.f, 0.f, -10.f}));
+	CullSkinnedModelDisplayLists(frustum, display_lists, mtxs, res);
+	TEST_CHECK(display_lists.empty());
+}
+
+static void test_ShadowMapCache() {
+	auto win = RenderInit(64, 64, bgfx::RendererType::Noop);
+	TEST_CHECK(win != nullptr);
+
+	{
+		ForwardPipeline pipeline; // only the shadow map views are computed, no resource is required
+		pipeline.cached_shadow_maps = true;
+		pipeline.framebuffers["linear_shadow_map"] = BGFX_INVALID_HANDLE;
+
+		const auto light_world = TransformationMat4({}, Deg3(45.f, 30.f, 0.f));
+		const auto lights = PrepareForwardPipelineLights(
+			{MakeForwardPipelineLinearLight(light_world, Color::White, Color::White, {10.f, 50.f, 100.f, 500.f}, 0.f, FPST_Map)});
+
+		const auto view_state = ComputePerspectiveViewState(TranslationMat4({0.f, 2.f, 0.f}), Deg(60.f), 0.1f, 1000.f, {1.f, 1.f});
+
+		ForwardPipelineShadowMapCache cache;
+		ForwardPipelineShadowMapViews views;
+		ForwardPipelineShadowData shadow_data;
+
+		ComputeLinearShadowMapViewsForForwardPipeline(view_state, lights, pipeline, views, shadow_data, &cache);
+
+		for (int i = FPSP_Slot0LinearSplit0; i <= FPSP_Slot0LinearSplit3; ++i) {
+			TEST_CHECK(views[i].active);
+			TEST_CHECK(!cache.entries[i].valid);
+			cache.entries[i].valid = true; // as if the cached split was rendered
+		}
+
+		// small view motion, cached splits are reused
+		const auto view_state_moved = ComputePerspectiveViewState(TranslationMat4({0.01f, 2.f, 0.f}), Deg(60.f), 0.1f, 1000.f, {1.f, 1.f});
+
+		ForwardPipelineShadowMapViews views_moved;
+		ComputeLinearShadowMapViewsForForwardPipeline(view_state_moved, lights, pipeline, views_moved, shadow_data, &cache);
+
+		for (int i = FPSP_Slot0LinearSplit0; i <= FPSP_Slot0LinearSplit3; ++i) {
+			TEST_CHECK(cache.entries[i].valid);
+			TEST_CHECK(views_moved[i].view == views[i].view);
+		}
+
+		// large view motion, the nearest split is out of the cached area
+		const auto view_state_far = ComputePerspectiveViewState(TranslationMat4({20.f, 2.f, 0.f}), Deg(60.f), 0.1f, 1000.f, {1.f, 1.f});
+		ComputeLinearShadowMapViewsForForwardPipeline(view_state_far, lights, pipeline, views_moved, shadow_data, &cache);
+		TEST_CHECK(!cache.entries[FPSP_Slot0LinearSplit0].valid);
+		TEST_CHECK(cache.entries[FPSP_Slot0LinearSplit3].valid);
+
+		// light motion invalidates all splits
+		const auto light_world_rotated = TransformationMat4({}, Deg3(50.f, 30.f, 0.f));
+		const auto lights_rotated = PrepareForwardPipelineLights(
+			{MakeForwardPipelineLinearLight(light_world_rotated, Color::White, Color::White, {10.f, 50.f, 100.f, 500.f}, 0.f, FPST_Map)});
+
+		ComputeLinearShadowMapViewsForForwardPipeline(view_state, lights_rotated, pipeline, views_moved, shadow_data, &cache);
+		for (int i = FPSP_Slot0LinearSplit0; i <= FPSP_Slot0LinearSplit3; ++i)
+			TEST_CHECK(!cache.entries[i].valid);
+
+		// static shadow casters hash
+		Material mat;
+		std::vector<ModelDisplayList> static_display_lists = {{&mat, 0, 0, 0}, {&mat, 1, 0, 0}};
+		std::vector<Mat4> mtxs = {Mat4::Identity, TranslationMat4({1.f, 0.f, 0.f})};
+
+		UpdateForwardPipelineShadowMapCache(cache, static_display_lists, mtxs);
+		const auto static_hash = cache.static_hash;
+
+		UpdateForwardPipelineShadowMapCache(cache, static_display_lists, mtxs);
+		TEST_CHECK(cache.static_hash == static_hash);
+
+		const Material mat_copy = mat; // same material at a different address
+		static_display_lists[1].mat = &mat_copy;
+		UpdateForwardPipelineShadowMapCache(cache, static_display_lists, mtxs);
+		TEST_CHECK(cache.static_hash == static_hash);
+
+		SetMaterialValue(mat, "uColor", Vec4{1.f, 0.f, 0.f, 1.f});
+		UpdateForwardPipelineShadowMapCache(cache, static_display_lists, mtxs);
+		TEST_CHECK(cache.static_hash != static_hash);
+
+		static_display_lists[0].mat = &mat_copy;
+		mtxs[1] = TranslationMat4({1.f, 0.1f, 0.f});
+		UpdateForwardPipelineShadowMapCache(cache, static_display_lists, mtxs);
+		TEST_CHECK(cache.static_hash != static_hash);
+	}
+
+	RenderShutdown();
+	DestroyWindow(win);
+}
+
+static size_t CountRecordedDraws(const std::vector<DisplayListSubmitRecord> &record, const Material &mat) {
+	return std::count_if(std::begin(record), std::end(record), [&](const DisplayListSubmitRecord &r) { return r.mat == &mat; });
+}
+
+static void test_ShadowMapCacheStaticCasters() {
+	auto win = RenderInit(64, 64, bgfx::RendererType::Noop);
+	TEST_CHECK(win != nullptr);
+
+	{
+		auto pipeline = CreateForwardPipeline(64, true, true);
+		TEST_ASSERT(pipeline.cached_shadow_maps);
+
+		PipelineResources res;
+
+		const auto prg_ref = AddNoopDepthOnlyPipelineProgram(res);
+		const auto mdl_ref = res.models.Add("cube", CreateCubeModel(VertexLayoutPosFloatNormUInt8(), 1.f, 1.f, 1.f));
+
+		Material static_mat, dynamic_mat;
+		static_mat.program = dynamic_mat.program = prg_ref;
+
+		const auto lights = PrepareForwardPipelineLights(
+			{MakeForwardPipelineLinearLight(TransformationMat4({}, Deg3(45.f, 30.f, 0.f)), Color::White, Color::White, {10.f, 50.f, 100.f, 500.f}, 0.f,
+				FPST_Map)});
+		const auto view_state = ComputePerspectiveViewState(TranslationMat4({0.f, 2.f, 0.f}), Deg(60.f), 0.1f, 1000.f, {1.f, 1.f});
+
+		// 8 static shadow casters and a dynamic one, drawn to all splits
+		std::vector<Mat4> mtxs;
+		std::vector<ModelDisplayList> static_display_lists;
+		for (uint32_t i = 0; i < 8; ++i) {
+			mtxs.push_back(TranslationMat4({float(i) - 4.f, 0.f, 5.f}));
+			static_display_lists.push_back({&static_mat, i, uint16_t(mdl_ref.ref.idx), 0});
+		}
+		mtxs.push_back(TranslationMat4({0.f, 1.f, 5.f}));
+
+		ForwardPipelineShadowPassDisplayLists static_pass_display_lists, dynamic_pass_display_lists;
+		ForwardPipelineShadowPassSkinnedDisplayLists skinned_pass_display_lists;
+		for (int i = FPSP_Slot0LinearSplit0; i <= FPSP_Slot0LinearSplit3; ++i) {
+			static_pass_display_lists[i] = static_display_lists;
+			dynamic_pass_display_lists[i] = {{&dynamic_mat, 8, uint16_t(mdl_ref.ref.idx), 0}};
+		}
+
+		ForwardPipelineShadowMapCache cache;
+		std::vector<DisplayListSubmitRecord> record;
+
+		const auto render_frame = [&]() {
+			UpdateForwardPipelineShadowMapCache(cache, static_display_lists, mtxs);
+
+			ForwardPipelineShadowMapViews shadow_views;
+			ForwardPipelineShadowData shadow_data;
+			ComputeLinearShadowMapViewsForForwardPipeline(view_state, lights, pipeline, shadow_views, shadow_data, &cache);
+
+			record.clear();
+			SetDisplayListSubmitRecord(&record);
+
+			bgfx::ViewId view_id = 0;
+			ForwardPipelineShadowPassViewId views;
+			GenerateLinearShadowMapForForwardPipeline(view_id, shadow_views, static_pass_display_lists, dynamic_pass_display_lists,
+				skinned_pass_display_lists, mtxs, pipeline, res, cache, views);
+
+			SetDisplayListSubmitRecord(nullptr);
+			bgfx::frame();
+		};
+
+		// first frame, static shadow casters are drawn to the cache
+		render_frame();
+		TEST_CHECK(cache.refresh_count == 4);
+		TEST_CHECK(CountRecordedDraws(record, static_mat) == 4 * static_display_lists.size());
+		TEST_CHECK(CountRecordedDraws(record, dynamic_mat) == 4);
+
+		// second frame, the cached depth is reused and only the dynamic shadow caster is drawn
+		render_frame();
+		TEST_CHECK(cache.refresh_count == 4);
+		TEST_CHECK(CountRecordedDraws(record, static_mat) == 0);
+		TEST_CHECK(CountRecordedDraws(record, dynamic_mat) == 4);
+
+		// moving a static shadow caster invalidates the cache
+		mtxs[3] = TranslationMat4({-1.f, 0.5f, 5.f});
+
+		render_frame();
+		TEST_CHECK(cache.refresh_count == 8);
+		TEST_CHECK(CountRecordedDraws(record, static_mat) == 4 * static_display_lists.size());
+		TEST_CHECK(CountRecordedDraws(record, dynamic_mat) == 4);
+
+		render_frame();
+		TEST_CHECK(cache.refresh_count == 8);
+		TEST_CHECK(CountRecordedDraws(record, static_mat) == 0);
+
+		// a copy of the cache does not render to the depth map of the original
+		const auto cache_copy = cache;
+
+		render_frame();
+		TEST_CHECK(cache.refresh_count == 12);
+		TEST_CHECK(cache.linear_target != cache_copy.linear_target);
+
+		DestroyForwardPipeline(pipeline);
+	}
+
+	RenderShutdown();
+	DestroyWindow(win);
+}
+
+static void test_SortedSubmit() {
+	auto win = RenderInit(64, 64, bgfx::RendererType::Noop);
+	TEST_CHECK(win != nullptr);
+
+	{
+		PipelineResources res;
+
+		const auto prg_ref = AddNoopPipelineProgram(res);
+		const auto mdl_ref = res.models.Add("cube", CreateCubeModel(VertexLayoutPosFloatNormUInt8(), 1.f, 1.f, 1.f));
+
+		std::vector<Material> mats(4);
+		for (size_t i = 0; i < mats.size(); ++i) {
+			mats[i].program = prg_ref;
+			SetMaterialValue(mats[i], "uColor", Vec4(float(i), 0.f, 0.f, 1.f));
+		}
+
+		const size_t count = 256;
+
+		std::vector<Mat4> mtxs(count);
+		std::vector<ModelDisplayList> display_lists(count);
+
+		Seed(0);
+		for (size_t i = 0; i < count; ++i) {
+			mtxs[i] = TranslationMat4({FRand(10.f), FRand(10.f), 1.f + FRand(100.f)});
+			display_lists[i] = {&mats[i % mats.size()], uint32_t(i), uint16_t(mdl_ref.ref.idx), 0};
+		}
+
+		// front-to-back depth
+		const ModelDisplayList near_dl = {&mats[0], 0, uint16_t(mdl_ref.ref.idx), 0}, far_dl = {&mats[0], 1, uint16_t(mdl_ref.ref.idx), 0};
+		const std::vector<Mat4> near_far_mtxs = {TranslationMat4({0.f, 0.f, 1.f}), TranslationMat4({0.f, 0.f, 100.f})};
+
+		SortModelDisplayLists(display_lists, Mat4::Identity, mtxs, res); // bake material bindings
+		TEST_CHECK(
+			ComputeModelDisplayListSortKey(near_dl, 0, Mat4::Identity, near_far_mtxs) < ComputeModelDisplayListSortKey(far_dl, 0, Mat4::Identity, near_far_mtxs));
+
+		// program variants past 8 bit still sort after lower variants whatever the material state
+		auto mat_variant = mats[0];
+		mat_variant.variant_idx = 300;
+		SetMaterialValue(mat_variant, "uColor", Vec4(-1.f, 0.f, 0.f, 1.f));
+
+		std::vector<ModelDisplayList> variant_display_lists = {{&mat_variant, 0, uint16_t(mdl_ref.ref.idx), 0}, {&mats[3], 1, uint16_t(mdl_ref.ref.idx), 0}};
+		SortModelDisplayLists(variant_display_lists, Mat4::Identity, mtxs, res);
+		TEST_CHECK(variant_display_lists[0].mat == &mats[3]);
+		TEST_CHECK(ComputeModelDisplayListMaterialSortIds(variant_display_lists) == std::vector<uint32_t>({0, 1}));
+
+		// copies of a material share its bindings until modified
+		auto mat_copy = mats[0];
+		TEST_CHECK(mat_copy.bindings == mats[0].bindings);
+
+		SetMaterialValue(mat_copy, "uColor", Vec4(9.f, 0.f, 0.f, 1.f));
+		std::vector<ModelDisplayList> copy_display_lists = {{&mat_copy, 0, uint16_t(mdl_ref.ref.idx), 0}, {&mats[1], 1, uint16_t(mdl_ref.ref.idx), 0}};
+		const auto mat_bindings = mats[0].bindings;
+		SortModelDisplayLists(copy_display_lists, Mat4::Identity, mtxs, res);
+		TEST_CHECK(mat_copy.bindings != mat_bindings);
+		TEST_CHECK(mats[0].bindings == mat_bindings);
+
+		// interleaved materials
+		for (size_t i = 0; i < count; ++i)
+			display_lists[i] = {&mats[i % mats.size()], uint32_t(i), uint16_t(mdl_ref.ref.idx), 0};
+
+		std::vector<DisplayListSubmitRecord> record;
+		SetDisplayListSubmitRecord(&record);
+
+		ResetDisplayListSubmitStats();
+		DrawModelDisplayLists(0, display_lists, 0, {}, {}, mtxs, res);
+		bgfx::frame();
+		const auto unsorted = GetDisplayListSubmitStats();
+
+		TEST_CHECK(unsorted.draw_count == count);
+		TEST_CHECK(unsorted.program_change_count == 1);
+		TEST_CHECK(unsorted.uniform_change_count == count);
+		TEST_CHECK(unsorted.texture_change_count == 0);
+		TEST_CHECK(unsorted.elided_state_count == 0);
+
+		TEST_ASSERT(record.size() == count);
+		for (const auto &r : record)
+			TEST_CHECK(!r.keep_state);
+
+		// sorted, one run per material
+		SortModelDisplayLists(display_lists, Mat4::Identity, mtxs, res);
+
+		const auto material_ids = ComputeModelDisplayListMaterialSortIds(display_lists);
+
+		size_t material_change_count = 0;
+		for (size_t i = 1; i < count; ++i) {
+			TEST_CHECK(ComputeModelDisplayListSortKey(display_lists[i - 1], material_ids[i - 1], Mat4::Identity, mtxs) <=
+					   ComputeModelDisplayListSortKey(display_lists[i], material_ids[i], Mat4::Identity, mtxs));
+			if (display_lists[i].mat != display_lists[i - 1].mat)
+				++material_change_count;
+		}
+		TEST_CHECK(material_change_count == mats.size() - 1);
+
+		record.clear();
+
+		ResetDisplayListSubmitStats();
+		DrawModelDisplayLists(0, display_lists, 0, {}, {}, mtxs, res);
+		bgfx::frame();
+		const auto sorted = GetDisplayListSubmitStats();
+
+		TEST_CHECK(sorted.draw_count == count);
+		TEST_CHECK(sorted.program_change_count == 1);
+		TEST_CHECK(sorted.uniform_change_count == mats.size());
+		TEST_CHECK(sorted.texture_change_count == 0);
+		TEST_CHECK(sorted.elided_state_count == count - mats.size());
+
+		// one run per material, all draws of a run share the depth of its first draw
+		TEST_ASSERT(record.size() == count);
+		for (size_t i = 0; i < count; ++i) {
+			const bool last_of_run = i + 1 == count || record[i + 1].mat != record[i].mat;
+			TEST_CHECK(record[i].keep_state == !last_of_run);
+			if (i > 0)
+				TEST_CHECK((record[i].depth == record[i - 1].depth) == (record[i].mat == record[i - 1].mat));
+		}
+
+		// previous matrices are set per draw, runs are kept
+		record.clear();
+
+		ResetDisplayListSubmitStats();
+		DrawModelDisplayLists(0, display_lists, 0, {}, {}, mtxs, mtxs, res);
+		bgfx::frame();
+		const auto sorted_previous = GetDisplayListSubmitStats();
+
+		TEST_CHECK(sorted_previous.draw_count == count);
+		TEST_CHECK(sorted_previous.uniform_change_count == mats.size());
+		TEST_CHECK(sorted_previous.elided_state_count == count - mats.size());
+		TEST_CHECK(record.size() == count);
+
+		SetDisplayListSubmitRecord(nullptr);
+
+		for (auto &mat : mats)
+			Destroy(mat);
+	}
+
+	RenderShutdown();
+	DestroyWindow(win);
+}
+
+static void test_OcclusionCulling() {
+	// a 10x10 wall at z=10 in front of the camera and a floor at y=-1 crossing the near plane
+	const std::vector<float> vtx_data = {
+		-5.f, -5.f, 0.f, 0.f, 0.f, -1.f, 5.f, -5.f, 0.f, 0.f, 0.f, -1.f, 5.f, 5.f, 0.f, 0.f, 0.f, -1.f, -5.f, 5.f, 0.f, 0.f, 0.f, -1.f};
+	const std::vector<uint16_t> idx_data = {0, 1, 2, 0, 2, 3};
+
+	Model wall;
+	AppendOccluderMesh(wall.occluder, VertexLayoutPosFloatNormFloat(), vtx_data.data(), uint32_t(vtx_data.size() * sizeof(float)), idx_data.data(),
+		uint32_t(idx_data.size() * sizeof(uint16_t)), 2);
+	wall.bounds = {{{-5.f, -5.f, 0.f}, {5.f, 5.f, 0.f}}};
+
+	TEST_CHECK(wall.occluder.vtx.size() == 4);
+	TEST_CHECK(wall.occluder.idx.size() == 6);
+
+	Model floor;
+	floor.occluder.vtx = {{-50.f, -1.f, -10.f}, {50.f, -1.f, -10.f}, {50.f, -1.f, 100.f}, {-50.f, -1.f, 100.f}};
+	floor.occluder.idx = {0, 1, 2, 0, 2, 3};
+
+	Model box;
+	box.bounds = {{{-0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, 0.5f}}};
+
+	PipelineResources res;
+	const auto wall_ref = res.models.Add("wall", std::move(wall));
+	const auto floor_ref = res.models.Add("floor", std::move(floor));
+	const auto box_ref = res.models.Add("box", std::move(box));
+
+	std::vector<Mat4> mtxs = {TranslationMat4({0.f, 0.f, 10.f}), Mat4::Identity};
+	const std::vector<ModelOccluder> occluders = {{0, uint16_t(wall_ref.ref.idx)}, {1, uint16_t(floor_ref.ref.idx)}};
+
+	Material mat;
+	std::vector<ModelDisplayList> display_lists = {{&mat, 0, uint16_t(wall_ref.ref.idx), 0}}; // occluders must not occlude themselves
+
+	const Vec3 positions[] = {
+		{0.f, 0.f, 20.f}, // behind the wall
+		{4.f, 0.f, 20.f}, // behind the wall
+		{0.f, -5.f, 20.f}, // below the floor
+		{0.f, 0.f, 5.f}, // in front of the wall
+		{9.9f, 0.f, 20.f}, // partially behind the wall
+		{20.f, 0.f, 20.f}, // beside the wall
+		{0.f, 0.f, 10.f}, // intersecting the wall
+	};
+
+	for (const auto &pos : positions) {
+		display_lists.push_back({&mat, uint32_t(mtxs.size()), uint16_t(box_ref.ref.idx), 0});
+		mtxs.push_back(TranslationMat4(pos));
+	}
+
+	auto buffer = CreateOcclusionBuffer(256, 128);
+	TEST_CHECK(IsValid(buffer));
+	TEST_CHECK(buffer.levels.back().width == 1 && buffer.levels.back().height == 1);
+
+	start_workers(4);
+
+	for (int pass = 0; pass < 2; ++pass) {
+		ClearOcclusionBuffer(buffer, Mat4::Identity, ComputePerspectiveProjectionMatrix(0.1f, 100.f, 1.8f, {2.f, 1.f}));
+		TEST_CHECK(!IsOccluded(buffer, mtxs[2] * res.models.Get(box_ref).bounds[0])); // nothing rasterized yet
+
+		RasterizeOccluders(buffer, occluders, mtxs, res);
+		TEST_CHECK(buffer.polygon_count == 2); // each quad is rasterized as a single polygon
+
+		auto culled = display_lists;
+		CullModelDisplayLists(buffer, culled, mtxs, res);
+
+		TEST_CHECK(culled.size() == 5);
+		if (culled.size() == 5) {
+			TEST_CHECK(culled[0].mtx_idx == 0); // wall
+			TEST_CHECK(culled[1].mtx_idx == 5); // in front of the wall
+			TEST_CHECK(culled[2].mtx_idx == 6); // partially behind the wall
+			TEST_CHECK(culled[3].mtx_idx == 7); // beside the wall
+			TEST_CHECK(culled[4].mtx_idx == 8); // intersecting the wall
+		}
+
+		stop_workers(); // second pass on the calling thread must give the same result
+	}
+}
+
+static void test_OcclusionCullingConservative() {
+	const auto proj = ComputePerspectiveProjectionMatrix(0.1f, 100.f, 1.8f, {2.f, 1.f});
+
+	auto buffer = CreateOcclusionBuffer(256, 128);
+	ClearOcclusionBuffer(buffer, Mat4::Identity, proj);
+
+	// world coordinates at depth z projecting to a position in the occlusion buffer
+	const auto column_to_x = [&](float px, float z) { return (px / 256.f * 2.f - 1.f) * z / proj.m[0][0]; };
+	const auto row_to_y = [&](float py, float z) { return (1.f - py / 128.f * 2.f) * z / proj.m[1][1]; };
+
+	// wall at z=10 whose right edge crosses column 185 at three quarters of a texel, the texel centers of column 185 are covered
+	const float edge_x = column_to_x(185.75f, 10.f);
+
+	OccluderMesh wall;
+	wall.vtx = {{-5.f, -5.f, 10.f}, {edge_x, -5.f, 10.f}, {edge_x, 5.f, 10.f}, {-5.f, 5.f, 10.f}};
+	wall.idx = {0, 1, 2, 0, 2, 3};
+
+	RasterizeOccluders(buffer, {&wall}, {Mat4::Identity});
+	TEST_CHECK(buffer.polygon_count == 1);
+
+	// small bounds behind the wall covering 2x2 texels of the first level
+	const auto bounds_behind_wall = [&](float px0, float px1) {
+		return MinMax{{column_to_x(px0, 20.f), row_to_y(64.8f, 20.f), 20.f}, {column_to_x(px1, 20.f), row_to_y(63.2f, 20.f), 20.01f}};
+	};
+
+	TEST_CHECK(IsOccluded(buffer, bounds_behind_wall(183.2f, 184.9f))); // entirely behind the wall
+	TEST_CHECK(!IsOccluded(buffer, bounds_behind_wall(184.2f, 185.9f))); // peeking past the wall edge by a fraction of a texel
+	TEST_CHECK(!IsOccluded(buffer, bounds_behind_wall(184.2f, 185.5f))); // in a texel partially covered by the wall
+
+	// the quad diagonal leaves no unwritten texel, the same wall split in two triangles of opposite winding does
+	const auto bounds_on_diagonal = MinMax{{-0.1f, -0.1f, 20.f}, {0.1f, 0.1f, 20.01f}};
+	TEST_CHECK(IsOccluded(buffer, bounds_on_diagonal));
+
+	OccluderMesh wall_triangles;
+	wall_triangles.vtx = {{-5.f, -5.f, 10.f}, {5.f, -5.f, 10.f}, {5.f, 5.f, 10.f}, {-5.f, 5.f, 10.f}, {5.f, 5.f, 10.f}, {-5.f, -5.f, 10.f}};
+	wall_triangles.idx = {0, 1, 2, 3, 4, 5};
+
+	ClearOcclusionBuffer(buffer, Mat4::Identity, proj);
+	RasterizeOccluders(buffer, {&wall_triangles}, {Mat4::Identity});
+	TEST_CHECK(buffer.polygon_count == 2);
+	TEST_CHECK(!IsOccluded(buffer, bounds_on_diagonal));
+}
+
+static void test_TextureLoadPriority() {
+	PipelineResources res;
+
+	Model mdl;
+	mdl.bounds.push_back(MinMaxFromPositionSize({0, 0, 0}, {1, 1, 1}));
+	const auto mdl_ref = res.models.Add("mdl", mdl);
+
+	const auto near_ref = QueueLoadTextureFromFile("near.dds", 0, res);
+	const auto far_ref = QueueLoadTextureFromFile("far.dds", 0, res);
+	const auto unused_ref = QueueLoadTextureFromFile("unused.dds", 0, res);
+
+	TEST_CHECK(res.texture_loads.size() == 3);
+
+	Material near_mat, far_mat;
+	near_mat.textures["uBaseOpacityMap"].texture = near_ref;
+	far_mat.textures["uBaseOpacityMap"].texture = far_ref;
+
+	const std::vector<Mat4> mtxs = {TranslationMat4({0.f, 0.f, 10.f}), TranslationMat4({0.f, 0.f, 100.f})};
+	const std::vector<ModelDisplayList> display_lists = {{&far_mat, 1, uint16_t(mdl_ref.ref.idx), 0}, {&near_mat, 0, uint16_t(mdl_ref.ref.idx), 0}};
+
+	SetTextureLoadPriority(res, unused_ref, 100.f);
+	UpdateTextureLoadPriorities(res, display_lists, mtxs, {0.f, 0.f, 0.f}); // resets the unused texture priority
+
+	TEST_CHECK(res.texture_loads[0].priority > res.texture_loads[1].priority); // near covers more of the view than far
+	TEST_CHECK(res.texture_loads[1].priority > 0.f);
+	TEST_CHECK(res.texture_loads[2].priority == 0.f);
+	TEST_CHECK(res.texture_loads_sorted); // queuing order already matches priorities, no sort needed
+
+	// a zero time budget processes a single load per call, by decreasing priority
+	TEST_CHECK(ProcessTextureLoadQueue(res, 0, true) == 1);
+	TEST_CHECK(res.texture_loads.size() == 2 && res.texture_loads[0].ref == far_ref);
+
+	SetTextureLoadPriority(res, unused_ref, 1.f);
+	TEST_CHECK(!res.texture_loads_sorted);
+
+	TEST_CHECK(ProcessTextureLoadQueue(res, 0, true) == 1);
+	TEST_CHECK(res.texture_loads.size() == 1 && res.texture_loads[0].ref == far_ref);
+
+	// loads of destroyed textures are dropped
+	res.textures.Destroy(far_ref);
+	TEST_CHECK(ProcessTextureLoadQueue(res, 0, true) == 0);
+	TEST_CHECK(res.texture_loads.empty());
+
+	TEST_CHECK(res.texture_load_stats.completed_count == 2);
+	TEST_CHECK(res.texture_load_stats.total_latency >= res.texture_load_stats.max_latency);
+}
+
+static void test_TextureLoadStreaming() {
+	auto win = RenderInit(64, 64, bgfx::RendererType::Noop);
+
+	// 256x256 RGBA8 texture with a full mip chain (~341KB)
+	const auto path = PathJoin(test::GetTempDirectoryName(), "streamed.dds");
+	{
+		bx::DefaultAllocator allocator;
+		auto image = bimg::imageAlloc(&allocator, bimg::TextureFormat::RGBA8, 256, 256, 1, 1, false, true);
+
+		bx::FileWriter writer;
+		bx::Error err;
+		if (bx::open(&writer, path.c_str(), false, &err)) {
+			bimg::imageWriteDds(&writer, *image, image->m_data, image->m_size, &err);
+			bx::close(&writer);
+		}
+		TEST_CHECK(err.isOk());
+
+		bimg::imageFree(image);
+	}
+
+	const size_t budget = 64 * 1024, row_size = 256 * 4;
+
+	PipelineResources res;
+	res.texture_upload_budget = budget;
+
+	const auto ref = QueueLoadTextureFromFile(path.c_str(), 0, res);
+
+	// the first call creates a low resolution texture from the smallest mips fitting the budget
+	TEST_CHECK(ProcessTextureLoadQueue(res, time_from_sec(1), true) == 1);
+	TEST_CHECK(res.texture_loads.size() == 1);
+	TEST_CHECK(bgfx::isValid(res.texture_loads[0].pending));
+	TEST_CHECK(res.texture_load_stats.uploaded_size <= budget + row_size);
+
+	const auto low_res = res.textures.Get(ref).handle;
+	TEST_CHECK(bgfx::isValid(low_res));
+	TEST_CHECK(res.texture_infos[ref.ref].width == 256 && res.texture_infos[ref.ref].height == 256);
+
+	// the full resolution texture is then uploaded over several calls, the low resolution one is in use until it completes
+	size_t call_count = 1, total_uploaded = res.texture_load_stats.uploaded_size;
+
+	while (!res.texture_loads.empty() && call_count < 64) {
+		TEST_CHECK(res.textures.Get(ref).handle.idx == low_res.idx);
+
+		bgfx::frame();
+
+		ProcessTextureLoadQueue(res, time_from_sec(1), true);
+		++call_count;
+
+		TEST_CHECK(res.texture_load_stats.uploaded_size > 0);
+		TEST_CHECK(res.texture_load_stats.uploaded_size <= budget + row_size);
+		total_uploaded += res.texture_load_stats.uploaded_size;
+	}
+
+	TEST_CHECK(res.texture_loads.empty());
+	TEST_CHECK(call_count >= 6); // 341KB (+ low res mips) at 64KB per call
+	TEST_CHECK(total_uploaded > 256 * 256 * 4);
+
+	const auto full_res = res.textures.Get(ref).handle;
+	TEST_CHECK(bgfx::isValid(full_res) && full_res.idx != low_res.idx);
+	TEST_CHECK(res.texture_load_stats.completed_count == 1);
+
+	// textures fitting the budget are created at once
+	res.texture_upload_budget = 1024 * 1024;
+	res.textures.Destroy(ref);
+
+	const auto ref_at_once = QueueLoadTextureFromFile(path.c_str(), 0, res);
+	TEST_CHECK(ProcessTextureLoadQueue(res, time_from_sec(1), true) == 1);
+	TEST_CHECK(res.texture_loads.empty());
+	TEST_CHECK(bgfx::isValid(res.textures.Get(ref_at_once).handle));
+	TEST_CHECK(res.texture_load_stats.completed_count == 2);
+
+	res.DestroyAll();
+	Unlink(path.c_str());
+
+	RenderShutdown();
+	DestroyWindow(win);
+}
+
+void test_render_pipeline() {
+	test_MultiThreadedSubmit();
+	test_SortedSubmit();
+	test_InstancedSubmit();
+	test_MultiFrustumCull();
+	test_SkinnedModelBounds();
+	test_ShadowMapCache();
+	test_ShadowMapCacheStaticCasters();
+	test_OcclusionCulling();
+	test_OcclusionCullingConservative();
+	test_TextureLoadPriority();
+	test_TextureLoadStreaming();
+}
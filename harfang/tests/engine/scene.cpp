@@ -21,6 +21,24 @@
 
 #include "foundation/data.h"
 #include "foundation/data_rw_interface.h"
+#include "foundation/dir.h"
+#include "foundation/file.h"
+#include "foundation/format.h"
+#include "foundation/log.h"
+#include "foundation/math.h"
+#include "foundation/path_tools.h"
+#include "foundation/string.h"
+#include "foundation/time.h"
+#include "foundation/worker_pool.h"
+
+#include "platform/filesystem_watcher.h"
+
+#include "../utils.h"
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <thread>
 
 using namespace hg;
 
@@ -32,6 +50,153 @@ static void test_ComponentGarbageCollection() {
 	TEST_CHECK(transform.IsValid() == false);
 }
 
+static void test_IncrementalGarbageCollection() {
+	Scene scene;
+
+	const auto shared_light = scene.CreatePointLight(10.f);
+
+	std::vector<Node> nodes;
+	for (int i = 0; i < 1024; ++i) {
+		auto node = CreateObject(scene, TranslationMat4({float(i), 0.f, 0.f}), {});
+		node.SetLight(shared_light);
+		node.SetCollision(0, scene.CreateCollision());
+		nodes.push_back(node);
+	}
+
+	TEST_CHECK(scene.GarbageCollect() == 0); // all components are attached
+	TEST_CHECK(scene.GetPendingGarbageCount() == 0);
+
+	// replacing a component queues the previous one
+	const auto transform = nodes[0].GetTransform();
+	nodes[0].SetTransform(scene.CreateTransform());
+	TEST_CHECK(scene.GarbageCollect() == 1);
+	TEST_CHECK(transform.IsValid() == false);
+	TEST_CHECK(nodes[0].GetTransform().IsValid() == true);
+
+	// destroy a few nodes among many, only their components are queued
+	std::vector<Transform> destroyed_transforms;
+	for (int i = 0; i < 1024; i += 64) {
+		destroyed_transforms.push_back(nodes[i].GetTransform());
+		scene.DestroyNode(nodes[i]);
+	}
+
+	TEST_CHECK(scene.GetPendingGarbageCount() == 16 * 3); // transform, object and collision
+	TEST_CHECK(scene.GarbageCollect(0) < 16 * 3); // budget exhausted
+	TEST_CHECK(scene.GetPendingGarbageCount() > 0);
+
+	scene.GarbageCollect();
+	TEST_CHECK(scene.GetPendingGarbageCount() == 0);
+	for (const auto &t : destroyed_transforms)
+		TEST_CHECK(t.IsValid() == false);
+	TEST_CHECK(nodes[1].GetTransform().IsValid() == true);
+	TEST_CHECK(shared_light.IsValid() == true); // still referenced by the remaining nodes
+
+	// release the last references to the shared light
+	for (int i = 0; i < 1024; ++i)
+		if (nodes[i].IsValid())
+			nodes[i].RemoveLight();
+
+	TEST_CHECK(scene.GarbageCollect() == 1);
+	TEST_CHECK(shared_light.IsValid() == false);
+
+	// a component detached then reattached before the collection is kept
+	const auto object = nodes[1].GetObject();
+	nodes[1].RemoveObject();
+	nodes[1].SetObject(object);
+	TEST_CHECK(scene.GarbageCollect() == 0);
+	TEST_CHECK(object.IsValid() == true);
+}
+
+static void test_GarbageQueueCompaction() {
+	Scene scene;
+
+	// components attached right after creation do not accumulate in the queue
+	std::vector<Node> nodes;
+	for (int i = 0; i < 4096; ++i) {
+		auto node = scene.CreateNode();
+		node.SetTransform(scene.CreateTransform());
+		nodes.push_back(node);
+	}
+
+	TEST_CHECK(scene.GetPendingGarbageCount() <= 256);
+	TEST_CHECK(scene.GarbageCollect() == 0);
+
+	// replaced components are queued once
+	for (int i = 0; i < 2; ++i)
+		nodes[0].SetTransform(scene.CreateTransform());
+
+	TEST_CHECK(scene.GarbageCollect() == 2);
+	TEST_CHECK(nodes[0].GetTransform().IsValid() == true);
+}
+
+static void test_AnimGarbageCollection() {
+	Scene scene;
+
+	const auto node = scene.CreateNode();
+	const auto used_anim = scene.AddAnim({});
+	const auto unused_anim = scene.AddAnim({});
+
+	SceneAnim scene_anim;
+	scene_anim.node_anims.push_back({node.ref, used_anim});
+	const auto scene_anim_ref = scene.AddSceneAnim(scene_anim);
+
+	TEST_CHECK(scene.GarbageCollectAnims() == 1);
+	TEST_CHECK(scene.IsValidAnim(used_anim) == true);
+	TEST_CHECK(scene.IsValidAnim(unused_anim) == false);
+
+	TEST_CHECK(scene.GarbageCollectAnims() == 0); // nothing queued
+
+	// destroying the scene animation releases its animations
+	scene.DestroySceneAnim(scene_anim_ref);
+	TEST_CHECK(scene.GarbageCollect() == 1);
+	TEST_CHECK(scene.IsValidAnim(used_anim) == false);
+}
+
+static void test_NodeSideTables() {
+	Scene scene;
+
+	std::vector<Node> nodes;
+	for (int i = 0; i < 256; ++i) {
+		auto node = scene.CreateNode();
+		for (int j = 0; j < i % 4; ++j)
+			node.SetCollision(j, scene.CreateCollision());
+		if (i % 2)
+			node.SetScript(0, scene.CreateScript("script.lua"));
+		nodes.push_back(node);
+	}
+
+	for (int i = 0; i < 256; ++i) {
+		TEST_CHECK(scene.GetNodeCollisionCount(nodes[i].ref) == size_t(i % 4));
+		TEST_CHECK(scene.GetNodeScriptCount(nodes[i].ref) == size_t(i % 2));
+	}
+
+	// grow lists out of order, remove trailing slots
+	scene.SetNodeCollision(nodes[1].ref, 5, scene.CreateCollision());
+	TEST_CHECK(scene.GetNodeCollisionCount(nodes[1].ref) == 6);
+	TEST_CHECK(scene.GetNodeCollisionRef(nodes[1].ref, 0) != InvalidComponentRef);
+	TEST_CHECK(scene.GetNodeCollisionRef(nodes[1].ref, 3) == InvalidComponentRef);
+
+	scene.RemoveNodeCollision(nodes[1].ref, size_t(5));
+	TEST_CHECK(scene.GetNodeCollisionCount(nodes[1].ref) == 1);
+
+	// destroyed nodes and recycled node slots do not see stale entries
+	for (int i = 0; i < 256; i += 2)
+		scene.DestroyNode(nodes[i]);
+	scene.GarbageCollect();
+
+	for (int i = 0; i < 128; ++i) {
+		const auto node = scene.CreateNode();
+		TEST_CHECK(scene.GetNodeCollisionCount(node.ref) == 0);
+		TEST_CHECK(scene.GetNodeScriptCount(node.ref) == 0);
+		TEST_CHECK(scene.GetNodeInstanceRef(node.ref) == InvalidComponentRef);
+	}
+
+	TEST_CHECK(scene.GetNodeCollisionCount(nodes[3].ref) == 3);
+	TEST_CHECK(scene.GetNodeScript(nodes[3].ref, 0).GetPath() == "script.lua");
+
+	DumpSceneMemoryFootprint(scene);
+}
+
 static void test_DuplicateNodes() {
 	PipelineResources resources;
 
@@ -52,6 +217,109 @@ static void test_DuplicateNodes() {
 	TEST_CHECK(cam_copy.GetCamera().GetZFar() == 1024.f);
 }
 
+static void test_CloneNodes() {
+	Model mdl;
+	mdl.bounds.push_back(MinMaxFromPositionSize({0, 0, 0}, {1, 1, 1}));
+
+	PipelineResources resources;
+	const auto mdl_ref = resources.models.Add("mdl", mdl);
+
+	Scene scene;
+
+	// skinned object parented to a root node, its bone is part of the selection while its material is shared
+	const auto root = CreatePointLight(scene, TranslationMat4({1.f, 2.f, 3.f}), 2.f);
+	auto bone = scene.CreateNode("bone");
+	bone.SetTransform(scene.CreateTransform({0.f, 1.f, 0.f}));
+	bone.GetTransform().SetParent(root.ref);
+
+	auto obj = CreateObject(scene, Mat4::Identity, mdl_ref, {{}});
+	obj.GetTransform().SetParent(root.ref);
+	obj.GetObject().SetBoneCount(1);
+	obj.GetObject().SetBone(0, bone.ref);
+	scene.SetNodeFlags(obj.ref, scene.GetNodeFlags(obj.ref) | NF_Static);
+
+	const auto outside = CreatePointLight(scene, Mat4::Identity, 1.f);
+	auto child = CreatePointLight(scene, Mat4::Identity, 1.f);
+	child.GetTransform().SetParent(outside.ref);
+	child.Disable();
+
+	const std::vector<NodeRef> selection = {root.ref, bone.ref, obj.ref, child.ref};
+	const auto node_count = scene.GetNodeCount();
+
+	const auto out = scene.CloneNodes(selection, 3, g_assets_reader, g_assets_read_provider, resources, GetForwardPipelineInfo());
+	TEST_CHECK(out.size() == 3 * 4);
+	TEST_CHECK(scene.GetNodeCount() == node_count + 3 * 4);
+
+	for (size_t copy = 0; copy < 3; ++copy) {
+		const auto root_copy = scene.GetNode(out[copy * 4 + 0]), bone_copy = scene.GetNode(out[copy * 4 + 1]);
+		const auto obj_copy = scene.GetNode(out[copy * 4 + 2]), child_copy = scene.GetNode(out[copy * 4 + 3]);
+
+		TEST_CHECK(root_copy.GetLight().GetRadius() == 2.f);
+		TEST_CHECK(GetT(root_copy.GetTransform().GetWorld()) == Vec3(1.f, 2.f, 3.f));
+
+		TEST_CHECK(bone_copy.GetName() == "bone");
+		TEST_CHECK(bone_copy.GetTransform().GetParent() == root_copy.ref);
+		TEST_CHECK(obj_copy.GetTransform().GetParent() == root_copy.ref);
+		TEST_CHECK(obj_copy.GetObject().GetBone(0) == bone_copy.ref);
+		TEST_CHECK(obj_copy.GetObject().GetModelRef() == mdl_ref);
+		TEST_CHECK(obj_copy.GetObject().ref != obj.GetObject().ref);
+		TEST_CHECK(scene.GetNodeFlags(obj_copy.ref) & NF_Static);
+
+		TEST_CHECK(child_copy.GetTransform().GetParent() == InvalidNodeRef); // parent outside of the selection
+		TEST_CHECK(child_copy.IsEnabled() == false);
+	}
+}
+
+#if HG_BUILD_TESTS_BENCHMARKS
+static void test_CloneNodesPerformance() {
+	Model mdl;
+	mdl.bounds.push_back(MinMaxFromPositionSize({0, 0, 0}, {1, 1, 1}));
+
+	PipelineResources resources;
+	const auto mdl_ref = resources.models.Add("mdl", mdl);
+
+	Scene scene;
+
+	// compare cloning with a round trip through the binary serialization
+	std::vector<NodeRef> spawn;
+	for (int i = 0; i < 256; ++i) {
+		const auto node = CreateObject(scene, TranslationMat4({float(i), 0.f, 0.f}), mdl_ref, {{}});
+		scene.SetNodeFlags(node.ref, NF_Static);
+		spawn.push_back(node.ref);
+	}
+
+	const int copy_count = 16;
+
+	auto t_0 = time_now();
+	for (int i = 0; i < copy_count; ++i) {
+		Data data;
+		scene.SaveNodes_binary(g_data_writer, DataWriteHandle(data), spawn, resources);
+		data.Rewind();
+
+		LoadSceneContext ctx;
+		scene.LoadNodes_binary(g_data_reader, DataReadHandle(data), "CloneNodes", g_assets_reader, g_assets_read_provider, resources,
+			GetForwardPipelineInfo(), ctx);
+		TEST_CHECK(ctx.view.nodes.size() == spawn.size());
+		TEST_CHECK(scene.GetNodeFlags(ctx.view.nodes[0]) == NF_Static);
+	}
+	const auto t_serialize = time_now() - t_0;
+
+	t_0 = time_now();
+	const auto clones = scene.CloneNodes(spawn, copy_count, g_assets_reader, g_assets_read_provider, resources, GetForwardPipelineInfo());
+	const auto t_clone = time_now() - t_0;
+
+	TEST_CHECK(clones.size() == spawn.size() * copy_count);
+	TEST_CHECK(scene.GetNodeCount() == spawn.size() * (1 + 2 * copy_count));
+
+	log(format("Duplicate %1 x %2 nodes: serialization %3 ms, clone %4 ms")
+			.arg(copy_count)
+			.arg(spawn.size())
+			.arg(time_to_ms_f(t_serialize), 3)
+			.arg(time_to_ms_f(t_clone), 3)
+			.c_str());
+}
+#endif // HG_BUILD_TESTS_BENCHMARKS
+
 static void test_WalkHierarchy() {
 	Scene scene;
 
@@ -153,6 +421,171 @@ static void test_DisableObjectNodes() {
 	TEST_CHECK(opaque.size() == 0);
 }
 
+static void test_AnimateMaterialValue() {
+	Scene scene;
+
+	Material mat;
+	mat.values["uColor"].value = {0.f, 0.f, 0.f, 0.f};
+	const auto node = CreateObject(scene, Mat4::Identity, {}, {mat});
+	const auto &obj_mat = node.GetObject().GetMaterial(0);
+
+	// modifying a material value in place must bump its revision so that its bindings are rebuilt
+	auto revision = obj_mat.revision;
+	SetAnimableNodePropertyVec4(scene, node.ref, "Material.0.uColor", {1.f, 2.f, 3.f, 4.f});
+	TEST_CHECK(obj_mat.revision != revision);
+	TEST_CHECK(GetAnimableNodePropertyVec4(scene, node.ref, "Material.0.uColor") == Vec4(1.f, 2.f, 3.f, 4.f));
+
+	Anim anim;
+	anim.t_end = time_from_sec(1);
+
+	AnimTrackHermiteT<Vec4> track;
+	track.target = "Material.0.uColor";
+	track.keys.push_back({0, Vec4(5.f, 5.f, 5.f, 5.f)});
+	track.keys.push_back({time_from_sec(1), Vec4(5.f, 5.f, 5.f, 5.f)});
+	anim.vec4_tracks.push_back(track);
+
+	SceneAnim scene_anim;
+	scene_anim.t_end = time_from_sec(1);
+	scene_anim.node_anims.push_back({node.ref, scene.AddAnim(anim)});
+	scene.PlayAnim(scene.AddSceneAnim(scene_anim), ALM_Loop);
+
+	revision = obj_mat.revision;
+	scene.Update(time_from_ms(100));
+	TEST_CHECK(obj_mat.revision != revision);
+	TEST_CHECK(GetAnimableNodePropertyVec4(scene, node.ref, "Material.0.uColor") == Vec4(5.f, 5.f, 5.f, 5.f));
+}
+
+static void test_SceneUpdateSystemsConcurrentStages() {
+	Scene scene;
+
+	Anim anim;
+	anim.t_end = time_from_sec(1);
+
+	AnimTrackHermiteT<Vec3> track;
+	track.target = "Position";
+	track.keys.push_back({0, Vec3(0.f, 0.f, 0.f)});
+	track.keys.push_back({time_from_sec(1), Vec3(1.f, 2.f, 3.f)});
+	anim.vec3_tracks.push_back(track);
+
+	const auto anim_ref = scene.AddAnim(anim);
+
+	// animate enough nodes for UpdatePlayingAnims to outlast the scheduling of StorePreviousWorldMatrices
+	SceneAnim scene_anim;
+	scene_anim.t_end = time_from_sec(1);
+	for (int i = 0; i < 20000; ++i)
+		scene_anim.node_anims.push_back({CreateSceneRootNode(scene).ref, anim_ref});
+	scene.PlayAnim(scene.AddSceneAnim(scene_anim), ALM_Loop);
+
+	start_workers(3);
+
+	SceneClocks clocks;
+	bool concurrent = false;
+
+	for (int frame = 0; frame < 20 && !concurrent; ++frame) {
+		job_graph_trace trace;
+		SceneUpdateSystems(scene, clocks, time_from_ms(16), &trace);
+
+		TEST_CHECK(trace.nodes.size() == 3);
+		const auto &store = trace.nodes[0], &anims = trace.nodes[1];
+		TEST_CHECK(store.name == "StorePreviousWorldMatrices" && anims.name == "UpdatePlayingAnims");
+		TEST_CHECK(store.dependencies.empty() && anims.dependencies.empty());
+
+		concurrent = store.start < anims.end && anims.start < store.end;
+	}
+
+	stop_workers();
+
+	TEST_CHECK(concurrent);
+}
+
+static void test_SpatialIndex() {
+	Model mdl;
+	mdl.bounds.push_back(MinMaxFromPositionSize({0, 0, 0}, {1, 1, 1}));
+	mdl.lists.push_back({BGFX_INVALID_HANDLE, BGFX_INVALID_HANDLE});
+	mdl.mats.push_back(0);
+
+	PipelineResources resources;
+	const auto mdl_ref = resources.models.Add("mdl", mdl);
+
+	Scene scene;
+
+	std::vector<Node> objs;
+	for (int i = 0; i < 16; ++i)
+		objs.push_back(CreateObject(scene, TranslationMat4({float(i) * 10.f, 0.f, 0.f}), mdl_ref, {{}}));
+
+	CreatePointLight(scene, TranslationMat4({0.f, 0.f, 100.f}), 5.f);
+	const auto sun = CreateLinearLight(scene, Mat4::Identity);
+
+	scene.Update(0);
+	scene.UpdateSpatialIndex(resources);
+
+	std::vector<NodeRef> refs;
+
+	scene.QueryObjectNodes(MinMax{{-1.f, -1.f, -1.f}, {21.f, 1.f, 1.f}}, refs);
+	TEST_CHECK(refs.size() == 3);
+
+	scene.QueryObjectNodes(Vec3(150.f, 0.f, 0.f), 2.f, refs);
+	TEST_CHECK(refs.size() == 1 && refs[0] == objs[15].ref);
+
+	scene.QueryLightNodes(Vec3(0.f, 0.f, 0.f), 2.f, refs);
+	TEST_CHECK(refs.size() == 1 && refs[0] == sun.ref); // linear lights affect the whole scene
+
+	scene.QueryLightNodes(Vec3(0.f, 0.f, 95.f), 2.f, refs);
+	TEST_CHECK(refs.size() == 2);
+
+	// moved, disabled and destroyed nodes are reflected in the index
+	objs[15].GetTransform().SetPos({0.f, 0.f, 0.f});
+	objs[1].Disable();
+	scene.DestroyNode(objs[2]);
+	scene.GarbageCollect();
+
+	scene.Update(0);
+	scene.UpdateSpatialIndex(resources);
+
+	scene.QueryObjectNodes(MinMax{{-1.f, -1.f, -1.f}, {21.f, 1.f, 1.f}}, refs);
+	TEST_CHECK(refs.size() == 2);
+
+	std::vector<ModelDisplayList> opaque, transparent;
+	std::vector<SkinnedModelDisplayList> opaque_skinned, transparent_skinned;
+
+	scene.GetModelDisplayLists(refs, opaque, transparent, opaque_skinned, transparent_skinned, resources);
+	TEST_CHECK(opaque.size() == 2);
+
+	scene.QueryObjectNodes(Vec3(150.f, 0.f, 0.f), 2.f, refs);
+	TEST_CHECK(refs.empty());
+
+	// static frames leave the index up to date, moving a node outdates it
+	scene.Update(0);
+	TEST_CHECK(scene.IsSpatialIndexUpToDate(resources));
+
+	objs[3].GetTransform().SetPos({0.f, 50.f, 0.f});
+	scene.Update(0);
+	TEST_CHECK(!scene.IsSpatialIndexUpToDate(resources));
+
+	scene.UpdateSpatialIndex(resources);
+	TEST_CHECK(scene.IsSpatialIndexUpToDate(resources));
+
+	scene.QueryObjectNodes(Vec3(0.f, 50.f, 0.f), 2.f, refs);
+	TEST_CHECK(refs.size() == 1 && refs[0] == objs[3].ref);
+
+	// scene bounds are read from the index
+	MinMax minmax;
+	TEST_CHECK(scene.GetMinMax(resources, minmax));
+	TEST_CHECK(minmax.mx.y > 50.f);
+	TEST_CHECK(minmax.mx.x < 141.f); // objs[15] moved to the origin
+
+	// a model reloaded in place refreshes the bounds of its objects
+	Model large_mdl = mdl;
+	large_mdl.bounds[0] = MinMaxFromPositionSize({0, 0, 0}, {10, 10, 10});
+	resources.models.Update(mdl_ref, large_mdl);
+	TEST_CHECK(!scene.IsSpatialIndexUpToDate(resources));
+
+	scene.UpdateSpatialIndex(resources);
+
+	scene.QueryObjectNodes(Vec3(144.f, 0.f, 0.f), 0.5f, refs);
+	TEST_CHECK(refs.size() == 1 && refs[0] == objs[14].ref);
+}
+
 static void test_LoadSaveEmptyScene() {
 	PipelineResources resources;
 
@@ -219,6 +652,37 @@ static void test_LoadSaveObject() {
 	}
 }
 
+static void test_LoadSaveNodeFlags() {
+	PipelineResources resources;
+
+	for (const bool binary : {false, true}) {
+		Data data;
+		{
+			Scene scene;
+			scene.CreateNode("static").SetFlags(NF_Static);
+			scene.CreateNode("occluder").SetFlags(NF_Occluder);
+			scene.CreateNode("disabled_static_occluder").SetFlags(NF_Disabled | NF_Static | NF_Occluder);
+			scene.CreateNode("none");
+			TEST_CHECK((binary ? SaveSceneBinaryToData(data, scene, resources) : SaveSceneJsonToData(data, scene, resources)) == true);
+		}
+
+		data.Rewind();
+
+		{
+			Scene scene;
+			LoadSceneContext ctx;
+			TEST_CHECK((binary ? LoadSceneBinaryFromData(data, "data", scene, g_assets_reader, g_assets_read_provider, resources, GetForwardPipelineInfo(), ctx)
+							   : LoadSceneJsonFromData(data, "data", scene, g_assets_reader, g_assets_read_provider, resources, GetForwardPipelineInfo(), ctx)) ==
+					   true);
+
+			TEST_CHECK((scene.GetNode("static").GetFlags() & NF_SerializedMask) == NF_Static);
+			TEST_CHECK((scene.GetNode("occluder").GetFlags() & NF_SerializedMask) == NF_Occluder);
+			TEST_CHECK((scene.GetNode("disabled_static_occluder").GetFlags() & NF_SerializedMask) == (NF_Disabled | NF_Static | NF_Occluder));
+			TEST_CHECK((scene.GetNode("none").GetFlags() & NF_SerializedMask) == 0);
+		}
+	}
+}
+
 static void test_LoadSaveObjectBinary() {
 	PipelineResources resources;
 
@@ -460,6 +924,188 @@ end\n\
 	TEST_CHECK(LuaObjValue(Get(vm.GetG(), "on_update"), -1) == 32);
 }
 
+static void test_LuaScriptNodeOnUpdateCallbackCacheInvalidation() {
+	Scene scene;
+	auto script = scene.CreateScript();
+	scene.CreateNode().SetScript(0, script);
+
+	SceneLuaVM vm;
+	TEST_CHECK(Execute(vm.GetL(), "G.a = 0; G.b = 0; function G.OnUpdateB(node) G.b = G.b + 1 end", "bootstrap") == true);
+	vm.OverrideScriptSource(script.ref, "\
+function OnUpdate(node)\n\
+	G.a = G.a + 1\n\
+end\n\
+");
+
+	SceneSyncToSystemsFromAssets(scene, vm);
+
+	SceneClocks clocks;
+	for (int i = 0; i < 4; ++i)
+		SceneUpdateSystems(scene, clocks, 0, vm);
+
+	TEST_CHECK(vm.SetScriptValue(script.ref, "OnUpdate", Get(vm.GetG(), "OnUpdateB"), false) == true); // the new callback is called
+
+	for (int i = 0; i < 4; ++i)
+		SceneUpdateSystems(scene, clocks, 0, vm);
+
+	TEST_CHECK(LuaObjValue(Get(vm.GetG(), "a"), -1) == 4);
+	TEST_CHECK(LuaObjValue(Get(vm.GetG(), "b"), -1) == 4);
+
+	auto node = scene.CreateNode(); // attaching the script to a second node must invalidate the cache
+	node.SetScript(0, script);
+
+	SceneUpdateSystems(scene, clocks, 0, vm);
+	TEST_CHECK(LuaObjValue(Get(vm.GetG(), "b"), -1) == 6);
+
+	// a script reassigning its own callback from Lua
+	auto self_script = scene.CreateScript();
+	scene.CreateNode().SetScript(0, self_script);
+
+	vm.OverrideScriptSource(self_script.ref, "\
+function OnUpdate(node)\n\
+	G.c = 1\n\
+	OnUpdate = function(node) G.c = G.c + 10 end\n\
+end\n\
+");
+
+	SceneSyncToSystemsFromAssets(scene, vm);
+
+	for (int i = 0; i < 3; ++i)
+		SceneUpdateSystems(scene, clocks, 0, vm);
+
+	TEST_CHECK(LuaObjValue(Get(vm.GetG(), "c"), -1) == 21);
+}
+
+#if HG_BUILD_TESTS_BENCHMARKS
+static void test_LuaScriptNodeOnUpdateDispatchCost() {
+	Scene scene;
+
+	static const int node_count = 5000, frame_count = 60;
+
+	for (int i = 0; i < node_count; ++i) {
+		auto node = scene.CreateNode();
+		node.SetTransform(scene.CreateTransform());
+		node.SetScript(0, scene.CreateScript());
+	}
+
+	SceneLuaVM vm;
+	TEST_CHECK(Execute(vm.GetL(), "G.on_update = 0;", "bootstrap") == true);
+	for (auto ref : scene.GetScriptRefs())
+		vm.OverrideScriptSource(ref, "function OnUpdate(node, dt) G.on_update = G.on_update + 1 end");
+
+	SceneSyncToSystemsFromAssets(scene, vm);
+
+	SceneClocks clocks;
+	const auto t_start = time_now();
+	for (int i = 0; i < frame_count; ++i)
+		SceneUpdateSystems(scene, clocks, time_from_ms(16), vm);
+	const auto t_frame = (time_now() - t_start) / frame_count;
+
+	TEST_CHECK(LuaObjValue(Get(vm.GetG(), "on_update"), -1) == node_count * frame_count);
+	log(format("Lua OnUpdate dispatch, %1 scripted nodes: %2 ms per frame").arg(node_count).arg(time_to_ms_f(t_frame), 3).c_str());
+}
+#endif // HG_BUILD_TESTS_BENCHMARKS
+
+static void test_LuaScriptReloadPreservesState() {
+	Scene scene;
+	auto script = scene.CreateScript();
+	scene.CreateNode().SetScript(0, script);
+	auto other_script = scene.CreateScript();
+	scene.CreateNode().SetScript(0, other_script);
+
+	SceneLuaVM vm;
+	vm.OverrideScriptSource(script.ref, "counter = 0\nfunction OnUpdate(node) counter = counter + 1 end");
+	vm.OverrideScriptSource(other_script.ref, "counter = 0\nfunction OnUpdate(node) counter = counter + 1 end");
+	SceneSyncToSystemsFromAssets(scene, vm);
+
+	SceneClocks clocks;
+	for (int i = 0; i < 3; ++i)
+		SceneUpdateSystems(scene, clocks, 0, vm);
+
+	TEST_CHECK(vm.ReloadScriptFromSource(scene, script.ref, "counter = 0\nfunction OnUpdate(node) counter = counter + 10 end") == true);
+	TEST_CHECK(vm.ReloadScriptFromSource(scene, script.ref, "function OnUpdate(node) syntax error") == false); // keeps running the previous version
+
+	SceneUpdateSystems(scene, clocks, 0, vm);
+
+	TEST_CHECK(LuaObjValue(vm.GetScriptValue(script.ref, "counter"), -1) == 13);
+	TEST_CHECK(LuaObjValue(vm.GetScriptValue(other_script.ref, "counter"), -1) == 4);
+}
+
+// wait for the watcher to complete its initial scan of a directory, a file created once it is done is reported as added
+static bool WaitForDirectoryWatch(const std::string &dir, time_ns timeout) {
+	const auto t_end = time_now() + timeout;
+
+	for (int i = 0; time_now() < t_end; ++i) {
+		const auto sentinel = format("watch_sentinel_%1").arg(i).str();
+		StringToFile(PathJoin(dir, sentinel).c_str(), "");
+
+		for (const auto t_retry = std::min(time_now() + time_from_ms(250), t_end); time_now() < t_retry;) {
+			for (const auto &e : GetDirectoryWatchEvents(dir))
+				if (e.type == WatchEvent::FileAdded && ends_with(e.path, sentinel))
+					return true;
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+	}
+	return false;
+}
+
+static void test_LuaScriptReloadModifiedFiles() {
+	const auto dir = PathJoin(test::GetTempDirectoryName(), "hg_script_reload");
+	MkTree(dir.c_str());
+
+	const auto path = PathJoin(dir, "reload.lua");
+	TEST_CHECK(StringToFile(path.c_str(), "counter = 0\nfunction OnUpdate(node) counter = counter + 1 end"));
+
+	Scene scene;
+	auto script = scene.CreateScript(dir + "/./reload.lua");
+	scene.CreateNode().SetScript(0, script);
+	auto overridden_script = scene.CreateScript(path);
+	scene.CreateNode().SetScript(0, overridden_script);
+
+	SceneLuaVM vm;
+	vm.OverrideScriptSource(overridden_script.ref, "counter = 0\nfunction OnUpdate(node) counter = counter - 1 end");
+	SceneSyncToSystemsFromFile(scene, vm);
+
+	SceneClocks clocks;
+	for (int i = 0; i < 2; ++i)
+		SceneUpdateSystems(scene, clocks, 0, vm);
+
+	// paths are compared once cleaned, the overridden script does not revert to the file
+	TEST_CHECK(StringToFile(path.c_str(), "counter = 0\nfunction OnUpdate(node) counter = counter + 10 end"));
+
+	TEST_CHECK(vm.ReloadScriptsFromFile(scene, {PathJoin(dir, "other.lua")}).empty());
+
+	const auto reloaded = vm.ReloadScriptsFromFile(scene, {dir + "//reload.lua"});
+	TEST_CHECK(reloaded.size() == 1 && reloaded[0] == script.ref);
+
+	SceneUpdateSystems(scene, clocks, 0, vm);
+
+	TEST_CHECK(LuaObjValue(vm.GetScriptValue(script.ref, "counter"), -1) == 12);
+	TEST_CHECK(LuaObjValue(vm.GetScriptValue(overridden_script.ref, "counter"), -1) == -3);
+
+	// reload from the events of a watched directory
+	Unlink(path.c_str());
+	WatchDirectory(dir, false);
+	TEST_CHECK(WaitForDirectoryWatch(dir, time_from_sec(10)));
+
+	TEST_CHECK(StringToFile(path.c_str(), "counter = 0\nfunction OnUpdate(node) counter = counter + 100 end"));
+
+	std::vector<ComponentRef> watched_reloaded;
+	for (const auto t_end = time_now() + time_from_sec(10); watched_reloaded.empty() && time_now() < t_end;) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		watched_reloaded = SceneReloadModifiedScriptsFromFile(scene, vm, dir);
+	}
+
+	UnwatchDirectory(dir);
+
+	TEST_CHECK(watched_reloaded.size() == 1);
+
+	SceneUpdateSystems(scene, clocks, 0, vm);
+	TEST_CHECK(LuaObjValue(vm.GetScriptValue(script.ref, "counter"), -1) == 112);
+
+	RmTree(dir.c_str());
+}
+
 static void test_LuaScriptOnDestroyCalledBySceneClear() {
 	SceneLuaVM vm;
 	TEST_CHECK(Execute(vm.GetL(), "G.on_destroy = 0;", "bootstrap") == true);
@@ -524,6 +1170,26 @@ static void test_PhysicKinematicRigidBodyNoFreefall() {
 	TEST_CHECK(GetT(sphere.GetTransform().GetWorld()).y == 0.f);
 }
 
+static void test_PhysicKinematicRigidBodyMovedByScript() {
+	Scene scene;
+	auto sphere = CreatePhysicSphere(scene, 0.5, Mat4::Identity, {}, {}, 1.f);
+	sphere.GetRigidBody().SetType(RBT_Kinematic);
+
+	auto script = scene.CreateScript();
+	sphere.SetScript(0, script);
+
+	SceneBullet3Physics physics;
+	SceneLuaVM vm;
+	vm.OverrideScriptSource(script.ref, "function OnUpdate(node) node:GetTransform():SetPos(hg.Vec3(5, 0, 0)) end");
+	SceneSyncToSystemsFromAssets(scene, physics, vm);
+
+	// synchronizing the physics world must not keep the transform modified by the script from being applied this frame
+	SceneClocks clocks;
+	SceneUpdateSystems(scene, clocks, time_from_ms(16), physics, time_from_ms(16), 1, vm);
+
+	TEST_CHECK(GetT(scene.GetNodeWorldMatrix(sphere.ref)).x == 5.f);
+}
+
 static void test_PhysicDynamicVsStaticRigidBodyCollisionCallback() {
 	Scene scene;
 	auto sphere = CreatePhysicSphere(scene, 0.5, TranslationMat4({0, 5, 0}), {}, {}, 1.f);
@@ -623,18 +1289,164 @@ static void test_PhysicRaycastAllHitsOutOfReach() {
 	const auto out = physics.RaycastAllHits(scene, {0, 0, -10.f}, {0, 0, -2.f});
 	TEST_CHECK(out.empty() == true);
 }
+
+static Node CreatePhysicCollisionTree(Scene &scene, const std::string &path, float mass) {
+	auto node = scene.CreateNode();
+	node.SetTransform(scene.CreateTransform());
+	node.SetRigidBody(scene.CreateRigidBody());
+
+	auto col = scene.CreateCollision();
+	col.SetType(CT_Mesh);
+	col.SetCollisionResource(path);
+	col.SetMass(mass);
+	node.SetCollision(0, col);
+
+	return node;
+}
+
+static void test_PhysicCollisionTreeCache() {
+	Scene scene;
+	const auto a = CreatePhysicCollisionTree(scene, "./data/physics/quad.physics_bullet", 0.f);
+	const auto b = CreatePhysicCollisionTree(scene, "./data/physics/quad.physics_bullet", 0.f);
+
+	const auto cache_size = GetBullet3CollisionTreeCacheSize();
+
+	auto world_a = std::make_unique<SceneBullet3Physics>();
+	world_a->SceneCreatePhysicsFromFile(scene);
+	auto world_b = std::make_unique<SceneBullet3Physics>();
+	world_b->SceneCreatePhysicsFromFile(scene);
+
+	TEST_CHECK(world_a->NodeHasBody(a.ref) && world_a->NodeHasBody(b.ref));
+	TEST_CHECK(world_b->NodeHasBody(a.ref) && world_b->NodeHasBody(b.ref));
+	TEST_CHECK(GetBullet3CollisionTreeCacheSize() == cache_size + 1); // parsed once for both worlds
+
+	world_a.reset();
+	TEST_CHECK(GetBullet3CollisionTreeCacheSize() == cache_size + 1); // still used by the second world
+
+	world_b.reset();
+	TEST_CHECK(GetBullet3CollisionTreeCacheSize() == cache_size);
+
+	// the mass of a collision tree that failed to load is not accounted for
+	auto node = CreatePhysicCollisionTree(scene, "./data/physics/missing.physics_bullet", 1000.f);
+	node.SetCollision(1, scene.CreateSphereCollision(0.5f, 1.f));
+
+	SceneBullet3Physics physics;
+	physics.NodeCreatePhysicsFromFile(node);
+	physics.NodeAddImpulse(node.ref, {2.f, 0.f, 0.f});
+
+	TEST_CHECK(AlmostEqual(physics.NodeGetLinearVelocity(node.ref).x, 2.f, 0.001f));
+	TEST_CHECK(GetBullet3CollisionTreeCacheSize() == cache_size);
+}
+
+static void test_PhysicBodyTableRemoval() {
+	Scene scene;
+	auto a = CreatePhysicSphere(scene, 0.5, TranslationMat4({0, 0, 0}), {}, {}, 1.f);
+	auto b = CreatePhysicSphere(scene, 0.5, TranslationMat4({2, 0, 0}), {}, {}, 1.f);
+	auto c = CreatePhysicSphere(scene, 0.5, TranslationMat4({4, 0, 0}), {}, {}, 1.f);
+	c.GetRigidBody().SetType(RBT_Kinematic);
+
+	SceneBullet3Physics physics;
+	physics.SceneCreatePhysicsFromAssets(scene);
+
+	TEST_CHECK(physics.NodeHasBody(a) && physics.NodeHasBody(b) && physics.NodeHasBody(c));
+
+	physics.NodeDestroyPhysics(a); // last body is moved in place of the destroyed one
+	TEST_CHECK(!physics.NodeHasBody(a));
+	TEST_CHECK(physics.NodeHasBody(b) && physics.NodeHasBody(c));
+
+	scene.DestroyNode(b);
+	scene.GarbageCollect();
+	TEST_CHECK(physics.GarbageCollect(scene) == 1);
+	TEST_CHECK(!physics.NodeHasBody(b.ref));
+	TEST_CHECK(physics.NodeHasBody(c));
+
+	c.GetTransform().SetPos({4, 1, 0});
+
+	scene.ReadyWorldMatrices();
+	physics.SyncTransformsFromScene(scene);
+	physics.StepSimulation(time_from_ms(16));
+	physics.SyncTransformsToScene(scene);
+	scene.ComputeWorldMatrices();
+
+	TEST_CHECK(GetT(c.GetTransform().GetWorld()).y == 1.f);
+}
+
+#if HG_BUILD_TESTS_BENCHMARKS
+static void test_PhysicSyncTransformsCost() {
+	for (auto body_count : {1000, 10000, 50000}) {
+		Scene scene;
+
+		const int side = int(std::ceil(std::sqrt(float(body_count))));
+
+		std::vector<Node> nodes;
+		nodes.reserve(body_count);
+
+		for (int i = 0; i < body_count; ++i) {
+			auto node = CreatePhysicSphere(scene, 0.25f, TranslationMat4({float(i % side), 0.f, float(i / side)}), {}, {}, 1.f);
+			if (i % 8 == 0)
+				node.GetRigidBody().SetType(RBT_Kinematic);
+			nodes.push_back(node);
+		}
+
+		SceneBullet3Physics physics;
+		physics.SceneCreatePhysicsFromAssets(scene);
+
+		const int frame_count = 8;
+		time_ns t_sync = 0, t_step = 0;
+
+		for (int frame = 0; frame < frame_count; ++frame) {
+			scene.StorePreviousWorldMatrices();
+			scene.ReadyWorldMatrices();
+
+			const auto t_0 = time_now();
+			physics.SyncTransformsFromScene(scene);
+			const auto t_1 = time_now();
+			physics.StepSimulation(time_from_ms(16));
+			const auto t_2 = time_now();
+			physics.SyncTransformsToScene(scene);
+			const auto t_3 = time_now();
+
+			scene.ComputeWorldMatrices();
+
+			t_sync += (t_1 - t_0) + (t_3 - t_2);
+			t_step += t_2 - t_1;
+		}
+
+		TEST_CHECK(GetT(nodes[1].GetTransform().GetWorld()).y < 0.f); // dynamic body falls
+		TEST_CHECK(GetT(nodes[0].GetTransform().GetWorld()).y == 0.f); // kinematic body does not
+
+		log(format("SceneBullet3Physics %1 bodies: sync %2 ms, step %3 ms per frame")
+				.arg(body_count)
+				.arg(time_to_ms_f(t_sync / frame_count), 3)
+				.arg(time_to_ms_f(t_step / frame_count), 3)
+				.c_str());
+	}
+}
+#endif // HG_BUILD_TESTS_BENCHMARKS
 #endif // HG_ENABLE_BULLET3_SCENE_PHYSICS
 
 void test_scene() {
 	test_ComponentGarbageCollection();
+	test_IncrementalGarbageCollection();
+	test_GarbageQueueCompaction();
+	test_AnimGarbageCollection();
+	test_NodeSideTables();
 	test_DuplicateNodes();
+	test_CloneNodes();
+#if HG_BUILD_TESTS_BENCHMARKS
+	test_CloneNodesPerformance();
+#endif
 	test_WalkHierarchy();
 	test_DisableLightNodes();
 	test_DisableObjectNodes();
+	test_SpatialIndex();
+	test_AnimateMaterialValue();
+	test_SceneUpdateSystemsConcurrentStages();
 	test_LoadSaveEmptyScene();
 	test_LoadSaveEmptySceneBinary();
 	test_LoadSaveObject();
 	test_LoadSaveObjectBinary();
+	test_LoadSaveNodeFlags();
 	test_LoadSaveCamera();
 	test_LoadSaveCameraBinary();
 	test_LoadSaveLight();
@@ -644,16 +1456,28 @@ void test_scene() {
 	test_LuaScriptSceneOnCreateOnDestroyEventCallback();
 	test_LuaScriptNodeOnAttachOnDetachEventCallback();
 	test_LuaScriptNodeOnUpdateEventCallback();
+	test_LuaScriptNodeOnUpdateCallbackCacheInvalidation();
+#if HG_BUILD_TESTS_BENCHMARKS
+	test_LuaScriptNodeOnUpdateDispatchCost();
+#endif
+	test_LuaScriptReloadPreservesState();
+	test_LuaScriptReloadModifiedFiles();
 	test_LuaScriptOnDestroyCalledBySceneClear();
 	test_LuaScriptWriteToG();
 #if HG_ENABLE_BULLET3_SCENE_PHYSICS
 	test_PhysicDynamicRigidBodyFreefall();
 	test_PhysicKinematicRigidBodyNoFreefall();
+	test_PhysicKinematicRigidBodyMovedByScript();
 	test_PhysicDynamicVsStaticRigidBodyCollisionCallback();
 	test_PhysicKinematicRigidBodyCollideWorld();
 	test_PhysicRaycastFirstHit();
 	test_PhysicRaycastFirstHitOutOfReach();
 	test_PhysicRaycastAllHits();
 	test_PhysicRaycastAllHitsOutOfReach();
+	test_PhysicBodyTableRemoval();
+	test_PhysicCollisionTreeCache();
+#if HG_BUILD_TESTS_BENCHMARKS
+	test_PhysicSyncTransformsCost();
+#endif
 #endif // HG_ENABLE_BULLET3_SCENE_PHYSICS
 }
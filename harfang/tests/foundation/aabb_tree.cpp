@@ -0,0 +1,120 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include "foundation/aabb_tree.h"
+#include "foundation/math.h"
+#include "foundation/projection.h"
+#include "foundation/rand.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace hg;
+
+static MinMax RandomBounds(float extent, float size) {
+	const Vec3 p(FRRand(-extent, extent), FRRand(-extent, extent), FRRand(-extent, extent));
+	const Vec3 s(FRand(size), FRand(size), FRand(size));
+	return {p, p + s};
+}
+
+static bool IsSphereOverlapping(const MinMax &mm, const Vec3 &center, float radius) {
+	return Dist2(center, Clamp(center, mm.mn, mm.mx)) <= radius * radius;
+}
+
+template <typename F> static std::vector<uint32_t> BruteForceQuery(const AABBTree &tree, const std::vector<int32_t> &proxies, F overlap) {
+	std::vector<uint32_t> out;
+	for (size_t i = 0; i < proxies.size(); ++i)
+		if (proxies[i] != AABBTree::invalid_proxy && overlap(tree.GetBounds(proxies[i])))
+			out.push_back(uint32_t(i));
+	return out;
+}
+
+static bool IsSameSet(std::vector<uint32_t> a, std::vector<uint32_t> b) {
+	std::sort(std::begin(a), std::end(a));
+	std::sort(std::begin(b), std::end(b));
+	return a == b;
+}
+
+void test_aabb_tree() {
+	Seed(12);
+
+	AABBTree tree(0.5f);
+	TEST_CHECK(tree.GetHeight() == 0);
+
+	std::vector<uint32_t> out;
+	tree.Query(MinMax{{-1.f, -1.f, -1.f}, {1.f, 1.f, 1.f}}, out);
+	TEST_CHECK(out.empty());
+
+	// proxy values are indices in the proxies vector
+	std::vector<int32_t> proxies;
+	std::vector<MinMax> bounds;
+
+	for (uint32_t i = 0; i < 4096; ++i) {
+		bounds.push_back(RandomBounds(500.f, 8.f));
+		proxies.push_back(tree.Insert(bounds.back(), i));
+	}
+
+	TEST_CHECK(tree.GetProxyCount() == 4096);
+	TEST_CHECK(tree.GetHeight() <= 3 * 12); // balanced
+
+	for (size_t i = 0; i < proxies.size(); ++i) {
+		TEST_CHECK(tree.GetValue(proxies[i]) == i);
+		TEST_CHECK(Overlap(tree.GetBounds(proxies[i]), bounds[i]));
+	}
+
+	// small moves stay within the enlarged bounds, large ones reinsert the proxy
+	int reinsert_count = 0;
+	for (size_t i = 0; i < proxies.size(); i += 2) {
+		const bool large_move = (i % 4) == 0;
+		const Vec3 d = large_move ? Vec3(100.f, 0.f, 0.f) : Vec3(0.1f, 0.f, 0.f);
+
+		bounds[i] = {bounds[i].mn + d, bounds[i].mx + d};
+		if (tree.Move(proxies[i], bounds[i]))
+			++reinsert_count;
+	}
+
+	TEST_CHECK(reinsert_count == 1024);
+
+	// remove a third of the proxies
+	for (size_t i = 0; i < proxies.size(); i += 3) {
+		tree.Remove(proxies[i]);
+		proxies[i] = AABBTree::invalid_proxy;
+	}
+
+	TEST_CHECK(tree.GetProxyCount() == 4096 - 1366);
+
+	// queries must match a brute force test of the enlarged bounds
+	size_t frustum_hit_count = 0;
+
+	for (int j = 0; j < 16; ++j) {
+		const auto volume = RandomBounds(500.f, 200.f);
+
+		out.clear();
+		tree.Query(volume, out);
+		TEST_CHECK(IsSameSet(out, BruteForceQuery(tree, proxies, [&](const MinMax &mm) { return Overlap(mm, volume); })));
+
+		const Vec3 center(FRRand(-500.f, 500.f), FRRand(-500.f, 500.f), FRRand(-500.f, 500.f));
+		const float radius = FRand(150.f);
+
+		out.clear();
+		tree.Query(center, radius, out);
+		TEST_CHECK(IsSameSet(out, BruteForceQuery(tree, proxies, [&](const MinMax &mm) { return IsSphereOverlapping(mm, center, radius); })));
+
+		const auto frustum = MakeFrustum(ComputePerspectiveProjectionMatrix(0.1f, FRRand(100.f, 1000.f), 1.8f, {1.f, 1.f}),
+			TransformationMat4(center, Vec3(FRRand(-1.f, 1.f), FRRand(-Pi, Pi), 0.f)));
+
+		out.clear();
+		tree.Query(frustum, out);
+		frustum_hit_count += out.size();
+		TEST_CHECK(IsSameSet(out, BruteForceQuery(tree, proxies, [&](const MinMax &mm) { return TestVisibility(frustum, mm) != V_Outside; })));
+	}
+
+	TEST_CHECK(frustum_hit_count > 0);
+
+	tree.Clear();
+	TEST_CHECK(tree.GetProxyCount() == 0);
+	TEST_CHECK(tree.GetHeight() == 0);
+}
@@ -0,0 +1,134 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include "foundation/gen_ref_table.h"
+
+#include <map>
+#include <string>
+
+using namespace hg;
+
+static void test_gen_ref_table_values() {
+	gen_ref_table<std::string> table;
+	TEST_CHECK(table.empty());
+	TEST_CHECK(table.find({0, 0}) == nullptr);
+
+	table[{4, 1}] = "four";
+	table[{1, 0}] = "one";
+	table[{9, 2}] = "nine";
+	TEST_CHECK(table.size() == 3);
+
+	TEST_CHECK(table.find({4, 1}) != nullptr && *table.find({4, 1}) == "four");
+	TEST_CHECK(table.find({4, 0}) == nullptr); // generation mismatch
+	TEST_CHECK(table.contains({9, 2}));
+	TEST_CHECK(table.contains({2, 0}) == false);
+
+	// a newer generation replaces a stale entry
+	table[{4, 2}] = "four again";
+	TEST_CHECK(table.size() == 3);
+	TEST_CHECK(table.find({4, 1}) == nullptr);
+	TEST_CHECK(*table.find({4, 2}) == "four again");
+
+	// removing an entry keeps the others addressable
+	TEST_CHECK(table.erase({1, 0}) == true);
+	TEST_CHECK(table.erase({1, 0}) == false);
+	TEST_CHECK(table.size() == 2);
+	TEST_CHECK(*table.find({4, 2}) == "four again");
+	TEST_CHECK(*table.find({9, 2}) == "nine");
+
+	size_t count = 0;
+	for (const auto &i : table) {
+		TEST_CHECK(*table.find(i.first) == i.second);
+		++count;
+	}
+	TEST_CHECK(count == 2);
+
+	table.clear();
+	TEST_CHECK(table.empty());
+	TEST_CHECK(table.find({9, 2}) == nullptr);
+}
+
+static void test_gen_ref_table_lists() {
+	gen_ref_list_table<int> table;
+	TEST_CHECK(table.get({0, 0}).empty());
+
+	// interleave list growth so that lists are moved around the pool
+	std::map<uint32_t, std::vector<int>> expected;
+
+	for (int j = 0; j < 16; ++j)
+		for (uint32_t i = 0; i < 32; ++i) {
+			table.push_back({i, 1}, int(i * 100 + j));
+			expected[i].push_back(int(i * 100 + j));
+		}
+
+	TEST_CHECK(table.size() == 32);
+	TEST_CHECK(table.get({3, 0}).empty()); // generation mismatch
+
+	const auto IsExpected = [&]() {
+		if (table.size() != expected.size())
+			return false;
+		for (const auto &i : expected) {
+			const auto list = table.get({i.first, 1});
+			if (!std::equal(list.begin(), list.end(), i.second.begin(), i.second.end()))
+				return false;
+		}
+		return true;
+	};
+
+	TEST_CHECK(IsExpected());
+
+	// shrink then regrow within capacity
+	table.resize({5, 1}, 2);
+	table.resize({5, 1}, 4, -1);
+	expected[5].resize(2);
+	expected[5].resize(4, -1);
+	TEST_CHECK(IsExpected());
+
+	// in place modification
+	table.get({7, 1})[3] = 42;
+	expected[7][3] = 42;
+	TEST_CHECK(IsExpected());
+
+	// erase most lists, triggering a compaction
+	for (uint32_t i = 0; i < 32; i += 4)
+		for (uint32_t k = i; k < i + 3; ++k) {
+			TEST_CHECK(table.erase({k, 1}));
+			expected.erase(k);
+		}
+
+	TEST_CHECK(table.erase({0, 1}) == false);
+	TEST_CHECK(IsExpected());
+	TEST_CHECK(table.memory_footprint() > 0);
+
+	// iteration is in key index order
+	size_t count = 0;
+	auto expected_key = std::begin(expected);
+	for (auto i : table) {
+		TEST_CHECK(i.first.idx == expected_key->first);
+		TEST_CHECK(i.second.size() == expected_key->second.size());
+		++expected_key;
+		++count;
+	}
+	TEST_CHECK(count == expected.size());
+
+	// push back an entry of the list being grown
+	for (int j = 0; j < 64; ++j) {
+		table.push_back({3, 1}, table.get({3, 1})[0]);
+		expected[3].push_back(expected[3][0]);
+	}
+	TEST_CHECK(IsExpected());
+
+	table.compact();
+	TEST_CHECK(IsExpected());
+
+	table.clear();
+	TEST_CHECK(table.empty());
+	TEST_CHECK(table.get({7, 1}).empty());
+}
+
+void test_gen_ref_table() {
+	test_gen_ref_table_values();
+	test_gen_ref_table_lists();
+}
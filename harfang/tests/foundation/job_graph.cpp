@@ -0,0 +1,181 @@
+// HARFANG(R) Copyright (C) 2022 NWNC. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include "foundation/job_graph.h"
+#include "foundation/worker_pool.h"
+
+#include <atomic>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace hg;
+
+static void test_parallel_for() {
+	std::vector<int> values(100000, 0);
+
+	parallel_for(values.size(), 1000, [&](size_t begin, size_t end) {
+		for (auto i = begin; i < end; ++i)
+			values[i] += int(i % 7);
+	});
+
+	int expected = 0;
+	for (size_t i = 0; i < values.size(); ++i)
+		expected += int(i % 7);
+
+	TEST_CHECK(std::accumulate(std::begin(values), std::end(values), 0) == expected);
+}
+
+static void test_nested_jobs() {
+	std::atomic<int> count{0};
+	job_counter counter;
+
+	for (int i = 0; i < 16; ++i)
+		run_job(
+			[&]() {
+				parallel_for(64, 8, [&](size_t begin, size_t end) { count += int(end - begin); }); // waiting from a worker must not deadlock
+			},
+			counter);
+
+	wait_jobs(counter);
+	TEST_CHECK(count == 16 * 64);
+}
+
+static void test_job_graph_dependencies() {
+	job_graph graph;
+
+	add_job(graph, "write a", [] {}, {}, {0});
+	add_job(graph, "read a", [] {}, {0}, {});
+	add_job(graph, "read a again", [] {}, {0}, {});
+	add_job(graph, "write b", [] {}, {}, {1});
+	add_job(graph, "write a after reads", [] {}, {}, {0});
+
+	const auto deps = compute_job_graph_dependencies(graph);
+
+	TEST_CHECK(deps[0].empty());
+	TEST_CHECK(deps[1] == std::vector<size_t>{0});
+	TEST_CHECK(deps[2] == std::vector<size_t>{0});
+	TEST_CHECK(deps[3].empty()); // independent of all previous jobs
+	TEST_CHECK(deps[4].size() == 3); // write after write on job 0, write after read on jobs 1 and 2
+}
+
+static void test_run_job_graph() {
+	std::vector<int> order;
+	std::atomic<int> independent{0};
+	std::thread::id calling_thread_id;
+
+	job_graph graph;
+	add_job(graph, "a", [&] { order.push_back(0); }, {}, {0});
+	add_job(graph, "b", [&] { order.push_back(1); }, {0}, {0});
+	add_job(graph, "independent", [&] { ++independent; }, {}, {1});
+	add_job(graph, "c", [&] { order.push_back(2); calling_thread_id = std::this_thread::get_id(); }, {0}, {0}, true);
+
+	job_graph_trace trace;
+	run_job_graph(graph, &trace);
+
+	TEST_CHECK(order == (std::vector<int>{0, 1, 2}));
+	TEST_CHECK(independent == 1);
+	TEST_CHECK(calling_thread_id == std::this_thread::get_id());
+
+	TEST_CHECK(trace.nodes.size() == 4);
+	TEST_CHECK(trace.nodes[3].worker == -1);
+	TEST_CHECK(trace.nodes[1].start >= trace.nodes[0].end);
+	TEST_CHECK(job_graph_trace_to_dot(trace).find("job0 -> job1") != std::string::npos);
+
+	// a graph can be run again
+	run_job_graph(graph);
+
+	TEST_CHECK(order == (std::vector<int>{0, 1, 2, 0, 1, 2}));
+	TEST_CHECK(independent == 2);
+}
+
+static void test_run_job_graph_with_busy_workers() {
+	// the only worker is blocked until the graph completes, the calling thread has to execute the graph jobs
+	std::atomic<bool> graph_done{false};
+	job_counter counter;
+	run_job([&] {
+		while (!graph_done)
+			std::this_thread::yield();
+	}, counter);
+
+	std::atomic<int> executed{0};
+
+	job_graph graph;
+	for (int i = 0; i < 8; ++i)
+		add_job(graph, "job", [&] { ++executed; }, {}, {job_resource(i % 2)});
+
+	run_job_graph(graph);
+	graph_done = true;
+	wait_jobs(counter);
+
+	TEST_CHECK(executed == 8);
+
+	// graphs run from workers
+	std::atomic<int> nested_executed{0};
+
+	for (int i = 0; i < 4; ++i)
+		run_job(
+			[&] {
+				job_graph nested_graph;
+				for (int j = 0; j < 8; ++j)
+					add_job(nested_graph, "nested job", [&] { ++nested_executed; }, {}, {job_resource(j % 3)});
+				run_job_graph(nested_graph);
+			},
+			counter);
+
+	wait_jobs(counter);
+	TEST_CHECK(nested_executed == 4 * 8);
+}
+
+static void test_wait_jobs_only_runs_its_jobs() {
+	// the only worker is blocked, the calling thread executes the jobs it waits on but not the jobs of another counter
+	std::atomic<bool> release{false};
+	job_counter busy_counter;
+	run_job([&] {
+		while (!release)
+			std::this_thread::yield();
+	}, busy_counter);
+
+	std::atomic<bool> other_ran{false};
+	job_counter other_counter;
+	run_job([&] { other_ran = true; }, other_counter);
+
+	std::atomic<int> executed{0};
+	job_counter counter;
+	for (int i = 0; i < 4; ++i)
+		run_job([&] { ++executed; }, counter);
+
+	wait_jobs(counter);
+	TEST_CHECK(executed == 4);
+	TEST_CHECK(other_ran == false);
+
+	release = true;
+	wait_jobs(other_counter);
+	wait_jobs(busy_counter);
+	TEST_CHECK(other_ran == true);
+}
+
+void test_job_graph() {
+	// serial fallback
+	test_parallel_for();
+	test_nested_jobs();
+	test_job_graph_dependencies();
+	test_run_job_graph();
+
+	start_workers(3);
+	TEST_CHECK(get_worker_count() == 3);
+
+	test_parallel_for();
+	test_nested_jobs();
+	test_run_job_graph();
+
+	stop_workers();
+	TEST_CHECK(get_worker_count() == 0);
+
+	start_workers(1);
+	test_run_job_graph_with_busy_workers();
+	test_wait_jobs_only_runs_its_jobs();
+	stop_workers();
+}
@@ -42,6 +42,9 @@ extern void test_version();
 extern void test_rect();
 extern void test_timer();
 extern void test_signal();
+extern void test_job_graph();
+extern void test_aabb_tree();
+extern void test_gen_ref_table();
 
 // platform tests
 extern void test_window();
@@ -50,8 +53,13 @@ extern void test_window();
 extern void test_assets();
 extern void test_animation();
 extern void test_audio();
+extern void test_font();
+extern void test_geometry();
+extern void test_iso_surface();
 extern void test_meta();
 extern void test_picture();
+extern void test_picture_processing();
+extern void test_render_pipeline();
 extern void test_video_stream();
 extern void test_scene();
 
@@ -100,6 +108,9 @@ TEST_LIST = {
 	{"foundation.rect", test_rect},
 	{"foundation.timer", test_timer},
 	{"foundation.signal", test_signal},
+	{"foundation.job_graph", test_job_graph},
+	{"foundation.aabb_tree", test_aabb_tree},
+	{"foundation.gen_ref_table", test_gen_ref_table},
 
 	// platform
 	{"platform.window", test_window},
@@ -108,8 +119,13 @@ TEST_LIST = {
 	{"engine.assets", test_assets},
 	{"engine.animation", test_animation},
 	{"engine.audio", test_audio},
+	{"engine.font", test_font},
+	{"engine.geometry", test_geometry},
+	{"engine.iso_surface", test_iso_surface},
 	{"engine.meta", test_meta},
 	{"engine.picture", test_picture},
+	{"engine.picture_processing", test_picture_processing},
+	{"engine.render_pipeline", test_render_pipeline},
 	{"engine.video_stream", test_video_stream},
 	{"engine.scene", test_scene},
 
@@ -1408,6 +1408,8 @@ static std::string GetDefines(const std::vector<PipelineProgramFeature> &feats,
 			defines.push_back(format("ENABLE_SKINNING=%1").arg(state ? "1" : "0"));
 		} else if (feats[i] == OptionalAlphaCut) {
 			defines.push_back(format("ENABLE_ALPHA_CUT=%1").arg(state ? "1" : "0"));
+		} else if (feats[i] == OptionalInstancing) {
+			defines.push_back(format("ENABLE_INSTANCING=%1").arg(state ? "1" : "0"));
 		}
 	}
 
@@ -1116,7 +1116,7 @@ static hg::ModelRef ExportGeometry(const aiScene *ai_scene, hg::Node &node, cons
 		}
 	}
 
-	const auto vtx_to_pol = hg::ComputeVertexToPolygon(geo);
+	const auto vtx_to_pol = hg::ComputeVertexPolygonAdjacency(geo);
 	const auto vtx_normal = hg::ComputeVertexNormal(geo, vtx_to_pol, hg::Deg(45.f));
 
 	// recalculate normals
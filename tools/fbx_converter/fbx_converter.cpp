@@ -1015,7 +1015,7 @@ hg::ModelRef DoExportGeometry(FbxMesh *fbx_mesh, FbxNode *pNode, hg::Object &obj
 
 	float max_smoothing_angle = hg::Deg(config.max_smoothing_angle);
 
-	const auto vtx_to_pol = hg::ComputeVertexToPolygon(geo);
+	const auto vtx_to_pol = hg::ComputeVertexPolygonAdjacency(geo);
 	const auto vtx_normal = hg::ComputeVertexNormal(geo, vtx_to_pol, max_smoothing_angle);
 
 	// recalculate normals
@@ -10,6 +10,8 @@
 #include <foundation/build_info.h>
 #include <foundation/cext.h>
 #include <foundation/cmd_line.h>
+#include <foundation/data.h>
+#include <foundation/data_rw_interface.h>
 #include <foundation/dir.h>
 #include <foundation/format.h>
 #include <foundation/log.h>
@@ -23,14 +25,17 @@
 #include <foundation/string.h>
 #include <foundation/time.h>
 #include <foundation/vector3.h>
+#include <foundation/worker_pool.h>
 
 #include "json.hpp"
 #include "stb_image.h"
 #include "tiny_gltf.h"
 
+#include <deque>
 #include <fstream>
 #include <iostream>
 #include <mutex>
+#include <set>
 
 #undef CopyFile
 #undef GetObject
@@ -43,9 +48,38 @@ using nlohmann::json;
 std::map<int, hg::NodeRef> idNode_to_NodeRef;
 std::vector<std::string> already_saved_picture;
 
-std::map<std::string, std::string> primitiveIdsToGeoPath;
 std::map<std::string, int> geoPathOcurrence;
 
+// geometries are converted in parallel once the node hierarchy is exported
+struct GeometryExport {
+	int mesh{-1}, skin{-1};
+	std::string name; // output name before collision handling
+
+	bool converted{false};
+	hg::Data data; // serialized geometry
+	std::string hash; // content hash of the serialized geometry
+	std::string path; // resource path
+};
+
+std::deque<GeometryExport> geometry_exports;
+std::map<std::string, size_t> primitiveIdsToGeometryExport;
+std::map<std::string, std::string> geometryHashToPath;
+
+struct PendingModelRef {
+	hg::Object object;
+	size_t geometry_export;
+};
+
+std::vector<PendingModelRef> pending_model_refs;
+
+// images are collected while loading and written in parallel once loading completes
+std::map<int, std::string> image_dst_paths; // output path by glTF image index
+
+struct ImportTimings {
+	hg::time_ns load{0}, images{0}, nodes{0}, geometry_conversion{0}, geometry_save{0}, animations{0}, scene_save{0};
+	size_t geometry_count{0}, deduplicated_geometry_count{0}, image_count{0}, deduplicated_image_count{0};
+};
+
 static std::string Indent(const int indent) {
 	std::string s;
 	for (int i = 0; i < indent; i++) {
@@ -574,6 +608,11 @@ static hg::TextureRef ExportTexture(const Model &model, const int &textureIndex,
 	const auto &texture = model.textures[textureIndex];
 	const auto &image = model.images[texture.source];
 
+	// path resolved by ExportImages, shared by all images with the same content
+	const auto dst_itr = image_dst_paths.find(texture.source);
+	if (dst_itr != image_dst_paths.end())
+		return ExportTexture(model, textureIndex, dst_itr->second, config, resources);
+
 	std::string dst_path;
 
 	if (image.uri.empty()) {
@@ -742,10 +781,7 @@ static hg::Material ExportMaterial(const Model &model, const Material &gltf_mat,
 #define __PolIndex (pol_index[p] + v)
 #define __PolRemapIndex (pol_index[p] + (geo.pol[p].vtx_count - 1 - v))
 
-static void ExportGeometry(
-	const Model &model, const Primitive &meshPrimitive, const int &primitiveID, const Config &config, hg::PipelineResources &resources, hg::Geometry &geo) {
-	// TODO detect instancing (using SHA1 on model)
-
+static void ExportGeometry(const Model &model, const Primitive &meshPrimitive, const int &primitiveID, const Config &config, hg::Geometry &geo) {
 	// Boolean used to check if we have converted the vertex buffer format
 	bool convertedToTriangleList = false;
 	// This permit to get a type agnostic way of reading the index buffer
@@ -1118,129 +1154,146 @@ static void ExportGeometry(
 }
 
 //
-static void ExportObject(const Model &model, const Node &gltf_node, hg::Node &node, hg::Scene &scene, const Config &config, hg::PipelineResources &resources,
-	const int &gltf_id_node) {
+static bool IsSkinnedMesh(const Model &model, const Node &gltf_node) {
+	if (gltf_node.mesh < 0)
+		return false;
 
-	// if there is no mesh or no skin, nothing inside object
-	if (gltf_node.mesh < 0 && gltf_node.skin < 0)
-		return;
+	for (const auto &meshPrimitive : model.meshes[gltf_node.mesh].primitives)
+		if (meshPrimitive.attributes.count("JOINTS_0") || meshPrimitive.attributes.count("WEIGHTS_0"))
+			return true;
+	return false;
+}
 
+// convert the mesh and skin of a geometry export, safe to call from any thread
+static void ConvertGeometry(const Model &model, const Config &config, GeometryExport &geo_export) {
 	hg::Geometry geo;
-	std::string path = node.GetName();
-	std::string primitiveIds;
-	auto object = scene.CreateObject();
 
-	// check path geo
-	if (gltf_node.mesh >= 0) {
-		auto gltf_mesh = model.meshes[gltf_node.mesh];
-		if (!gltf_mesh.name.empty())
-			path = hg::CleanFileName(hg::CutFileExtension(gltf_mesh.name));
-		for (auto meshPrimitive : gltf_mesh.primitives) {
-			// add attribute ids to be sure to have this one particular geo and material
-			for (const auto &a : meshPrimitive.attributes)
-				primitiveIds += std::to_string(a.second) + "_";
-			primitiveIds += std::to_string(meshPrimitive.indices) + "_";
+	if (geo_export.mesh >= 0) {
+		const auto &gltf_mesh = model.meshes[geo_export.mesh];
+
+		int primitiveId = 0;
+		for (const auto &meshPrimitive : gltf_mesh.primitives) {
+			ExportGeometry(model, meshPrimitive, primitiveId, config, geo);
+			++primitiveId;
 		}
-	}
 
-	primitiveIds += "_" + std::to_string(gltf_node.skin);
-	bool found_geo = false;
-
-	// if there is set of primitive ids existing
-	auto primitiveIdsToGeoPath_itr = primitiveIdsToGeoPath.find(primitiveIds);
-	if (primitiveIdsToGeoPath_itr != primitiveIdsToGeoPath.end()) {
-		// get path to geo
-		path = primitiveIdsToGeoPath_itr->second;
-		GetOutputPath(path, config.base_output_path, path, {}, "geo", config.import_policy_geometry);
-		path = MakeRelativeResourceName(path, config.prj_path, config.prefix);
-	} else {
-		// export geo mesh
-		if (gltf_node.mesh >= 0) {
-			auto gltf_mesh = model.meshes[gltf_node.mesh];
+		const auto vtx_to_pol = hg::ComputeVertexPolygonAdjacency(geo);
+		auto vtx_normal = hg::ComputeVertexNormal(geo, vtx_to_pol, hg::Deg(45.f));
 
-			int primitiveId = 0;
-			for (auto meshPrimitive : gltf_mesh.primitives) {
-				ExportGeometry(model, meshPrimitive, primitiveId, config, resources, geo);
-				++primitiveId;
-			}
+		// recalculate normals
+		bool recalculate_normal = config.recalculate_normal;
+		if (geo.normal.empty())
+			recalculate_normal = true;
 
-			const auto vtx_to_pol = hg::ComputeVertexToPolygon(geo);
-			auto vtx_normal = hg::ComputeVertexNormal(geo, vtx_to_pol, hg::Deg(45.f));
-
-			// recalculate normals
-			bool recalculate_normal = config.recalculate_normal;
-			if (geo.normal.empty())
-				recalculate_normal = true;
-
-			if (recalculate_normal) {
-				hg::debug("    - Recalculate normals");
-				geo.normal = vtx_normal;
-			} else
-				vtx_normal = geo.normal;
-
-			// recalculate tangent frame
-			bool recalculate_tangent = config.recalculate_tangent;
-			if (geo.tangent.empty())
-				recalculate_tangent = true;
-			else if (geo.tangent.size() != geo.normal.size()) { // be sure tangent is same size of normal, some strange things can happen with multiple submesh
-				hg::debug("CAREFUL Normal and Tangent are not the same size, can happen if you have submesh (some with tangent and some without)");
-				geo.tangent.resize(geo.normal.size());
-			}
+		if (recalculate_normal) {
+			hg::debug("    - Recalculate normals");
+			geo.normal = vtx_normal;
+		} else
+			vtx_normal = geo.normal;
+
+		// recalculate tangent frame
+		bool recalculate_tangent = config.recalculate_tangent;
+		if (geo.tangent.empty())
+			recalculate_tangent = true;
+		else if (geo.tangent.size() != geo.normal.size()) { // be sure tangent is same size of normal, some strange things can happen with multiple submesh
+			hg::debug("CAREFUL Normal and Tangent are not the same size, can happen if you have submesh (some with tangent and some without)");
+			geo.tangent.resize(geo.normal.size());
+		}
 
-			if (recalculate_tangent) {
-				hg::debug("    - Recalculate tangent frames (MikkT)");
-				if (!geo.uv[0].empty())
-					geo.tangent = hg::ComputeVertexTangent(geo, vtx_normal, 0, hg::Deg(45.f));
-			}
+		if (recalculate_tangent) {
+			hg::debug("    - Recalculate tangent frames (MikkT)");
+			if (!geo.uv[0].empty())
+				geo.tangent = hg::ComputeVertexTangent(geo, vtx_normal, 0, hg::Deg(45.f));
 		}
-		// find bind pose in the skins
-		if (gltf_node.skin >= 0) {
-			hg::debug(hg::format("Exporting geometry skin"));
+	}
 
-			const auto &skin = model.skins[gltf_node.skin];
-			geo.bind_pose.resize(skin.joints.size());
-
-			const auto attribAccessor = model.accessors[skin.inverseBindMatrices];
-			const auto &bufferView = model.bufferViews[attribAccessor.bufferView];
-			const auto &buffer = model.buffers[bufferView.buffer];
-			const auto dataPtr = buffer.data.data() + bufferView.byteOffset + attribAccessor.byteOffset;
-			const auto byte_stride = attribAccessor.ByteStride(bufferView);
-			const auto count = attribAccessor.count;
-
-			switch (attribAccessor.type) {
-				case TINYGLTF_TYPE_MAT4: {
-					switch (attribAccessor.componentType) {
-						case TINYGLTF_COMPONENT_TYPE_DOUBLE:
-						case TINYGLTF_COMPONENT_TYPE_FLOAT: {
-							floatArray<float> value(arrayAdapter<float>(dataPtr, count * 16, sizeof(float)));
+	// find bind pose in the skins
+	if (geo_export.skin >= 0) {
+		hg::debug(hg::format("Exporting geometry skin"));
 
-							for (size_t k{0}; k < count; ++k) {
-								hg::Mat4 m_InverseBindMatrices(value[k * 16], value[k * 16 + 1], value[k * 16 + 2], value[k * 16 + 4], value[k * 16 + 5],
-									value[k * 16 + 6], value[k * 16 + 8], value[k * 16 + 9], value[k * 16 + 10], value[k * 16 + 12], value[k * 16 + 13],
-									value[k * 16 + 14]);
+		const auto &skin = model.skins[geo_export.skin];
+		geo.bind_pose.resize(skin.joints.size());
 
-								m_InverseBindMatrices = hg::InverseFast(m_InverseBindMatrices);
+		const auto attribAccessor = model.accessors[skin.inverseBindMatrices];
+		const auto &bufferView = model.bufferViews[attribAccessor.bufferView];
+		const auto &buffer = model.buffers[bufferView.buffer];
+		const auto dataPtr = buffer.data.data() + bufferView.byteOffset + attribAccessor.byteOffset;
+		const auto byte_stride = attribAccessor.ByteStride(bufferView);
+		const auto count = attribAccessor.count;
 
-								auto p = hg::GetT(m_InverseBindMatrices);
-								p.z = -p.z;
-								auto r = hg::GetR(m_InverseBindMatrices);
-								r.x = -r.x;
-								r.y = -r.y;
-								auto s = hg::GetS(m_InverseBindMatrices);
+		switch (attribAccessor.type) {
+			case TINYGLTF_TYPE_MAT4: {
+				switch (attribAccessor.componentType) {
+					case TINYGLTF_COMPONENT_TYPE_DOUBLE:
+					case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+						floatArray<float> value(arrayAdapter<float>(dataPtr, count * 16, sizeof(float)));
+
+						for (size_t k{0}; k < count; ++k) {
+							hg::Mat4 m_InverseBindMatrices(value[k * 16], value[k * 16 + 1], value[k * 16 + 2], value[k * 16 + 4], value[k * 16 + 5],
+								value[k * 16 + 6], value[k * 16 + 8], value[k * 16 + 9], value[k * 16 + 10], value[k * 16 + 12], value[k * 16 + 13],
+								value[k * 16 + 14]);
+
+							m_InverseBindMatrices = hg::InverseFast(m_InverseBindMatrices);
+
+							auto p = hg::GetT(m_InverseBindMatrices);
+							p.z = -p.z;
+							auto r = hg::GetR(m_InverseBindMatrices);
+							r.x = -r.x;
+							r.y = -r.y;
+							auto s = hg::GetS(m_InverseBindMatrices);
+
+							geo.bind_pose[k] = hg::InverseFast(hg::TransformationMat4(p, r, s));
+						}
+					} break;
+					default:
+						hg::error("Unhandeled component type for inverseBindMatrices");
+				}
+			} break;
+			default:
+				hg::error("Unhandeled MAT4 type for inverseBindMatrices");
+		}
+	}
 
-								geo.bind_pose[k] = hg::InverseFast(hg::TransformationMat4(p, r, s));
-							}
-						} break;
-						default:
-							hg::error("Unhandeled component type for inverseBindMatrices");
-					}
-				} break;
-				default:
-					hg::error("Unhandeled MAT4 type for inverseBindMatrices");
-			}
+	// serialize once, the content hash detects identical geometries coming from different meshes
+	hg::SaveGeometry(hg::g_data_writer, hg::DataWriteHandle(geo_export.data), geo);
+	geo_export.hash = hg::ComputeSHA1String(geo_export.data.GetData(), geo_export.data.GetSize());
+	geo_export.converted = true;
+}
+
+/*
+	Convert all pending geometries in parallel, name and save unique geometries then assign the model references of the objects using them.
+*/
+static void ExportGeometries(const Model &model, const Config &config, hg::PipelineResources &resources, ImportTimings &timings) {
+	auto t = hg::time_now();
+
+	std::vector<GeometryExport *> to_convert;
+	for (auto &geo_export : geometry_exports)
+		if (!geo_export.converted)
+			to_convert.push_back(&geo_export);
+
+	hg::parallel_for(to_convert.size(), 1, [&](size_t begin, size_t end) {
+		for (auto i = begin; i < end; ++i)
+			ConvertGeometry(model, config, *to_convert[i]);
+	});
+
+	timings.geometry_conversion += hg::time_now() - t;
+	t = hg::time_now();
+
+	// name geometries in traversal order, identical content shares the first geometry file
+	std::vector<std::pair<std::string, const hg::Data *>> to_save;
+
+	for (auto geo_export : to_convert) {
+		auto hash_itr = geometryHashToPath.find(geo_export->hash);
+		if (hash_itr != geometryHashToPath.end()) {
+			hg::debug(hg::format("Geometry '%1' is identical to '%2'").arg(geo_export->name).arg(hash_itr->second));
+			geo_export->path = hash_itr->second;
+			++timings.deduplicated_geometry_count;
+			continue;
 		}
 
 		// check if name already taken
+		auto path = geo_export->name;
+
 		auto geoPathOcurrence_itr = geoPathOcurrence.find(path);
 		if (geoPathOcurrence_itr != geoPathOcurrence.end()) {
 			geoPathOcurrence_itr->second++;
@@ -1248,19 +1301,70 @@ static void ExportObject(const Model &model, const Node &gltf_node, hg::Node &no
 		} else
 			geoPathOcurrence[path] = 0;
 
-		// save it to geo to keep
-		primitiveIdsToGeoPath[primitiveIds] = path;
+		if (GetOutputPath(path, config.base_output_path, path, {}, "geo", config.import_policy_geometry)) {
+			hg::debug(hg::format("Export geometry to '%1'").arg(path));
+			to_save.push_back({path, &geo_export->data});
+		}
 
-		if (gltf_node.mesh >= 0 || gltf_node.skin >= 0) {
-			if (GetOutputPath(path, config.base_output_path, path, {}, "geo", config.import_policy_geometry)) {
-				hg::debug(hg::format("Export geometry to '%1'").arg(path));
-				hg::SaveGeometryToFile(path.c_str(), geo);
-			}
+		geo_export->path = MakeRelativeResourceName(path, config.prj_path, config.prefix);
+		geometryHashToPath[geo_export->hash] = geo_export->path;
+	}
+
+	hg::parallel_for(to_save.size(), 1, [&](size_t begin, size_t end) {
+		for (auto i = begin; i < end; ++i)
+			if (!hg::SaveDataToFile(to_save[i].first.c_str(), *to_save[i].second))
+				hg::error(hg::format("Failed to save geometry to '%1'").arg(to_save[i].first));
+	});
 
-			path = MakeRelativeResourceName(path, config.prj_path, config.prefix);
+	timings.geometry_save += hg::time_now() - t;
+	timings.geometry_count += to_convert.size();
+
+	// set the objects model now that geometry paths are known
+	for (auto &pending : pending_model_refs)
+		pending.object.SetModelRef(resources.models.Add(geometry_exports[pending.geometry_export].path.c_str(), {}));
+	pending_model_refs.clear();
+}
+
+//
+static void ExportObject(const Model &model, const Node &gltf_node, hg::Node &node, hg::Scene &scene, const Config &config, hg::PipelineResources &resources,
+	const int &gltf_id_node) {
+
+	// if there is no mesh or no skin, nothing inside object
+	if (gltf_node.mesh < 0 && gltf_node.skin < 0)
+		return;
+
+	std::string path = node.GetName();
+	std::string primitiveIds;
+	auto object = scene.CreateObject();
+
+	// check path geo
+	if (gltf_node.mesh >= 0) {
+		const auto &gltf_mesh = model.meshes[gltf_node.mesh];
+		if (!gltf_mesh.name.empty())
+			path = hg::CleanFileName(hg::CutFileExtension(gltf_mesh.name));
+		for (const auto &meshPrimitive : gltf_mesh.primitives) {
+			// add attribute ids to be sure to have this one particular geo and material
+			for (const auto &a : meshPrimitive.attributes)
+				primitiveIds += std::to_string(a.second) + "_";
+			primitiveIds += std::to_string(meshPrimitive.indices) + "_";
 		}
 	}
 
+	primitiveIds += "_" + std::to_string(gltf_node.skin);
+
+	// geometry conversion is deferred to ExportGeometries, only queue it the first time this set of primitive ids is met
+	auto primitiveIdsToGeometryExport_itr = primitiveIdsToGeometryExport.find(primitiveIds);
+	if (primitiveIdsToGeometryExport_itr == primitiveIdsToGeometryExport.end()) {
+		geometry_exports.emplace_back();
+		geometry_exports.back().mesh = gltf_node.mesh;
+		geometry_exports.back().skin = gltf_node.skin;
+		geometry_exports.back().name = path;
+
+		primitiveIdsToGeometryExport_itr = primitiveIdsToGeometryExport.insert({primitiveIds, geometry_exports.size() - 1}).first;
+	}
+
+	const bool skinned = IsSkinnedMesh(model, gltf_node);
+
 	// add materials
 	if (gltf_node.mesh >= 0) {
 		auto gltf_mesh = model.meshes[gltf_node.mesh];
@@ -1273,7 +1377,7 @@ static void ExportObject(const Model &model, const Node &gltf_node, hg::Node &no
 			if (meshPrimitive.material >= 0) {
 				auto gltf_mat = model.materials[meshPrimitive.material];
 				auto mat = ExportMaterial(model, gltf_mat, config, resources);
-				if (geo.skin.size())
+				if (skinned)
 					mat.flags |= hg::MF_EnableSkinning;
 
 				object.SetMaterial(primitiveId, std::move(mat));
@@ -1304,11 +1408,9 @@ static void ExportObject(const Model &model, const Node &gltf_node, hg::Node &no
 		}
 	}
 
-	// set object
-	if (gltf_node.mesh >= 0 || gltf_node.skin >= 0) {
-		node.SetObject(object);
-		object.SetModelRef(resources.models.Add(path.c_str(), {}));
-	}
+	// set object, its model is assigned once its geometry is exported
+	node.SetObject(object);
+	pending_model_refs.push_back({object, primitiveIdsToGeometryExport_itr->second});
 }
 
 static void ExportCamera(const Model &model, const Node &gltf_node, hg::Node &node, hg::Scene &scene, const Config &config, hg::PipelineResources &resources) {
@@ -1432,24 +1534,29 @@ static hg::Node ExportNode(const Model &model, const int &gltf_id_node, hg::Scen
 	return node;
 }
 
+/*
+	Images are hashed and written from the loader callback, their bytes are not kept once written. Images with identical content are only written once.
+*/
+struct ImageExports {
+	const Config *config;
+	ImportTimings *timings;
+
+	std::map<std::string, std::string> hash_to_path; // output path by content hash
+	std::set<std::string> claimed_paths; // paths written by this import, visible to GetOutputPath unless overwriting
+};
+
 bool LoadImageDataEx(Image *image, const int image_idx, std::string *err, std::string *warn, int req_width, int req_height, const unsigned char *bytes,
 	int size, void *user_data) {
-	(void)user_data;
 	(void)warn;
 
-	Config *config = static_cast<Config *>(user_data);
+	auto *exports = static_cast<ImageExports *>(user_data);
+	const Config *config = exports->config;
 
-	std::string dst_path;
+	std::string name, ext;
 
 	if (image->uri.empty()) { // copy the buffer into image
-		std::string mimeType = image->mimeType.replace(image->mimeType.find("image/", 0), std::string("image/").size(), "");
-		std::string name = image->name.empty() ? hg::format("%1").arg(image_idx) : image->name;
-
-		if (GetOutputPath(dst_path, config->base_output_path, name, {}, mimeType, config->import_policy_texture)) {
-			auto myfile = std::fstream(dst_path, std::ios::out | std::ios::binary);
-			myfile.write((const char *)bytes, size);
-			myfile.close();
-		}
+		ext = image->mimeType.replace(image->mimeType.find("image/", 0), std::string("image/").size(), "");
+		name = image->name.empty() ? hg::format("%1").arg(image_idx) : image->name;
 	} else {
 		// copy the image
 		std::string src_path = image->uri;
@@ -1468,13 +1575,40 @@ bool LoadImageDataEx(Image *image, const int image_idx, std::string *err, std::s
 			}
 		}
 
-		if (GetOutputPath(dst_path, config->base_output_path, hg::GetFileName(src_path), {}, hg::GetFileExtension(src_path), config->import_policy_texture)) {
+		name = hg::GetFileName(src_path);
+		ext = hg::GetFileExtension(src_path);
+	}
+
+	// the buffer is only valid during the callback, write it now
+	const auto t = hg::time_now();
+
+	const auto hash = hg::ComputeSHA1String(bytes, size);
+	++exports->timings->image_count;
+
+	const auto hash_itr = exports->hash_to_path.find(hash);
+	if (hash_itr != exports->hash_to_path.end()) {
+		image_dst_paths[image_idx] = hash_itr->second;
+		++exports->timings->deduplicated_image_count;
+	} else {
+		std::string dst_path;
+		bool write = GetOutputPath(dst_path, config->base_output_path, name, {}, ext, config->import_policy_texture);
+
+		// a different image already uses this path
+		for (auto n = 0; exports->claimed_paths.count(dst_path); ++n)
+			write = GetOutputPath(dst_path, config->base_output_path, hg::format("%1-%2").arg(name).arg(n), {}, ext, config->import_policy_texture);
+
+		if (write) {
 			auto myfile = std::fstream(dst_path, std::ios::out | std::ios::binary);
 			myfile.write((const char *)bytes, size);
 			myfile.close();
 		}
+
+		exports->claimed_paths.insert(dst_path);
+		exports->hash_to_path[hash] = dst_path;
+		image_dst_paths[image_idx] = dst_path;
 	}
 
+	exports->timings->images += hg::time_now() - t;
 	return true;
 }
 
@@ -1499,7 +1633,11 @@ static bool ImportGltfScene(const std::string &path, const Config &config) {
 	std::string warn;
 
 	// set our own save picture
-	loader.SetImageLoader(LoadImageDataEx, const_cast<Config *>(&config));
+	ImportTimings timings;
+	ImageExports image_exports{&config, &timings};
+	loader.SetImageLoader(LoadImageDataEx, &image_exports);
+
+	auto t = hg::time_now();
 	bool ret;
 	if (hg::tolower(hg::GetFileExtension(path)) == "gltf")
 		ret = loader.LoadASCIIFromFile(&model, &err, &warn, path);
@@ -1514,6 +1652,8 @@ static bool ImportGltfScene(const std::string &path, const Config &config) {
 		hg::log(hg::format("warning %1: %2").arg(path.c_str()).arg(warn.c_str()));
 	}
 
+	timings.load = hg::time_now() - t - timings.images; // images are written while loading
+
 	hg::log("loaded glTF file has:");
 	hg::log(hg::format("%1 accessors").arg(model.accessors.size()).c_str());
 	hg::log(hg::format("%1 animations").arg(model.animations.size()).c_str());
@@ -1538,13 +1678,20 @@ static bool ImportGltfScene(const std::string &path, const Config &config) {
 		hg::Scene scene;
 		hg::PipelineResources resources;
 
+		t = hg::time_now();
 		for (auto gltf_id_node : gltf_scene.nodes) {
 			auto node = ExportNode(model, gltf_id_node, scene, config, resources);
 		}
+		timings.nodes += hg::time_now() - t;
+
+		ExportGeometries(model, config, resources, timings);
 
+		t = hg::time_now();
 		ExportMotions(model, gltf_scene, scene, config);
 		ExportSkins(model, gltf_scene, scene, config);
+		timings.animations += hg::time_now() - t;
 
+		t = hg::time_now();
 		FinalizeScene(scene);
 
 		// add default pbr map
@@ -1558,8 +1705,23 @@ static bool ImportGltfScene(const std::string &path, const Config &config) {
 				config.name.empty() ? hg::GetFileName(path) + (gltf_scene.name.empty() ? "" : "_" + gltf_scene.name) : config.name, {}, "scn",
 				config.import_policy_scene))
 			SaveSceneJsonToFile(out_path.c_str(), scene, resources);
+		timings.scene_save += hg::time_now() - t;
 	}
 
+	hg::log(hg::format("Load (excluding images): %1 ms").arg(hg::time_to_ms(timings.load)));
+	hg::log(hg::format("Image hash and write: %1 ms, %2 images (%3 duplicates)")
+				.arg(hg::time_to_ms(timings.images))
+				.arg(timings.image_count)
+				.arg(timings.deduplicated_image_count));
+	hg::log(hg::format("Nodes: %1 ms").arg(hg::time_to_ms(timings.nodes)));
+	hg::log(hg::format("Geometry conversion: %1 ms, save: %2 ms, %3 geometries (%4 duplicates)")
+				.arg(hg::time_to_ms(timings.geometry_conversion))
+				.arg(hg::time_to_ms(timings.geometry_save))
+				.arg(timings.geometry_count)
+				.arg(timings.deduplicated_geometry_count));
+	hg::log(hg::format("Animations: %1 ms").arg(hg::time_to_ms(timings.animations)));
+	hg::log(hg::format("Scene save: %1 ms").arg(hg::time_to_ms(timings.scene_save)));
+
 	hg::log(hg::format("Import complete, took %1 ms").arg(hg::time_to_ms(hg::time_now() - t_start)));
 	return true;
 }
@@ -1694,7 +1856,9 @@ int main(int argc, const char **argv) {
 
 	//
 	config.input_path = cmd_content.positionals[0];
+	hg::start_workers();
 	auto res = ImportGltfScene(cmd_content.positionals[0], config);
+	hg::stop_workers();
 
 	const auto msg = std::string("[ImportScene") + std::string(res ? ": OK]" : ": KO]");
 	hg::log(msg.c_str());